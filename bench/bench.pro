@@ -0,0 +1,32 @@
+#-------------------------------------------------
+#
+# torchio-bench: benchmarks of the Morse encoder, the edge scheduler, the
+# LED backends and startup, written out as JSON.
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = torchio-bench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    torbench.cpp \
+    torbenchswitch.cpp
+
+HEADERS += \
+    torbench.h \
+    torbenchswitch.h
+
+# The front end's Morse playback, which is what is under test:
+include(../playback.pri)
+
+include(../core/core.pri)
+
+# clock_gettime():
+LIBS += -lrt
@@ -0,0 +1,126 @@
+//
+// main.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+// torchio-bench: Torchio's benchmark suite.  Results go to standard
+// output (or a file) as JSON, so they can be collected and compared
+// from build to build.
+
+#include <QtCore/QCoreApplication>
+
+#include <QFile>
+#include <QTextStream>
+#include "torbench.h"
+
+
+static void displayHelp(
+  QTextStream &qts)
+{
+  qts << "Usage: torchio-bench [options]" << endl;
+  qts << "-o <file>              Write the results to a file" << endl;
+  qts << "--runs <n>             Repetitions of each timed run (default 5)" << endl;
+  qts << "--jitter <ms>          Real time playback per jitter run (default 2000)" << endl;
+  qts << "--torchio <path>       Time this torchio binary to its first edge" << endl;
+  qts << "--torchio-core <path>  Time this torchio-core binary to its first edge" << endl;
+  qts << "-h                     Show this help info" << endl;
+}
+
+
+int main(
+  int argc,
+  char *argv[])
+{
+  // Needed for the event loop of the jitter benchmark:
+  QCoreApplication a(argc, argv);
+
+  QStringList argList = a.arguments();
+  QTextStream err(stderr);
+  TorBench bench;
+  QString outputPath;
+  QString torchioPath;
+  QString corePath;
+
+  int i = 1;
+  while (i < argList.size())
+  {
+    QString arg = argList.at(i);
+    bool hasValue = (i + 1 < argList.size());
+
+    if ( (arg == "-h")
+      || (arg == "--help"))
+    {
+      displayHelp(err);
+      return 0;
+    }
+    else if ((arg == "-o") && hasValue)
+    {
+      outputPath = argList.at(++i);
+    }
+    else if ((arg == "--runs") && hasValue)
+    {
+      bench.setRuns(argList.at(++i).toInt());
+    }
+    else if ((arg == "--jitter") && hasValue)
+    {
+      bench.setJitterDuration(argList.at(++i).toInt());
+    }
+    else if ((arg == "--torchio") && hasValue)
+    {
+      torchioPath = argList.at(++i);
+    }
+    else if ((arg == "--torchio-core") && hasValue)
+    {
+      corePath = argList.at(++i);
+    }
+    else
+    {
+      err << "Unrecognized argument: " << arg << endl;
+      displayHelp(err);
+      return 1;
+    }
+
+    ++i;
+  }
+
+  bench.setStartupTargets(torchioPath, corePath);
+
+  if (outputPath.isEmpty())
+  {
+    QTextStream out(stdout);
+    bench.run(out);
+    return 0;
+  }
+
+  QFile file(outputPath);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    err << "Unable to open " << outputPath << ": ";
+    err << file.errorString() << endl;
+    return 1;
+  }
+
+  QTextStream out(&file);
+  bench.run(out);
+
+  return 0;
+}
@@ -0,0 +1,673 @@
+//
+// torbench.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torbench.h"
+#include "torbenchswitch.h"
+#include "tormorse.h"
+#include "torclock.h"
+#include "torvirtualclock.h"
+#include "torfakeled.h"
+#include "torcoreloop.h"
+#include "torwordcache.h"
+
+#include <QTextStream>
+#include <QEventLoop>
+#include <QTimer>
+
+#include <malloc.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+#include <string>
+#include <algorithm>
+
+#define CORPUS_SIZE 65536
+#define CORPUS_KINDS 3
+
+// Real time playback of E, one edge per dot:
+#define JITTER_DOT 10
+#define MAX_LOAD_THREADS 64
+
+// The SOS pattern is 37 units long, gaps included:
+#define SOS_DOT 100
+#define SOS_CYCLE_UNITS 37
+#define SOS_CYCLES 10
+
+#define LOG_LINES 5000
+#define WORD_CACHE_SIZE 256
+
+// Milliseconds to wait for a first edge before giving up:
+#define STARTUP_TIMEOUT 5000
+
+static const char *corpusNames[CORPUS_KINDS] =
+{
+  "english",
+  "digits",
+  "random"
+};
+
+
+// Heap in use, as far as malloc knows:
+static long heapInUse()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  return mallinfo2().uordblks;
+#else
+  return mallinfo().uordblks;
+#endif
+}
+
+
+// Each load thread just burns a CPU until told to stop:
+static volatile bool loadRunning = false;
+
+static void *burnCPU(
+  void *arg)
+{
+  (void) arg;
+
+  while (loadRunning) {}
+
+  return 0;
+}
+
+
+TorBench::TorBench()
+  : runs(5),
+    jitterDuration(2000)
+{
+}
+
+
+void TorBench::setRuns(
+  int r)
+{
+  if (r > 0) runs = r;
+}
+
+
+void TorBench::setJitterDuration(
+  int duration)
+{
+  if (duration > 0) jitterDuration = duration;
+}
+
+
+void TorBench::setStartupTargets(
+  QString tp,
+  QString cp)
+{
+  torchioPath = tp;
+  corePath = cp;
+}
+
+
+void TorBench::run(
+  QTextStream &out)
+{
+  struct utsname machine;
+  uname(&machine);
+
+  out << "{" << endl;
+  out << "  \"machine\": {\"system\": \"" << machine.sysname;
+  out << "\", \"release\": \"" << machine.release;
+  out << "\", \"arch\": \"" << machine.machine;
+  out << "\", \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << "}," << endl;
+  out << "  \"runs\": " << runs << "," << endl;
+
+  benchEncoding(out);
+  benchMemory(out);
+  benchJitter(out);
+  benchSOSCycle(out);
+  benchWordCache(out);
+  benchStartup(out);
+
+  out << "}" << endl;
+}
+
+
+void TorBench::benchEncoding(
+  QTextStream &out)
+{
+  out << "  \"encoding\": {" << endl;
+
+  int kind = 0;
+  while (kind < CORPUS_KINDS)
+  {
+    QString text = makeCorpus(kind);
+    qint64 time = timeEncoding(text);
+
+    out << "    \"" << corpusNames[kind] << "\": {";
+    out << "\"characters\": " << text.size();
+    out << ", \"median_us\": " << time;
+    out << ", \"characters_per_second\": ";
+    out << QString::number(time ? text.size() * 1000000.0 / time : 0.0, 'f', 0);
+    out << "}";
+
+    ++kind;
+    if (kind < CORPUS_KINDS) out << ",";
+    out << endl;
+  }
+
+  out << "  }," << endl;
+}
+
+
+void TorBench::benchMemory(
+  QTextStream &out)
+{
+  // The timeline is built once per transmission and held until the next
+  // one, so the heap grows by exactly its size:
+  QString text = makeCorpus(0);
+  TorVirtualClock clock;
+  TorMorse *morse = new TorMorse(&clock);
+
+  long before = heapInUse();
+  QTextStream stream(&text);
+  morse->startMorseFromStream(stream);
+  long after = heapInUse();
+
+  morse->stopRunning();
+  delete morse;
+
+  out << "  \"memory\": {\"characters\": " << text.size();
+  out << ", \"timeline_bytes\": " << qint64(after - before);
+  out << ", \"bytes_per_character\": ";
+  out << QString::number(double(after - before) / text.size(), 'f', 1);
+  out << "}," << endl;
+}
+
+
+void TorBench::benchJitter(
+  QTextStream &out)
+{
+  out << "  \"jitter\": {" << endl;
+  out << "    \"dot_ms\": " << JITTER_DOT << "," << endl;
+  out << "    \"duration_ms\": " << jitterDuration << "," << endl;
+
+  out << "    \"idle\": ";
+  measureJitter(false, out);
+  out << "," << endl;
+
+  out << "    \"loaded\": ";
+  measureJitter(true, out);
+  out << endl;
+
+  out << "  }," << endl;
+}
+
+
+void TorBench::benchSOSCycle(
+  QTextStream &out)
+{
+  // Played against the fake backend on virtual time, so the counts are
+  // exact and the run takes no real time at all:
+  TorVirtualClock clock;
+  TorFakeLED led(&clock, 0);
+  TorBenchSwitch lightSwitch(&led);
+  TorMorse morse(&clock);
+
+  QObject::connect(
+    &morse, SIGNAL(turnTorchOn()), &lightSwitch, SLOT(turnOn()));
+
+  QObject::connect(
+    &morse, SIGNAL(turnTorchOff()), &lightSwitch, SLOT(turnOff()));
+
+  morse.setDotDuration(SOS_DOT);
+
+  qint64 start = clock.currentTime();
+  morse.startSOS();
+
+  // Stop just short of the first edge of the next cycle:
+  unsigned int wakeups = clock.run(
+    start + qint64(SOS_CYCLES) * SOS_CYCLE_UNITS * SOS_DOT * 1000 - 1);
+
+  morse.stopRunning();
+
+  out << "  \"sos_cycle\": {\"cycles\": " << SOS_CYCLES;
+  out << ", \"backend_calls\": ";
+  out << QString::number(double(lightSwitch.getCallCount()) / SOS_CYCLES, 'f', 1);
+  out << ", \"edges\": ";
+  out << QString::number(double(led.getEdgeCount()) / SOS_CYCLES, 'f', 1);
+  out << ", \"timer_wakeups\": ";
+  out << QString::number(double(wakeups) / SOS_CYCLES, 'f', 1);
+  out << "}," << endl;
+}
+
+
+void TorBench::benchWordCache(
+  QTextStream &out)
+{
+  QList<QByteArray> lines = makeLogCorpus();
+
+  out << "  \"word_cache\": {\"lines\": " << lines.size() << "," << endl;
+
+  out << "    \"uncached\": ";
+  writeWordCache(lines, 0, out);
+  out << "," << endl;
+
+  out << "    \"cached\": ";
+  writeWordCache(lines, WORD_CACHE_SIZE, out);
+  out << endl;
+
+  out << "  }," << endl;
+}
+
+
+void TorBench::benchStartup(
+  QTextStream &out)
+{
+  out << "  \"startup\": {" << endl;
+
+  // The Qt front end reports its first light on stderr as soon as it
+  // happens; the core's fake LEDs print each edge straight away:
+  QStringList torchioArgs;
+  torchioArgs << "--fakeleds" << "--trace-startup";
+
+  QStringList coreArgs;
+  coreArgs << "--fakeleds";
+
+  out << "    \"torchio\": ";
+  writeStartup(
+    torchioPath,
+    torchioArgs,
+    true,
+    "First light",
+    out);
+  out << "," << endl;
+
+  out << "    \"torchio_core\": ";
+  writeStartup(
+    corePath,
+    coreArgs,
+    false,
+    " torch 1",
+    out);
+  out << endl;
+
+  out << "  }" << endl;
+}
+
+
+qint64 TorBench::timeEncoding(
+  const QString &text)
+{
+  TorVirtualClock clock;
+  TorMorse morse(&clock);
+  std::vector<qint64> times;
+
+  int i = 0;
+  while (i < runs)
+  {
+    QString copy = text;
+    QTextStream stream(&copy);
+
+    qint64 start = TorCoreLoop::currentTime();
+    morse.startMorseFromStream(stream);
+    times.push_back(TorCoreLoop::currentTime() - start);
+
+    morse.stopRunning();
+    ++i;
+  }
+
+  return median(times);
+}
+
+
+void TorBench::measureJitter(
+  bool loaded,
+  QTextStream &out)
+{
+  pthread_t threads[MAX_LOAD_THREADS];
+  int threadCount = 0;
+
+  if (loaded)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    if (cpus > MAX_LOAD_THREADS) cpus = MAX_LOAD_THREADS;
+
+    loadRunning = true;
+
+    while (threadCount < cpus)
+    {
+      if (pthread_create(&threads[threadCount], 0, burnCPU, 0)) break;
+      ++threadCount;
+    }
+  }
+
+  TorSystemClock clock;
+  TorFakeLED led(&clock, 0);
+  TorBenchSwitch lightSwitch(&led);
+  TorMorse morse(&clock);
+
+  QObject::connect(
+    &morse, SIGNAL(turnTorchOn()), &lightSwitch, SLOT(turnOn()));
+
+  QObject::connect(
+    &morse, SIGNAL(turnTorchOff()), &lightSwitch, SLOT(turnOff()));
+
+  morse.setDotDuration(JITTER_DOT);
+  morse.startE();
+
+  QEventLoop loop;
+  QTimer::singleShot(jitterDuration, &loop, SLOT(quit()));
+  loop.exec();
+
+  morse.stopRunning();
+
+  if (loaded)
+  {
+    loadRunning = false;
+
+    int i = 0;
+    while (i < threadCount)
+    {
+      pthread_join(threads[i], 0);
+      ++i;
+    }
+  }
+
+  const TorCoreSummary &lateness = morse.getEdgeLateness();
+
+  out << "{";
+  if (loaded) out << "\"load_threads\": " << threadCount << ", ";
+  out << "\"edges\": " << quint64(lateness.count);
+  out << ", \"mean_lateness_us\": ";
+  out << (lateness.count ? qint64(lateness.sum / qint64(lateness.count)) : 0);
+  out << ", \"max_lateness_us\": " << qint64(lateness.max);
+  out << ", \"mean_edge_error_us\": " << morse.getMeanEdgeError();
+  out << ", \"missed_deadlines\": " << quint64(morse.getMissedDeadlines());
+  out << "}";
+}
+
+
+void TorBench::writeStartup(
+  QString program,
+  QStringList args,
+  bool fromStderr,
+  const char *marker,
+  QTextStream &out)
+{
+  if (program.isEmpty())
+  {
+    out << "null";
+    return;
+  }
+
+  std::vector<qint64> times;
+  int failures = 0;
+
+  int i = 0;
+  while (i < runs)
+  {
+    qint64 time = measureStartup(program, args, fromStderr, marker);
+
+    if (time < 0) ++failures;
+    else times.push_back(time);
+
+    ++i;
+  }
+
+  out << "{\"runs\": " << int(times.size());
+  out << ", \"failures\": " << failures;
+  out << ", \"median_us\": ";
+
+  if (times.empty()) out << "null";
+  else out << median(times);
+
+  out << "}";
+}
+
+
+qint64 TorBench::measureStartup(
+  QString program,
+  QStringList args,
+  bool fromStderr,
+  const char *marker)
+{
+  // Build the argument list before forking:
+  std::vector<std::string> strings;
+  strings.push_back(program.toLocal8Bit().constData());
+
+  int i = 0;
+  while (i < args.size())
+  {
+    strings.push_back(args.at(i).toLocal8Bit().constData());
+    ++i;
+  }
+
+  std::vector<char *> argv;
+  i = 0;
+  while (i < int(strings.size()))
+  {
+    argv.push_back(const_cast<char *>(strings[i].c_str()));
+    ++i;
+  }
+  argv.push_back(0);
+
+  int fds[2];
+  if (pipe(fds) < 0) return -1;
+
+  qint64 start = TorCoreLoop::currentTime();
+  pid_t pid = fork();
+
+  if (pid < 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+
+  if (pid == 0)
+  {
+    // The output we are not watching goes nowhere:
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(fds[1], fromStderr ? 2 : 1);
+    if (devNull >= 0) dup2(devNull, fromStderr ? 1 : 2);
+    close(fds[0]);
+    close(fds[1]);
+    execv(argv[0], &argv[0]);
+    _exit(127);
+  }
+
+  close(fds[1]);
+
+  std::string seen;
+  qint64 result = -1;
+  char buffer[4096];
+
+  while (true)
+  {
+    struct pollfd pfd;
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, STARTUP_TIMEOUT) <= 0) break;
+
+    ssize_t count = read(fds[0], buffer, sizeof(buffer));
+    if (count <= 0) break;
+
+    seen.append(buffer, count);
+
+    if (seen.find(marker) != std::string::npos)
+    {
+      result = TorCoreLoop::currentTime() - start;
+      break;
+    }
+  }
+
+  kill(pid, SIGKILL);
+  waitpid(pid, 0, 0);
+  close(fds[0]);
+
+  return result;
+}
+
+
+void TorBench::writeWordCache(
+  const QList<QByteArray> &lines,
+  int capacity,
+  QTextStream &out)
+{
+  TorWordCache cache(capacity);
+  std::vector<TorCoreRun> runs;
+
+  int i = 0;
+  while (i < lines.size())
+  {
+    runs.clear();
+    cache.encodeLine(lines.at(i).constData(), lines.at(i).size(), runs);
+    ++i;
+  }
+
+  const TorCoreSummary &time = cache.getEncodeTime();
+
+  out << "{\"capacity\": " << capacity;
+  out << ", \"words\": " << cache.getLookupCount();
+  out << ", \"hit_rate\": ";
+  out << QString::number(
+    cache.getLookupCount()
+      ? double(cache.getHitCount()) / cache.getLookupCount()
+      : 0.0,
+    'f',
+    3);
+  out << ", \"cpu_ns_per_line\": ";
+  out << (time.count ? qint64(time.sum / qint64(time.count)) : 0);
+  out << "}";
+}
+
+
+QString TorBench::makeCorpus(
+  int kind)
+{
+  QString text;
+  text.reserve(CORPUS_SIZE);
+
+  if (kind == 0)
+  {
+    const char *pangram = "The quick brown fox jumps over the lazy dog. ";
+    const char *c = pangram;
+
+    while (text.size() < CORPUS_SIZE)
+    {
+      text += QChar(*c);
+      ++c;
+      if (!*c) c = pangram;
+    }
+  }
+  else if (kind == 1)
+  {
+    int i = 0;
+    while (text.size() < CORPUS_SIZE)
+    {
+      text += QChar((i % 11 == 10) ? ' ' : char('0' + i % 11));
+      ++i;
+    }
+  }
+  else
+  {
+    // Printable ASCII from a fixed seed, including the characters Morse
+    // has no code for:
+    unsigned int seed = 12345;
+
+    while (text.size() < CORPUS_SIZE)
+    {
+      seed = seed * 1103515245 + 12345;
+      text += QChar(char(32 + (seed >> 16) % 95));
+    }
+  }
+
+  return text;
+}
+
+
+qint64 TorBench::median(
+  std::vector<qint64> values)
+{
+  if (values.empty()) return 0;
+
+  std::sort(values.begin(), values.end());
+
+  return values[values.size() / 2];
+}
+
+
+QList<QByteArray> TorBench::makeLogCorpus()
+{
+  static const char *hosts[] =
+    {"gw01", "db-primary", "db-replica", "web03", "cache7"};
+  static const char *services[] =
+    {"sshd", "nginx", "postgres", "cron", "kernel", "systemd"};
+  static const char *levels[] =
+    {"OK", "OK", "OK", "INFO", "INFO", "WARN", "ERROR"};
+  static const char *messages[] =
+  {
+    "connection accepted from",
+    "request completed in",
+    "health check passed",
+    "disk usage above threshold on",
+    "replication lag is",
+    "timeout waiting for",
+    "session closed for user root"
+  };
+
+  QList<QByteArray> lines;
+  unsigned int seed = 54321;
+  int seconds = 0;
+
+  int i = 0;
+  while (i < LOG_LINES)
+  {
+    seed = seed * 1103515245 + 12345;
+    unsigned int r = seed >> 8;
+
+    seconds += r % 3;
+
+    char line[160];
+    snprintf(
+      line,
+      sizeof(line),
+      "%02d:%02d:%02d %s %s[%u]: %s %s %u",
+      (seconds / 3600) % 24,
+      (seconds / 60) % 60,
+      seconds % 60,
+      hosts[r % 5],
+      services[(r / 5) % 6],
+      1000 + (r / 30) % 200,
+      levels[(r / 6000) % 7],
+      messages[(r / 42000) % 7],
+      (r / 294000) % 100);
+
+    lines.append(QByteArray(line));
+    ++i;
+  }
+
+  return lines;
+}
@@ -0,0 +1,125 @@
+//
+// torbench.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORBENCH_H
+#define TORBENCH_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QByteArray>
+
+#include <vector>
+
+class QTextStream;
+
+// Torchio's benchmark suite.  Each benchmark is deterministic in what it
+// feeds Torchio (fixed corpora, fixed patterns), so runs on the same
+// machine are comparable from one build to the next.  Results are written
+// as a single JSON object; all times are in microseconds.
+class TorBench
+{
+public:
+  TorBench();
+
+  // Repetitions of each timed run; the median is reported:
+  void setRuns(
+    int runs);
+
+  // How long (in milliseconds) to play Morse in real time for the jitter
+  // benchmark, idle and loaded:
+  void setJitterDuration(
+    int duration);
+
+  // The binaries to time from exec to first edge; empty skips them:
+  void setStartupTargets(
+    QString torchioPath,
+    QString corePath);
+
+  void run(
+    QTextStream &out);
+
+private:
+  void benchEncoding(
+    QTextStream &out);
+
+  void benchMemory(
+    QTextStream &out);
+
+  void benchJitter(
+    QTextStream &out);
+
+  void benchSOSCycle(
+    QTextStream &out);
+
+  void benchWordCache(
+    QTextStream &out);
+
+  void benchStartup(
+    QTextStream &out);
+
+  // Median time to encode the text once:
+  qint64 timeEncoding(
+    const QString &text);
+
+  void measureJitter(
+    bool loaded,
+    QTextStream &out);
+
+  void writeStartup(
+    QString program,
+    QStringList args,
+    bool fromStderr,
+    const char *marker,
+    QTextStream &out);
+
+  // Time from fork() until the marker appears in the program's output,
+  // or -1 if it never does:
+  qint64 measureStartup(
+    QString program,
+    QStringList args,
+    bool fromStderr,
+    const char *marker);
+
+  void writeWordCache(
+    const QList<QByteArray> &lines,
+    int capacity,
+    QTextStream &out);
+
+  static QString makeCorpus(
+    int kind);
+
+  // Syslog-style lines: a few hosts, services and status words, with
+  // timestamps and process IDs that rarely repeat:
+  static QList<QByteArray> makeLogCorpus();
+
+  static qint64 median(
+    std::vector<qint64> values);
+
+  int runs;
+  int jitterDuration;
+  QString torchioPath;
+  QString corePath;
+};
+
+#endif // TORBENCH_H
@@ -0,0 +1,53 @@
+//
+// torbenchswitch.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torbenchswitch.h"
+#include "torledbackend.h"
+
+
+TorBenchSwitch::TorBenchSwitch(
+  TorLEDBackend *l)
+  : led(l),
+    callCount(0)
+{
+}
+
+
+unsigned int TorBenchSwitch::getCallCount()
+{
+  return callCount;
+}
+
+
+void TorBenchSwitch::turnOn()
+{
+  ++callCount;
+  led->turnTorchOn();
+}
+
+
+void TorBenchSwitch::turnOff()
+{
+  ++callCount;
+  led->turnTorchOff();
+}
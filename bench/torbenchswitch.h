@@ -0,0 +1,53 @@
+//
+// torbenchswitch.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORBENCHSWITCH_H
+#define TORBENCHSWITCH_H
+
+#include <QObject>
+
+class TorLEDBackend;
+
+// Stands in for the controller between TorMorse and an LED backend, and
+// counts the calls made on the backend, to set against the edges (the
+// calls that actually changed the LED's state) the backend counts.
+class TorBenchSwitch: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorBenchSwitch(
+    TorLEDBackend *led);
+
+  unsigned int getCallCount();
+
+public slots:
+  void turnOn();
+  void turnOff();
+
+private:
+  TorLEDBackend *led;
+  unsigned int callCount;
+};
+
+#endif // TORBENCHSWITCH_H
@@ -0,0 +1,40 @@
+#-------------------------------------------------
+#
+# The Qt-free Torchio core, shared by the Qt front end (torchio.pro) and
+# the core-only command line tool (torchio-core.pro).
+#
+#-------------------------------------------------
+
+INCLUDEPATH += $$PWD
+
+# Flash discovery probes every node at once:
+LIBS += -lpthread
+
+# Timeline tracing (--tracefile) is only built on request:
+tracing {
+    DEFINES += TORCHIO_TRACING
+}
+
+SOURCES += \
+    $$PWD/torcoreloop.cpp \
+    $$PWD/torcoreflashled.cpp \
+    $$PWD/torcoreflashdiscovery.cpp \
+    $$PWD/torcorefakeled.cpp \
+    $$PWD/torcoremorse.cpp \
+    $$PWD/torcoreprocess.cpp \
+    $$PWD/torcoremetrics.cpp \
+    $$PWD/torcoretrace.cpp \
+    $$PWD/tormorsetable.cpp
+
+HEADERS += \
+    $$PWD/torcoreexception.h \
+    $$PWD/torcoreloop.h \
+    $$PWD/torcoreled.h \
+    $$PWD/torcoreflashled.h \
+    $$PWD/torcoreflashdiscovery.h \
+    $$PWD/torcorefakeled.h \
+    $$PWD/torcoremorse.h \
+    $$PWD/torcoreprocess.h \
+    $$PWD/torcoremetrics.h \
+    $$PWD/torcoretrace.h \
+    $$PWD/tormorsetable.h
@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# libtorchio-core: a static library with no Qt dependency.
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+CONFIG   += staticlib
+
+TARGET = torchio-core
+
+TEMPLATE = lib
+
+include(core.pri)
@@ -0,0 +1,595 @@
+//
+// main.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+// torchio-core: the core Torchio modes, without Qt.  This is both a
+// stripped-down flashlight for tight spots and a measure of what the Qt
+// front end costs in startup time and memory (see --stats).
+
+#include "torcoreloop.h"
+#include "torcoreflashled.h"
+#include "torcoreflashdiscovery.h"
+#include "torcorefakeled.h"
+#include "torcoremorse.h"
+#include "torcoreprocess.h"
+#include "torcoreexception.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+// Played runs are only dropped in batches, to keep the copying down:
+#define CORE_COMPACT_THRESHOLD 4096
+
+enum CorePulse
+{
+  No_CorePulse,
+  Simple_CorePulse,
+  SOS_CorePulse,
+  MorseFromStdin_CorePulse,
+  MorseFromFile_CorePulse
+};
+
+
+// Notes when the LEDs first light, for --stats:
+class CoreStatsLED: public TorCoreLED
+{
+public:
+  CoreStatsLED(
+    TorCoreLED *l)
+    : led(l),
+      firstLight(-1)
+  {
+  }
+
+  int getMinLevel(
+    TorCoreChannel channel)
+  {
+    return led->getMinLevel(channel);
+  }
+
+  int getMaxLevel(
+    TorCoreChannel channel)
+  {
+    return led->getMaxLevel(channel);
+  }
+
+  void setLevel(
+    TorCoreChannel channel,
+    int level)
+  {
+    led->setLevel(channel, level);
+
+    if ( (firstLight < 0)
+      && (level > led->getMinLevel(channel)))
+    {
+      firstLight = TorCoreLoop::currentTime();
+    }
+  }
+
+  int64_t getFirstLight()
+  {
+    return firstLight;
+  }
+
+private:
+  TorCoreLED *led;
+  int64_t firstLight;
+};
+
+
+// Traces the fake LEDs to standard output, timed from startup:
+class CoreTrace: public TorCoreFakeLEDClient
+{
+public:
+  CoreTrace()
+    : startTime(TorCoreLoop::currentTime())
+  {
+  }
+
+  int64_t currentTime()
+  {
+    return TorCoreLoop::currentTime() - startTime;
+  }
+
+  void writeTrace(
+    TorCoreChannel channel,
+    int level,
+    const char *line)
+  {
+    (void) channel;
+    (void) level;
+
+    fputs(line, stdout);
+
+    // There is no simulated time in the core, so edges are few and far
+    // between; pass each one on at once, for anything reading a pipe:
+    fflush(stdout);
+  }
+
+private:
+  int64_t startTime;
+};
+
+
+// Hands the player its runs on the loop's clock, ends the loop when
+// playback or the timeout is over, and feeds standard input to the
+// encoder as it arrives:
+class CoreSession
+  : public TorCorePlayerClient,
+    public TorCoreTimerClient,
+    public TorCoreWatchClient
+{
+public:
+  CoreSession(
+    TorCoreLoop *l,
+    TorCoreLED *cl,
+    TorCoreChannel c)
+    : loop(l),
+      led(cl),
+      channel(c),
+      player(this),
+      playerTimer(l, this),
+      position(0),
+      repeating(false),
+      inputOpen(false)
+  {
+  }
+
+  TorCoreMorseEncoder &getEncoder()
+  {
+    return encoder;
+  }
+
+  TorCoreMorsePlayer &getPlayer()
+  {
+    return player;
+  }
+
+  // Starts again from the beginning after the last run:
+  void setRepeat(
+    bool repeat)
+  {
+    repeating = repeat;
+  }
+
+  // Runs will keep arriving until closeInput():
+  void openInput()
+  {
+    inputOpen = true;
+  }
+
+  void closeInput()
+  {
+    inputOpen = false;
+    player.runsAppended();
+  }
+
+  int64_t currentTime()
+  {
+    return TorCoreLoop::currentTime();
+  }
+
+  int64_t currentRealTime()
+  {
+    return TorCoreLoop::currentRealTime();
+  }
+
+  void startTimerAt(
+    int64_t deadline,
+    bool precisely)
+  {
+    // The loop's timerfd is armed to the microsecond anyway:
+    (void) precisely;
+
+    playerTimer.startAt(deadline);
+  }
+
+  void stopTimer()
+  {
+    playerTimer.stop();
+  }
+
+  TorCorePlayerStep nextRun(
+    TorCoreRun &run)
+  {
+    const std::vector<TorCoreRun> &runs = encoder.getRuns();
+
+    if (position >= runs.size())
+    {
+      if (repeating && !runs.empty())
+      {
+        position = 0;
+        return Repeat_CorePlayerStep;
+      }
+
+      // Wait for more input, if there is any to come:
+      if (inputOpen) return Stall_CorePlayerStep;
+
+      return End_CorePlayerStep;
+    }
+
+    run = runs[position];
+    ++position;
+
+    // Streamed input never loops, so played runs can go:
+    if (!repeating && (position >= CORE_COMPACT_THRESHOLD))
+    {
+      encoder.discard(position);
+      position = 0;
+    }
+
+    return Run_CorePlayerStep;
+  }
+
+  void switchLight(
+    bool lit)
+  {
+    if (lit)
+    {
+      led->setLevel(channel, led->getMaxLevel(channel));
+    }
+    else
+    {
+      led->setLevel(channel, led->getMinLevel(channel));
+    }
+  }
+
+  void playbackFinished()
+  {
+    loop->quit();
+  }
+
+  void timerFired(
+    TorCoreTimer *timer)
+  {
+    if (timer == &playerTimer)
+    {
+      player.timerFired();
+      return;
+    }
+
+    // Anything else is the timeout:
+    loop->quit();
+  }
+
+  void descriptorReadable(
+    int descriptor)
+  {
+    char buffer[4096];
+    ssize_t size = read(descriptor, buffer, sizeof(buffer));
+
+    if ((size < 0) && ((errno == EAGAIN) || (errno == EINTR))) return;
+
+    if (size <= 0)
+    {
+      loop->unwatch(descriptor);
+      closeInput();
+      return;
+    }
+
+    encoder.appendText(buffer, size);
+    player.runsAppended();
+  }
+
+private:
+  TorCoreLoop *loop;
+  TorCoreLED *led;
+  TorCoreChannel channel;
+  TorCoreMorseEncoder encoder;
+  TorCoreMorsePlayer player;
+  TorCoreTimer playerTimer;
+  size_t position;
+  bool repeating;
+  bool inputOpen;
+};
+
+
+static void displayHelp(
+  const char *name)
+{
+  printf("Torchio core: the Qt-free Torchio flashlight.\n");
+  printf("\n");
+  printf("Usage: %s [options]\n", name);
+  printf("\n");
+  printf("Options:\n");
+  printf("-p         Pulsed mode\n");
+  printf("-s         SOS mode\n");
+  printf("-m         Generate Morse code from standard input\n");
+  printf("-mf <filename>   Generate Morse code from text file\n");
+  printf("-d nnn     Set the dot duration to nnn milliseconds\n");
+  printf("           (default is 100)\n");
+  printf("-w         Use white LEDs\n");
+  printf("-r         Use red LED\n");
+  printf("-t nnn     Switch LEDs off and exit after nnn minutes\n");
+  printf("--fakeleds Print each LED change instead of driving the LEDs\n");
+  printf("--stats    Report startup time and memory use on exit\n");
+  printf("-h         Show this help info\n");
+}
+
+
+static void appendFile(
+  const char *filename,
+  TorCoreMorseEncoder &encoder)
+{
+  FILE *file = fopen(filename, "r");
+
+  if (!file)
+  {
+    std::string err = "Unable to open ";
+    err += filename;
+    err += ": ";
+    err += strerror(errno);
+    throw TorCoreException(err);
+  }
+
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    encoder.appendText(buffer, size);
+  }
+
+  fclose(file);
+}
+
+
+static bool standardInputIsFile()
+{
+  struct stat info;
+
+  return (fstat(STDIN_FILENO, &info) == 0) && S_ISREG(info.st_mode);
+}
+
+
+int main(
+  int argc,
+  char *argv[])
+{
+  int64_t processAge = torCoreProcessAge();
+  int64_t mainEntered = TorCoreLoop::currentTime();
+
+  CorePulse pulse = No_CorePulse;
+  const char *morseFile = 0;
+  unsigned int dotDuration = 100;
+  TorCoreChannel channel = Torch_CoreChannel;
+  int timeout = 0;
+  bool fakeLEDs = false;
+  bool reportStats = false;
+
+  int i = 1;
+  while (i < argc)
+  {
+    if ( (strcmp(argv[i], "-h") == 0)
+      || (strcmp(argv[i], "--help") == 0))
+    {
+      displayHelp(argv[0]);
+      return 0;
+    }
+    else if (strcmp(argv[i], "-p") == 0)
+    {
+      pulse = Simple_CorePulse;
+    }
+    else if (strcmp(argv[i], "-s") == 0)
+    {
+      pulse = SOS_CorePulse;
+    }
+    else if (strcmp(argv[i], "-m") == 0)
+    {
+      pulse = MorseFromStdin_CorePulse;
+    }
+    else if (strcmp(argv[i], "-mf") == 0)
+    {
+      ++i;
+      if (i >= argc)
+      {
+        printf("Error: no filename provided\n");
+        return 1;
+      }
+
+      pulse = MorseFromFile_CorePulse;
+      morseFile = argv[i];
+    }
+    else if (strcmp(argv[i], "-d") == 0)
+    {
+      ++i;
+      if ((i >= argc) || (atoi(argv[i]) <= 0))
+      {
+        printf("Error: -d needs a duration in milliseconds\n");
+        return 1;
+      }
+
+      dotDuration = atoi(argv[i]);
+    }
+    else if (strcmp(argv[i], "-t") == 0)
+    {
+      ++i;
+      if ((i >= argc) || (atoi(argv[i]) <= 0))
+      {
+        printf("Error: -t needs a number of minutes\n");
+        return 1;
+      }
+
+      timeout = atoi(argv[i]);
+    }
+    else if (strcmp(argv[i], "-w") == 0)
+    {
+      channel = Torch_CoreChannel;
+    }
+    else if (strcmp(argv[i], "-r") == 0)
+    {
+      channel = Indicator_CoreChannel;
+    }
+    else if (strcmp(argv[i], "--fakeleds") == 0)
+    {
+      fakeLEDs = true;
+    }
+    else if (strcmp(argv[i], "--stats") == 0)
+    {
+      reportStats = true;
+    }
+    else
+    {
+      printf("Error: unknown option %s\n", argv[i]);
+      return 1;
+    }
+
+    ++i;
+  }
+
+  CoreTrace trace;
+  TorCoreLED *hardware = 0;
+  int result = 0;
+
+  try
+  {
+    TorCoreLoop loop;
+
+    if (fakeLEDs)
+    {
+      hardware = new TorCoreFakeLED(&trace);
+    }
+    else
+    {
+      TorCoreFlashDiscovery discovery(
+        TorCoreFlashDiscovery::defaultCachePath());
+
+      hardware = new TorCoreFlashLED(discovery.discover(true));
+    }
+
+    CoreStatsLED led(hardware);
+    CoreSession session(&loop, &led, channel);
+    TorCoreMorsePlayer &player = session.getPlayer();
+    TorCoreTimer timeoutTimer(&loop, &session);
+
+    player.setDotDuration(dotDuration);
+
+    switch (pulse)
+    {
+    case Simple_CorePulse:
+      // An "E", followed by a word space:
+      session.getEncoder().appendText("E", 1);
+      session.getEncoder().appendGap(4);
+      session.setRepeat(true);
+      player.start();
+      break;
+
+    case SOS_CorePulse:
+      session.getEncoder().appendText("SOS", 3);
+      session.getEncoder().appendGap(4);
+      session.setRepeat(true);
+      player.start();
+      break;
+
+    case MorseFromStdin_CorePulse:
+      if (standardInputIsFile())
+      {
+        // epoll won't take regular files, but they're never short of data:
+        appendFile("/dev/stdin", session.getEncoder());
+        player.start();
+      }
+      else
+      {
+        fcntl(
+          STDIN_FILENO,
+          F_SETFL,
+          fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+        session.openInput();
+        player.start();
+        loop.watch(STDIN_FILENO, &session);
+      }
+      break;
+
+    case MorseFromFile_CorePulse:
+      appendFile(morseFile, session.getEncoder());
+      player.start();
+      break;
+
+    case No_CorePulse:
+    default:
+      led.setLevel(channel, led.getMaxLevel(channel));
+      break;
+    }
+
+    int64_t modeStarted = TorCoreLoop::currentTime();
+
+    if (timeout)
+    {
+      timeoutTimer.startAt(modeStarted + int64_t(timeout) * 60000000);
+    }
+
+    loop.run();
+
+    player.stop();
+    led.setLevel(channel, led.getMinLevel(channel));
+
+    if (reportStats)
+    {
+      fprintf(stderr, "Startup statistics:\n");
+
+      if (processAge >= 0)
+      {
+        fprintf(
+          stderr,
+          "Process start to main(): %.1f ms\n",
+          processAge / 1000.0);
+      }
+
+      fprintf(
+        stderr,
+        "main() to mode started: %.1f ms\n",
+        (modeStarted - mainEntered) / 1000.0);
+
+      if (led.getFirstLight() >= 0)
+      {
+        fprintf(
+          stderr,
+          "main() to first light: %.1f ms\n",
+          (led.getFirstLight() - mainEntered) / 1000.0);
+      }
+
+      long resident;
+      long peak;
+      if (torCoreMemoryUsage(resident, peak))
+      {
+        fprintf(
+          stderr,
+          "Resident memory: %ld kB (peak %ld kB)\n",
+          resident,
+          peak);
+      }
+    }
+  }
+  catch (TorCoreException &e)
+  {
+    fprintf(stderr, "%s\n", e.getError().c_str());
+    result = 1;
+  }
+
+  delete hardware;
+  return result;
+}
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# torchio-core: the core Torchio modes, without Qt.
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = torchio-core
+
+TEMPLATE = app
+
+SOURCES += main.cpp
+
+include(core.pri)
+
+# clock_gettime():
+LIBS += -lrt
+
+maemo5 {
+    target.path = /opt/torchio/bin
+    INSTALLS += target
+}
@@ -0,0 +1,51 @@
+//
+// torcoreexception.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCOREEXCEPTION_H
+#define TORCOREEXCEPTION_H
+
+#include <string>
+
+// The core's counterpart to TorException, for code that can't use Qt:
+class TorCoreException
+{
+public:
+  TorCoreException(
+    std::string s)
+  : errStr(s)
+  {}
+
+  std::string getError();
+
+private:
+  std::string errStr;
+};
+
+
+inline std::string TorCoreException::getError()
+{
+  return errStr;
+}
+
+#endif // TORCOREEXCEPTION_H
@@ -0,0 +1,97 @@
+//
+// torcorefakeled.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcorefakeled.h"
+
+#include <stdio.h>
+
+
+TorCoreFakeLED::TorCoreFakeLED(
+  TorCoreFakeLEDClient *c)
+  : client(c),
+    torchLevel(0),
+    indicatorLevel(0),
+    edgeCount(0)
+{
+}
+
+
+int TorCoreFakeLED::getMinLevel(
+  TorCoreChannel channel)
+{
+  (void) channel;
+
+  return 0;
+}
+
+
+int TorCoreFakeLED::getMaxLevel(
+  TorCoreChannel channel)
+{
+  if (channel == Torch_CoreChannel) return 1;
+
+  return 7;
+}
+
+
+void TorCoreFakeLED::setLevel(
+  TorCoreChannel channel,
+  int level)
+{
+  if (level < getMinLevel(channel)) level = getMinLevel(channel);
+  else if (level > getMaxLevel(channel)) level = getMaxLevel(channel);
+
+  int &current = (channel == Torch_CoreChannel) ? torchLevel : indicatorLevel;
+
+  if (current == level) return;
+
+  current = level;
+  ++edgeCount;
+
+  char line[64];
+  snprintf(
+    line,
+    sizeof(line),
+    "%lld %s %d\n",
+    (long long) client->currentTime(),
+    (channel == Torch_CoreChannel) ? "torch" : "indicator",
+    level);
+
+  client->writeTrace(channel, level, line);
+}
+
+
+int TorCoreFakeLED::getLevel(
+  TorCoreChannel channel)
+{
+  if (channel == Torch_CoreChannel) return torchLevel;
+
+  return indicatorLevel;
+}
+
+
+unsigned int TorCoreFakeLED::getEdgeCount()
+{
+  return edgeCount;
+}
@@ -0,0 +1,84 @@
+//
+// torcorefakeled.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCOREFAKELED_H
+#define TORCOREFAKELED_H
+
+#include "torcoreled.h"
+
+#include <stdint.h>
+
+// Where a fake LED's trace goes, and the time it is stamped with
+// (torchio-core's loop, or the Qt front end's possibly virtual clock):
+class TorCoreFakeLEDClient
+{
+public:
+  virtual ~TorCoreFakeLEDClient() {}
+
+  virtual int64_t currentTime() = 0;
+
+  // One line per change of level, newline included:
+  virtual void writeTrace(
+    TorCoreChannel channel,
+    int level,
+    const char *line) = 0;
+};
+
+
+// Stands in for the real hardware (with the ranges of the N900's adp1653
+// controller), tracing every change of level as a line of the form:
+//
+//   <time in microseconds> <channel> <level>
+//
+class TorCoreFakeLED: public TorCoreLED
+{
+public:
+  TorCoreFakeLED(
+    TorCoreFakeLEDClient *client);
+
+  int getMinLevel(
+    TorCoreChannel channel);
+
+  int getMaxLevel(
+    TorCoreChannel channel);
+
+  // Out of range levels are clamped:
+  void setLevel(
+    TorCoreChannel channel,
+    int level);
+
+  int getLevel(
+    TorCoreChannel channel);
+
+  // Only actual changes in level count as edges:
+  unsigned int getEdgeCount();
+
+private:
+  TorCoreFakeLEDClient *client;
+  int torchLevel;
+  int indicatorLevel;
+  unsigned int edgeCount;
+};
+
+#endif // TORCOREFAKELED_H
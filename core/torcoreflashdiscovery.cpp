@@ -0,0 +1,486 @@
+//
+// torcoreflashdiscovery.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcoreflashdiscovery.h"
+#include "torcoreexception.h"
+#include "torcoreloop.h"
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <linux/videodev2.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#define CACHE_MAGIC "torchio-flash 1"
+
+// More nodes than this are probed in turn rather than all at once:
+#define MAX_PROBE_THREADS 16
+
+
+TorCoreFlashDevice::TorCoreFlashDevice()
+  : identity(0),
+    hasTorch(false),
+    minTorch(0),
+    maxTorch(1),
+    hasFlash(false),
+    minFlash(12),
+    maxFlash(19),
+    minTime(3000),
+    maxTime(10000),
+    hasIndicator(false),
+    minIndicator(0),
+    maxIndicator(7)
+{
+}
+
+
+// The node's device number, or false if it has gone:
+static bool readIdentity(
+  const std::string &path,
+  uint64_t &identity)
+{
+  struct stat info;
+  if (stat(path.c_str(), &info) == -1) return false;
+
+  identity = info.st_rdev;
+  return true;
+}
+
+
+// The driver's name for a node, from sysfs:
+static std::string readDriverName(
+  const std::string &path)
+{
+  std::string sysfsPath = "/sys/class/video4linux/";
+  sysfsPath += path.substr(path.rfind('/') + 1);
+  sysfsPath += "/name";
+
+  char name[128] = "";
+  FILE *file = fopen(sysfsPath.c_str(), "r");
+  if (file)
+  {
+    if (!fgets(name, sizeof(name), file)) name[0] = 0;
+    fclose(file);
+  }
+
+  name[strcspn(name, "\n")] = 0;
+  return name;
+}
+
+
+static std::string kernelRelease()
+{
+  struct utsname names;
+  if (uname(&names) == -1) return "";
+
+  return names.release;
+}
+
+
+static bool queryRange(
+  int descriptor,
+  unsigned int id,
+  int &minimum,
+  int &maximum)
+{
+  struct v4l2_queryctrl qctrl;
+  memset(&qctrl, 0, sizeof(qctrl));
+  qctrl.id = id;
+
+  if (ioctl(descriptor, VIDIOC_QUERYCTRL, &qctrl) == -1) return false;
+  if (qctrl.flags & V4L2_CTRL_FLAG_DISABLED) return false;
+
+  minimum = qctrl.minimum;
+  maximum = qctrl.maximum;
+  return true;
+}
+
+
+struct TorCoreProbe
+{
+  TorCoreFlashDevice device;
+  bool usable;
+  bool threaded;
+  pthread_t thread;
+};
+
+
+static void *probeNode(
+  void *argument)
+{
+  TorCoreProbe *probe = (TorCoreProbe *) argument;
+  TorCoreFlashDevice &device = probe->device;
+
+  probe->usable = false;
+
+  // Not sure why "O_RDWR", but it seems to be necessary:
+  int descriptor = open(device.path.c_str(), O_RDWR | O_NONBLOCK, 0);
+  if (descriptor == -1) return 0;
+
+  device.hasTorch = queryRange(
+    descriptor,
+    V4L2_CID_TORCH_INTENSITY,
+    device.minTorch,
+    device.maxTorch);
+
+  device.hasFlash =
+    queryRange(
+      descriptor,
+      V4L2_CID_FLASH_INTENSITY,
+      device.minFlash,
+      device.maxFlash)
+    && queryRange(
+      descriptor,
+      V4L2_CID_FLASH_TIMEOUT,
+      device.minTime,
+      device.maxTime);
+
+  device.hasIndicator = queryRange(
+    descriptor,
+    V4L2_CID_INDICATOR_INTENSITY,
+    device.minIndicator,
+    device.maxIndicator);
+
+  close(descriptor);
+
+  readIdentity(device.path, device.identity);
+  device.driver = readDriverName(device.path);
+
+  probe->usable = device.hasTorch || device.hasFlash;
+
+  return 0;
+}
+
+
+// The torch matters most, as it is what Torchio mostly uses:
+static int score(
+  const TorCoreFlashDevice &device)
+{
+  return (device.hasTorch ? 4 : 0)
+    + (device.hasFlash ? 2 : 0)
+    + (device.hasIndicator ? 1 : 0);
+}
+
+
+#define VIDEO_PREFIX "/dev/video"
+#define SUBDEVICE_PREFIX "/dev/v4l-subdev"
+
+
+// The number after the node's "video" or "v4l-subdev", or -1 if there
+// isn't a plain number there:
+static long nodeNumber(
+  const std::string &path,
+  const char *prefix)
+{
+  size_t length = strlen(prefix);
+
+  if ( (path.compare(0, length, prefix) != 0)
+    || !isdigit((unsigned char) path.c_str()[length]))
+  {
+    return -1;
+  }
+
+  char *end;
+  long number = strtol(path.c_str() + length, &end, 10);
+
+  return *end ? -1 : number;
+}
+
+
+// Video nodes come before subdevices, and each kind in numeric order, so
+// that /dev/video0 keeps winning any tie; anything oddly named goes last
+// of its kind:
+static bool probeOrder(
+  const std::string &a,
+  const std::string &b)
+{
+  bool aIsVideo = (a.compare(0, strlen(VIDEO_PREFIX), VIDEO_PREFIX) == 0);
+  bool bIsVideo = (b.compare(0, strlen(VIDEO_PREFIX), VIDEO_PREFIX) == 0);
+  if (aIsVideo != bIsVideo) return aIsVideo;
+
+  const char *prefix = aIsVideo ? VIDEO_PREFIX : SUBDEVICE_PREFIX;
+  unsigned long aNumber = nodeNumber(a, prefix);
+  unsigned long bNumber = nodeNumber(b, prefix);
+
+  // (-1 becomes the largest unsigned long, so sorts after any number)
+  if (aNumber != bNumber) return aNumber < bNumber;
+
+  return a < b;
+}
+
+
+TorCoreFlashDiscovery::TorCoreFlashDiscovery(
+  const std::string &path)
+  : cachePath(path),
+    cacheHit(false),
+    discoveryTime(0),
+    probedCount(0)
+{
+}
+
+
+std::string TorCoreFlashDiscovery::defaultCachePath()
+{
+  const char *home = getenv("HOME");
+  if (!home) return "";
+
+  std::string path = home;
+  path += "/.cache/torchio-flash";
+  return path;
+}
+
+
+void TorCoreFlashDiscovery::sortForProbing(
+  std::vector<std::string> &paths)
+{
+  // No two paths compare equal, but stable all the same, so that the
+  // order readdir() happened to give can never decide anything:
+  std::stable_sort(paths.begin(), paths.end(), probeOrder);
+}
+
+
+TorCoreFlashDevice TorCoreFlashDiscovery::discover(
+  bool useCache)
+{
+  int64_t start = TorCoreLoop::currentTime();
+
+  cacheHit = false;
+  probedCount = 0;
+
+  TorCoreFlashDevice best;
+
+  if (useCache && loadCache(best))
+  {
+    cacheHit = true;
+    discoveryTime = TorCoreLoop::currentTime() - start;
+    return best;
+  }
+
+  std::vector<std::string> paths;
+
+  DIR *dev = opendir("/dev");
+  if (dev)
+  {
+    struct dirent *entry;
+    while ((entry = readdir(dev)) != 0)
+    {
+      if ( (strncmp(entry->d_name, "video", 5) == 0)
+        || (strncmp(entry->d_name, "v4l-subdev", 10) == 0))
+      {
+        paths.push_back(std::string("/dev/") + entry->d_name);
+      }
+    }
+
+    closedir(dev);
+  }
+
+  sortForProbing(paths);
+
+  std::vector<TorCoreProbe> probes(paths.size());
+
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    probes[i].device.path = paths[i];
+    probes[i].threaded =
+      (i < MAX_PROBE_THREADS)
+      && (pthread_create(&probes[i].thread, 0, probeNode, &probes[i]) == 0);
+  }
+
+  // Whatever didn't get a thread of its own is probed here meanwhile:
+  for (size_t i = 0; i < probes.size(); ++i)
+  {
+    if (!probes[i].threaded) probeNode(&probes[i]);
+  }
+
+  bool found = false;
+
+  for (size_t i = 0; i < probes.size(); ++i)
+  {
+    if (probes[i].threaded) pthread_join(probes[i].thread, 0);
+
+    ++probedCount;
+
+    if ( probes[i].usable
+      && (!found || (score(probes[i].device) > score(best))))
+    {
+      best = probes[i].device;
+      found = true;
+    }
+  }
+
+  discoveryTime = TorCoreLoop::currentTime() - start;
+
+  if (!found)
+  {
+    throw TorCoreException(
+      "No flash LED controls found on any video or subdevice node");
+  }
+
+  saveCache(best);
+
+  return best;
+}
+
+
+bool TorCoreFlashDiscovery::usedCache()
+{
+  return cacheHit;
+}
+
+
+int64_t TorCoreFlashDiscovery::getDiscoveryTime()
+{
+  return discoveryTime;
+}
+
+
+unsigned int TorCoreFlashDiscovery::getProbedCount()
+{
+  return probedCount;
+}
+
+
+bool TorCoreFlashDiscovery::loadCache(
+  TorCoreFlashDevice &device)
+{
+  if (cachePath.empty()) return false;
+
+  FILE *file = fopen(cachePath.c_str(), "r");
+  if (!file) return false;
+
+  char lines[5][256];
+  int count = 0;
+  while ((count < 5) && fgets(lines[count], sizeof(lines[count]), file))
+  {
+    lines[count][strcspn(lines[count], "\n")] = 0;
+    ++count;
+  }
+
+  fclose(file);
+
+  unsigned long long identity;
+  char release[128];
+  int hasTorch;
+  int hasFlash;
+  int hasIndicator;
+
+  if ( (count < 5)
+    || (strcmp(lines[0], CACHE_MAGIC) != 0)
+    || (sscanf(lines[2], "%llu %127s", &identity, release) != 2)
+    || (sscanf(
+          lines[4],
+          "%d %d %d %d %d %d %d %d %d %d %d",
+          &hasTorch,
+          &device.minTorch,
+          &device.maxTorch,
+          &hasFlash,
+          &device.minFlash,
+          &device.maxFlash,
+          &device.minTime,
+          &device.maxTime,
+          &hasIndicator,
+          &device.minIndicator,
+          &device.maxIndicator) != 11))
+  {
+    return false;
+  }
+
+  device.path = lines[1];
+  device.identity = identity;
+  device.driver = lines[3];
+  device.hasTorch = hasTorch;
+  device.hasFlash = hasFlash;
+  device.hasIndicator = hasIndicator;
+
+  // The same hardware must still be at the same path, under the same
+  // kernel (whose driver might have changed):
+  uint64_t currentIdentity;
+
+  return readIdentity(device.path, currentIdentity)
+    && (currentIdentity == device.identity)
+    && (readDriverName(device.path) == device.driver)
+    && (kernelRelease() == release);
+}
+
+
+void TorCoreFlashDiscovery::saveCache(
+  const TorCoreFlashDevice &device)
+{
+  if (cachePath.empty()) return;
+
+  // A missing cache directory is created; any other failure just means
+  // probing again next time:
+  std::string directory = cachePath.substr(0, cachePath.rfind('/'));
+  mkdir(directory.c_str(), 0755);
+
+  std::string tempPath = cachePath + ".tmp";
+  FILE *file = fopen(tempPath.c_str(), "w");
+  if (!file) return;
+
+  fprintf(file, "%s\n", CACHE_MAGIC);
+  fprintf(file, "%s\n", device.path.c_str());
+  fprintf(
+    file,
+    "%llu %s\n",
+    (unsigned long long) device.identity,
+    kernelRelease().c_str());
+  fprintf(file, "%s\n", device.driver.c_str());
+  fprintf(
+    file,
+    "%d %d %d %d %d %d %d %d %d %d %d\n",
+    device.hasTorch ? 1 : 0,
+    device.minTorch,
+    device.maxTorch,
+    device.hasFlash ? 1 : 0,
+    device.minFlash,
+    device.maxFlash,
+    device.minTime,
+    device.maxTime,
+    device.hasIndicator ? 1 : 0,
+    device.minIndicator,
+    device.maxIndicator);
+
+  bool succeeded = !ferror(file);
+  if (fclose(file) != 0) succeeded = false;
+
+  if (succeeded)
+  {
+    rename(tempPath.c_str(), cachePath.c_str());
+  }
+  else
+  {
+    unlink(tempPath.c_str());
+  }
+}
@@ -0,0 +1,101 @@
+//
+// torcoreflashdiscovery.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCOREFLASHDISCOVERY_H
+#define TORCOREFLASHDISCOVERY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// What a V4L2 node offers in the way of flash LED controls:
+struct TorCoreFlashDevice
+{
+  TorCoreFlashDevice();
+
+  std::string path;
+
+  // The device number and driver name, which identify the hardware
+  // behind the path:
+  uint64_t identity;
+  std::string driver;
+
+  bool hasTorch;
+  int minTorch;
+  int maxTorch;
+
+  bool hasFlash;
+  int minFlash;
+  int maxFlash;
+  int minTime;
+  int maxTime;
+
+  bool hasIndicator;
+  int minIndicator;
+  int maxIndicator;
+};
+
+
+// Finds the flash LEDs among the video and subdevice nodes.  Every node
+// is probed at once, each on its own thread, as opening a camera node
+// can mean waiting for the sensor to power up.  The winner is cached,
+// and a later run that finds the same device (and kernel) at the same
+// path uses the cached ranges without probing anything.
+class TorCoreFlashDiscovery
+{
+public:
+  TorCoreFlashDiscovery(
+    const std::string &cachePath);
+
+  // ~/.cache/torchio-flash:
+  static std::string defaultCachePath();
+
+  // Puts /dev paths in the order they are probed, which decides any tie:
+  // video nodes before subdevices, and each kind by node number.
+  static void sortForProbing(
+    std::vector<std::string> &paths);
+
+  // Throws a TorCoreException if no node has flash controls:
+  TorCoreFlashDevice discover(
+    bool useCache);
+
+  // How the last discovery went:
+  bool usedCache();
+  int64_t getDiscoveryTime();
+  unsigned int getProbedCount();
+
+private:
+  bool loadCache(
+    TorCoreFlashDevice &device);
+
+  void saveCache(
+    const TorCoreFlashDevice &device);
+
+  std::string cachePath;
+  bool cacheHit;
+  int64_t discoveryTime;
+  unsigned int probedCount;
+};
+
+#endif // TORCOREFLASHDISCOVERY_H
@@ -0,0 +1,440 @@
+//
+// torcoreflashled.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcoreflashled.h"
+#include "torcoreexception.h"
+#include "torcoretrace.h"
+
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+// The fault control arrived in Linux 3.2, after the N900's kernel:
+#ifndef V4L2_CID_FLASH_FAULT
+#define V4L2_CID_FLASH_FAULT 0x009c090a
+#endif
+
+struct TorCoreControlInfo
+{
+  unsigned int id;
+  const char *name;
+  const char *label;
+};
+
+// In TorCoreControl order:
+static const TorCoreControlInfo controlInfo[Control_Count] =
+{
+  { V4L2_CID_TORCH_INTENSITY, "torch intensity",
+    "control=\"torch_intensity\"" },
+  { V4L2_CID_INDICATOR_INTENSITY, "indicator intensity",
+    "control=\"indicator_intensity\"" },
+  { V4L2_CID_FLASH_INTENSITY, "flash intensity",
+    "control=\"flash_intensity\"" },
+  { V4L2_CID_FLASH_TIMEOUT, "flash timeout",
+    "control=\"flash_timeout\"" },
+  { V4L2_CID_FLASH_STROBE, "flash strobe",
+    "control=\"flash_strobe\"" },
+  { V4L2_CID_FLASH_FAULT, "flash fault",
+    "control=\"flash_fault\"" }
+};
+
+// The V4L2_FLASH_FAULT_* bits, in order:
+static const char *faultNames[] =
+{
+  "over-voltage",
+  "timeout",
+  "over-temperature",
+  "short circuit",
+  "over-current",
+  "indicator",
+  "under-voltage",
+  "input voltage",
+  "LED over-temperature"
+};
+
+#define FAULT_NAME_COUNT (sizeof(faultNames) / sizeof(faultNames[0]))
+
+
+
+TorCoreFlashLED::TorCoreFlashLED(
+  const TorCoreFlashDevice &device)
+  : fileDescriptor(-1),
+    torchProbed(device.hasTorch),
+    minTorch(device.minTorch),
+    maxTorch(device.maxTorch),
+    flashProbed(device.hasFlash),
+    minFlash(device.minFlash),
+    maxFlash(device.maxFlash),
+    minTime(device.minTime),
+    maxTime(device.maxTime),
+    indicatorProbed(device.hasIndicator),
+    minIndicator(device.minIndicator),
+    maxIndicator(device.maxIndicator)
+{
+  for (int i = 0; i < Control_Count; ++i)
+  {
+    ioctls[i] = 0;
+    ioctlErrors[i] = 0;
+  }
+
+  // Not sure why "O_RDWR", but it seems to be necessary:
+  fileDescriptor = open(device.path.c_str(), O_RDWR | O_NONBLOCK, 0);
+
+  if (fileDescriptor == -1)
+  {
+    std::string ss;
+    ss += "Failed to connect to ";
+    ss += device.path;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorCoreException(ss);
+  }
+}
+
+
+TorCoreFlashLED::~TorCoreFlashLED()
+{
+  if (fileDescriptor >= 0) close(fileDescriptor);
+}
+
+
+int TorCoreFlashLED::getMinLevel(
+  TorCoreChannel channel)
+{
+  if (channel == Torch_CoreChannel)
+  {
+    probeTorch();
+    return minTorch;
+  }
+
+  probeIndicator();
+  return minIndicator;
+}
+
+
+int TorCoreFlashLED::getMaxLevel(
+  TorCoreChannel channel)
+{
+  if (channel == Torch_CoreChannel)
+  {
+    probeTorch();
+    return maxTorch;
+  }
+
+  probeIndicator();
+  return maxIndicator;
+}
+
+
+void TorCoreFlashLED::setLevel(
+  TorCoreChannel channel,
+  int level)
+{
+  if (channel == Torch_CoreChannel)
+  {
+    probeTorch();
+
+    if (level < minTorch) level = minTorch;
+    else if (level > maxTorch) level = maxTorch;
+
+    setControl(TorchIntensity_Control, level);
+  }
+  else
+  {
+    probeIndicator();
+
+    if (level < minIndicator) level = minIndicator;
+    else if (level > maxIndicator) level = maxIndicator;
+
+    setControl(IndicatorIntensity_Control, level);
+  }
+}
+
+
+int TorCoreFlashLED::getMinFlash()
+{
+  probeFlash();
+  return minFlash;
+}
+
+
+int TorCoreFlashLED::getMaxFlash()
+{
+  probeFlash();
+  return maxFlash;
+}
+
+
+int TorCoreFlashLED::getMinTime()
+{
+  probeFlash();
+  return minTime;
+}
+
+
+int TorCoreFlashLED::getMaxTime()
+{
+  probeFlash();
+  return maxTime;
+}
+
+
+int TorCoreFlashLED::getDefaultTime()
+{
+  // For now, let's be a bit conservative and cut the max time in half:
+  probeFlash();
+  return maxTime / 2;
+}
+
+
+void TorCoreFlashLED::prepareStrobe(
+  int intensity,
+  int timeout)
+{
+  probeFlash();
+
+  setControl(FlashIntensity_Control, intensity);
+  setControl(FlashTimeout_Control, timeout);
+}
+
+
+void TorCoreFlashLED::triggerStrobe()
+{
+  setControl(FlashStrobe_Control, 0);
+}
+
+
+void TorCoreFlashLED::probeTorch()
+{
+  if (torchProbed) return;
+
+  queryControl(TorchIntensity_Control, minTorch, maxTorch);
+
+  torchProbed = true;
+}
+
+
+void TorCoreFlashLED::probeFlash()
+{
+  if (flashProbed) return;
+
+  queryControl(FlashIntensity_Control, minFlash, maxFlash);
+  queryControl(FlashTimeout_Control, minTime, maxTime);
+
+  flashProbed = true;
+}
+
+
+void TorCoreFlashLED::probeIndicator()
+{
+  if (indicatorProbed) return;
+
+  queryControl(IndicatorIntensity_Control, minIndicator, maxIndicator);
+
+  indicatorProbed = true;
+}
+
+
+bool TorCoreFlashLED::subscribeToEvents()
+{
+#ifdef V4L2_EVENT_CTRL
+  // Changes made through our own descriptor aren't reported back, so
+  // every event is news:
+  TorCoreControl subscriptions[] =
+  {
+    TorchIntensity_Control,
+    IndicatorIntensity_Control,
+    FlashFault_Control
+  };
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    struct v4l2_event_subscription sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.type = V4L2_EVENT_CTRL;
+    sub.id = controlInfo[subscriptions[i]].id;
+    sub.flags = V4L2_EVENT_SUB_FL_SEND_INITIAL;
+
+    if (ioctl(fileDescriptor, VIDIOC_SUBSCRIBE_EVENT, &sub) == -1)
+    {
+      // Drivers without a fault control still have useful events:
+      if (subscriptions[i] == FlashFault_Control) break;
+
+      // Don't leave the ones that worked queueing events nobody reads:
+      memset(&sub, 0, sizeof(sub));
+      sub.type = V4L2_EVENT_ALL;
+      ioctl(fileDescriptor, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
+
+      return false;
+    }
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+int TorCoreFlashLED::getDescriptor()
+{
+  return fileDescriptor;
+}
+
+
+bool TorCoreFlashLED::dequeueEvent(
+  TorCoreControlEvent &event)
+{
+#ifdef V4L2_EVENT_CTRL
+  struct v4l2_event ev;
+
+  while (ioctl(fileDescriptor, VIDIOC_DQEVENT, &ev) == 0)
+  {
+    if ( (ev.type != V4L2_EVENT_CTRL)
+      || !(ev.u.ctrl.changes & V4L2_EVENT_CTRL_CH_VALUE))
+    {
+      continue;
+    }
+
+    for (int i = 0; i < Control_Count; ++i)
+    {
+      if (controlInfo[i].id == ev.id)
+      {
+        event.control = TorCoreControl(i);
+        event.value = ev.u.ctrl.value;
+        return true;
+      }
+    }
+  }
+#else
+  (void) event;
+#endif
+
+  return false;
+}
+
+
+std::string TorCoreFlashLED::describeFaults(
+  int faults)
+{
+  std::string description;
+
+  for (unsigned int i = 0; i < FAULT_NAME_COUNT; ++i)
+  {
+    if (!(faults & (1 << i))) continue;
+
+    if (!description.empty()) description += ", ";
+    description += faultNames[i];
+  }
+
+  if (description.empty()) description = "unknown fault";
+
+  return description;
+}
+
+
+void TorCoreFlashLED::registerMetrics(
+  TorCoreMetrics &metrics)
+{
+  for (int i = 0; i < Control_Count; ++i)
+  {
+    metrics.addCounter(
+      "torchio_led_ioctls_total",
+      controlInfo[i].label,
+      "V4L2 control ioctls issued to the flash device.",
+      &ioctls[i]);
+  }
+
+  for (int i = 0; i < Control_Count; ++i)
+  {
+    metrics.addCounter(
+      "torchio_led_ioctl_errors_total",
+      controlInfo[i].label,
+      "V4L2 control ioctls that failed.",
+      &ioctlErrors[i]);
+  }
+}
+
+
+void TorCoreFlashLED::queryControl(
+  TorCoreControl control,
+  int &minimum,
+  int &maximum)
+{
+  struct v4l2_queryctrl qctrl;
+  memset(&qctrl, 0, sizeof(qctrl));
+  qctrl.id = controlInfo[control].id;
+
+  ++ioctls[control];
+  TOR_TRACE_SPAN(controlInfo[control].name, "led.query");
+
+  if (ioctl(fileDescriptor, VIDIOC_QUERYCTRL, &qctrl) == -1)
+  {
+    ++ioctlErrors[control];
+
+    std::string ss;
+    ss += "Failed to retrieve ";
+    ss += controlInfo[control].name;
+    ss += " values.\nError is ";
+    ss += strerror(errno);
+    throw TorCoreException(ss);
+  }
+
+  minimum = qctrl.minimum;
+  maximum = qctrl.maximum;
+}
+
+
+void TorCoreFlashLED::setControl(
+  TorCoreControl control,
+  int value)
+{
+  struct v4l2_control ctrl;
+  ctrl.id = controlInfo[control].id;
+  ctrl.value = value;
+
+  ++ioctls[control];
+  TOR_TRACE_SPAN(controlInfo[control].name, "led.set");
+
+  if (ioctl(fileDescriptor, VIDIOC_S_CTRL, &ctrl) == -1)
+  {
+    ++ioctlErrors[control];
+
+    char number[16];
+    snprintf(number, sizeof(number), "%d", value);
+
+    std::string ss;
+    ss += "Failed to set ";
+    ss += controlInfo[control].name;
+    ss += " to ";
+    ss += number;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorCoreException(ss);
+  }
+}
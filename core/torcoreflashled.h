@@ -0,0 +1,147 @@
+//
+// torcoreflashled.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCOREFLASHLED_H
+#define TORCOREFLASHLED_H
+
+#include "torcoreled.h"
+#include "torcoremetrics.h"
+#include "torcoreflashdiscovery.h"
+
+#include <string>
+
+// The V4L2 controls in use, for accounting:
+enum TorCoreControl
+{
+  TorchIntensity_Control,
+  IndicatorIntensity_Control,
+  FlashIntensity_Control,
+  FlashTimeout_Control,
+  FlashStrobe_Control,
+  FlashFault_Control,
+  Control_Count
+};
+
+
+// A control changed by someone else (or, for the fault control, a fault
+// raised by the driver):
+struct TorCoreControlEvent
+{
+  TorCoreControl control;
+  int value;
+};
+
+// Direct control of the flash LEDs, through the V4L2 controls of the
+// device found by TorCoreFlashDiscovery.  Any LED whose range discovery
+// didn't find is only looked up the first time it is used.  Levels are
+// clamped to the ranges the driver reports.
+class TorCoreFlashLED: public TorCoreLED
+{
+public:
+  TorCoreFlashLED(
+    const TorCoreFlashDevice &device);
+
+  ~TorCoreFlashLED();
+
+  int getMinLevel(
+    TorCoreChannel channel);
+
+  int getMaxLevel(
+    TorCoreChannel channel);
+
+  void setLevel(
+    TorCoreChannel channel,
+    int level);
+
+  // Flash strobe controls:
+  int getMinFlash();
+  int getMaxFlash();
+  int getMinTime();
+  int getMaxTime();
+
+  // The timeout the driver is happiest with, by default:
+  int getDefaultTime();
+
+  void prepareStrobe(
+    int intensity,
+    int timeout);
+
+  void triggerStrobe();
+
+  // Asks the driver to report the torch and indicator levels (at once,
+  // and then whenever anyone else changes them) and any flash faults.
+  // Returns false if it can't; control events need Linux 3.1 or later:
+  bool subscribeToEvents();
+
+  // The device signals pending events as an exceptional condition
+  // (POLLPRI) on this descriptor:
+  int getDescriptor();
+
+  // Returns false once there are no more events waiting:
+  bool dequeueEvent(
+    TorCoreControlEvent &event);
+
+  // Names the V4L2_FLASH_FAULT_* bits set in a fault value:
+  static std::string describeFaults(
+    int faults);
+
+  // Ioctls issued, and failed, for each control:
+  void registerMetrics(
+    TorCoreMetrics &metrics);
+
+private:
+  void probeTorch();
+  void probeFlash();
+  void probeIndicator();
+
+  void queryControl(
+    TorCoreControl control,
+    int &minimum,
+    int &maximum);
+
+  void setControl(
+    TorCoreControl control,
+    int value);
+
+  int fileDescriptor;
+
+  bool torchProbed;
+  int minTorch;
+  int maxTorch;
+
+  bool flashProbed;
+  int minFlash;
+  int maxFlash;
+  int minTime;
+  int maxTime;
+
+  bool indicatorProbed;
+  int minIndicator;
+  int maxIndicator;
+
+  TorCoreCounter ioctls[Control_Count];
+  TorCoreCounter ioctlErrors[Control_Count];
+};
+
+#endif // TORCOREFLASHLED_H
@@ -0,0 +1,53 @@
+//
+// torcoreled.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCORELED_H
+#define TORCORELED_H
+
+enum TorCoreChannel
+{
+  Torch_CoreChannel,
+  Indicator_CoreChannel
+};
+
+
+// The LED operations the core needs: each channel is driven at a level
+// within its own hardware range.
+class TorCoreLED
+{
+public:
+  virtual ~TorCoreLED() {}
+
+  virtual int getMinLevel(
+    TorCoreChannel channel) = 0;
+
+  virtual int getMaxLevel(
+    TorCoreChannel channel) = 0;
+
+  virtual void setLevel(
+    TorCoreChannel channel,
+    int level) = 0;
+};
+
+#endif // TORCORELED_H
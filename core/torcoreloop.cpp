@@ -0,0 +1,369 @@
+//
+// torcoreloop.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcoreloop.h"
+#include "torcoreexception.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define CORE_LOOP_MAX_EVENTS 8
+
+
+static std::string systemError(
+  const char *what)
+{
+  std::string ss;
+  ss += what;
+  ss += "\nError is ";
+  ss += strerror(errno);
+  return ss;
+}
+
+
+TorCoreTimer::TorCoreTimer(
+  TorCoreLoop *l,
+  TorCoreTimerClient *c)
+  : loop(l),
+    client(c),
+    active(false),
+    deadline(0),
+    sequence(0)
+{
+}
+
+
+TorCoreTimer::~TorCoreTimer()
+{
+  stop();
+}
+
+
+void TorCoreTimer::startAt(
+  int64_t d)
+{
+  deadline = d;
+  active = true;
+  loop->registerTimer(this);
+}
+
+
+void TorCoreTimer::stop()
+{
+  if (!active) return;
+
+  active = false;
+  loop->unregisterTimer(this);
+}
+
+
+bool TorCoreTimer::isActive()
+{
+  return active;
+}
+
+
+int64_t TorCoreTimer::getDeadline()
+{
+  return deadline;
+}
+
+
+TorCoreLoop::TorCoreLoop()
+  : epollDescriptor(-1),
+    timerDescriptor(-1),
+    signalDescriptor(-1),
+    running(false),
+    nextSequence(0)
+{
+  epollDescriptor = epoll_create(CORE_LOOP_MAX_EVENTS);
+
+  if (epollDescriptor == -1)
+  {
+    throw TorCoreException(systemError("Failed to create epoll set."));
+  }
+
+  timerDescriptor = timerfd_create(CLOCK_MONOTONIC, 0);
+
+  if (timerDescriptor == -1)
+  {
+    throw TorCoreException(systemError("Failed to create timerfd."));
+  }
+
+  // Signals are taken synchronously, as just another event:
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &mask, 0);
+
+  signalDescriptor = signalfd(-1, &mask, 0);
+
+  if (signalDescriptor == -1)
+  {
+    throw TorCoreException(systemError("Failed to create signalfd."));
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+
+  event.data.fd = timerDescriptor;
+  epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, timerDescriptor, &event);
+
+  event.data.fd = signalDescriptor;
+  epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, signalDescriptor, &event);
+}
+
+
+TorCoreLoop::~TorCoreLoop()
+{
+  if (signalDescriptor != -1) close(signalDescriptor);
+  if (timerDescriptor != -1) close(timerDescriptor);
+  if (epollDescriptor != -1) close(epollDescriptor);
+}
+
+
+int64_t TorCoreLoop::currentTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+int64_t TorCoreLoop::currentRealTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void TorCoreLoop::watch(
+  int descriptor,
+  TorCoreWatchClient *client)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = descriptor;
+
+  if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) == -1)
+  {
+    throw TorCoreException(systemError("Failed to watch descriptor."));
+  }
+
+  TorCoreWatch w;
+  w.descriptor = descriptor;
+  w.client = client;
+  watches.push_back(w);
+}
+
+
+void TorCoreLoop::unwatch(
+  int descriptor)
+{
+  epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, descriptor, 0);
+
+  std::vector<TorCoreWatch>::iterator i = watches.begin();
+  while (i != watches.end())
+  {
+    if (i->descriptor == descriptor)
+    {
+      watches.erase(i);
+      return;
+    }
+    ++i;
+  }
+}
+
+
+void TorCoreLoop::run()
+{
+  struct epoll_event events[CORE_LOOP_MAX_EVENTS];
+
+  running = true;
+
+  while (running)
+  {
+    int count = epoll_wait(epollDescriptor, events, CORE_LOOP_MAX_EVENTS, -1);
+
+    if (count == -1)
+    {
+      if (errno == EINTR) continue;
+      throw TorCoreException(systemError("Event loop wait failed."));
+    }
+
+    int i = 0;
+    while (running && (i < count))
+    {
+      int descriptor = events[i].data.fd;
+      ++i;
+
+      if (descriptor == timerDescriptor)
+      {
+        uint64_t expirations;
+        if (read(timerDescriptor, &expirations, sizeof(expirations)) > 0)
+        {
+          fireDueTimers();
+        }
+      }
+      else if (descriptor == signalDescriptor)
+      {
+        struct signalfd_siginfo info;
+        if (read(signalDescriptor, &info, sizeof(info)) > 0)
+        {
+          running = false;
+        }
+      }
+      else
+      {
+        // Look the client up afresh, as earlier events may have changed
+        // what is being watched:
+        std::vector<TorCoreWatch>::iterator w = watches.begin();
+        while (w != watches.end())
+        {
+          if (w->descriptor == descriptor)
+          {
+            w->client->descriptorReadable(descriptor);
+            break;
+          }
+          ++w;
+        }
+      }
+    }
+  }
+}
+
+
+void TorCoreLoop::quit()
+{
+  running = false;
+}
+
+
+void TorCoreLoop::registerTimer(
+  TorCoreTimer *timer)
+{
+  // Timers sharing a deadline fire in the order they were armed:
+  timer->sequence = nextSequence;
+  ++nextSequence;
+
+  std::vector<TorCoreTimer *>::iterator i = timers.begin();
+  while ((i != timers.end()) && (*i != timer)) ++i;
+
+  if (i == timers.end()) timers.push_back(timer);
+
+  armTimerDescriptor();
+}
+
+
+void TorCoreLoop::unregisterTimer(
+  TorCoreTimer *timer)
+{
+  std::vector<TorCoreTimer *>::iterator i = timers.begin();
+  while (i != timers.end())
+  {
+    if (*i == timer)
+    {
+      timers.erase(i);
+      break;
+    }
+    ++i;
+  }
+
+  armTimerDescriptor();
+}
+
+
+void TorCoreLoop::armTimerDescriptor()
+{
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+
+  if (!timers.empty())
+  {
+    int64_t earliest = timers.front()->deadline;
+
+    std::vector<TorCoreTimer *>::const_iterator i = timers.begin();
+    while (i != timers.end())
+    {
+      if ((*i)->deadline < earliest) earliest = (*i)->deadline;
+      ++i;
+    }
+
+    // An all-zero expiry would disarm the timer, rather than fire it:
+    if (earliest < 1) earliest = 1;
+
+    spec.it_value.tv_sec = earliest / 1000000;
+    spec.it_value.tv_nsec = (earliest % 1000000) * 1000;
+  }
+
+  timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &spec, 0);
+}
+
+
+void TorCoreLoop::fireDueTimers()
+{
+  int64_t now = currentTime();
+
+  while (running)
+  {
+    // The earliest due timer, by deadline and then by arming order:
+    std::vector<TorCoreTimer *>::iterator next = timers.end();
+    std::vector<TorCoreTimer *>::iterator i = timers.begin();
+    while (i != timers.end())
+    {
+      if ( ((*i)->deadline <= now)
+        && ( (next == timers.end())
+          || ((*i)->deadline < (*next)->deadline)
+          || ( ((*i)->deadline == (*next)->deadline)
+            && ((*i)->sequence < (*next)->sequence))))
+      {
+        next = i;
+      }
+      ++i;
+    }
+
+    if (next == timers.end()) break;
+
+    TorCoreTimer *timer = *next;
+    timers.erase(next);
+    timer->active = false;
+
+    // The client may well re-arm this or any other timer:
+    timer->client->timerFired(timer);
+  }
+
+  armTimerDescriptor();
+}
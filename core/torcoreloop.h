@@ -0,0 +1,140 @@
+//
+// torcoreloop.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCORELOOP_H
+#define TORCORELOOP_H
+
+#include <stdint.h>
+#include <vector>
+
+class TorCoreLoop;
+class TorCoreTimer;
+
+// Objects that want to hear from a TorCoreTimer or a watched descriptor
+// implement these:
+class TorCoreTimerClient
+{
+public:
+  virtual ~TorCoreTimerClient() {}
+
+  virtual void timerFired(
+    TorCoreTimer *timer) = 0;
+};
+
+
+class TorCoreWatchClient
+{
+public:
+  virtual ~TorCoreWatchClient() {}
+
+  virtual void descriptorReadable(
+    int descriptor) = 0;
+};
+
+
+// A single-shot timer that fires at an absolute deadline on the
+// monotonic clock (in microseconds), just like TorTimer:
+class TorCoreTimer
+{
+public:
+  TorCoreTimer(
+    TorCoreLoop *loop,
+    TorCoreTimerClient *client);
+
+  ~TorCoreTimer();
+
+  void startAt(
+    int64_t deadline);
+
+  void stop();
+
+  bool isActive();
+  int64_t getDeadline();
+
+private:
+  friend class TorCoreLoop;
+
+  TorCoreLoop *loop;
+  TorCoreTimerClient *client;
+  bool active;
+  int64_t deadline;
+  unsigned int sequence;
+};
+
+
+// A minimal event loop: a single epoll set holds one timerfd, always armed
+// for the earliest pending TorCoreTimer, plus any descriptors being
+// watched.  SIGINT and SIGTERM arrive through a signalfd and end the loop.
+class TorCoreLoop
+{
+public:
+  TorCoreLoop();
+  ~TorCoreLoop();
+
+  // CLOCK_MONOTONIC, in microseconds:
+  static int64_t currentTime();
+
+  // CLOCK_REALTIME, in microseconds since the epoch:
+  static int64_t currentRealTime();
+
+  void watch(
+    int descriptor,
+    TorCoreWatchClient *client);
+
+  void unwatch(
+    int descriptor);
+
+  // Runs until quit() is called or a signal arrives:
+  void run();
+
+  void quit();
+
+  // Used by TorCoreTimer:
+  void registerTimer(
+    TorCoreTimer *timer);
+
+  void unregisterTimer(
+    TorCoreTimer *timer);
+
+private:
+  struct TorCoreWatch
+  {
+    int descriptor;
+    TorCoreWatchClient *client;
+  };
+
+  void armTimerDescriptor();
+  void fireDueTimers();
+
+  int epollDescriptor;
+  int timerDescriptor;
+  int signalDescriptor;
+  bool running;
+
+  std::vector<TorCoreTimer *> timers;
+  std::vector<TorCoreWatch> watches;
+  unsigned int nextSequence;
+};
+
+#endif // TORCORELOOP_H
@@ -0,0 +1,198 @@
+//
+// torcoremetrics.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcoremetrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+void TorCoreMetrics::addCounter(
+  const char *name,
+  const char *labels,
+  const char *help,
+  const TorCoreCounter *counter)
+{
+  add(Counter_Metric, name, labels, help, counter, 1.0);
+}
+
+
+void TorCoreMetrics::addSummary(
+  const char *name,
+  const char *labels,
+  const char *help,
+  const TorCoreSummary *summary,
+  double scale)
+{
+  add(Summary_Metric, name, labels, help, summary, scale);
+}
+
+
+unsigned int TorCoreMetrics::getSeriesCount()
+{
+  return series.size();
+}
+
+
+void TorCoreMetrics::add(
+  TorCoreMetricType type,
+  const char *name,
+  const char *labels,
+  const char *help,
+  const void *value,
+  double scale)
+{
+  TorCoreSeries s;
+  s.type = type;
+  s.name = name;
+  s.labels = labels ? labels : "";
+  s.help = help;
+  s.value = value;
+  s.scale = scale;
+
+  series.push_back(s);
+}
+
+
+// Appends "name{labels} value\n":
+static void appendSample(
+  std::string &text,
+  const char *name,
+  const char *suffix,
+  const char *labels,
+  const char *value)
+{
+  text += name;
+  text += suffix;
+
+  if (*labels)
+  {
+    text += '{';
+    text += labels;
+    text += '}';
+  }
+
+  text += ' ';
+  text += value;
+  text += '\n';
+}
+
+
+static void appendDescription(
+  std::string &text,
+  const char *name,
+  const char *suffix,
+  const char *help,
+  const char *type)
+{
+  if (help)
+  {
+    text += "# HELP ";
+    text += name;
+    text += suffix;
+    text += ' ';
+    text += help;
+    text += '\n';
+  }
+
+  text += "# TYPE ";
+  text += name;
+  text += suffix;
+  text += ' ';
+  text += type;
+  text += '\n';
+}
+
+
+void TorCoreMetrics::render(
+  std::string &text)
+{
+  char value[32];
+
+  size_t start = 0;
+  while (start < series.size())
+  {
+    // Each metric is described once, followed by all of its series:
+    size_t end = start + 1;
+    while ( (end < series.size())
+      && (strcmp(series[end].name, series[start].name) == 0))
+    {
+      ++end;
+    }
+
+    const TorCoreSeries &first = series[start];
+
+    if (first.type == Counter_Metric)
+    {
+      appendDescription(text, first.name, "", first.help, "counter");
+
+      for (size_t i = start; i < end; ++i)
+      {
+        snprintf(
+          value,
+          sizeof(value),
+          "%llu",
+          (unsigned long long) *(const TorCoreCounter *) series[i].value);
+
+        appendSample(text, series[i].name, "", series[i].labels, value);
+      }
+    }
+    else
+    {
+      appendDescription(text, first.name, "", first.help, "summary");
+
+      for (size_t i = start; i < end; ++i)
+      {
+        const TorCoreSummary *summary =
+          (const TorCoreSummary *) series[i].value;
+
+        snprintf(value, sizeof(value), "%.6f", summary->sum * series[i].scale);
+        appendSample(text, series[i].name, "_sum", series[i].labels, value);
+
+        snprintf(
+          value,
+          sizeof(value),
+          "%llu",
+          (unsigned long long) summary->count);
+
+        appendSample(text, series[i].name, "_count", series[i].labels, value);
+      }
+
+      // As far as Prometheus is concerned, the largest value is a gauge
+      // of its own:
+      appendDescription(text, first.name, "_max", 0, "gauge");
+
+      for (size_t i = start; i < end; ++i)
+      {
+        const TorCoreSummary *summary =
+          (const TorCoreSummary *) series[i].value;
+
+        snprintf(value, sizeof(value), "%.6f", summary->max * series[i].scale);
+        appendSample(text, series[i].name, "_max", series[i].labels, value);
+      }
+    }
+
+    start = end;
+  }
+}
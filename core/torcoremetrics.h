@@ -0,0 +1,120 @@
+//
+// torcoremetrics.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCOREMETRICS_H
+#define TORCOREMETRICS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Torchio does all of its work on one thread, so a counter is just an
+// integer belonging to whatever it counts; bumping one costs a single
+// add.  The registry only holds pointers to them, and reads them when
+// asked for an export.
+typedef uint64_t TorCoreCounter;
+
+
+// A running count, total and maximum of some measurement:
+class TorCoreSummary
+{
+public:
+  TorCoreSummary()
+    : count(0),
+      sum(0),
+      max(0)
+  {}
+
+  void record(
+    int64_t value)
+  {
+    ++count;
+    sum += value;
+    if (value > max) max = value;
+  }
+
+  uint64_t count;
+  int64_t sum;
+  int64_t max;
+};
+
+
+// Collects the counters and summaries of every instrumented object, and
+// writes them out in the Prometheus text exposition format.  Series of
+// the same metric, differing only in their labels, should be added one
+// after the other.
+class TorCoreMetrics
+{
+public:
+  // "labels" is the inside of the braces (e.g. "channel=\"torch\""), or
+  // empty for none:
+  void addCounter(
+    const char *name,
+    const char *labels,
+    const char *help,
+    const TorCoreCounter *counter);
+
+  // Summaries are kept in microseconds, and exported in seconds (along
+  // with a "_max" gauge), unless scaled otherwise:
+  void addSummary(
+    const char *name,
+    const char *labels,
+    const char *help,
+    const TorCoreSummary *summary,
+    double scale = 0.000001);
+
+  unsigned int getSeriesCount();
+
+  void render(
+    std::string &text);
+
+private:
+  enum TorCoreMetricType
+  {
+    Counter_Metric,
+    Summary_Metric
+  };
+
+  struct TorCoreSeries
+  {
+    TorCoreMetricType type;
+    const char *name;
+    const char *labels;
+    const char *help;
+    const void *value;
+    double scale;
+  };
+
+  void add(
+    TorCoreMetricType type,
+    const char *name,
+    const char *labels,
+    const char *help,
+    const void *value,
+    double scale);
+
+  std::vector<TorCoreSeries> series;
+};
+
+#endif // TORCOREMETRICS_H
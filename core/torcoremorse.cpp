@@ -0,0 +1,334 @@
+//
+// torcoremorse.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcoremorse.h"
+#include "tormorsetable.h"
+
+#include <ctype.h>
+
+
+TorCoreMorseEncoder::TorCoreMorseEncoder()
+  : unitCount(0),
+    skippingWhiteSpace(false)
+{
+}
+
+
+void TorCoreMorseEncoder::appendText(
+  const char *text,
+  size_t length)
+{
+  size_t i = 0;
+  while (i < length)
+  {
+    char c = text[i];
+    ++i;
+
+    if (skippingWhiteSpace)
+    {
+      if (isspace((unsigned char) c)) continue;
+
+      skippingWhiteSpace = false;
+    }
+
+    if (c == ' ')
+    {
+      // End of a word, so need to add 4 units to the 3-unit character gap,
+      // and skip any extra whitespace chars:
+      appendRun(false, 4);
+      skippingWhiteSpace = true;
+    }
+    else if ((c == '\r') || ((c & 0xC0) == 0x80))
+    {
+      // Neither carriage returns nor the tails of UTF-8 characters
+      // count as characters of their own:
+      continue;
+    }
+    else
+    {
+      const char *code = torMorseCode(c);
+
+      while (code && *code)
+      {
+        appendRun(true, (*code == '.') ? 1 : 3);
+        appendRun(false, 1);
+        ++code;
+      }
+    }
+
+    // At the end of every character is a 3 unit gap:
+    appendRun(false, 3);
+  }
+}
+
+
+void TorCoreMorseEncoder::appendGap(
+  unsigned int units)
+{
+  appendRun(false, units);
+}
+
+
+void TorCoreMorseEncoder::discard(
+  size_t count)
+{
+  runs.erase(runs.begin(), runs.begin() + count);
+}
+
+
+void TorCoreMorseEncoder::clear()
+{
+  runs.clear();
+  unitCount = 0;
+  skippingWhiteSpace = false;
+}
+
+
+const std::vector<TorCoreRun> &TorCoreMorseEncoder::getRuns()
+{
+  return runs;
+}
+
+
+uint64_t TorCoreMorseEncoder::getUnitCount()
+{
+  return unitCount;
+}
+
+
+void TorCoreMorseEncoder::appendRun(
+  bool lit,
+  unsigned int units)
+{
+  unitCount += units;
+
+  if (!runs.empty() && (runs.back().lit == lit))
+  {
+    runs.back().units += units;
+    return;
+  }
+
+  TorCoreRun run;
+  run.lit = lit;
+  run.units = units;
+  runs.push_back(run);
+}
+
+
+TorCoreMorsePlayer::TorCoreMorsePlayer(
+  TorCorePlayerClient *pc)
+  : client(pc),
+    dotDuration(100000),
+    stalled(false),
+    stallCount(0),
+    nextEdge(0),
+    nextEdgeShift(0),
+    alignment(0),
+    boundaryPending(false),
+    pendingBoundary(0),
+    alignedStarts(0),
+    phaseErrorTotal(0),
+    maxPhaseError(0)
+{
+}
+
+
+void TorCoreMorsePlayer::setDotDuration(
+  unsigned int milliseconds)
+{
+  dotDuration = int64_t(milliseconds) * 1000;
+}
+
+
+void TorCoreMorsePlayer::setAlignment(
+  int64_t period)
+{
+  alignment = period;
+}
+
+
+//
+// Rather than waking up for every unit, the timer is set for the next
+// change of light, against absolute deadlines:
+//
+void TorCoreMorsePlayer::start()
+{
+  client->stopTimer();
+  stalled = false;
+  nextEdgeShift = 0;
+
+  if (alignment)
+  {
+    armAtBoundary(client->currentTime());
+    return;
+  }
+
+  nextEdge = client->currentTime() + dotDuration;
+  client->startTimerAt(nextEdge, false);
+}
+
+
+void TorCoreMorsePlayer::timerFired()
+{
+  TorCoreRun run;
+  TorCorePlayerStep step = client->nextRun(run);
+
+  if (step == Repeat_CorePlayerStep)
+  {
+    if (alignment)
+    {
+      armAtBoundary(nextEdge);
+      return;
+    }
+
+    step = client->nextRun(run);
+  }
+
+  switch (step)
+  {
+  case Run_CorePlayerStep:
+    playRun(run);
+    break;
+
+  case Stall_CorePlayerStep:
+    stalled = true;
+    ++stallCount;
+    break;
+
+  case End_CorePlayerStep:
+  default:
+    client->stopTimer();
+    client->playbackFinished();
+    break;
+  }
+}
+
+
+void TorCoreMorsePlayer::runsAppended()
+{
+  if (!stalled) return;
+
+  // Pick up from wherever the clock has got to:
+  stalled = false;
+
+  int64_t now = client->currentTime();
+  if (nextEdge < now)
+  {
+    nextEdge = now;
+    nextEdgeShift = 0;
+  }
+
+  client->startTimerAt(nextEdge - nextEdgeShift, false);
+}
+
+
+void TorCoreMorsePlayer::stop()
+{
+  client->stopTimer();
+  stalled = false;
+}
+
+
+unsigned int TorCoreMorsePlayer::getStallCount()
+{
+  return stallCount;
+}
+
+
+unsigned int TorCoreMorsePlayer::getAlignedStarts()
+{
+  return alignedStarts;
+}
+
+
+int64_t TorCoreMorsePlayer::getPhaseErrorTotal()
+{
+  return phaseErrorTotal;
+}
+
+
+int64_t TorCoreMorsePlayer::getMaxPhaseError()
+{
+  return maxPhaseError;
+}
+
+
+//
+// Wall-clock boundaries are turned into deadlines on the client's
+// (monotonic) clock, so the wait itself can't be thrown off by the wall
+// clock being set in the meantime:
+//
+void TorCoreMorsePlayer::armAtBoundary(
+  int64_t earliest)
+{
+  int64_t offset = client->currentRealTime() - client->currentTime();
+  int64_t real = earliest + offset;
+
+  pendingBoundary = ((real + alignment - 1) / alignment) * alignment;
+  boundaryPending = true;
+
+  nextEdge = pendingBoundary - offset;
+
+  // Every transmission starts by lighting up:
+  nextEdgeShift = client->getSwitchingTime(true);
+
+  // Millisecond rounding would swamp the phase error, so this wait goes
+  // to the microsecond:
+  client->startTimerAt(nextEdge - nextEdgeShift, true);
+}
+
+
+void TorCoreMorsePlayer::playRun(
+  const TorCoreRun &run)
+{
+  int64_t due = nextEdge;
+  int64_t shift = nextEdgeShift;
+
+  nextEdge += int64_t(run.units) * dotDuration;
+
+  // The next edge will (almost always) be the opposite of this one, so
+  // it can go out early by however long that change usually takes:
+  nextEdgeShift = client->getSwitchingTime(!run.lit);
+
+  // Re-arm first, so a client reacting to the switch can still stop us:
+  client->startTimerAt(nextEdge - nextEdgeShift, false);
+
+  int64_t started = client->currentTime();
+  client->switchLight(run.lit);
+  int64_t completed = client->currentTime();
+
+  if (boundaryPending)
+  {
+    // The phase error is how far from the boundary the light changed:
+    int64_t phaseError = client->currentRealTime() - pendingBoundary;
+    if (phaseError < 0) phaseError = -phaseError;
+
+    ++alignedStarts;
+    phaseErrorTotal += phaseError;
+    if (phaseError > maxPhaseError) maxPhaseError = phaseError;
+    boundaryPending = false;
+  }
+
+  client->edgePlayed(run, due, shift, started, completed);
+}
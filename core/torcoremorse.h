@@ -0,0 +1,203 @@
+//
+// torcoremorse.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCOREMORSE_H
+#define TORCOREMORSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Morse code held as runs of light and dark, measured in dot units:
+struct TorCoreRun
+{
+  bool lit;
+  unsigned int units;
+};
+
+
+// Translates text into runs; all Morse text, in torchio-core and TorMorse
+// alike, goes through here.  Text may arrive in pieces; runs of whitespace
+// are collapsed across them.
+class TorCoreMorseEncoder
+{
+public:
+  TorCoreMorseEncoder();
+
+  void appendText(
+    const char *text,
+    size_t length);
+
+  void appendGap(
+    unsigned int units);
+
+  // Drops the first "count" runs, once they have been played:
+  void discard(
+    size_t count);
+
+  void clear();
+
+  const std::vector<TorCoreRun> &getRuns();
+
+  // Units appended since the last clear(), discarded runs included:
+  uint64_t getUnitCount();
+
+private:
+  void appendRun(
+    bool lit,
+    unsigned int units);
+
+  std::vector<TorCoreRun> runs;
+  uint64_t unitCount;
+  bool skippingWhiteSpace;
+};
+
+
+// What a player's client has to offer next:
+enum TorCorePlayerStep
+{
+  Run_CorePlayerStep,     // The run to play
+  Repeat_CorePlayerStep,  // A repeating message is about to start again
+  Stall_CorePlayerStep,   // Nothing yet; runsAppended() will follow
+  End_CorePlayerStep      // Nothing more, ever
+};
+
+
+// A player runs against its client's clock and timer, and switches its
+// client's light, so the same player serves torchio-core's epoll loop and
+// TorMorse's (possibly virtual) clock alike.  Times are in microseconds.
+class TorCorePlayerClient
+{
+public:
+  virtual ~TorCorePlayerClient() {}
+
+  virtual int64_t currentTime() = 0;
+
+  // Wall-clock time, for alignment:
+  virtual int64_t currentRealTime() = 0;
+
+  // The player's one timer, which calls the player's timerFired() when it
+  // goes off.  Precise waits end to the microsecond, not the millisecond:
+  virtual void startTimerAt(
+    int64_t deadline,
+    bool precisely) = 0;
+
+  virtual void stopTimer() = 0;
+
+  virtual TorCorePlayerStep nextRun(
+    TorCoreRun &run) = 0;
+
+  // Returns once the light has changed:
+  virtual void switchLight(
+    bool lit) = 0;
+
+  // How long switching the light is expected to take, so that the switch
+  // can start that much early; zero leaves the edges where they fall:
+  virtual int64_t getSwitchingTime(
+    bool lit)
+  {
+    (void) lit;
+
+    return 0;
+  }
+
+  // Each edge once played: when it was due, how early its timer was set,
+  // and when the switch started and completed:
+  virtual void edgePlayed(
+    const TorCoreRun &run,
+    int64_t due,
+    int64_t shift,
+    int64_t started,
+    int64_t completed)
+  {
+    (void) run;
+    (void) due;
+    (void) shift;
+    (void) started;
+    (void) completed;
+  }
+
+  virtual void playbackFinished() = 0;
+};
+
+
+// Plays a client's runs, each edge scheduled at an absolute deadline so
+// that timer latency never accumulates.  The first edge comes one dot
+// after start(), or on the next multiple of the alignment period of
+// wall-clock time, as does each new start of a repeating message.
+class TorCoreMorsePlayer
+{
+public:
+  TorCoreMorsePlayer(
+    TorCorePlayerClient *client);
+
+  void setDotDuration(
+    unsigned int milliseconds);
+
+  // In microseconds; zero turns alignment off:
+  void setAlignment(
+    int64_t period);
+
+  void start();
+
+  void timerFired();
+
+  // Picks up again after a stall, once the client has more runs:
+  void runsAppended();
+
+  void stop();
+
+  unsigned int getStallCount();
+
+  // How closely the aligned starts hit their wall-clock boundaries:
+  unsigned int getAlignedStarts();
+  int64_t getPhaseErrorTotal();
+  int64_t getMaxPhaseError();
+
+private:
+  void armAtBoundary(
+    int64_t earliest);
+
+  void playRun(
+    const TorCoreRun &run);
+
+  TorCorePlayerClient *client;
+  int64_t dotDuration;
+  bool stalled;
+  unsigned int stallCount;
+
+  // The nominal time of the next edge, and how much earlier than that its
+  // timer was actually set:
+  int64_t nextEdge;
+  int64_t nextEdgeShift;
+
+  int64_t alignment;
+  bool boundaryPending;
+  int64_t pendingBoundary;
+  unsigned int alignedStarts;
+  int64_t phaseErrorTotal;
+  int64_t maxPhaseError;
+};
+
+#endif // TORCOREMORSE_H
@@ -0,0 +1,95 @@
+//
+// torcoreprocess.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcoreprocess.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+int64_t torCoreProcessAge()
+{
+  // The kernel records the process start time in clock ticks since boot
+  // (field 22 of /proc/self/stat), which can be compared against the
+  // uptime:
+  FILE *stat = fopen("/proc/self/stat", "r");
+  FILE *uptime = fopen("/proc/uptime", "r");
+  int64_t age = -1;
+
+  if (stat && uptime)
+  {
+    char buffer[1024];
+    size_t size = fread(buffer, 1, sizeof(buffer) - 1, stat);
+    buffer[size] = 0;
+
+    // Skip past the command name, which may itself hold spaces:
+    char *fields = strrchr(buffer, ')');
+    unsigned long long startTicks;
+    double upSeconds;
+
+    if ( fields
+      && (sscanf(
+            fields + 2,
+            "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d "
+            "%*d %*d %*d %*d %llu",
+            &startTicks) == 1)
+      && (fscanf(uptime, "%lf", &upSeconds) == 1))
+    {
+      age =
+        int64_t(upSeconds * 1000000)
+        - int64_t(startTicks * 1000000 / sysconf(_SC_CLK_TCK));
+
+      if (age < 0) age = 0;
+    }
+  }
+
+  if (stat) fclose(stat);
+  if (uptime) fclose(uptime);
+
+  return age;
+}
+
+
+bool torCoreMemoryUsage(
+  long &resident,
+  long &peak)
+{
+  FILE *status = fopen("/proc/self/status", "r");
+  if (!status) return false;
+
+  bool haveResident = false;
+  bool havePeak = false;
+  char line[256];
+
+  while (fgets(line, sizeof(line), status))
+  {
+    if (sscanf(line, "VmRSS: %ld", &resident) == 1) haveResident = true;
+    else if (sscanf(line, "VmHWM: %ld", &peak) == 1) havePeak = true;
+  }
+
+  fclose(status);
+
+  return haveResident && havePeak;
+}
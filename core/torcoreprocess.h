@@ -0,0 +1,39 @@
+//
+// torcoreprocess.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCOREPROCESS_H
+#define TORCOREPROCESS_H
+
+#include <stdint.h>
+
+// How long ago this process was started, in microseconds (to the nearest
+// clock tick), or -1 if the kernel won't say:
+int64_t torCoreProcessAge();
+
+// Resident memory now and at its peak, in kB; false if unknown:
+bool torCoreMemoryUsage(
+  long &resident,
+  long &peak);
+
+#endif // TORCOREPROCESS_H
@@ -0,0 +1,148 @@
+//
+// torcoretrace.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcoretrace.h"
+
+#ifdef TORCHIO_TRACING
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+TorCoreTraceEvent *TorCoreTrace::events = 0;
+size_t TorCoreTrace::capacity = 0;
+uint64_t TorCoreTrace::recorded = 0;
+
+
+void TorCoreTrace::start(
+  size_t c)
+{
+  stop();
+
+  events = new TorCoreTraceEvent[c];
+  capacity = c;
+  recorded = 0;
+}
+
+
+bool TorCoreTrace::isRunning()
+{
+  return events != 0;
+}
+
+
+void TorCoreTrace::stop()
+{
+  delete[] events;
+  events = 0;
+  capacity = 0;
+}
+
+
+int64_t TorCoreTrace::currentTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void TorCoreTrace::record(
+  const char *name,
+  const char *category,
+  int64_t start,
+  int64_t end)
+{
+  if (!events) return;
+
+  if (!end) end = currentTime();
+
+  TorCoreTraceEvent &event = events[recorded % capacity];
+  event.name = name;
+  event.category = category;
+  event.start = start;
+  event.duration = end - start;
+
+  ++recorded;
+}
+
+
+uint64_t TorCoreTrace::getDroppedCount()
+{
+  if (recorded <= capacity) return 0;
+
+  return recorded - capacity;
+}
+
+
+bool TorCoreTrace::writeChromeTrace(
+  const char *path)
+{
+  if (!events) return true;
+
+  FILE *file = fopen(path, "w");
+  if (!file) return false;
+
+  int pid = getpid();
+
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(
+    file,
+    "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+    "\"args\":{\"name\":\"torchio\"}}",
+    pid,
+    pid);
+
+  // Oldest first, starting after the newest if the ring has wrapped:
+  uint64_t first = getDroppedCount();
+
+  for (uint64_t i = first; i < recorded; ++i)
+  {
+    const TorCoreTraceEvent &event = events[i % capacity];
+
+    fprintf(
+      file,
+      ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,"
+      "\"dur\":%lld,\"pid\":%d,\"tid\":%d}",
+      event.name,
+      event.category,
+      (long long) event.start,
+      (long long) event.duration,
+      pid,
+      pid);
+  }
+
+  fprintf(
+    file,
+    "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%llu}}\n",
+    (unsigned long long) first);
+
+  bool succeeded = !ferror(file);
+  if (fclose(file) != 0) succeeded = false;
+
+  return succeeded;
+}
+
+#endif // TORCHIO_TRACING
@@ -0,0 +1,123 @@
+//
+// torcoretrace.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCORETRACE_H
+#define TORCORETRACE_H
+
+// Timeline tracing, for seeing how input, D-Bus calls, encoding and LED
+// ioctls interleave.  Spans are recorded into a fixed ring of binary
+// events (so a long run keeps its most recent history), and only turned
+// into Chrome trace JSON, which Perfetto loads, when the trace is
+// written out at exit.
+//
+// Tracing is only built when TORCHIO_TRACING is defined (CONFIG+=tracing
+// in qmake); otherwise TOR_TRACE_SPAN() compiles to nothing.  Span names
+// and categories must be string literals (or otherwise outlive the
+// trace), as only their pointers are kept.
+
+#ifdef TORCHIO_TRACING
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct TorCoreTraceEvent
+{
+  const char *name;
+  const char *category;
+  int64_t start;
+  int64_t duration;
+};
+
+
+class TorCoreTrace
+{
+public:
+  // Allocates room for "capacity" events; nothing is recorded before
+  // this is called:
+  static void start(
+    size_t capacity);
+
+  static bool isRunning();
+
+  // Returns false on failure, with errno set:
+  static bool writeChromeTrace(
+    const char *path);
+
+  static void stop();
+
+  // CLOCK_MONOTONIC, in microseconds:
+  static int64_t currentTime();
+
+  static void record(
+    const char *name,
+    const char *category,
+    int64_t start,
+    int64_t end);
+
+  // Events overwritten once the ring filled up:
+  static uint64_t getDroppedCount();
+
+private:
+  static TorCoreTraceEvent *events;
+  static size_t capacity;
+  static uint64_t recorded;
+};
+
+
+// Records a span from construction to the end of its scope:
+class TorCoreTraceSpan
+{
+public:
+  TorCoreTraceSpan(
+    const char *n,
+    const char *c)
+    : name(n),
+      category(c),
+      start(TorCoreTrace::isRunning() ? TorCoreTrace::currentTime() : 0)
+  {}
+
+  ~TorCoreTraceSpan()
+  {
+    if (start) TorCoreTrace::record(name, category, start, 0);
+  }
+
+private:
+  const char *name;
+  const char *category;
+  int64_t start;
+};
+
+#define TOR_TRACE_JOIN2(a, b) a##b
+#define TOR_TRACE_JOIN(a, b) TOR_TRACE_JOIN2(a, b)
+
+#define TOR_TRACE_SPAN(name, category) \
+  TorCoreTraceSpan TOR_TRACE_JOIN(torTraceSpan, __LINE__)(name, category)
+
+#else // TORCHIO_TRACING
+
+#define TOR_TRACE_SPAN(name, category) do {} while (0)
+
+#endif // TORCHIO_TRACING
+
+#endif // TORCORETRACE_H
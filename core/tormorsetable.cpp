@@ -0,0 +1,149 @@
+//
+// tormorsetable.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "tormorsetable.h"
+
+struct TorMorseElement
+{
+  char character;
+  const char *code;
+};
+
+static const TorMorseElement morseElements[] =
+{
+  {'A', ".-"},
+  {'B', "-..."},
+  {'C', "-.-."},
+  {'D', "-.."},
+  {'E', "."},
+  {'F', "..-."},
+  {'G', "--."},
+  {'H', "...."},
+  {'I', ".."},
+  {'J', ".---"},
+  {'K', "-.-"},
+  {'L', ".-.."},
+  {'M', "--"},
+  {'N', "-."},
+  {'O', "---"},
+  {'P', ".--."},
+  {'Q', "--.-"},
+  {'R', ".-."},
+  {'S', "..."},
+  {'T', "-"},
+  {'U', "..-"},
+  {'V', "...-"},
+  {'W', ".--"},
+  {'X', "-..-"},
+  {'Y', "-.--"},
+  {'Z', "--.."},
+  {'0', "-----"},
+  {'1', ".----"},
+  {'2', "..---"},
+  {'3', "...--"},
+  {'4', "....-"},
+  {'5', "....."},
+  {'6', "-...."},
+  {'7', "--..."},
+  {'8', "---.."},
+  {'9', "----."},
+  {'.', ".-.-.-"},
+  {',', "--..--"},
+  {'?', "..--.."},
+  {'\'', ".----."},
+  {'!', "-.-.--"},
+  {'/', "-..-."},
+  {'(', "-.--."},
+  {')', "-.--.-"},
+  {'&', ".-..."},
+  {':', "---..."},
+  {';', "-.-.-."},
+  {'=', "-...-"},
+  {'+', ".-.-."},
+  {'-', "-....-"},
+  {'_', "..--.-"},
+  {'"', ".-..-."},
+  {'$', "...-..-"},
+  {'@', ".--.-."},
+  {0, 0}
+};
+
+
+// Both lookup tables are built from morseElements on first use:
+static const char *codeTable[128];
+static char characterTable[TOR_MORSE_MAX_INDEX];
+static bool tablesReady = false;
+
+
+static void setupTables()
+{
+  const TorMorseElement *element = morseElements;
+
+  while (element->character)
+  {
+    codeTable[(unsigned char)element->character] = element->code;
+
+    // Lower case letters share the upper case codes:
+    if ((element->character >= 'A') && (element->character <= 'Z'))
+    {
+      codeTable[element->character - 'A' + 'a'] = element->code;
+    }
+
+    unsigned int index = TOR_MORSE_ROOT;
+    const char *position = element->code;
+
+    while (*position)
+    {
+      index = (2 * index) + ((*position == '-') ? 1 : 0);
+      ++position;
+    }
+
+    characterTable[index] = element->character;
+
+    ++element;
+  }
+
+  tablesReady = true;
+}
+
+
+const char *torMorseCode(
+  char c)
+{
+  if (!tablesReady) setupTables();
+
+  if ((unsigned char)c >= 128) return 0;
+
+  return codeTable[(unsigned char)c];
+}
+
+
+char torMorseCharacter(
+  unsigned int treeIndex)
+{
+  if (!tablesReady) setupTables();
+
+  if (treeIndex >= TOR_MORSE_MAX_INDEX) return 0;
+
+  return characterTable[treeIndex];
+}
@@ -0,0 +1,45 @@
+//
+// tormorsetable.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORMORSETABLE_H
+#define TORMORSETABLE_H
+
+// The Morse elements for each supported character, written as strings of
+// '.' and '-'.  Used both to encode text and (run backwards) to decode it.
+
+// Returns 0 for characters with no Morse equivalent.  Letters may be in
+// either case.
+const char *torMorseCode(
+  char c);
+
+// Elements can also be tracked as a position in a binary tree, which
+// makes decoding cheap: start at TOR_MORSE_ROOT, then move to
+// (2 * index) for a dot or (2 * index + 1) for a dash.
+#define TOR_MORSE_ROOT 1
+#define TOR_MORSE_MAX_INDEX 256
+
+// Returns 0 if the position doesn't correspond to a character.
+char torMorseCharacter(
+  unsigned int treeIndex);
+
+#endif // TORMORSETABLE_H
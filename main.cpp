@@ -23,16 +23,25 @@
 #include <QtCore/QCoreApplication>
 
 #include <QTimer>
+#include <QSocketNotifier>
 #include <torcontroller.h>
+#include <torstartuptrace.h>
 #include <signal.h> // to catch SIGINT
+#include <unistd.h>
+#include <fcntl.h>
 
+// Little can safely be done inside a signal handler, so SIGINT is only
+// written into this pipe; the event loop reads it and has the controller
+// shut down properly:
+static int interruptPipe[2] = {-1, -1};
 
 void signalhandler(
   int s)
 {
   if (s == SIGINT)
   {
-    qApp->quit();
+    char c = 0;
+    if (write(interruptPipe[1], &c, 1) < 0) return;
   }
 }
 
@@ -41,13 +50,26 @@ int main(
   int argc,
   char *argv[])
 {
+  // Startup is timed from here on:
+  TorStartupTrace startupTrace;
+
+  if (pipe(interruptPipe) == 0)
+  {
+    fcntl(interruptPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(interruptPipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(interruptPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(interruptPipe[1], F_SETFD, FD_CLOEXEC);
+  }
+
   signal(SIGINT, signalhandler);
 
   QCoreApplication a(argc, argv);
 
+  startupTrace.mark("Qt application created");
+
   QStringList argList = a.arguments();
 
-  TorController controller(argList);
+  TorController controller(argList, &startupTrace);
 
   // set up the mechanism for the controller to call it quits:
   QObject::connect(
@@ -56,6 +78,15 @@ int main(
     &a,
     SLOT(quit()));
 
+  // ...and to wind down on SIGINT:
+  QSocketNotifier interruptNotifier(interruptPipe[0], QSocketNotifier::Read);
+
+  QObject::connect(
+    &interruptNotifier,
+    SIGNAL(activated(int)),
+    &controller,
+    SLOT(handleInterrupt(int)));
+
   QTimer::singleShot(0, &controller, SLOT(parseArgs()));
 //  controller.parseArgs(argList);
 
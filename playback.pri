@@ -0,0 +1,37 @@
+#-------------------------------------------------
+#
+# Morse playback (the player, its clocks and timers, and the LED
+# backends), shared by the Qt front end (torchio.pro) and the benchmarks
+# (bench/bench.pro).
+#
+#-------------------------------------------------
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/tormorse.cpp \
+    $$PWD/torclock.cpp \
+    $$PWD/tortimer.cpp \
+    $$PWD/torvirtualclock.cpp \
+    $$PWD/torfakeled.cpp \
+    $$PWD/torledbackend.cpp \
+    $$PWD/torlatencyestimator.cpp \
+    $$PWD/tordatalink.cpp \
+    $$PWD/torcheckpoint.cpp \
+    $$PWD/torcarousel.cpp \
+    $$PWD/torwordcache.cpp
+
+HEADERS += \
+    $$PWD/tormorse.h \
+    $$PWD/torclock.h \
+    $$PWD/tortimer.h \
+    $$PWD/torvirtualclock.h \
+    $$PWD/torfakeled.h \
+    $$PWD/torledbackend.h \
+    $$PWD/torlatencyestimator.h \
+    $$PWD/tordatalink.h \
+    $$PWD/torcheckpoint.h \
+    $$PWD/torcarousel.h \
+    $$PWD/torwordcache.h \
+    $$PWD/torexception.h
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# Runs two SOS instances with --fakeleds and --align at once, the second
+# started partway into an alignment period, and checks that every SOS
+# cycle of both starts at the same phase of the period.
+#
+# Usage: run.sh [path to torchio]
+#
+
+TORCHIO=${1:-./torchio}
+
+# Seconds, as given to --align:
+PERIOD=2
+
+# Far more than a scheduling hiccup, far less than a dot (microseconds):
+TOLERANCE=20000
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+
+fail()
+{
+  echo "FAIL: $1"
+  failures=$((failures + 1))
+}
+
+"$TORCHIO" --fakeleds -s --align $PERIOD \
+  > "$WORK/first.trace" 2> "$WORK/first.log" &
+first=$!
+sleep 0.7
+"$TORCHIO" --fakeleds -s --align $PERIOD \
+  > "$WORK/second.trace" 2> "$WORK/second.log" &
+second=$!
+
+# Long enough for two cycles of each:
+sleep 7
+kill -INT $first $second
+wait $first || fail "first instance exited $?"
+wait $second || fail "second instance exited $?"
+
+# Both traces are stamped with the same monotonic clock.  An SOS cycle
+# starts with the first edge, and after every dark gap longer than the
+# three dots between letters (so more than 500 ms):
+cycle_starts()
+{
+  awk '$2 == "torch" {
+      if ($3 == 1 && (!n++ || $1 - last > 500000)) print $1
+      last = $1
+    }' "$1"
+}
+
+cycle_starts "$WORK/first.trace" > "$WORK/first.starts"
+cycle_starts "$WORK/second.trace" > "$WORK/second.starts"
+
+[ "$(wc -l < "$WORK/first.starts")" -ge 2 ] \
+  || fail "first instance played fewer than two cycles"
+[ "$(wc -l < "$WORK/second.starts")" -ge 2 ] \
+  || fail "second instance played fewer than two cycles"
+
+# The phase of each start, against the first instance's first start:
+cat "$WORK/first.starts" "$WORK/second.starts" \
+  | awk -v period=$((PERIOD * 1000000)) -v tolerance=$TOLERANCE '
+      NR == 1 { reference = $1 }
+      {
+        phase = ($1 - reference) % period
+        if (phase < 0) phase += period
+        if (phase > period / 2) phase -= period
+        if (phase < 0) phase = -phase
+        if (phase > tolerance) bad = bad " " $1 " (" phase " us)"
+      }
+      END { if (bad != "") { print "out of phase:" bad; exit 1 } }' \
+  || fail "cycles don't start in phase"
+
+if [ $failures -ne 0 ]
+then
+  echo "--- first instance:"; cat "$WORK/first.log" "$WORK/first.starts"
+  echo "--- second instance:"; cat "$WORK/second.log" "$WORK/second.starts"
+  exit 1
+fi
+
+echo "PASS: two --align instances in phase"
@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Runs the --beacon controller in simulated time against a fake
+# /sys/class/power_supply tree, once with a healthy battery and once with
+# one that is nearly flat, and checks the beacon paces itself to suit.
+#
+# Usage: run.sh [path to torchio]
+#
+
+TORCHIO=${1:-./torchio}
+FIXTURE=$(dirname "$0")/power_supply
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+
+fail()
+{
+  echo "FAIL: $1"
+  failures=$((failures + 1))
+}
+
+# Runs a ten minute beacon against the tree in $1; the report goes to $2:
+run_beacon()
+{
+  "$TORCHIO" --simulate --fakeleds --beacon 10 --powersupply "$1" \
+    > /dev/null 2> "$2"
+}
+
+# Pulls the number of SOS cycles played out of a report:
+cycles()
+{
+  sed -n 's/^Beacon: \([0-9]*\) SOS cycles.*/\1/p' "$1"
+}
+
+cp -R "$FIXTURE" "$WORK/full"
+cp -R "$FIXTURE" "$WORK/flat"
+
+# 2 mAh at 3.8 V is 7.6 mWh, a fortieth of what full rate would need:
+echo 2000 > "$WORK/flat/BAT0/charge_now"
+
+run_beacon "$WORK/full" "$WORK/full.log" || fail "full battery run exited $?"
+run_beacon "$WORK/flat" "$WORK/flat.log" || fail "flat battery run exited $?"
+
+for log in full flat
+do
+  grep -q '^Beacon: [1-9][0-9]* SOS cycles in 10.0 minutes' "$WORK/$log.log" \
+    || fail "$log: no beacon report for the whole ten minutes"
+  grep -q 'LED energy 0.000 mWh' "$WORK/$log.log" \
+    && fail "$log: no LED energy accounted"
+done
+
+grep -q '^Battery: 4560.0 mWh at start' "$WORK/full.log" \
+  || fail "full: battery not read from the fake tree"
+grep -q '^Battery: 7.6 mWh at start' "$WORK/flat.log" \
+  || fail "flat: battery not read from the fake tree"
+
+# With plenty of charge the SOS repeats back to back, the 37 dots of -s at 100 ms:
+grep -q '^Final settings: interval 3.70 s, intensity 100%' "$WORK/full.log" \
+  || fail "full: beacon did not run at full rate"
+
+# Nearly flat, it must spread the signals out instead (it only catches up
+# in the last minute or so, as the time left to cover runs out):
+full_cycles=$(cycles "$WORK/full.log")
+flat_cycles=$(cycles "$WORK/flat.log")
+[ "${flat_cycles:-0}" -gt 0 ] && [ $((flat_cycles * 2)) -lt "${full_cycles:-0}" ] \
+  || fail "flat: beacon did not slow down to save the battery"
+
+if [ $failures -ne 0 ]
+then
+  echo "--- full battery:"; cat "$WORK/full.log"
+  echo "--- flat battery:"; cat "$WORK/flat.log"
+  exit 1
+fi
+
+echo "PASS: beacon against a fake power_supply tree"
@@ -0,0 +1,96 @@
+//
+// probeordertest.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+
+// Checks the order flash discovery probes /dev nodes in, which decides
+// which of several equally good nodes is used: video nodes first, then
+// subdevices, each by number (so /dev/v4l-subdev10 comes after
+// /dev/v4l-subdev2), and the same whatever order the names were found in.
+//
+// Usage: probeordertest
+
+#include "torcoreflashdiscovery.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+static const char *expected[] =
+{
+  "/dev/video0",
+  "/dev/video1",
+  "/dev/video2",
+  "/dev/video10",
+  "/dev/video-odd",
+  "/dev/v4l-subdev0",
+  "/dev/v4l-subdev1",
+  "/dev/v4l-subdev4",
+  "/dev/v4l-subdev10"
+};
+
+#define EXPECTED_COUNT (sizeof(expected) / sizeof(expected[0]))
+
+
+static void fail(
+  const std::vector<std::string> &paths)
+{
+  fprintf(stderr, "FAIL: probe order was");
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    fprintf(stderr, " %s", paths[i].c_str());
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+int main()
+{
+  std::vector<std::string> found(expected, expected + EXPECTED_COUNT);
+  std::reverse(found.begin(), found.end());
+
+  // Every one of the 9! orders readdir() might give:
+  std::sort(found.begin(), found.end());
+  unsigned int orders = 0;
+
+  do
+  {
+    std::vector<std::string> paths(found);
+    TorCoreFlashDiscovery::sortForProbing(paths);
+
+    for (size_t i = 0; i < EXPECTED_COUNT; ++i)
+    {
+      if (paths[i] != expected[i]) fail(paths);
+    }
+
+    ++orders;
+  }
+  while (std::next_permutation(found.begin(), found.end()));
+
+  printf("PASS: probe order, from %u starting orders\n", orders);
+  return 0;
+}
@@ -0,0 +1,113 @@
+#!/bin/sh
+#
+# Runs each mode in simulated time and compares the LED edges it prints
+# with the traces in expected/, so any change in timing shows up.  Runs
+# that must come out the same as another (a replayed recording, the word
+# cache on and off) are compared with the same trace, and the Morse
+# decoder is checked by feeding it the samples of a -mf trace.
+#
+# Usage: run.sh [path to torchio]
+#
+# After a deliberate change in timing, rewrite the traces with:
+#   GOLDEN_UPDATE=1 sh run.sh [path to torchio]
+#
+
+TORCHIO=${1:-./torchio}
+HERE=$(dirname "$0")
+EXPECTED=$HERE/expected
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+
+fail()
+{
+  echo "FAIL: $1"
+  failures=$((failures + 1))
+}
+
+# Runs torchio --simulate with the remaining arguments, as the run named
+# $2, and compares what it prints with expected/$1.trace:
+compare()
+{
+  trace=$1
+  name=$2
+  shift 2
+
+  "$TORCHIO" --simulate "$@" > "$WORK/$name.trace" 2> "$WORK/$name.log" \
+    || fail "$name: exited $?"
+
+  if [ -n "$GOLDEN_UPDATE" ] && [ "$trace" = "$name" ]
+  then
+    cp "$WORK/$name.trace" "$EXPECTED/$trace.trace"
+  elif ! cmp -s "$EXPECTED/$trace.trace" "$WORK/$name.trace"
+  then
+    fail "$name: trace differs from expected/$trace.trace"
+    diff "$EXPECTED/$trace.trace" "$WORK/$name.trace" | head -10
+    cat "$WORK/$name.log"
+  fi
+}
+
+# The usual case, a run with a trace of its own:
+golden()
+{
+  compare "$1" "$@"
+}
+
+golden sos -s -t 1
+golden timeout -p -t 2
+golden morsefile -mf "$HERE/message.txt"
+golden datalink --data "$HERE/frame.txt" --loopback
+golden datalink-nrz-fec --data "$HERE/frame.txt" --nrz --fec --loopback
+golden carousel --carousel "CQ CQ" --carousel "DE TORCHIO" --carouselcycles 2
+
+# A recording plays back exactly as it was made:
+"$TORCHIO" --simulate -mf "$HERE/message.txt" --record "$WORK/morsefile.log" \
+  > /dev/null 2>&1 || fail "record: exited $?"
+compare morsefile replay --replay "$WORK/morsefile.log"
+
+# The word cache, of any size, must not change what is sent; nor does the
+# queue while it has room for everything:
+golden stdin -m < "$HERE/log.txt"
+for options in "--wordcache 0" "--wordcache 2" "--queuelines 2 --queuepolicy block"
+do
+  compare stdin "stdin $options" -m $options < "$HERE/log.txt"
+done
+
+# Overflowing the queue, each policy drops different lines:
+for policy in dropoldest dropnewest latest
+do
+  golden "queue-$policy" -m --queuelines 2 --queuepolicy $policy \
+    < "$HERE/log.txt"
+done
+
+# Cut short by -t, then resumed from the checkpoint it saved on the way out:
+golden checkpoint-cut -mf "$HERE/message.txt" -t 1 \
+  --checkpoint "$WORK/checkpoint"
+golden checkpoint-resume -mf "$HERE/message.txt" \
+  --checkpoint "$WORK/checkpoint" --resume
+
+# The decoder reads the -mf trace back, as 10 ms light sensor samples; the
+# "vvv" at the start gives it time to settle on the dot length:
+awk '$2 == "torch" {
+    for (t = last; t < $1; t += 10000) print t "," (lit ? 1000 : 0)
+    last = $1
+    lit = $3
+  }
+  END { for (i = 0; i < 100; i++) print last + i * 10000 ",0" }' \
+  "$EXPECTED/morsefile.trace" > "$WORK/samples.csv"
+"$TORCHIO" --simulate --receive "$WORK/samples.csv" \
+  > "$WORK/decoded.txt" 2> /dev/null || fail "decoder: exited $?"
+tr 'a-z' 'A-Z' < "$HERE/message.txt" | tr -s ' \n' ' ' | sed 's/ $//' \
+  | sed 's/^VVV //' > "$WORK/message.upper"
+tr -s ' \n' ' ' < "$WORK/decoded.txt" | sed 's/ $//' \
+  | grep -qF "$(cat "$WORK/message.upper")" \
+  || fail "decoder: got \"$(cat "$WORK/decoded.txt")\""
+
+if [ $failures -ne 0 ]
+then
+  exit 1
+fi
+
+echo "PASS: golden traces of simulated runs"
@@ -0,0 +1,350 @@
+//
+// keyertest.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+// Drives "torchio --keyer" through a pty, the way a person at a terminal
+// would, and checks what the fake LEDs did with it: the elements sent and
+// their lengths, how soon the light answered each key, and that the
+// terminal was put back the way it was found.
+//
+// Usage: keyertest [path to torchio]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+// The dot length handed to the keyer, in milliseconds:
+#define TEST_DOT 60
+
+// How far an element may stray from its nominal length, in microseconds:
+#define TEST_TOLERANCE (TEST_DOT * 1000 / 5)
+
+// The keyer's own key-to-light budget, in microseconds:
+#define TEST_LATENCY_BUDGET 5000
+
+// Long enough for any test letter to finish playing, in milliseconds:
+#define TEST_SETTLE 500
+
+
+struct Pulse
+{
+  long long on;
+  long long off;
+};
+
+
+static int failures = 0;
+
+
+static void fail(
+  const char *what)
+{
+  printf("FAIL: %s\n", what);
+  ++failures;
+}
+
+
+static long long now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (long long)(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void waitFor(
+  int milliseconds)
+{
+  struct timespec ts;
+  ts.tv_sec = milliseconds / 1000;
+  ts.tv_nsec = (milliseconds % 1000) * 1000000L;
+
+  nanosleep(&ts, 0);
+}
+
+
+// Appends whatever the pipe has to offer, without waiting:
+static void drain(
+  int fd,
+  std::string &output)
+{
+  char buffer[4096];
+  ssize_t count;
+
+  while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+  {
+    output.append(buffer, count);
+  }
+}
+
+
+// Sends one key and notes when it went, to time the light's answer by:
+static long long press(
+  int master,
+  char key)
+{
+  long long sent = now();
+
+  if (write(master, &key, 1) != 1) fail("couldn't write to the pty");
+
+  return sent;
+}
+
+
+// The fake LEDs print "<monotonic time> torch <intensity>" per edge:
+static std::vector<Pulse> parsePulses(
+  const std::string &trace)
+{
+  std::vector<Pulse> pulses;
+  bool lit = false;
+
+  size_t start = 0;
+  while (start < trace.size())
+  {
+    size_t end = trace.find('\n', start);
+    if (end == std::string::npos) end = trace.size();
+
+    std::string line = trace.substr(start, end - start);
+    start = end + 1;
+
+    long long time;
+    int intensity;
+    if (sscanf(line.c_str(), "%lld torch %d", &time, &intensity) != 2)
+    {
+      continue;
+    }
+
+    if (intensity && !lit)
+    {
+      Pulse pulse;
+      pulse.on = time;
+      pulse.off = 0;
+      pulses.push_back(pulse);
+    }
+    else if (!intensity && lit)
+    {
+      pulses.back().off = time;
+    }
+
+    lit = (intensity != 0);
+  }
+
+  return pulses;
+}
+
+
+static void checkLength(
+  const char *what,
+  long long length,
+  long long nominal)
+{
+  if ((length < nominal - TEST_TOLERANCE)
+    || (length > nominal + TEST_TOLERANCE))
+  {
+    printf("%s lasted %lld us, not %lld us\n", what, length, nominal);
+    fail(what);
+  }
+}
+
+
+int main(
+  int argc,
+  char *argv[])
+{
+  const char *torchio = (argc > 1) ? argv[1] : "./torchio";
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((master == -1) || grantpt(master) || unlockpt(master))
+  {
+    perror("keyertest: pty");
+    return 1;
+  }
+
+  std::string slavePath = ptsname(master);
+
+  // Held open throughout, so the terminal settings outlive torchio and
+  // can be checked once it has gone:
+  int slave = open(slavePath.c_str(), O_RDWR | O_NOCTTY);
+
+  struct termios before;
+  if ((slave == -1) || (tcgetattr(slave, &before) == -1))
+  {
+    perror("keyertest: pty slave");
+    return 1;
+  }
+
+  int traceFds[2];
+  int reportFds[2];
+  if ((pipe(traceFds) == -1) || (pipe(reportFds) == -1))
+  {
+    perror("keyertest: pipe");
+    return 1;
+  }
+
+  char dot[16];
+  snprintf(dot, sizeof(dot), "%d", TEST_DOT);
+
+  pid_t child = fork();
+  if (child == 0)
+  {
+    dup2(traceFds[1], STDOUT_FILENO);
+    dup2(reportFds[1], STDERR_FILENO);
+    close(traceFds[0]);
+    close(reportFds[0]);
+    close(master);
+    close(slave);
+
+    execl(
+      torchio, torchio,
+      "--fakeleds", "-d", dot, "--keyer", slavePath.c_str(),
+      (char *) 0);
+
+    _exit(127);
+  }
+
+  close(traceFds[1]);
+  close(reportFds[1]);
+  fcntl(traceFds[0], F_SETFL, O_NONBLOCK);
+  fcntl(reportFds[0], F_SETFL, O_NONBLOCK);
+
+  std::string trace;
+  std::string report;
+
+  // Anything typed before the keyer goes raw would sit in the line
+  // discipline waiting for a newline:
+  long long giveUp = now() + 5000000;
+  struct termios during;
+  while (now() < giveUp)
+  {
+    if ((tcgetattr(slave, &during) == 0) && !(during.c_lflag & ICANON)) break;
+    waitFor(10);
+  }
+
+  if (during.c_lflag & ICANON) fail("keyer never put the terminal into raw mode");
+  if (during.c_lflag & ECHO) fail("keyer left echo on");
+
+  // E is a dot, T a dash, and A both with a one dot gap between:
+  long long sentE = press(master, 'e');
+  waitFor(TEST_SETTLE);
+  long long sentT = press(master, 't');
+  waitFor(TEST_SETTLE);
+  long long sentA = press(master, 'a');
+  waitFor(TEST_SETTLE);
+
+  // Ctrl-D ends the session:
+  press(master, 4);
+
+  int status = 0;
+  giveUp = now() + 5000000;
+  while (waitpid(child, &status, WNOHANG) == 0)
+  {
+    drain(traceFds[0], trace);
+    drain(reportFds[0], report);
+
+    if (now() > giveUp)
+    {
+      fail("torchio didn't exit after Ctrl-D");
+      kill(child, SIGKILL);
+      waitpid(child, &status, 0);
+      break;
+    }
+
+    waitFor(10);
+  }
+
+  drain(traceFds[0], trace);
+  drain(reportFds[0], report);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status))
+  {
+    fail("torchio didn't exit cleanly");
+  }
+
+  std::vector<Pulse> pulses = parsePulses(trace);
+
+  if (pulses.size() != 4)
+  {
+    printf("%u pulses seen, not 4\n", (unsigned int) pulses.size());
+    fail("wrong number of elements");
+  }
+  else
+  {
+    long long dotLength = TEST_DOT * 1000;
+
+    checkLength("E's dot", pulses[0].off - pulses[0].on, dotLength);
+    checkLength("T's dash", pulses[1].off - pulses[1].on, dotLength * 3);
+    checkLength("A's dot", pulses[2].off - pulses[2].on, dotLength);
+    checkLength("A's gap", pulses[3].on - pulses[2].off, dotLength);
+    checkLength("A's dash", pulses[3].off - pulses[3].on, dotLength * 3);
+
+    const long long sent[3] = {sentE, sentT, sentA};
+    const size_t first[3] = {0, 1, 2};
+    int i = 0;
+    while (i < 3)
+    {
+      long long latency = pulses[first[i]].on - sent[i];
+      if ((latency < 0) || (latency > TEST_LATENCY_BUDGET))
+      {
+        printf("key %d lit the LED after %lld us\n", i + 1, latency);
+        fail("key-to-light latency over budget");
+      }
+      ++i;
+    }
+  }
+
+  if (report.find("Keyer: 3 keyed edges") == std::string::npos)
+  {
+    fail("keyer report missing or wrong");
+  }
+
+  struct termios after;
+  tcgetattr(slave, &after);
+
+  if ((after.c_lflag != before.c_lflag)
+    || (after.c_iflag != before.c_iflag)
+    || (after.c_cc[VMIN] != before.c_cc[VMIN])
+    || (after.c_cc[VTIME] != before.c_cc[VTIME]))
+  {
+    fail("terminal settings not restored");
+  }
+
+  if (failures)
+  {
+    printf("--- fake LED trace:\n%s", trace.c_str());
+    printf("--- torchio stderr:\n%s", report.c_str());
+    return 1;
+  }
+
+  printf("PASS: keyer through a pty\n");
+  return 0;
+}
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Interrupts a real-time -mf transmission with SIGINT, checks that the
+# final checkpoint was saved on the way out, and that --resume carries on
+# with the rest of the message.
+#
+# Usage: run.sh [path to torchio]
+#
+
+TORCHIO=${1:-./torchio}
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+
+fail()
+{
+  echo "FAIL: $1"
+  failures=$((failures + 1))
+}
+
+# Turns a fake LED trace into the lengths of its lit and dark runs:
+durations()
+{
+  awk '$2 == "torch" { if (n++) print $1 - last; last = $1 }' "$1"
+}
+
+echo "the quick brown fox jumps over the lazy dog" > "$WORK/message.txt"
+
+# The interval is far longer than the run, so only the save made while
+# shutting down can leave a checkpoint behind:
+"$TORCHIO" --fakeleds -d 20 -mf "$WORK/message.txt" \
+  --checkpoint "$WORK/checkpoint" --checkpointinterval 100000 \
+  > "$WORK/interrupted.trace" 2> "$WORK/interrupted.log" &
+pid=$!
+sleep 1
+kill -INT $pid
+wait $pid || fail "interrupted run exited $?"
+
+grep -q '^torchio-resume 1 .*[1-9]' "$WORK/checkpoint" 2> /dev/null \
+  || fail "no checkpoint saved on SIGINT"
+
+"$TORCHIO" --simulate --fakeleds -d 20 -mf "$WORK/message.txt" \
+  > "$WORK/whole.trace" 2> /dev/null || fail "uninterrupted run exited $?"
+"$TORCHIO" --simulate --fakeleds -d 20 -mf "$WORK/message.txt" \
+  --checkpoint "$WORK/checkpoint" --resume \
+  > "$WORK/resumed.trace" 2> "$WORK/resumed.log" || fail "resumed run exited $?"
+
+grep -q '^Resuming from byte [1-9]' "$WORK/resumed.trace" \
+  || fail "resumed run started from the beginning"
+
+# Past its first run, the resumed transmission must be the end of the
+# whole one:
+durations "$WORK/whole.trace" > "$WORK/whole.runs"
+durations "$WORK/resumed.trace" | sed 1d > "$WORK/resumed.runs"
+whole=$(wc -l < "$WORK/whole.runs")
+resumed=$(wc -l < "$WORK/resumed.runs")
+
+if [ "$resumed" -eq 0 ] || [ "$resumed" -ge "$whole" ]
+then
+  fail "resumed run sent $resumed runs out of $whole"
+else
+  tail -n "$resumed" "$WORK/whole.runs" | cmp -s - "$WORK/resumed.runs" \
+    || fail "resumed run is not the rest of the message"
+fi
+
+if [ $failures -ne 0 ]
+then
+  echo "--- interrupted run:"; cat "$WORK/interrupted.log"
+  echo "--- resumed run:"; cat "$WORK/resumed.log"
+  exit 1
+fi
+
+echo "PASS: -mf resumes after SIGINT"
@@ -0,0 +1,454 @@
+//
+// torbeacon.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torbeacon.h"
+#include "torclock.h"
+#include "tortimer.h"
+#include "torpowersupply.h"
+#include "torexception.h"
+
+#include <QTextStream>
+#include <math.h>
+
+// Rough LED power draw at full intensity, in milliwatts:
+#define TORCH_POWER 700.0
+#define INDICATOR_POWER 20.0
+
+// Hold back this share of the battery, rather than running it flat:
+#define BEACON_RESERVE 0.1
+
+// The longest wait between the start of one SOS and the next, and the
+// dimmest and shortest the beacon may get, as shares of the defaults:
+#define BEACON_MAX_INTERVAL 60000000
+#define BEACON_MIN_INTENSITY 0.25
+#define BEACON_MIN_DOT 0.5
+
+#define MICROSECONDS_PER_HOUR 3600000000.0
+
+
+TorBeacon::TorBeacon(
+  TorClock *c,
+  TorLEDBackend *l,
+  TorPowerSupply *p)
+  : clock(c),
+    timer(0),
+    led(l),
+    powerSupply(p),
+    channel(Torch_Channel),
+    minIntensity(0),
+    maxIntensity(1),
+    ledPower(TORCH_POWER),
+    endTime(0),
+    baseDot(100000),
+    interval(0),
+    intensity(1.0),
+    dot(100000),
+    patternUnits(0),
+    onUnits(0),
+    position(0),
+    cycleStart(0),
+    nextStep(0),
+    nextCycle(0),
+    compensateLatency(false),
+    alignment(0),
+    boundaryPending(false),
+    pendingBoundary(0),
+    alignedStarts(0),
+    phaseErrorTotal(0),
+    maxPhaseError(0),
+    currentPower(0.0),
+    lastEdgeTime(0),
+    totalEnergy(0.0),
+    cycleStartEnergy(0.0),
+    lastCycleEnergy(0.0),
+    running(false),
+    startTime(0),
+    stopTime(0),
+    cycleCount(0),
+    startBattery(-1.0),
+    lastBattery(-1.0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(playStep()));
+
+  // The same SOS as -s, stretched out to a word gap at the end:
+  TorCoreMorseEncoder encoder;
+  encoder.appendText("SOS", 3);
+  encoder.appendGap(4);
+  pattern = encoder.getRuns();
+  patternUnits = encoder.getUnitCount();
+
+  for (size_t i = 0; i < pattern.size(); ++i)
+  {
+    if (pattern[i].lit) onUnits += pattern[i].units;
+  }
+
+  led->addEdgeListener(this);
+}
+
+
+TorBeacon::~TorBeacon()
+{
+  if (timer) delete timer;
+}
+
+
+void TorBeacon::setLatencyCompensation(
+  bool compensate)
+{
+  compensateLatency = compensate;
+}
+
+
+void TorBeacon::setAlignment(
+  qint64 period)
+{
+  alignment = period;
+}
+
+
+void TorBeacon::startBeacon(
+  TorLEDChannel ch,
+  qint64 targetDuration,
+  unsigned int dotDuration)
+{
+  channel = ch;
+  minIntensity = led->getMinIntensity(channel);
+  maxIntensity = led->getMaxIntensity(channel);
+  ledPower = (channel == Torch_Channel) ? TORCH_POWER : INDICATOR_POWER;
+
+  running = true;
+  startTime = clock->currentTime();
+  endTime = startTime + targetDuration;
+  stopTime = 0;
+  lastEdgeTime = startTime;
+  baseDot = qint64(dotDuration) * 1000;
+
+  if (powerSupply && powerSupply->refresh())
+  {
+    startBattery = powerSupply->getRemainingEnergy();
+  }
+
+  if (alignment)
+  {
+    // Wait for the first boundary, as though an SOS had just finished:
+    position = pattern.size();
+    armNextCycle(startTime);
+    return;
+  }
+
+  startCycle(startTime);
+}
+
+
+void TorBeacon::stopRunning()
+{
+  timer->stop();
+
+  if (running)
+  {
+    accountOnTime();
+    stopTime = clock->currentTime();
+    running = false;
+  }
+}
+
+
+bool TorBeacon::isRunning()
+{
+  return running;
+}
+
+
+void TorBeacon::edgeEmitted(
+  TorLEDChannel ch,
+  int level)
+{
+  if (ch != channel) return;
+
+  accountOnTime();
+
+  if (maxIntensity > minIntensity)
+  {
+    currentPower =
+      ledPower * (level - minIntensity) / (maxIntensity - minIntensity);
+  }
+}
+
+
+void TorBeacon::writeReport(
+  QTextStream &out)
+{
+  qint64 end = running ? clock->currentTime() : stopTime;
+
+  out << "Beacon: " << cycleCount << " SOS cycles in ";
+  out << QString::number((end - startTime) / 60000000.0, 'f', 1);
+  out << " minutes, LED energy ";
+  out << QString::number(totalEnergy, 'f', 3) << " mWh" << endl;
+
+  if (cycleCount > 1)
+  {
+    out << "Energy per cycle: last ";
+    out << QString::number(lastCycleEnergy, 'f', 4) << " mWh, mean ";
+    out << QString::number(cycleStartEnergy / (cycleCount - 1), 'f', 4);
+    out << " mWh" << endl;
+  }
+
+  out << "Final settings: interval ";
+  out << QString::number(interval / 1000000.0, 'f', 2) << " s, intensity ";
+  out << int(intensity * 100 + 0.5) << "%, dot " << dot / 1000 << " ms";
+  out << endl;
+
+  if (startBattery < 0.0)
+  {
+    out << "No battery readings; ran at full rate" << endl;
+  }
+  else
+  {
+    out << "Battery: " << QString::number(startBattery, 'f', 1);
+    out << " mWh at start, " << QString::number(lastBattery, 'f', 1);
+    out << " mWh at the last cycle" << endl;
+  }
+}
+
+
+void TorBeacon::writeAlignmentReport(
+  QTextStream &out)
+{
+  if (!alignedStarts)
+  {
+    out << "No aligned starts were made" << endl;
+    return;
+  }
+
+  out << "Aligned starts: " << alignedStarts << ", phase error ";
+  out << "mean " << QString::number(
+    double(phaseErrorTotal) / alignedStarts / 1000.0, 'f', 3);
+  out << " ms, max " << QString::number(maxPhaseError / 1000.0, 'f', 3);
+  out << " ms" << endl;
+}
+
+
+void TorBeacon::playStep()
+{
+  // Past the end of the pattern, the LED stays dark until the next cycle
+  // is due:
+  if (position >= pattern.size())
+  {
+    startCycle(nextCycle);
+    return;
+  }
+
+  const TorCoreRun &run = pattern[position];
+
+  int level = minIntensity;
+  if (run.lit)
+  {
+    level = minIntensity +
+      int(intensity * (maxIntensity - minIntensity) + 0.5);
+  }
+
+  nextStep += run.units * dot;
+  ++position;
+
+  if (position < pattern.size())
+  {
+    // The next edge will be the opposite of this one, so it can go out
+    // early by however long that change usually takes:
+    qint64 shift = 0;
+    if (compensateLatency)
+    {
+      shift = run.lit ? offLatency.getEstimate() : onLatency.getEstimate();
+    }
+
+    timer->startAt(nextStep - shift);
+  }
+  else
+  {
+    armNextCycle(cycleStart + interval);
+  }
+
+  qint64 before = clock->currentTime();
+
+  try
+  {
+    led->setIntensity(channel, level);
+  }
+  catch (TorException &e)
+  {
+    QTextStream qts(stderr);
+    qts << e.getError() << endl;
+    timer->stop();
+    emit beaconFailed();
+    return;
+  }
+
+  qint64 after = clock->currentTime();
+
+  if (run.lit)
+  {
+    onLatency.addSample(after - before);
+  }
+  else
+  {
+    offLatency.addSample(after - before);
+  }
+
+  if (boundaryPending)
+  {
+    // The phase error is how far from the boundary the light changed:
+    qint64 phaseError = qAbs(clock->currentRealTime() - pendingBoundary);
+    ++alignedStarts;
+    phaseErrorTotal += phaseError;
+    if (phaseError > maxPhaseError) maxPhaseError = phaseError;
+    boundaryPending = false;
+  }
+}
+
+
+void TorBeacon::startCycle(
+  qint64 start)
+{
+  accountOnTime();
+
+  if (cycleCount)
+  {
+    lastCycleEnergy = totalEnergy - cycleStartEnergy;
+  }
+  cycleStartEnergy = totalEnergy;
+
+  fitToBudget();
+
+  ++cycleCount;
+  cycleStart = start;
+  nextStep = cycleStart;
+  position = 0;
+
+  playStep();
+}
+
+
+//
+// As in TorMorse, wall-clock boundaries become deadlines on our own clock,
+// and the wait for one goes to the microsecond:
+//
+void TorBeacon::armNextCycle(
+  qint64 earliest)
+{
+  // Every SOS starts by lighting up:
+  qint64 shift = 0;
+  if (compensateLatency) shift = onLatency.getEstimate();
+
+  if (!alignment)
+  {
+    nextCycle = earliest;
+    timer->startAt(nextCycle - shift);
+    return;
+  }
+
+  qint64 offset = clock->currentRealTime() - clock->currentTime();
+  qint64 real = earliest + offset;
+
+  pendingBoundary = ((real + alignment - 1) / alignment) * alignment;
+  boundaryPending = true;
+
+  nextCycle = pendingBoundary - offset;
+  timer->startAtPrecisely(nextCycle - shift);
+}
+
+
+void TorBeacon::fitToBudget()
+{
+  // What the beacon drew, on average, over the last cycle:
+  double beaconDraw = 0.0;
+  if (cycleCount && (interval > 0))
+  {
+    beaconDraw = lastCycleEnergy / (interval / MICROSECONDS_PER_HOUR);
+  }
+
+  // Until told otherwise, run at full rate:
+  interval = patternUnits * baseDot;
+  intensity = 1.0;
+  dot = baseDot;
+
+  if (!powerSupply || !powerSupply->refresh()) return;
+
+  lastBattery = powerSupply->getRemainingEnergy();
+
+  qint64 now = clock->currentTime();
+  double hoursLeft = (endTime - now) / MICROSECONDS_PER_HOUR;
+  if (hoursLeft <= 0.0) return;
+
+  double budget = lastBattery * (1.0 - BEACON_RESERVE) / hoursLeft;
+
+  // Whatever the rest of the device draws isn't available to the beacon:
+  double draw = powerSupply->getPowerDraw();
+  if (draw > beaconDraw) budget -= draw - beaconDraw;
+
+  double steps = maxIntensity - minIntensity;
+
+  if (budget <= 0.0)
+  {
+    // Nothing to spare, so just go as frugally as possible:
+    interval = BEACON_MAX_INTERVAL;
+    intensity = BEACON_MIN_INTENSITY;
+    if (steps > 0.0) intensity = ceil(intensity * steps) / steps;
+    dot = qint64(baseDot * BEACON_MIN_DOT);
+    return;
+  }
+
+  // Average power = LED power * intensity * on-time / interval:
+  double onTime = double(onUnits) * dot;
+  double needed = ledPower * intensity * onTime / interval;
+  if (needed <= budget) return;
+
+  // First, spread the signals out:
+  interval = qint64(ledPower * intensity * onTime / budget);
+  if (interval <= BEACON_MAX_INTERVAL) return;
+  interval = BEACON_MAX_INTERVAL;
+
+  // Then dim them, to the next whole hardware step up:
+  intensity = budget * interval / (ledPower * onTime);
+  if (intensity < BEACON_MIN_INTENSITY) intensity = BEACON_MIN_INTENSITY;
+  if (steps > 0.0) intensity = ceil(intensity * steps) / steps;
+  if (ledPower * intensity * onTime / interval <= budget) return;
+
+  // And finally shorten them:
+  dot = qint64(budget * interval / (ledPower * intensity * onUnits));
+  if (dot < baseDot * BEACON_MIN_DOT) dot = qint64(baseDot * BEACON_MIN_DOT);
+}
+
+
+void TorBeacon::accountOnTime()
+{
+  qint64 now = clock->currentTime();
+
+  totalEnergy += currentPower * (now - lastEdgeTime) / MICROSECONDS_PER_HOUR;
+  lastEdgeTime = now;
+}
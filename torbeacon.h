@@ -0,0 +1,162 @@
+//
+// torbeacon.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORBEACON_H
+#define TORBEACON_H
+
+#include <QObject>
+#include "torledbackend.h"
+#include "torlatencyestimator.h"
+#include "torcoremorse.h"
+
+#include <vector>
+
+class TorClock;
+class TorTimer;
+class TorPowerSupply;
+class QTextStream;
+
+// An SOS beacon that tries to keep going until a target time, given the
+// battery it has.  At the start of each SOS, it works out how much power it
+// can afford (the remaining battery energy spread across the remaining
+// time, less whatever the rest of the device is drawing), then fits the
+// beacon to that budget: first by waiting longer between SOS signals, then
+// by lowering the intensity, and finally by shortening the dots (and the
+// gaps along with them).  LED energy is tracked from actual on-time.
+class TorBeacon: public QObject, public TorEdgeListener
+{
+  Q_OBJECT
+
+public:
+  // Registers itself as a listener on the LEDs, so must outlive them:
+  TorBeacon(
+    TorClock *clock,
+    TorLEDBackend *led,
+    TorPowerSupply *powerSupply);
+
+  ~TorBeacon();
+
+  // Fire each edge early by the expected time it takes to switch the LED:
+  void setLatencyCompensation(
+    bool compensate);
+
+  // Start each SOS on a multiple of this period (in microseconds) of
+  // wall-clock time, as TorMorse does; zero turns alignment off:
+  void setAlignment(
+    qint64 period);
+
+  // Duration in microseconds, dot duration in milliseconds:
+  void startBeacon(
+    TorLEDChannel channel,
+    qint64 targetDuration,
+    unsigned int dotDuration);
+
+  void stopRunning();
+
+  bool isRunning();
+
+  void edgeEmitted(
+    TorLEDChannel channel,
+    int intensity);
+
+  void writeReport(
+    QTextStream &out);
+
+  void writeAlignmentReport(
+    QTextStream &out);
+
+signals:
+  void beaconFailed();
+
+private slots:
+  void playStep();
+
+private:
+  void startCycle(
+    qint64 start);
+
+  // Sets the timer for the next SOS, due no earlier than "earliest":
+  void armNextCycle(
+    qint64 earliest);
+
+  void fitToBudget();
+
+  void accountOnTime();
+
+  TorClock *clock;
+  TorTimer *timer;
+  TorLEDBackend *led;
+  TorPowerSupply *powerSupply;
+
+  TorLEDChannel channel;
+  int minIntensity;
+  int maxIntensity;
+  double ledPower;
+
+  qint64 endTime;
+  qint64 baseDot;
+
+  // The current settings:
+  qint64 interval;
+  double intensity;
+  qint64 dot;
+
+  // One SOS, as the encoder's runs of light and dark counted in dots:
+  std::vector<TorCoreRun> pattern;
+  int patternUnits;
+  int onUnits;
+
+  size_t position;
+  qint64 cycleStart;
+  qint64 nextStep;
+  qint64 nextCycle;
+
+  bool compensateLatency;
+  TorLatencyEstimator onLatency;
+  TorLatencyEstimator offLatency;
+
+  // Wall-clock alignment:
+  qint64 alignment;
+  bool boundaryPending;
+  qint64 pendingBoundary;
+  unsigned int alignedStarts;
+  qint64 phaseErrorTotal;
+  qint64 maxPhaseError;
+
+  // On-time accounting, in milliwatt-hours:
+  double currentPower;
+  qint64 lastEdgeTime;
+  double totalEnergy;
+  double cycleStartEnergy;
+  double lastCycleEnergy;
+
+  bool running;
+  qint64 startTime;
+  qint64 stopTime;
+  unsigned int cycleCount;
+  double startBattery;
+  double lastBattery;
+};
+
+#endif // TORBEACON_H
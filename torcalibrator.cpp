@@ -0,0 +1,184 @@
+//
+// torcalibrator.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torcalibrator.h"
+#include "tormorse.h"
+
+#include <QSettings>
+#include <QString>
+#include <QTextStream>
+
+// "PARIS" is the traditional word for timing Morse; it is exactly 50 units
+// long, including the word gap.
+#define CALIBRATION_TEXT "PARIS PARIS"
+
+
+TorCalibrator::TorCalibrator(
+  TorMorse *m,
+  unsigned int budget)
+  : morse(m),
+    errorBudget(budget),
+    running(false),
+    runIndex(0),
+    chosenDuration(0)
+{
+  // Dot durations to try, slowest first (in milliseconds):
+  durations << 200 << 150 << 100 << 80 << 60 << 50 << 40 << 30 << 25;
+  durations << 20 << 15 << 12 << 10 << 8 << 6 << 5 << 4 << 3 << 2 << 1;
+}
+
+
+TorCalibrator::~TorCalibrator()
+{
+}
+
+
+void TorCalibrator::startCalibration()
+{
+  connect(
+    morse,
+    SIGNAL(morseFinished()),
+    this,
+    SLOT(handleEndOfRun()));
+
+  running = true;
+  runIndex = 0;
+  chosenDuration = 0;
+  errors.clear();
+
+  startRun();
+}
+
+
+void TorCalibrator::stopRunning()
+{
+  if (running)
+  {
+    morse->stopRunning();
+    running = false;
+  }
+}
+
+
+unsigned int TorCalibrator::getChosenDuration()
+{
+  return chosenDuration;
+}
+
+
+void TorCalibrator::writeReport(
+  QTextStream &stream)
+{
+  int index = 0;
+
+  while (index < errors.size())
+  {
+    // Error as a percentage of one unit:
+    qint64 error = errors.at(index);
+    unsigned int duration = durations.at(index);
+
+    stream << "Dot duration " << duration << " ms: unit error ";
+    stream << QString::number(error / (duration * 10.0), 'f', 2) << "%";
+
+    if (duration == chosenDuration)
+    {
+      stream << " (chosen)";
+    }
+
+    stream << endl;
+
+    ++index;
+  }
+
+  if (chosenDuration)
+  {
+    stream << "Fastest dot duration within a " << errorBudget;
+    stream << "% error budget: " << chosenDuration << " ms" << endl;
+  }
+  else
+  {
+    stream << "No dot duration met the " << errorBudget;
+    stream << "% error budget" << endl;
+  }
+}
+
+
+void TorCalibrator::storeDotDuration(
+  unsigned int dotDuration)
+{
+  QSettings settings("Torchio", "torchio");
+
+  settings.setValue("calibratedDotDuration", dotDuration);
+}
+
+
+unsigned int TorCalibrator::retrieveDotDuration()
+{
+  QSettings settings("Torchio", "torchio");
+
+  return settings.value("calibratedDotDuration", 0).toUInt();
+}
+
+
+void TorCalibrator::handleEndOfRun()
+{
+  if (!running) return;
+
+  qint64 error = morse->getMeanEdgeError();
+  unsigned int duration = durations.at(runIndex);
+
+  errors.append(error);
+
+  // Compare error against the budget (both in microseconds):
+  if (error * 100 > qint64(errorBudget) * duration * 1000)
+  {
+    // Too fast; the previous duration (if any) is the winner.
+    running = false;
+    emit calibrationFinished();
+    return;
+  }
+
+  chosenDuration = duration;
+  ++runIndex;
+
+  if (runIndex >= durations.size())
+  {
+    running = false;
+    emit calibrationFinished();
+    return;
+  }
+
+  startRun();
+}
+
+
+void TorCalibrator::startRun()
+{
+  morse->resetTimingStats();
+  morse->setDotDuration(durations.at(runIndex));
+
+  QString text(CALIBRATION_TEXT);
+  QTextStream stream(&text);
+
+  morse->startMorseFromStream(stream);
+}
@@ -0,0 +1,84 @@
+//
+// torcalibrator.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORCALIBRATOR_H
+#define TORCALIBRATOR_H
+
+#include <QObject>
+#include <QList>
+
+class TorMorse;
+class QTextStream;
+
+// Finds the shortest dot duration this device can manage.  A short test
+// message is played at a series of ever-faster dot durations; for each,
+// the average timing error of the edges is measured as a fraction of one
+// unit.  The sweep stops at the first duration whose error exceeds the
+// budget, and the last one that met it is chosen.
+class TorCalibrator: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorCalibrator(
+    TorMorse *morse,
+    unsigned int errorBudget);
+
+  ~TorCalibrator();
+
+  void startCalibration();
+
+  void stopRunning();
+
+  // Zero if no duration met the budget:
+  unsigned int getChosenDuration();
+
+  void writeReport(
+    QTextStream &stream);
+
+  // Stored calibration results:
+  static void storeDotDuration(
+    unsigned int dotDuration);
+
+  static unsigned int retrieveDotDuration();
+
+signals:
+  void calibrationFinished();
+
+private slots:
+  void handleEndOfRun();
+
+private:
+  void startRun();
+
+  TorMorse *morse;
+  unsigned int errorBudget; // in percent of one unit
+  bool running;
+
+  QList<unsigned int> durations;
+  QList<qint64> errors;
+  int runIndex;
+  unsigned int chosenDuration;
+};
+
+#endif // TORCALIBRATOR_H
@@ -0,0 +1,196 @@
+//
+// torcarousel.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torcarousel.h"
+#include "torexception.h"
+#include "torcoremorse.h"
+
+#include <QFile>
+
+
+TorCarousel::TorCarousel()
+  : gap(4),
+    repeats(1),
+    cycles(0),
+    messageIndex(0),
+    runIndex(0),
+    repeatIndex(0),
+    cycleIndex(0),
+    finished(false)
+{
+}
+
+
+void TorCarousel::addText(
+  const QByteArray &text)
+{
+  TorCoreMorseEncoder encoder;
+  encoder.appendText(text.constData(), text.size());
+
+  const std::vector<TorCoreRun> &runs = encoder.getRuns();
+
+  // Leading whitespace would only delay the first character:
+  size_t first = 0;
+  while ((first < runs.size()) && !runs[first].lit) ++first;
+
+  if (first == runs.size())
+  {
+    throw TorException("Carousel message has nothing to send");
+  }
+
+  TorCarouselMessage message;
+  message.firstRun = arena.size();
+  message.runCount = 0;
+
+  size_t i = first;
+  while (i < runs.size())
+  {
+    if (runs[i].units > 0xFFFF)
+    {
+      throw TorException("Carousel message has too long a run");
+    }
+
+    arena.append(quint16(runs[i].units));
+    ++message.runCount;
+    ++i;
+  }
+
+  // Every character is followed by a gap, but make sure of it, so that
+  // the next message starts lit:
+  if (runs.back().lit)
+  {
+    arena.append(3);
+    ++message.runCount;
+  }
+
+  messages.append(message);
+  arena.squeeze();
+}
+
+
+void TorCarousel::addFile(
+  QString filename)
+{
+  QFile file(filename);
+
+  if (!file.open(QFile::ReadOnly))
+  {
+    QString errString = "Unable to open carousel file ";
+    errString += filename;
+    throw TorException(errString);
+  }
+
+  addText(file.readAll());
+}
+
+
+void TorCarousel::setGap(
+  unsigned int units)
+{
+  gap = units;
+}
+
+
+void TorCarousel::setRepeats(
+  unsigned int r)
+{
+  repeats = r ? r : 1;
+}
+
+
+void TorCarousel::setCycles(
+  unsigned int c)
+{
+  cycles = c;
+}
+
+
+int TorCarousel::getMessageCount()
+{
+  return messages.size();
+}
+
+
+int TorCarousel::getArenaSize()
+{
+  return arena.size() * sizeof(quint16)
+    + messages.size() * sizeof(TorCarouselMessage);
+}
+
+
+qint64 TorCarousel::getRotationUnits()
+{
+  qint64 units = 0;
+
+  int i = 0;
+  while (i < arena.size())
+  {
+    units += arena.at(i);
+    ++i;
+  }
+
+  return (units + qint64(gap) * messages.size()) * repeats;
+}
+
+
+void TorCarousel::rewind()
+{
+  messageIndex = 0;
+  runIndex = 0;
+  repeatIndex = 0;
+  cycleIndex = 0;
+  finished = messages.isEmpty();
+}
+
+
+bool TorCarousel::nextRun(
+  bool &lit,
+  unsigned int &units)
+{
+  if (finished) return false;
+
+  const TorCarouselMessage &message = messages.at(messageIndex);
+
+  lit = !(runIndex & 1);
+  units = arena.at(message.firstRun + runIndex);
+
+  ++runIndex;
+  if (runIndex < message.runCount) return true;
+
+  // The message's closing dark run stretches over the gap:
+  units += gap;
+  runIndex = 0;
+
+  ++repeatIndex;
+  if (repeatIndex < repeats) return true;
+  repeatIndex = 0;
+
+  ++messageIndex;
+  if (messageIndex < messages.size()) return true;
+  messageIndex = 0;
+
+  ++cycleIndex;
+  if (cycles && (cycleIndex >= cycles)) finished = true;
+
+  return true;
+}
@@ -0,0 +1,101 @@
+//
+// torcarousel.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORCAROUSEL_H
+#define TORCAROUSEL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// Where one message lies in the arena:
+struct TorCarouselMessage
+{
+  int firstRun;
+  int runCount;
+};
+
+
+// A rotation of messages, each encoded into Morse once, up front.  All of
+// them share a single arena of run lengths: runs alternate between light
+// and dark, and every message starts lit and ends dark, so a run is just
+// its length in dot units (two bytes).  Playing the rotation only steps
+// through the arena, so it never allocates or encodes again, however long
+// it runs.
+class TorCarousel
+{
+public:
+  TorCarousel();
+
+  // Add a message to the end of the rotation:
+  void addText(
+    const QByteArray &text);
+
+  void addFile(
+    QString filename);
+
+  // Extra dark units after each message (4, the default, makes it a word
+  // space):
+  void setGap(
+    unsigned int units);
+
+  // Times each message is sent in a row before moving on to the next:
+  void setRepeats(
+    unsigned int repeats);
+
+  // Times through the whole rotation; zero means forever:
+  void setCycles(
+    unsigned int cycles);
+
+  int getMessageCount();
+
+  // Memory held for the encoded messages, in bytes:
+  int getArenaSize();
+
+  // Length of one full rotation, in dot units:
+  qint64 getRotationUnits();
+
+  void rewind();
+
+  // The next run to play; false once the last cycle is done:
+  bool nextRun(
+    bool &lit,
+    unsigned int &units);
+
+private:
+  QVector<quint16> arena;
+  QVector<TorCarouselMessage> messages;
+
+  unsigned int gap;
+  unsigned int repeats;
+  unsigned int cycles;
+
+  // Playback position:
+  int messageIndex;
+  int runIndex;
+  unsigned int repeatIndex;
+  unsigned int cycleIndex;
+  bool finished;
+};
+
+#endif // TORCAROUSEL_H
@@ -0,0 +1,264 @@
+//
+// torcheckpoint.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torcheckpoint.h"
+#include "torexception.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#define CHECKPOINT_MAGIC "torchio-resume 1"
+
+// By default, progress is synced to disk every ten seconds:
+#define DEFAULT_SYNC_INTERVAL 10000000
+
+
+TorCheckpoint::TorCheckpoint(
+  TorClock *c,
+  QString p)
+  : clock(c),
+    path(p),
+    syncInterval(DEFAULT_SYNC_INTERVAL),
+    sourceSize(0),
+    descriptor(-1),
+    dirty(false),
+    lastSync(0),
+    firstSave(0),
+    lastSave(0),
+    saveCount(0),
+    saveTime(0),
+    syncCount(0),
+    syncTime(0)
+{
+}
+
+
+TorCheckpoint::~TorCheckpoint()
+{
+  sync();
+
+  if (descriptor != -1) close(descriptor);
+}
+
+
+void TorCheckpoint::setSyncInterval(
+  qint64 interval)
+{
+  syncInterval = interval;
+}
+
+
+void TorCheckpoint::setSource(
+  QString filename)
+{
+  QFileInfo info(filename);
+
+  source = info.canonicalFilePath();
+  sourceSize = info.size();
+}
+
+
+bool TorCheckpoint::load(
+  qint64 &fileOffset,
+  qint64 &unitOffset)
+{
+  QFile file(path);
+
+  if (!file.open(QFile::ReadOnly)) return false;
+
+  QByteArray contents = file.readAll();
+
+  long long size;
+  long long storedFileOffset;
+  long long storedUnitOffset;
+  int headerLength = 0;
+
+  if ( (sscanf(
+          contents.constData(),
+          CHECKPOINT_MAGIC " %lld %lld %lld\n%n",
+          &size,
+          &storedFileOffset,
+          &storedUnitOffset,
+          &headerLength) != 3)
+    || !headerLength)
+  {
+    return false;
+  }
+
+  // The rest is the source's path:
+  QByteArray storedSource = contents.mid(headerLength);
+  int end = storedSource.indexOf('\n');
+  if (end != -1) storedSource = storedSource.left(end);
+
+  // Only a checkpoint for this very file, unchanged, is any use:
+  if ( (size != sourceSize)
+    || (QString::fromLocal8Bit(storedSource.constData()) != source)
+    || (storedFileOffset < 0)
+    || (storedFileOffset > sourceSize)
+    || (storedUnitOffset < 0))
+  {
+    return false;
+  }
+
+  fileOffset = storedFileOffset;
+  unitOffset = storedUnitOffset;
+
+  return true;
+}
+
+
+void TorCheckpoint::save(
+  qint64 fileOffset,
+  qint64 unitOffset)
+{
+  qint64 saveStart = wallClock.currentTime();
+
+  if (descriptor == -1)
+  {
+    descriptor = open(
+      path.toLocal8Bit().constData(),
+      O_WRONLY | O_CREAT | O_TRUNC,
+      0644);
+
+    if (descriptor == -1)
+    {
+      QString ss;
+      ss += "Failed to open checkpoint file ";
+      ss += path;
+      ss += "\nError is ";
+      ss += strerror(errno);
+      throw TorException(ss);
+    }
+
+    lastSync = clock->currentTime();
+    firstSave = lastSync;
+  }
+
+  // The numbers are padded to a fixed width, so each record exactly
+  // overwrites the last:
+  char header[128];
+  snprintf(
+    header,
+    sizeof(header),
+    "%s %20lld %20lld %20lld\n",
+    CHECKPOINT_MAGIC,
+    (long long) sourceSize,
+    (long long) fileOffset,
+    (long long) unitOffset);
+
+  record = header;
+  record += source.toLocal8Bit();
+  record += '\n';
+
+  if (pwrite(descriptor, record.constData(), record.size(), 0) == -1)
+  {
+    QString ss;
+    ss += "Failed to write checkpoint file ";
+    ss += path;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorException(ss);
+  }
+
+  dirty = true;
+  ++saveCount;
+
+  qint64 now = clock->currentTime();
+  lastSave = now;
+
+  saveTime += wallClock.currentTime() - saveStart;
+
+  if (now - lastSync >= syncInterval) sync();
+}
+
+
+void TorCheckpoint::sync()
+{
+  if (!dirty) return;
+
+  qint64 syncStart = wallClock.currentTime();
+
+  fdatasync(descriptor);
+
+  syncTime += wallClock.currentTime() - syncStart;
+  ++syncCount;
+
+  dirty = false;
+  lastSync = clock->currentTime();
+}
+
+
+void TorCheckpoint::clear()
+{
+  if (descriptor != -1)
+  {
+    close(descriptor);
+    descriptor = -1;
+  }
+
+  dirty = false;
+
+  unlink(path.toLocal8Bit().constData());
+}
+
+
+void TorCheckpoint::writeReport(
+  QTextStream &out)
+{
+  if (!saveCount)
+  {
+    out << "Checkpoints: none saved" << endl;
+    return;
+  }
+
+  out << "Checkpoints: " << saveCount << " saved, mean ";
+  out << QString::number(double(saveTime) / saveCount, 'f', 1) << " us; ";
+  out << syncCount << " synced, mean ";
+  if (syncCount)
+  {
+    out << QString::number(double(syncTime) / syncCount, 'f', 1);
+  }
+  else
+  {
+    out << 0;
+  }
+  out << " us" << endl;
+
+  // Overhead as a share of the transmission time they covered:
+  qint64 span = lastSave - firstSave;
+  if (span > 0)
+  {
+    out << "Checkpoint overhead: ";
+    out << QString::number((saveTime + syncTime) * 100.0 / span, 'f', 4);
+    out << "% of " << QString::number(span / 1000000.0, 'f', 1);
+    out << " s" << endl;
+  }
+}
@@ -0,0 +1,103 @@
+//
+// torcheckpoint.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORCHECKPOINT_H
+#define TORCHECKPOINT_H
+
+#include <QString>
+#include <QByteArray>
+#include "torclock.h"
+
+class QTextStream;
+
+// Keeps track of how far a transmission from a file has got, so that an
+// interrupted run can be picked up again later.  The position is a byte
+// offset into the file (always at the start of a word) plus a number of
+// Morse units into that word.
+//
+// Saving just overwrites a small fixed-size record in place, which costs
+// little more than a system call.  The much more expensive sync to disk is
+// coalesced, happening at most once per sync interval (and when the
+// checkpoint is destroyed).  A crash can therefore lose at most one sync
+// interval of progress, and even that only when the whole system goes
+// down.
+class TorCheckpoint
+{
+public:
+  TorCheckpoint(
+    TorClock *clock,
+    QString path);
+
+  ~TorCheckpoint();
+
+  void setSyncInterval(
+    qint64 interval);
+
+  // Checkpoints belong to one source file, identified by its full path
+  // and size:
+  void setSource(
+    QString filename);
+
+  // Returns false if there's no checkpoint for the current source:
+  bool load(
+    qint64 &fileOffset,
+    qint64 &unitOffset);
+
+  void save(
+    qint64 fileOffset,
+    qint64 unitOffset);
+
+  // Pushes any unsynced checkpoint out to disk:
+  void sync();
+
+  // The transmission is complete, so there's nothing left to resume:
+  void clear();
+
+  void writeReport(
+    QTextStream &out);
+
+private:
+  TorClock *clock;
+  TorSystemClock wallClock;
+  QString path;
+  qint64 syncInterval;
+
+  QString source;
+  qint64 sourceSize;
+
+  int descriptor;
+  bool dirty;
+  qint64 lastSync;
+  QByteArray record;
+
+  // Statistics:
+  qint64 firstSave;
+  qint64 lastSave;
+  unsigned int saveCount;
+  qint64 saveTime;
+  unsigned int syncCount;
+  qint64 syncTime;
+};
+
+#endif // TORCHECKPOINT_H
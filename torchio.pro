@@ -19,7 +19,65 @@ SOURCES += main.cpp \
     torcontroller.cpp \
     tordbus.cpp \
     torflashled.cpp \
-    tormorse.cpp
+    toredgelog.cpp \
+    toredgereplayer.cpp \
+    torcalibrator.cpp \
+    tormorsedecoder.cpp \
+    torlightsensor.cpp \
+    torfader.cpp \
+    torsysfsled.cpp \
+    tortimeline.cpp \
+    torstroboscope.cpp \
+    torthermalgovernor.cpp \
+    torpowersupply.cpp \
+    torbeacon.cpp \
+    torkeyer.cpp \
+    tortimingscript.cpp \
+    torstartuptrace.cpp \
+    tormetricsexporter.cpp \
+    toringestqueue.cpp
+
+# Morse playback, which the benchmarks build too:
+include(playback.pri)
+
+# The Qt-free core (LED hardware, Morse tables, the epoll loop):
+include(core/core.pri)
+
+# clock_gettime():
+LIBS += -lrt
+
+# "make check" compares simulated runs of each mode with golden traces,
+# runs the beacon against a fake power_supply tree, an -mf transmission
+# interrupted and resumed, two --align instances side by side, the keyer
+# through a pty, and the flash discovery probe order (against the core
+# objects just built):
+check.commands = \
+    sh $$PWD/tests/golden/run.sh ./$$TARGET && \
+    sh $$PWD/tests/beacon/run.sh ./$$TARGET && \
+    sh $$PWD/tests/resume/run.sh ./$$TARGET && \
+    sh $$PWD/tests/align/run.sh ./$$TARGET && \
+    $$QMAKE_CXX -o keyertest $$PWD/tests/keyer/keyertest.cpp && \
+    ./keyertest ./$$TARGET && \
+    $$QMAKE_CXX -I$$PWD/core -o probeordertest \
+        $$PWD/tests/discovery/probeordertest.cpp \
+        torcoreflashdiscovery.o torcoreloop.o -lpthread -lrt && \
+    ./probeordertest
+check.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += check
+
+# "make bench" builds torchio-bench (bench/bench.pro) in bench/ below the
+# build directory:
+bench.commands = \
+    $(MKDIR) bench && \
+    cd bench && \
+    $(QMAKE) $$PWD/bench/bench.pro && \
+    $(MAKE)
+QMAKE_EXTRA_TARGETS += bench
+
+# Neither target is a file, and bench/ is a directory in the source tree:
+phony.target = .PHONY
+phony.depends = check bench
+QMAKE_EXTRA_TARGETS += phony
 
 maemo5 {
     target.path = /opt/torchio/bin
@@ -41,6 +99,21 @@ OTHER_FILES += \
 HEADERS += \
     torcontroller.h \
     tordbus.h \
-    torexception.h \
     torflashled.h \
-    tormorse.h
+    toredgelog.h \
+    toredgereplayer.h \
+    torcalibrator.h \
+    tormorsedecoder.h \
+    torlightsensor.h \
+    torfader.h \
+    torsysfsled.h \
+    tortimeline.h \
+    torstroboscope.h \
+    torthermalgovernor.h \
+    torpowersupply.h \
+    torbeacon.h \
+    torkeyer.h \
+    tortimingscript.h \
+    torstartuptrace.h \
+    tormetricsexporter.h \
+    toringestqueue.h
@@ -0,0 +1,71 @@
+//
+// torclock.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torclock.h"
+#include "tortimer.h"
+
+#include <time.h>
+#include <unistd.h>
+
+
+TorSystemClock::TorSystemClock()
+{
+}
+
+
+TorSystemClock::~TorSystemClock()
+{
+}
+
+
+qint64 TorSystemClock::currentTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (qint64(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+
+qint64 TorSystemClock::currentRealTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (qint64(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+
+TorTimer *TorSystemClock::createTimer()
+{
+  return new TorSystemTimer(this);
+}
+
+
+void TorSystemClock::delay(
+  qint64 duration)
+{
+  if (duration > 0) usleep(duration);
+}
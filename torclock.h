@@ -0,0 +1,71 @@
+//
+// torclock.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORCLOCK_H
+#define TORCLOCK_H
+
+#include <QtGlobal>
+
+class TorTimer;
+
+// A TorClock provides the current time, and creates timers that run against
+// that time.  All times are in microseconds, from an arbitrary origin.
+class TorClock
+{
+public:
+  virtual ~TorClock() {}
+
+  virtual qint64 currentTime() = 0;
+
+  // Wall-clock time, in microseconds since the epoch.  Unlike
+  // currentTime(), it can be compared across devices (as far as their
+  // clocks agree), but it may jump when the clock is set:
+  virtual qint64 currentRealTime() = 0;
+
+  virtual TorTimer *createTimer() = 0;
+
+  // Let the given amount of time pass before returning:
+  virtual void delay(
+    qint64 duration) = 0;
+};
+
+
+// The system clock follows CLOCK_MONOTONIC, and its timers run off of the
+// Qt event loop:
+class TorSystemClock: public TorClock
+{
+public:
+  TorSystemClock();
+  ~TorSystemClock();
+
+  qint64 currentTime();
+
+  qint64 currentRealTime();
+
+  TorTimer *createTimer();
+
+  void delay(
+    qint64 duration);
+};
+
+#endif // TORCLOCK_H
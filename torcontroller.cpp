@@ -22,13 +22,61 @@
 
 #include "torcontroller.h"
 #include "torexception.h"
+#include "torclock.h"
+#include "torvirtualclock.h"
+#include "tortimer.h"
+#include "torflashled.h"
+#include "torfakeled.h"
+#include "tordbus.h"
+#include "tormorse.h"
+#include "toredgelog.h"
+#include "toredgereplayer.h"
+#include "torcalibrator.h"
+#include "tordatalink.h"
+#include "tormorsedecoder.h"
+#include "torlightsensor.h"
+#include "tortimeline.h"
+#include "torstroboscope.h"
+#include "torthermalgovernor.h"
+#include "torpowersupply.h"
+#include "torbeacon.h"
+#include "torkeyer.h"
+#include "tortimingscript.h"
+#include "torcheckpoint.h"
+#include "torstartuptrace.h"
+#include "tormetricsexporter.h"
+#include "torcarousel.h"
+#include "torwordcache.h"
+#include "torcoretrace.h"
 
 #include <QTextStream>
+#include <QDir>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// When simulating a mode that never ends on its own, stop after the
+// longest supported timeout (120 minutes, in microseconds):
+#define SIMULATION_HORIZON (120LL * 60 * 1000000)
+
+// Beacons can be asked to last for up to a week (in minutes):
+#define MAX_BEACON_DURATION (7 * 24 * 60)
+#define MAX_CAROUSEL_COUNT 1000000
+
+#define POWER_SUPPLY_ROOT "/sys/class/power_supply"
+
+// Progress through -mf files is kept here, in the home directory:
+#define CHECKPOINT_FILENAME ".torchio-resume"
+
+// Room for the most recent 64k spans (about 2 MB) when tracing:
+#define TRACE_CAPACITY 65536
 
 //#include <QDebug>
 
 TorController::TorController(
-  QStringList args)
+  QStringList args,
+  TorStartupTrace *st)
   : pulse(No_Pulse),
     color(White_Color),
     ignoreCover(false),
@@ -36,47 +84,130 @@ TorController::TorController(
     argList(args),
     morseRunning(false),
     morseFromStdin(false),
-    inputStream(stdin)
+    simulate(false),
+    fakeLEDs(false),
+    alignment(0),
+    simulatedLatency(0),
+    compensateLatency(false),
+    timingReport(false),
+    dotDuration(100),
+    errorBudget(10),
+    dataUsesNRZ(false),
+    dataUsesFEC(false),
+    dataLoopback(false),
+    sampleRate(1000),
+    fadeDuration(0),
+    fadeFrom(0),
+    fadeTo(100),
+    fadeCurve(Gamma_Curve),
+    fadeUpdateRate(200),
+    strobeFrequency(0.0),
+    strobeDuty(10),
+    useGovernor(false),
+    beaconDuration(0),
+    straightKey(false),
+    resume(false),
+    traceStartup(false),
+    rediscover(false),
+    checkpointInterval(1000),
+    metricsInterval(10),
+    carouselGap(4),
+    carouselRepeats(1),
+    carouselCycles(0),
+    ingestPolicy(Block_Policy),
+    ingestLines(64),
+    ingestBytes(65536),
+    ingestLatest(1),
+    wordCacheSize(256),
+    sendingLine(false),
+    powerSupplyRoot(POWER_SUPPLY_ROOT),
+    replayFrom(0),
+    traceStream(stdout),
+    clock(0),
+    virtualClock(0),
+    offTimer(0),
+    led(0),
+    flashLED(0),
+    dbus(0),
+    morse(0),
+    recorder(0),
+    replayer(0),
+    calibrator(0),
+    dataDecoder(0),
+    morseDecoder(0),
+    lightSensor(0),
+    fader(0),
+    timeline(0),
+    stroboscope(0),
+    governor(0),
+    powerSupply(0),
+    beacon(0),
+    keyer(0),
+    script(0),
+    checkpoint(0),
+    metrics(0),
+    metricsExporter(0),
+    startupTrace(st),
+    carousel(0),
+    ingest(0),
+    wordCache(0)
 {
-  // Set up the timer:
-  connect(
-    &offTimer,
-    SIGNAL(timeout()),
-    this,
-    SLOT(cleanupAndExit()));
+}
 
-  // Set up for a shutter closed event:
-  connect(
-    &dbus,
-    SIGNAL(userClosedCover()),
-    this,
-    SLOT(cleanupAndExit()));
 
-  // Also, when Morse code has finished:
-  connect(
-    &morse,
-    SIGNAL(morseFinished()),
-    this,
-    SLOT(handleEndOfMorse()));
+TorController::~TorController()
+{
+  // Timers must go before the clock that drives them:
+  if (metricsExporter) delete metricsExporter;
+  if (lightSensor) delete lightSensor;
+  if (fader) delete fader;
+  if (script) delete script;
+  if (timeline) delete timeline;
+  if (stroboscope) delete stroboscope;
+  if (keyer) delete keyer;
+  if (morseDecoder) delete morseDecoder;
+  if (calibrator) delete calibrator;
+  if (morse) delete morse;
+  if (ingest) delete ingest;
+  if (wordCache) delete wordCache;
+  if (carousel) delete carousel;
+  if (checkpoint) delete checkpoint;
+  if (replayer) delete replayer;
+  if (offTimer) delete offTimer;
+  if (dbus) delete dbus;
 
-  // More Morse integration:
-  connect(
-    &morse,
-    SIGNAL(turnTorchOn()),
-    this,
-    SLOT(turnOn()));
+  // The LEDs may still report a final edge as they shut down:
+  if (led) delete led;
+  if (governor) delete governor;
+  if (beacon) delete beacon;
+  if (powerSupply) delete powerSupply;
+  if (recorder) delete recorder;
+  if (dataDecoder) delete dataDecoder;
+  if (metrics) delete metrics;
 
-  connect(
-    &morse,
-    SIGNAL(turnTorchOff()),
-    this,
-    SLOT(turnOff()));
-}
+  if (clock) delete clock;
+
+#ifdef TORCHIO_TRACING
+  // Written last, so that the LEDs being switched off are included:
+  if (!traceFile.isEmpty())
+  {
+    QTextStream qts(stderr);
 
+    if (!TorCoreTrace::writeChromeTrace(traceFile.toLocal8Bit().constData()))
+    {
+      qts << "Failed to write trace file " << traceFile;
+      qts << ": " << strerror(errno) << endl;
+    }
+    else if (TorCoreTrace::getDroppedCount())
+    {
+      qts << "Trace kept the last " << TRACE_CAPACITY << " spans; ";
+      qts << TorCoreTrace::getDroppedCount() << " earlier ones were dropped";
+      qts << endl;
+    }
 
-TorController::~TorController()
-{
-  // nothing to do here.
+    TorCoreTrace::stop();
+  }
+#endif
 }
 
 
@@ -84,6 +215,8 @@ void TorController::parseArgs()
 {
   QTextStream qts(stdout);
 
+  startupTrace->mark("Event loop started");
+
   int i = 1;
   while (i < argList.size())
   {
@@ -105,11 +238,111 @@ void TorController::parseArgs()
       qts << "--sos" << endl;
       qts << "-m         Generate Morse code from standard input" << endl;
       qts << "--morse" << endl;
+      qts << "--queuelines nnn  Lines of -m input held while waiting to be" << endl;
+      qts << "           sent (default 64)" << endl;
+      qts << "--queuebytes nnn  Bytes of -m input held (default 65536)" << endl;
+      qts << "--queuepolicy <policy>  What gives when the -m queue is full:" << endl;
+      qts << "           block (stop reading, so the producer waits; the" << endl;
+      qts << "           default), dropoldest, dropnewest, or latest (keep" << endl;
+      qts << "           only the newest --queuelatest lines)" << endl;
+      qts << "--queuelatest nnn Lines kept by the latest policy (default 1)" << endl;
+      qts << "--wordcache nnn   Keep the Morse for the nnn most recently" << endl;
+      qts << "           used words of -m input (default 256; 0 turns the" << endl;
+      qts << "           cache off)" << endl;
       qts << "-mf <filename>   Generate Morse code from text file" << endl;
       qts << "--morsefromfile <filename>" << endl;
+      qts << "--resume   Carry on an interrupted -mf transmission from" << endl;
+      qts << "           where it stopped" << endl;
+      qts << "--checkpoint <filename>  Where -mf progress is kept" << endl;
+      qts << "           (default is ~/" << CHECKPOINT_FILENAME << ")" << endl;
+      qts << "--checkpointinterval nnn  Save -mf progress every nnn" << endl;
+      qts << "           milliseconds (default 1000; 0 turns it off)" << endl;
+      qts << "--data <filename>  Send the file's contents as a data frame" << endl;
+      qts << "--nrz      Use NRZ line coding for --data (default is Manchester)" << endl;
+      qts << "--fec      Add forward error correction to --data" << endl;
+      qts << "--loopback Decode --data frames from the LEDs, to check them" << endl;
+      qts << endl;
+      qts << "--receive <source>  Decode Morse from light sensor samples;" << endl;
+      qts << "           the source is either a sysfs illuminance attribute" << endl;
+      qts << "           or a recorded CSV or binary sample file" << endl;
+      qts << "--samplerate nnn    Live sensor samples per second" << endl;
+      qts << "                    (default is 1000)" << endl;
+      qts << endl;
+      qts << "--timeline <filename>  Play a multi-track LED timeline; each" << endl;
+      qts << "           line is \"<channel> <once|loop> <steps>\", where" << endl;
+      qts << "           the channel is torch, indicator or a sysfs LED," << endl;
+      qts << "           and steps are \"<level> <ms>\" pairs (levels may be" << endl;
+      qts << "           on or off) or \"morse <text>\"" << endl;
+      qts << "--script <filename>  Play exact timings, read as they arrive" << endl;
+      qts << "           (\"-\" for standard input): \"on <ms>\", \"off <ms>\"" << endl;
+      qts << "           and \"i=<level>\" for later \"on\"s, or the packed" << endl;
+      qts << "           binary form" << endl;
+      qts << endl;
+      qts << "--carousel <text>  Add a message to a carousel, which sends" << endl;
+      qts << "           each message in turn, over and over; may be given" << endl;
+      qts << "           any number of times" << endl;
+      qts << "--carouselfile <filename>  Add a file's text to the carousel" << endl;
+      qts << "--carouselgap nnn     Extra dots of darkness after each" << endl;
+      qts << "           message (default 4, a word space)" << endl;
+      qts << "--carouselrepeat nnn  Send each message nnn times in a row" << endl;
+      qts << "           (default 1)" << endl;
+      qts << "--carouselcycles nnn  Stop after nnn times through the" << endl;
+      qts << "           carousel (default is to carry on until -t)" << endl;
+      qts << endl;
+      qts << "--beacon nnn  SOS beacon, paced to last nnn minutes on the" << endl;
+      qts << "           remaining battery (stops then, unless -t is given)" << endl;
+      qts << "--powersupply <dir>  Where to find the battery for --beacon" << endl;
+      qts << "           (default is /sys/class/power_supply)" << endl;
+      qts << endl;
+      qts << "--keyer <device>  Key Morse live from a terminal or evdev" << endl;
+      qts << "           device (\"-\" for standard input); see --straight" << endl;
+      qts << "--straight Use an evdev keyer as a straight key rather than" << endl;
+      qts << "           as iambic paddles" << endl;
+      qts << endl;
+      qts << "--strobe nn  Fire the flash nn times per second" << endl;
+      qts << "--duty nn    Flash duration, as a percentage of each strobe" << endl;
+      qts << "             period (default 10); limited to what the flash" << endl;
+      qts << "             supports" << endl;
+      qts << endl;
+      qts << "--fade nnn Fade the LEDs over nnn milliseconds" << endl;
+      qts << "--fadefrom nn     Starting brightness, in percent (default 0)" << endl;
+      qts << "--fadeto nn       Final brightness, in percent (default 100)" << endl;
+      qts << "--curve <curve>   Fade curve: linear, exp or gamma" << endl;
+      qts << "                  (default is gamma)" << endl;
+      qts << "--updaterate nnn  Fade updates per second (default is 200);" << endl;
+      qts << "                  levels between hardware steps are dithered" << endl;
+      qts << "                  at this rate" << endl;
       qts << endl;
       qts << "-d nnn     Set the dot duration to nnn milliseconds" << endl;
       qts << "--dotduration nnn                  (default is 100)" << endl;
+      qts << "-d auto    Use the dot duration found by --calibrate" << endl;
+      qts << endl;
+      qts << "--calibrate       Find the fastest usable dot duration" << endl;
+      qts << "--errorbudget nn  Allowed timing error for --calibrate, as a" << endl;
+      qts << "                  percentage of one dot (default is 10)" << endl;
+      qts << endl;
+      qts << "--align nn Start (and restart SOS and pulses) on multiples of" << endl;
+      qts << "           nn seconds of wall-clock time, so several devices" << endl;
+      qts << "           flash in phase; the phase error is reported on exit" << endl;
+      qts << endl;
+      qts << "-c         Compensate for the time taken to switch the LEDs" << endl;
+      qts << "--compensate" << endl;
+      qts << "--timingreport    Report Morse, fade, timeline or strobe timing" << endl;
+      qts << "                  on exit" << endl;
+      qts << "--trace-startup   Report how long each phase of startup took" << endl;
+      qts << "--rediscover      Probe for the flash device again, rather" << endl;
+      qts << "                  than trusting the last run's findings" << endl;
+      qts << endl;
+      qts << "--metricsfile <filename>  Keep Prometheus metrics in a file," << endl;
+      qts << "           rewritten every --metricsinterval seconds" << endl;
+      qts << "--metricsinterval nnn     (default is 10)" << endl;
+      qts << "--metricssocket <path>    Serve Prometheus metrics on a Unix" << endl;
+      qts << "           socket, one export per connection" << endl;
+      qts << "--metricsbench   Measure the cost of the metrics themselves" << endl;
+#ifdef TORCHIO_TRACING
+      qts << "--tracefile <filename>    Write a Chrome trace (for Perfetto) of" << endl;
+      qts << "           input, D-Bus, encoding and LED activity on exit" << endl;
+#endif
       qts << endl;
       qts << "-w         Use white LEDs" << endl;
       qts << "--white" << endl;
@@ -119,10 +352,26 @@ void TorController::parseArgs()
       qts << "-i         Ignore camera cover" << endl;
       qts << "--ignorecover" << endl;
       qts << endl;
+      qts << "--governor Dim the LEDs gradually as they heat up, to keep" << endl;
+      qts << "           them lit for longer, and report the light delivered" << endl;
+      qts << "           (steady light only)" << endl;
+      qts << "--thermalzone <path>  Temperature attribute for --governor" << endl;
+      qts << "           (default is the first sysfs thermal zone found)" << endl;
+      qts << endl;
       qts << "-t nnn     Switch LEDs off and exit after nnn minutes" << endl;
       qts << "           (from 1 to 120 minutes supported)" << endl;
       qts << "--timeout nnn" << endl;
       qts << endl;
+      qts << "--record <filename>  Record every LED change to a binary log" << endl;
+      qts << "--replay <filename>  Play back a recorded LED log" << endl;
+      qts << "--replayfrom nnn     Start playback nnn seconds into the log" << endl;
+      qts << endl;
+      qts << "--simulate Run against a virtual clock and fake LEDs," << endl;
+      qts << "           printing each LED change instead" << endl;
+      qts << "--fakeleds Run in real time, but print each LED change instead" << endl;
+      qts << "           of driving the LEDs" << endl;
+      qts << "--simlatency nnn  Simulated LEDs take nnn microseconds to switch" << endl;
+      qts << endl;
       qts << "-v         Print the version number" << endl;
       qts << "--version" << endl;
       qts << endl;
@@ -156,6 +405,88 @@ void TorController::parseArgs()
       pulse = MorseFromStream_Pulse;
       morseFromStdin = true;
     }
+    else if (argList.at(i) == "--queuepolicy")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no queue policy provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      if (argList.at(i) == "block")
+      {
+        ingestPolicy = Block_Policy;
+      }
+      else if (argList.at(i) == "dropoldest")
+      {
+        ingestPolicy = DropOldest_Policy;
+      }
+      else if (argList.at(i) == "dropnewest")
+      {
+        ingestPolicy = DropNewest_Policy;
+      }
+      else if (argList.at(i) == "latest")
+      {
+        ingestPolicy = Latest_Policy;
+      }
+      else
+      {
+        qts << "Error: unknown queue policy \"" << argList.at(i);
+        qts << "\"" << endl;
+        emit controllerDone();
+        return;
+      }
+    }
+    else if ( (argList.at(i) == "--queuelines")
+      || (argList.at(i) == "--queuebytes")
+      || (argList.at(i) == "--queuelatest"))
+    {
+      QString option = argList.at(i);
+
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no value provided for " << option << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 1))
+      {
+        qts << "Error: " << option << " must be at least 1" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      if (option == "--queuelines") ingestLines = t;
+      else if (option == "--queuebytes") ingestBytes = t;
+      else ingestLatest = t;
+    }
+    else if (argList.at(i) == "--wordcache")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no word cache size provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 0))
+      {
+        qts << "Error: couldn't parse word cache size" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      wordCacheSize = t;
+    }
     else if ((argList.at(i) == "-mf")
       || (argList.at(i) == "-morsefromfile"))
     {
@@ -185,6 +516,20 @@ void TorController::parseArgs()
         return;
       }
 
+      if (argList.at(i) == "auto")
+      {
+        dotDuration = TorCalibrator::retrieveDotDuration();
+        if (!dotDuration)
+        {
+          qts << "Warning: no calibrated dot duration stored" << endl;
+          qts << "Dot duration being set to 100 milliseconds." << endl;
+          dotDuration = 100;
+        }
+
+        ++i;
+        continue;
+      }
+
       bool isANumber;
       int t = argList.at(i).toInt(&isANumber);
       if (!isANumber)
@@ -198,161 +543,1037 @@ void TorController::parseArgs()
       {
         qts << "Warning: dot duration value less than 1" << endl;
         qts << "Dot duration being set to 1 millisecond." << endl;
-        morse.setDotDuration(1);
+        dotDuration = 1;
       }
       else if (t > 600000)
       {
         qts << "Warning: dot duration value greater than 10 minutes" << endl;
         qts << "Dot duration being set to 600000 (10 minutes)" << endl;
-        morse.setDotDuration(600000);
+        dotDuration = 600000;
       }
       else
       {
-        morse.setDotDuration(t);
+        dotDuration = t;
       }
     }
-    else if ((argList.at(i) == "-w")
-      || (argList.at(i) == "--white"))
+    else if ((argList.at(i) == "-c")
+      || (argList.at(i) == "--compensate"))
     {
-      color = White_Color;
+      compensateLatency = true;
     }
-    else if ((argList.at(i) == "-r")
-      || (argList.at(i) == "--red"))
+    else if (argList.at(i) == "--timingreport")
     {
-      color = Red_Color;
+      timingReport = true;
     }
-    else if ((argList.at(i) == "-i")
-      || (argList.at(i) == "--ignorecover"))
+    else if (argList.at(i) == "--trace-startup")
     {
-      ignoreCover = true;
+      traceStartup = true;
     }
-    else if ((argList.at(i) == "-t")
-      || (argList.at(i) == "--timeout"))
+    else if (argList.at(i) == "--rediscover")
+    {
+      rediscover = true;
+    }
+    else if (argList.at(i) == "--metricsfile")
     {
       ++i;
       if (i >= argList.size())
       {
-        // error: reached end of list
-        qts << "Error: no timeout duration provided" << endl;
+        qts << "Error: no metrics filename provided" << endl;
         emit controllerDone();
         return;
       }
 
-      bool isANumber;
-      int t = argList.at(i).toInt(&isANumber);
-      if (!isANumber)
+      metricsFile = argList.at(i);
+    }
+    else if (argList.at(i) == "--metricsinterval")
+    {
+      ++i;
+      if (i >= argList.size())
       {
-        // error: couldn't parse duration value
-        qts << "Error: couldn't parse timeout value" << endl;
+        qts << "Error: no metrics interval provided" << endl;
         emit controllerDone();
         return;
       }
 
-      if (t < 1)
-      {
-        // error: timeout too small
-        qts << "Warning: timeout value less than 1." << endl;
-        qts << "Timeout being set to 1 minute." << endl;
-        timeoutDuration = 1;
-      }
-      else if (t > 120)
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t <= 0))
       {
-        // error: timeout too large
-        qts << "Warning: timeout value greater than 120." << endl;
-        qts << "Timeout being set to 120 minutes." << endl;
-        timeoutDuration = 120;
+        qts << "Error: couldn't parse metrics interval" << endl;
+        emit controllerDone();
+        return;
       }
-      else
+
+      metricsInterval = t;
+    }
+    else if (argList.at(i) == "--metricssocket")
+    {
+      ++i;
+      if (i >= argList.size())
       {
-        timeoutDuration = t;
+        qts << "Error: no metrics socket path provided" << endl;
+        emit controllerDone();
+        return;
       }
+
+      metricsSocket = argList.at(i);
     }
-    else
+    else if (argList.at(i) == "--tracefile")
     {
-      // Print out the "I didn't understand that" and quit:
-      qts << "Error: argument \"" << argList.at(i);
-      qts << "\" not supported" << endl;
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no trace filename provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+#ifdef TORCHIO_TRACING
+      // Start straight away, to catch as much of startup as possible:
+      traceFile = argList.at(i);
+      TorCoreTrace::start(TRACE_CAPACITY);
+#else
+      qts << "Error: this build has no tracing (rebuild with";
+      qts << " CONFIG+=tracing)" << endl;
       emit controllerDone();
       return;
+#endif
     }
-
-    ++i;
-  }
-
-  // So, on to the actual implementation:
-  if (dbus.coverCurrentlyClosed() && !ignoreCover)
-  {
-    // Print out the "camera cover closed" message and quit:
-    qts << "Error: camera cover is currently closed" << endl;
-    emit controllerDone();
-    return;
-  }
-
-  // Set up the timer:
-  if (timeoutDuration)
-  {
-    unsigned int milliseconds = timeoutDuration * 60000;
-    offTimer.start(milliseconds);
-  }
-
-  // Actually turn on the device:
-  if (pulse == Simple_Pulse)
-  {
-    morse.startE();
-    morseRunning = true;
-  }
-  else if (pulse == SOS_Pulse)
-  {
-    morse.startSOS();
-    morseRunning = true;
-  }
-  else if (pulse == MorseFromStream_Pulse)
-  {
-    // We need to grab the first chunk of input and parse it:
-    QString firstChunk = inputStream.readLine();
-    if (firstChunk.isNull())
+    else if (argList.at(i) == "--metricsbench")
     {
-      // No input.
-      cleanupAndExit();
+      TorMetricsExporter::writeBenchmark(qts);
+      emit controllerDone();
       return;
     }
-
-    QTextStream lineStream(&firstChunk);
-
-    morse.startMorseFromStream(lineStream);
-  }
-  else if (pulse == MorseFromFile_Pulse)
-  {
-    try
+    else if (argList.at(i) == "--resume")
     {
-      morse.startMorseFromFile(filename);
+      resume = true;
     }
-    catch (TorException &e)
+    else if (argList.at(i) == "--checkpoint")
     {
-      QTextStream qts(stderr);
-      qts << e.getError() << endl;
-      cleanupAndExit();
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no checkpoint filename provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      checkpointPath = argList.at(i);
     }
-    morseRunning = true;
-  }
-  else
-  {
-    turnOn();
-  }
-}
+    else if (argList.at(i) == "--checkpointinterval")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no checkpoint interval provided" << endl;
+        emit controllerDone();
+        return;
+      }
 
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 0))
+      {
+        qts << "Error: couldn't parse checkpoint interval" << endl;
+        emit controllerDone();
+        return;
+      }
 
-void TorController::turnOn()
-{
-  try
-  {
-    if (color == White_Color)
+      checkpointInterval = t;
+    }
+    else if ((argList.at(i) == "-w")
+      || (argList.at(i) == "--white"))
     {
-      led.turnTorchOn();
+      color = White_Color;
     }
-    else
+    else if ((argList.at(i) == "-r")
+      || (argList.at(i) == "--red"))
     {
-      led.turnIndicatorOn();
+      color = Red_Color;
+    }
+    else if ((argList.at(i) == "-i")
+      || (argList.at(i) == "--ignorecover"))
+    {
+      ignoreCover = true;
+    }
+    else if (argList.at(i) == "--data")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no filename provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = DataFromFile_Pulse;
+      filename = argList.at(i);
+      morseFromStdin = false;
+    }
+    else if (argList.at(i) == "--nrz")
+    {
+      dataUsesNRZ = true;
+    }
+    else if (argList.at(i) == "--fec")
+    {
+      dataUsesFEC = true;
+    }
+    else if (argList.at(i) == "--loopback")
+    {
+      dataLoopback = true;
+    }
+    else if (argList.at(i) == "--receive")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no sample source provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Receive_Pulse;
+      filename = argList.at(i);
+    }
+    else if (argList.at(i) == "--samplerate")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no sample rate provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 1) || (t > 100000))
+      {
+        qts << "Error: sample rate must be from 1 to 100000" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      sampleRate = t;
+    }
+    else if (argList.at(i) == "--timeline")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no filename provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Timeline_Pulse;
+      filename = argList.at(i);
+      morseFromStdin = false;
+    }
+    else if (argList.at(i) == "--script")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no filename provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Script_Pulse;
+      filename = argList.at(i);
+      morseFromStdin = false;
+    }
+    else if (argList.at(i) == "--strobe")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no strobe frequency provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      strobeFrequency = argList.at(i).toDouble(&isANumber);
+      if (!isANumber || (strobeFrequency <= 0.0) || (strobeFrequency > 1000.0))
+      {
+        qts << "Error: strobe frequency must be above 0 and at most 1000" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Strobe_Pulse;
+    }
+    else if (argList.at(i) == "--duty")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no duty cycle provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 1) || (t > 100))
+      {
+        qts << "Error: duty cycle must be from 1 to 100 percent" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      strobeDuty = t;
+    }
+    else if (argList.at(i) == "--beacon")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no beacon duration provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 1) || (t > MAX_BEACON_DURATION))
+      {
+        qts << "Error: beacon duration must be from 1 to ";
+        qts << MAX_BEACON_DURATION << " minutes" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Beacon_Pulse;
+      beaconDuration = t;
+    }
+    else if ( (argList.at(i) == "--carousel")
+      || (argList.at(i) == "--carouselfile"))
+    {
+      bool fromFile = (argList.at(i) == "--carouselfile");
+
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no carousel message provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      // Each message is encoded as soon as it is given, and only then:
+      if (!carousel) carousel = new TorCarousel();
+
+      try
+      {
+        if (fromFile)
+        {
+          carousel->addFile(argList.at(i));
+        }
+        else
+        {
+          carousel->addText(argList.at(i).toLocal8Bit());
+        }
+      }
+      catch (TorException &e)
+      {
+        qts << "Error: " << e.getError() << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Carousel_Pulse;
+      morseFromStdin = false;
+    }
+    else if ( (argList.at(i) == "--carouselgap")
+      || (argList.at(i) == "--carouselrepeat")
+      || (argList.at(i) == "--carouselcycles"))
+    {
+      QString option = argList.at(i);
+
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no value provided for " << option << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      int lowest = (option == "--carouselrepeat") ? 1 : 0;
+      if (!isANumber || (t < lowest) || (t > MAX_CAROUSEL_COUNT))
+      {
+        qts << "Error: " << option << " must be from " << lowest;
+        qts << " to " << MAX_CAROUSEL_COUNT << endl;
+        emit controllerDone();
+        return;
+      }
+
+      if (option == "--carouselgap") carouselGap = t;
+      else if (option == "--carouselrepeat") carouselRepeats = t;
+      else carouselCycles = t;
+    }
+    else if (argList.at(i) == "--keyer")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no keyer device provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Keyer_Pulse;
+      keyerInput = argList.at(i);
+    }
+    else if (argList.at(i) == "--straight")
+    {
+      straightKey = true;
+    }
+    else if (argList.at(i) == "--powersupply")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no power supply directory provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      powerSupplyRoot = argList.at(i);
+    }
+    else if (argList.at(i) == "--governor")
+    {
+      useGovernor = true;
+    }
+    else if (argList.at(i) == "--thermalzone")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no thermal zone provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      thermalZone = argList.at(i);
+    }
+    else if (argList.at(i) == "--fade")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no fade duration provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 0) || (t > 600000))
+      {
+        qts << "Error: fade duration must be from 0 to 600000" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Fade_Pulse;
+      fadeDuration = t;
+    }
+    else if ( (argList.at(i) == "--fadefrom")
+      || (argList.at(i) == "--fadeto"))
+    {
+      QString option = argList.at(i);
+
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no brightness provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 0) || (t > 100))
+      {
+        qts << "Error: brightness must be from 0 to 100 percent" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      if (option == "--fadefrom")
+      {
+        fadeFrom = t;
+      }
+      else
+      {
+        fadeTo = t;
+      }
+    }
+    else if (argList.at(i) == "--curve")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no fade curve provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      if (argList.at(i) == "linear")
+      {
+        fadeCurve = Linear_Curve;
+      }
+      else if (argList.at(i) == "exp")
+      {
+        fadeCurve = Exponential_Curve;
+      }
+      else if (argList.at(i) == "gamma")
+      {
+        fadeCurve = Gamma_Curve;
+      }
+      else
+      {
+        qts << "Error: fade curve must be linear, exp or gamma" << endl;
+        emit controllerDone();
+        return;
+      }
+    }
+    else if (argList.at(i) == "--updaterate")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no update rate provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 1) || (t > 100000))
+      {
+        qts << "Error: update rate must be from 1 to 100000" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      fadeUpdateRate = t;
+    }
+    else if (argList.at(i) == "--calibrate")
+    {
+      pulse = Calibrate_Pulse;
+    }
+    else if (argList.at(i) == "--errorbudget")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no error budget provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 1) || (t > 100))
+      {
+        qts << "Error: error budget must be from 1 to 100 percent" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      errorBudget = t;
+    }
+    else if (argList.at(i) == "--record")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no record filename provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      recordFilename = argList.at(i);
+    }
+    else if (argList.at(i) == "--replay")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no replay filename provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      pulse = Replay_Pulse;
+      replayFilename = argList.at(i);
+    }
+    else if (argList.at(i) == "--replayfrom")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no replay starting point provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      replayFrom = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (replayFrom < 0))
+      {
+        qts << "Error: couldn't parse replay starting point" << endl;
+        emit controllerDone();
+        return;
+      }
+    }
+    else if (argList.at(i) == "--simulate")
+    {
+      simulate = true;
+    }
+    else if (argList.at(i) == "--fakeleds")
+    {
+      fakeLEDs = true;
+    }
+    else if (argList.at(i) == "--align")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no alignment period provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (t < 1) || (t > 3600))
+      {
+        qts << "Error: alignment period must be from 1 to 3600 seconds" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      alignment = t;
+    }
+    else if (argList.at(i) == "--simlatency")
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        qts << "Error: no simulated latency provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      simulatedLatency = argList.at(i).toInt(&isANumber);
+      if (!isANumber || (simulatedLatency < 0))
+      {
+        qts << "Error: couldn't parse simulated latency" << endl;
+        emit controllerDone();
+        return;
+      }
+    }
+    else if ((argList.at(i) == "-t")
+      || (argList.at(i) == "--timeout"))
+    {
+      ++i;
+      if (i >= argList.size())
+      {
+        // error: reached end of list
+        qts << "Error: no timeout duration provided" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      bool isANumber;
+      int t = argList.at(i).toInt(&isANumber);
+      if (!isANumber)
+      {
+        // error: couldn't parse duration value
+        qts << "Error: couldn't parse timeout value" << endl;
+        emit controllerDone();
+        return;
+      }
+
+      if (t < 1)
+      {
+        // error: timeout too small
+        qts << "Warning: timeout value less than 1." << endl;
+        qts << "Timeout being set to 1 minute." << endl;
+        timeoutDuration = 1;
+      }
+      else if (t > 120)
+      {
+        // error: timeout too large
+        qts << "Warning: timeout value greater than 120." << endl;
+        qts << "Timeout being set to 120 minutes." << endl;
+        timeoutDuration = 120;
+      }
+      else
+      {
+        timeoutDuration = t;
+      }
+    }
+    else
+    {
+      // Print out the "I didn't understand that" and quit:
+      qts << "Error: argument \"" << argList.at(i);
+      qts << "\" not supported" << endl;
+      emit controllerDone();
+      return;
+    }
+
+    ++i;
+  }
+
+  if ((pulse == Keyer_Pulse) && simulate)
+  {
+    // A live keyer can't run ahead of its input:
+    qts << "Error: --keyer needs real time; use --fakeleds instead of --simulate" << endl;
+    emit controllerDone();
+    return;
+  }
+
+  if (useGovernor && (pulse != No_Pulse))
+  {
+    // The governor sets a steady level; the other modes set their own:
+    qts << "Error: --governor only works with the steady light, not with other modes" << endl;
+    emit controllerDone();
+    return;
+  }
+
+  if (resume && ((pulse != MorseFromFile_Pulse) || !checkpointInterval))
+  {
+    qts << "Error: --resume needs -mf, with checkpoints on" << endl;
+    emit controllerDone();
+    return;
+  }
+
+  startupTrace->mark("Arguments parsed");
+
+  // So, on to the actual implementation:
+  if (!setupSubsystems()) return;
+
+  startupTrace->mark("Subsystems set up");
+
+  if (dbus && !ignoreCover && dbus->coverCurrentlyClosed())
+  {
+    // Print out the "camera cover closed" message and quit:
+    qts << "Error: camera cover is currently closed" << endl;
+    emit controllerDone();
+    return;
+  }
+
+  if (dbus && !ignoreCover) startupTrace->mark("Cover state received");
+
+  // Set up the timer:
+  if (timeoutDuration)
+  {
+    qint64 microseconds = qint64(timeoutDuration) * 60000000;
+    offTimer->startAt(clock->currentTime() + microseconds);
+  }
+  else if (pulse == Beacon_Pulse)
+  {
+    qint64 microseconds = qint64(beaconDuration) * 60000000;
+    offTimer->startAt(clock->currentTime() + microseconds);
+  }
+
+  // Actually turn on the device:
+  if (pulse == Simple_Pulse)
+  {
+    morse->startE();
+    morseRunning = true;
+  }
+  else if (pulse == SOS_Pulse)
+  {
+    morse->startSOS();
+    morseRunning = true;
+  }
+  else if (pulse == MorseFromStream_Pulse)
+  {
+    // Under virtual time, sendNextLine() reads each line as it's needed:
+    if (!virtualClock) ingest->startWatching();
+
+    sendNextLine();
+  }
+  else if (pulse == MorseFromFile_Pulse)
+  {
+    try
+    {
+      qint64 fileOffset = 0;
+      qint64 unitOffset = 0;
+
+      if (resume)
+      {
+        if (checkpoint && checkpoint->load(fileOffset, unitOffset))
+        {
+          qts << "Resuming from byte " << fileOffset << endl;
+        }
+        else
+        {
+          qts << "Nothing to resume; starting from the beginning" << endl;
+        }
+      }
+
+      morse->startMorseFromFile(filename, fileOffset, unitOffset);
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+    }
+    morseRunning = true;
+  }
+  else if (pulse == DataFromFile_Pulse)
+  {
+    TorDataEncoder encoder(
+      dataUsesNRZ ? NRZ_Coding : Manchester_Coding,
+      dataUsesFEC);
+
+    try
+    {
+      morse->startDataFromFile(filename, encoder);
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+      return;
+    }
+
+    morseRunning = true;
+
+    qts << "Sending " << encoder.getPayloadSize() << " bytes as ";
+    qts << encoder.getUnitCount() << " units: ";
+    qts << QString::number(encoder.getEffectiveBitRate(dotDuration), 'f', 1);
+    qts << " bits per second" << endl;
+  }
+  else if (pulse == Carousel_Pulse)
+  {
+    carousel->setGap(carouselGap);
+    carousel->setRepeats(carouselRepeats);
+    carousel->setCycles(carouselCycles);
+
+    qts << "Carousel of " << carousel->getMessageCount() << " messages in ";
+    qts << carousel->getArenaSize() << " bytes; one rotation takes ";
+    qts << QString::number(
+      carousel->getRotationUnits() * dotDuration / 1000.0, 'f', 1);
+    qts << " seconds" << endl;
+
+    morse->startCarousel(carousel);
+    morseRunning = true;
+  }
+  else if (pulse == Calibrate_Pulse)
+  {
+    calibrator->startCalibration();
+  }
+  else if (pulse == Timeline_Pulse)
+  {
+    try
+    {
+      timeline->loadFile(filename);
+      timeline->startTimeline();
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+      return;
+    }
+  }
+  else if (pulse == Script_Pulse)
+  {
+    try
+    {
+      script->openInput(filename);
+
+      if (virtualClock)
+      {
+        // Nothing can arrive during a simulated run, so take it all now:
+        script->readToEnd();
+        timeline->startTimeline();
+      }
+      else
+      {
+        timeline->startTimeline();
+        script->startWatching();
+      }
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+      return;
+    }
+  }
+  else if (pulse == Beacon_Pulse)
+  {
+    beacon->startBeacon(
+      (color == White_Color) ? Torch_Channel : Indicator_Channel,
+      qint64(beaconDuration) * 60000000,
+      dotDuration);
+  }
+  else if (pulse == Keyer_Pulse)
+  {
+    try
+    {
+      keyer->openInput(keyerInput);
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+      return;
+    }
+  }
+  else if (pulse == Strobe_Pulse)
+  {
+    try
+    {
+      stroboscope->startStrobe(strobeFrequency, strobeDuty);
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+      return;
+    }
+  }
+  else if (pulse == Fade_Pulse)
+  {
+    fader->startFade(
+      (color == White_Color) ? Torch_Channel : Indicator_Channel,
+      fadeFrom,
+      fadeTo,
+      qint64(fadeDuration) * 1000);
+  }
+  else if (pulse == Receive_Pulse)
+  {
+    try
+    {
+      if (filename.startsWith("/sys/"))
+      {
+        lightSensor->startPolling(filename, sampleRate);
+      }
+      else
+      {
+        TorSystemClock wallClock;
+        qint64 startTime = wallClock.currentTime();
+
+        lightSensor->decodeFile(filename);
+
+        qint64 elapsed = wallClock.currentTime() - startTime;
+        unsigned int samples = morseDecoder->getSampleCount();
+
+        QTextStream qts(stderr);
+        qts << endl << "Decoded " << samples << " samples in ";
+        qts << QString::number(elapsed / 1000.0, 'f', 3) << " ms";
+        if (elapsed > 0)
+        {
+          qts << " (" << qint64(samples * 1000000.0 / elapsed);
+          qts << " samples per second)";
+        }
+        qts << endl;
+
+        cleanupAndExit();
+        return;
+      }
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+      return;
+    }
+  }
+  else if (pulse == Replay_Pulse)
+  {
+    try
+    {
+      replayer->startReplay(replayFilename, qint64(replayFrom) * 1000000);
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      cleanupAndExit();
+      return;
+    }
+  }
+  else if (governor)
+  {
+    governor->startGoverning(
+      (color == White_Color) ? Torch_Channel : Indicator_Channel);
+  }
+  else
+  {
+    turnOn();
+  }
+
+  startupTrace->mark("Mode started");
+
+  // Watching the cover can wait until the light is already on:
+  if (dbus)
+  {
+    dbus->watchCover();
+    startupTrace->mark("Cover watch set up");
+  }
+
+  // As can keeping up with other users of the flash, and its faults:
+  if (flashLED)
+  {
+    flashLED->watchControlEvents();
+    startupTrace->mark("Control events set up");
+  }
+
+  if (traceStartup)
+  {
+    QTextStream qts(stderr);
+    startupTrace->writeReport(qts);
+    if (flashLED) flashLED->writeDiscoveryReport(qts);
+  }
+
+  if (virtualClock)
+  {
+    // Play the whole run through right now, then wrap things up:
+    qint64 horizon = SIMULATION_HORIZON;
+    if ((pulse == Beacon_Pulse) && !timeoutDuration)
+    {
+      horizon = qint64(beaconDuration) * 60000000;
+    }
+
+    virtualClock->run(horizon);
+    cleanupAndExit();
+  }
+}
+
+
+void TorController::turnOn()
+{
+  try
+  {
+    if (color == White_Color)
+    {
+      led->turnTorchOn();
+    }
+    else
+    {
+      led->turnIndicatorOn();
     }
   }
   catch (TorException &e)
@@ -368,8 +1589,16 @@ void TorController::turnOff()
 {
   try
   {
-    led.turnTorchOff();
-    led.turnIndicatorOff();
+    // Only the LED that turnOn() lit needs switching off; the latency
+    // estimator times this call, so it must be the edge alone:
+    if (color == White_Color)
+    {
+      led->turnTorchOff();
+    }
+    else
+    {
+      led->turnIndicatorOff();
+    }
   }
   catch (TorException &e)
   {
@@ -382,25 +1611,119 @@ void TorController::turnOff()
 
 void TorController::handleEndOfMorse()
 {
-  if (!morseFromStdin)
+  TOR_TRACE_SPAN("handleEndOfMorse", "controller");
+
+  if (dataDecoder)
+  {
+    QTextStream qts(stdout);
+    QByteArray payload;
+    QString error;
+
+    if (dataDecoder->finish(payload, error))
+    {
+      qts << "Loopback: decoded " << payload.size();
+      qts << " bytes, CRC OK" << endl;
+    }
+    else
+    {
+      qts << "Loopback: " << error << endl;
+    }
+  }
+
+  if (!ingest)
   {
     // We were reading from a file, so just end it here.
     cleanupAndExit();
     return;
   }
 
-  // We need to grab the next chunk of input and parse it:
-  QString nextChunk = inputStream.readLine();
-  if (nextChunk.isNull())
+  ingest->lineSent(currentLine);
+  sendingLine = false;
+
+  sendNextLine();
+}
+
+
+void TorController::sendNextLine()
+{
+  if (sendingLine) return;
+
+  if (virtualClock) ingest->waitForLine();
+
+  if (!ingest->takeLine(currentLine))
   {
-    // No more input.
-    cleanupAndExit();
+    // Either more is on its way, or that was the lot:
+    if (ingest->isFinished()) cleanupAndExit();
     return;
   }
 
-  QTextStream lineStream(&nextChunk);
+  sendingLine = true;
+  morseRunning = true;
+
+  morse->startMorseFromLine(currentLine.text, *wordCache);
+}
+
+
+void TorController::handleFlashFault(
+  QString description)
+{
+  QTextStream qts(stderr);
+  qts << "Flash fault: " << description << endl;
+
+  cleanupAndExit();
+}
+
+
+void TorController::handleEndOfReplay()
+{
+  cleanupAndExit();
+}
+
+
+void TorController::handleEndOfCalibration()
+{
+  QTextStream qts(stdout);
+
+  calibrator->writeReport(qts);
+
+  unsigned int chosen = calibrator->getChosenDuration();
+
+  if (chosen && !simulate)
+  {
+    TorCalibrator::storeDotDuration(chosen);
+    qts << "Stored for use with \"-d auto\"" << endl;
+  }
+
+  cleanupAndExit();
+}
+
+
+void TorController::handleEndOfFade()
+{
+  // A faded-up LED stays lit until the timeout or cover closes it; under
+  // simulation with no timeout, the run ends with the fade:
+  if (!fadeTo || (simulate && !timeoutDuration))
+  {
+    cleanupAndExit();
+  }
+}
 
-  morse.startMorseFromStream(lineStream);
+
+void TorController::handleEndOfTimeline()
+{
+  cleanupAndExit();
+}
+
+
+void TorController::handleInterrupt(
+  int descriptor)
+{
+  // Drain the bytes the SIGINT handler wrote, then shut down as if the run
+  // had ended by itself, so checkpoints and reports get written:
+  char buffer[16];
+  while (read(descriptor, buffer, sizeof(buffer)) > 0);
+
+  cleanupAndExit();
 }
 
 
@@ -409,16 +1732,440 @@ void TorController::cleanupAndExit()
   // Stop any pulsing:
   if (morseRunning)
   {
-    morse.stopRunning();
+    morse->stopRunning();
     morseRunning = false;
   }
 
+  if (replayer) replayer->stopRunning();
+  if (calibrator) calibrator->stopRunning();
+  if (fader) fader->stopRunning();
+  if (timeline) timeline->stopRunning();
+  if (stroboscope) stroboscope->stopRunning();
+
+  if (script)
+  {
+    script->stopRunning();
+
+    QTextStream qts(stderr);
+    script->writeReport(qts);
+  }
+
+  if (ingest && ingest->isRunning())
+  {
+    // Also hands standard input back in blocking mode:
+    ingest->stopRunning();
+
+    QTextStream qts(stderr);
+    ingest->writeReport(qts);
+    wordCache->writeReport(qts);
+  }
+
+  if (keyer)
+  {
+    // Also hands the terminal back in its original state:
+    keyer->stopRunning();
+
+    QTextStream qts(stderr);
+    keyer->writeReport(qts);
+  }
+
+  if (alignment && (beacon || morse))
+  {
+    // The beacon plays its own SOS, so keeps its own alignment record:
+    QTextStream qts(stderr);
+    if (beacon)
+    {
+      beacon->writeAlignmentReport(qts);
+    }
+    else
+    {
+      morse->writeAlignmentReport(qts);
+    }
+    alignment = 0;
+  }
+
+  if (beacon && beacon->isRunning())
+  {
+    beacon->stopRunning();
+
+    QTextStream qts(stderr);
+    beacon->writeReport(qts);
+  }
+
+  if (governor && governor->isRunning())
+  {
+    governor->stopRunning();
+
+    QTextStream qts(stderr);
+    governor->writeReport(qts);
+  }
+
+  if (lightSensor)
+  {
+    lightSensor->stopRunning();
+    morseDecoder->finish();
+    traceStream << endl;
+  }
+
+  if (timingReport)
+  {
+    QTextStream qts(stderr);
+    if (fader)
+    {
+      fader->writeReport(qts);
+    }
+    else if (timeline)
+    {
+      timeline->writeReport(qts);
+    }
+    else if (stroboscope)
+    {
+      stroboscope->writeReport(qts);
+    }
+    else if (morse)
+    {
+      morse->writeTimingReport(qts);
+      if (checkpoint) checkpoint->writeReport(qts);
+    }
+    timingReport = false;
+  }
+
   // Turn off the LEDs:
 //  turnOff();
 
-  offTimer.stop();
+  // One last export, so the file shows how the run ended:
+  if (metricsExporter) metricsExporter->stopRunning();
+
+  if (offTimer) offTimer->stop();
 
   // Do we want to flash after timeout?
   // Otherwise, just exit here.
   emit controllerDone();
 }
+
+
+bool TorController::setupSubsystems()
+{
+  try
+  {
+    if (pulse == Receive_Pulse)
+    {
+      // Receiving needs no LEDs, and doesn't care about the cover:
+      if (simulate)
+      {
+        virtualClock = new TorVirtualClock();
+        clock = virtualClock;
+      }
+      else
+      {
+        clock = new TorSystemClock();
+      }
+    }
+    else if (simulate)
+    {
+      virtualClock = new TorVirtualClock();
+      clock = virtualClock;
+      TorFakeLED *fakeLED = new TorFakeLED(clock, &traceStream);
+      fakeLED->setSimulatedLatency(simulatedLatency);
+      led = fakeLED;
+    }
+    else if (fakeLEDs)
+    {
+      clock = new TorSystemClock();
+      TorFakeLED *fakeLED = new TorFakeLED(clock, &traceStream);
+      fakeLED->setSimulatedLatency(simulatedLatency);
+      led = fakeLED;
+    }
+    else
+    {
+      clock = new TorSystemClock();
+      dbus = new TorDBus();
+
+      // HAL can answer the cover query while the flash device is opened:
+      if (!ignoreCover)
+      {
+        dbus->requestCoverState();
+        startupTrace->mark("Cover query sent");
+      }
+
+      flashLED = new TorFlashLED(!rediscover);
+      led = flashLED;
+      startupTrace->mark("Flash device opened");
+
+      connect(
+        flashLED,
+        SIGNAL(flashFault(QString)),
+        this,
+        SLOT(handleFlashFault(QString)));
+    }
+
+    if (led) led->addEdgeListener(startupTrace);
+
+    if (led && !recordFilename.isEmpty())
+    {
+      recorder = new TorEdgeLogWriter(clock, recordFilename);
+      led->addEdgeListener(recorder);
+    }
+  }
+  catch (TorException &e)
+  {
+    QTextStream qts(stderr);
+    qts << e.getError() << endl;
+    emit controllerDone();
+    return false;
+  }
+
+  offTimer = clock->createTimer();
+  morse = new TorMorse(clock);
+  morse->setDotDuration(dotDuration);
+  morse->setLatencyCompensation(compensateLatency);
+  morse->setAlignment(qint64(alignment) * 1000000);
+
+  // Simulated runs only checkpoint when asked to, so they don't disturb
+  // any real transmission waiting to be resumed:
+  if ( (pulse == MorseFromFile_Pulse)
+    && checkpointInterval
+    && (!simulate || !checkpointPath.isEmpty()))
+  {
+    QString path = checkpointPath;
+    if (path.isEmpty())
+    {
+      path = QDir::homePath() + "/" + CHECKPOINT_FILENAME;
+    }
+
+    checkpoint = new TorCheckpoint(clock, path);
+    checkpoint->setSource(filename);
+    morse->setCheckpoint(checkpoint, qint64(checkpointInterval) * 1000);
+  }
+
+  if (pulse == MorseFromStream_Pulse)
+  {
+    ingest = new TorIngestQueue(clock);
+    ingest->setLimits(ingestLines, ingestBytes);
+    ingest->setPolicy(ingestPolicy, ingestLatest);
+
+    wordCache = new TorWordCache(wordCacheSize);
+
+    connect(
+      ingest,
+      SIGNAL(lineQueued()),
+      this,
+      SLOT(sendNextLine()));
+
+    connect(
+      ingest,
+      SIGNAL(inputEnded()),
+      this,
+      SLOT(sendNextLine()));
+  }
+
+  if (pulse == Receive_Pulse)
+  {
+    morseDecoder = new TorMorseDecoder(&traceStream);
+    lightSensor = new TorLightSensor(clock, morseDecoder);
+  }
+
+  if ((pulse == DataFromFile_Pulse) && dataLoopback)
+  {
+    dataDecoder = new TorDataDecoder(
+      clock,
+      dataUsesNRZ ? NRZ_Coding : Manchester_Coding,
+      dotDuration);
+
+    led->addEdgeListener(dataDecoder);
+  }
+
+  if (pulse == Fade_Pulse)
+  {
+    fader = new TorFader(clock, led);
+    fader->setCurve(fadeCurve);
+    fader->setUpdateRate(fadeUpdateRate);
+
+    connect(
+      fader,
+      SIGNAL(fadeFinished()),
+      this,
+      SLOT(handleEndOfFade()));
+  }
+
+  if ((pulse == Timeline_Pulse) || (pulse == Script_Pulse))
+  {
+    timeline = new TorTimeline(clock, led);
+    timeline->setDotDuration(dotDuration);
+    if (simulate) timeline->simulateSysfsLEDs(&traceStream);
+
+    connect(
+      timeline,
+      SIGNAL(timelineFinished()),
+      this,
+      SLOT(handleEndOfTimeline()));
+  }
+
+  if (pulse == Script_Pulse)
+  {
+    script = new TorTimingScript(
+      timeline,
+      (color == White_Color) ? Torch_Channel : Indicator_Channel);
+
+    connect(
+      script,
+      SIGNAL(scriptFailed()),
+      this,
+      SLOT(cleanupAndExit()));
+  }
+
+  if (pulse == Strobe_Pulse)
+  {
+    stroboscope = new TorStroboscope(clock, led);
+
+    connect(
+      stroboscope,
+      SIGNAL(strobeFailed()),
+      this,
+      SLOT(cleanupAndExit()));
+  }
+
+  if (pulse == Beacon_Pulse)
+  {
+    powerSupply = new TorPowerSupply(powerSupplyRoot);
+    if (!powerSupply->findBattery())
+    {
+      QTextStream qts(stderr);
+      qts << "Warning: no battery found under " << powerSupplyRoot;
+      qts << "; the beacon will run at full rate" << endl;
+    }
+
+    beacon = new TorBeacon(clock, led, powerSupply);
+    beacon->setLatencyCompensation(compensateLatency);
+    beacon->setAlignment(qint64(alignment) * 1000000);
+
+    connect(
+      beacon,
+      SIGNAL(beaconFailed()),
+      this,
+      SLOT(cleanupAndExit()));
+  }
+
+  if (pulse == Keyer_Pulse)
+  {
+    keyer = new TorKeyer(
+      clock,
+      led,
+      (color == White_Color) ? Torch_Channel : Indicator_Channel);
+
+    keyer->setMode(straightKey ? Straight_Keyer : Iambic_Keyer);
+    keyer->setDotDuration(dotDuration);
+
+    connect(
+      keyer,
+      SIGNAL(keyerFinished()),
+      this,
+      SLOT(cleanupAndExit()));
+  }
+
+  if (useGovernor)
+  {
+    governor = new TorThermalGovernor(clock, led);
+    if (!thermalZone.isEmpty()) governor->setThermalZone(thermalZone);
+  }
+
+  if (pulse == Replay_Pulse)
+  {
+    replayer = new TorEdgeReplayer(clock, led);
+
+    connect(
+      replayer,
+      SIGNAL(replayFinished()),
+      this,
+      SLOT(handleEndOfReplay()));
+  }
+
+  // Set up the timer:
+  connect(
+    offTimer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(cleanupAndExit()));
+
+  // Set up for a shutter closed event:
+  if (dbus)
+  {
+    connect(
+      dbus,
+      SIGNAL(userClosedCover()),
+      this,
+      SLOT(cleanupAndExit()));
+  }
+
+  if (pulse == Calibrate_Pulse)
+  {
+    // The calibrator takes over the end of each Morse run:
+    calibrator = new TorCalibrator(morse, errorBudget);
+
+    connect(
+      calibrator,
+      SIGNAL(calibrationFinished()),
+      this,
+      SLOT(handleEndOfCalibration()));
+  }
+  else
+  {
+    // Also, when Morse code has finished:
+    connect(
+      morse,
+      SIGNAL(morseFinished()),
+      this,
+      SLOT(handleEndOfMorse()));
+  }
+
+  // More Morse integration:
+  connect(
+    morse,
+    SIGNAL(turnTorchOn()),
+    this,
+    SLOT(turnOn()));
+
+  connect(
+    morse,
+    SIGNAL(turnTorchOff()),
+    this,
+    SLOT(turnOff()));
+
+  if (!metricsFile.isEmpty() || !metricsSocket.isEmpty())
+  {
+    metrics = new TorCoreMetrics();
+
+    if (led) led->registerMetrics(*metrics);
+    if (dbus) dbus->registerMetrics(*metrics);
+    morse->registerMetrics(*metrics);
+
+    if (ingest) ingest->registerMetrics(*metrics);
+    if (wordCache) wordCache->registerMetrics(*metrics);
+
+    metricsExporter = new TorMetricsExporter(clock, metrics);
+
+    try
+    {
+      if (!metricsFile.isEmpty())
+      {
+        metricsExporter->exportToFile(
+          metricsFile,
+          qint64(metricsInterval) * 1000000);
+      }
+
+      if (!metricsSocket.isEmpty())
+      {
+        metricsExporter->listenOnSocket(metricsSocket);
+      }
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      emit controllerDone();
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -23,12 +23,39 @@
 #ifndef TORCONTROLLER_H
 #define TORCONTROLLER_H
 
-#include "torflashled.h"
-#include "tordbus.h"
-#include "tormorse.h"
 #include <QObject>
 #include <QStringList>
-#include <QTimer>
+#include <QTextStream>
+
+#include "torfader.h"
+#include "torcoremetrics.h"
+#include "toringestqueue.h"
+
+class TorClock;
+class TorVirtualClock;
+class TorTimer;
+class TorLEDBackend;
+class TorFlashLED;
+class TorDBus;
+class TorMorse;
+class TorEdgeLogWriter;
+class TorEdgeReplayer;
+class TorCalibrator;
+class TorDataDecoder;
+class TorMorseDecoder;
+class TorLightSensor;
+class TorTimeline;
+class TorStroboscope;
+class TorThermalGovernor;
+class TorPowerSupply;
+class TorBeacon;
+class TorKeyer;
+class TorTimingScript;
+class TorCheckpoint;
+class TorStartupTrace;
+class TorMetricsExporter;
+class TorCarousel;
+class TorWordCache;
 
 enum TorPulseType
 {
@@ -36,7 +63,18 @@ enum TorPulseType
   Simple_Pulse,
   SOS_Pulse,
   MorseFromStream_Pulse,
-  MorseFromFile_Pulse
+  MorseFromFile_Pulse,
+  Replay_Pulse,
+  Calibrate_Pulse,
+  DataFromFile_Pulse,
+  Receive_Pulse,
+  Fade_Pulse,
+  Timeline_Pulse,
+  Strobe_Pulse,
+  Beacon_Pulse,
+  Keyer_Pulse,
+  Script_Pulse,
+  Carousel_Pulse
 };
 
 
@@ -53,7 +91,8 @@ class TorController: public QObject
 
 public:
   TorController(
-    QStringList args);
+    QStringList args,
+    TorStartupTrace *startupTrace);
 
   ~TorController();
 
@@ -66,11 +105,23 @@ public slots:
   void turnOn();
   void turnOff();
 
+  void handleInterrupt(
+    int descriptor);
+
 private slots:
+  void sendNextLine();
   void handleEndOfMorse();
+  void handleFlashFault(
+    QString description);
+  void handleEndOfReplay();
+  void handleEndOfCalibration();
+  void handleEndOfFade();
+  void handleEndOfTimeline();
   void cleanupAndExit();
 
 private:
+  bool setupSubsystems();
+
   TorPulseType pulse;
   TorColorType color;
   bool ignoreCover;
@@ -78,14 +129,86 @@ private:
   QStringList argList;
   bool morseRunning;
   bool morseFromStdin;
+  bool simulate;
+  bool fakeLEDs;
+  unsigned int alignment;
+  int simulatedLatency;
+  bool compensateLatency;
+  bool timingReport;
+  unsigned int dotDuration;
+  unsigned int errorBudget;
+  bool dataUsesNRZ;
+  bool dataUsesFEC;
+  bool dataLoopback;
+  unsigned int sampleRate;
+  unsigned int fadeDuration;
+  unsigned int fadeFrom;
+  unsigned int fadeTo;
+  TorFadeCurve fadeCurve;
+  unsigned int fadeUpdateRate;
+  double strobeFrequency;
+  unsigned int strobeDuty;
+  bool useGovernor;
+  unsigned int beaconDuration;
+  bool straightKey;
+  bool resume;
+  bool traceStartup;
+  bool rediscover;
+  unsigned int checkpointInterval;
+  unsigned int metricsInterval;
+  unsigned int carouselGap;
+  unsigned int carouselRepeats;
+  unsigned int carouselCycles;
+  TorIngestPolicy ingestPolicy;
+  int ingestLines;
+  int ingestBytes;
+  int ingestLatest;
+  int wordCacheSize;
+  bool sendingLine;
+  TorIngestLine currentLine;
 
   QString filename;
-  QTextStream inputStream;
-  QTimer offTimer;
-
-  TorFlashLED led;
-  TorDBus dbus;
-  TorMorse morse;
+  QString recordFilename;
+  QString replayFilename;
+  QString thermalZone;
+  QString powerSupplyRoot;
+  QString keyerInput;
+  QString checkpointPath;
+  QString metricsFile;
+  QString metricsSocket;
+  QString traceFile;
+  int replayFrom;
+  QTextStream traceStream;
+
+  TorClock *clock;
+  TorVirtualClock *virtualClock;
+  TorTimer *offTimer;
+
+  TorLEDBackend *led;
+  TorFlashLED *flashLED;
+  TorDBus *dbus;
+  TorMorse *morse;
+  TorEdgeLogWriter *recorder;
+  TorEdgeReplayer *replayer;
+  TorCalibrator *calibrator;
+  TorDataDecoder *dataDecoder;
+  TorMorseDecoder *morseDecoder;
+  TorLightSensor *lightSensor;
+  TorFader *fader;
+  TorTimeline *timeline;
+  TorStroboscope *stroboscope;
+  TorThermalGovernor *governor;
+  TorPowerSupply *powerSupply;
+  TorBeacon *beacon;
+  TorKeyer *keyer;
+  TorTimingScript *script;
+  TorCheckpoint *checkpoint;
+  TorCoreMetrics *metrics;
+  TorMetricsExporter *metricsExporter;
+  TorStartupTrace *startupTrace;
+  TorCarousel *carousel;
+  TorIngestQueue *ingest;
+  TorWordCache *wordCache;
 };
 
 #endif // TORCONTROLLER_H
@@ -0,0 +1,398 @@
+//
+// tordatalink.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "tordatalink.h"
+#include "torclock.h"
+
+#define DATALINK_PREAMBLE 0xAA
+#define DATALINK_SYNC 0x7E
+#define DATALINK_SYNC_FEC 0x7D
+
+// Off units added after the frame, so the last pulse has a clean end:
+#define DATALINK_TRAILER_UNITS 3
+
+
+quint32 torCRC32(
+  const QByteArray &data)
+{
+  static quint32 table[256];
+  static bool tableReady = false;
+
+  if (!tableReady)
+  {
+    for (quint32 i = 0; i < 256; ++i)
+    {
+      quint32 c = i;
+      for (int k = 0; k < 8; ++k)
+      {
+        c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+      }
+      table[i] = c;
+    }
+
+    tableReady = true;
+  }
+
+  quint32 crc = 0xFFFFFFFF;
+  int index = 0;
+
+  while (index < data.size())
+  {
+    crc = table[(crc ^ (unsigned char)data.at(index)) & 0xFF] ^ (crc >> 8);
+    ++index;
+  }
+
+  return crc ^ 0xFFFFFFFF;
+}
+
+
+// Hamming(7,4): codeword bits, from first sent to last, are
+// p1 p2 d1 p3 d2 d3 d4, where d1 is the high bit of the nibble.
+static unsigned char hammingEncode(
+  unsigned char nibble)
+{
+  bool d1 = nibble & 0x8;
+  bool d2 = nibble & 0x4;
+  bool d3 = nibble & 0x2;
+  bool d4 = nibble & 0x1;
+
+  bool p1 = d1 ^ d2 ^ d4;
+  bool p2 = d1 ^ d3 ^ d4;
+  bool p3 = d2 ^ d3 ^ d4;
+
+  return (p1 << 6) | (p2 << 5) | (d1 << 4) | (p3 << 3)
+    | (d2 << 2) | (d3 << 1) | d4;
+}
+
+
+static unsigned char hammingDecode(
+  unsigned char codeword)
+{
+  // Bit n of "c" (1-based, as in the classic layout) is codeword position n:
+  bool c[8];
+  for (int n = 1; n <= 7; ++n)
+  {
+    c[n] = codeword & (1 << (7 - n));
+  }
+
+  int syndrome =
+    (c[1] ^ c[3] ^ c[5] ^ c[7])
+    | ((c[2] ^ c[3] ^ c[6] ^ c[7]) << 1)
+    | ((c[4] ^ c[5] ^ c[6] ^ c[7]) << 2);
+
+  // A non-zero syndrome names the flipped position:
+  if (syndrome) c[syndrome] = !c[syndrome];
+
+  return (c[3] << 3) | (c[5] << 2) | (c[6] << 1) | c[7];
+}
+
+
+TorDataEncoder::TorDataEncoder(
+  TorLineCoding lc,
+  bool fec)
+  : coding(lc),
+    useFEC(fec),
+    payloadSize(0),
+    unitCount(0)
+{
+}
+
+
+void TorDataEncoder::encode(
+  const QByteArray &payload,
+  TorBoolList &units)
+{
+  units.clear();
+
+  pushByte(units, DATALINK_PREAMBLE, false);
+  pushByte(units, DATALINK_PREAMBLE, false);
+
+  if (useFEC)
+  {
+    pushByte(units, DATALINK_SYNC_FEC, false);
+  }
+  else
+  {
+    pushByte(units, DATALINK_SYNC, false);
+  }
+
+  pushByte(units, (payload.size() >> 8) & 0xFF, useFEC);
+  pushByte(units, payload.size() & 0xFF, useFEC);
+
+  int index = 0;
+  while (index < payload.size())
+  {
+    pushByte(units, payload.at(index), useFEC);
+    ++index;
+  }
+
+  quint32 crc = torCRC32(payload);
+
+  pushByte(units, (crc >> 24) & 0xFF, useFEC);
+  pushByte(units, (crc >> 16) & 0xFF, useFEC);
+  pushByte(units, (crc >> 8) & 0xFF, useFEC);
+  pushByte(units, crc & 0xFF, useFEC);
+
+  for (int i = 0; i < DATALINK_TRAILER_UNITS; ++i)
+  {
+    units.push_back(false);
+  }
+
+  payloadSize = payload.size();
+  unitCount = units.size();
+}
+
+
+double TorDataEncoder::getEffectiveBitRate(
+  unsigned int dotDuration)
+{
+  if (!unitCount || !dotDuration) return 0.0;
+
+  double seconds = (double(unitCount) * dotDuration) / 1000.0;
+
+  return (payloadSize * 8) / seconds;
+}
+
+
+unsigned int TorDataEncoder::getPayloadSize()
+{
+  return payloadSize;
+}
+
+
+unsigned int TorDataEncoder::getUnitCount()
+{
+  return unitCount;
+}
+
+
+void TorDataEncoder::pushByte(
+  TorBoolList &units,
+  unsigned char byte,
+  bool protect)
+{
+  if (protect)
+  {
+    unsigned char high = hammingEncode(byte >> 4);
+    unsigned char low = hammingEncode(byte & 0x0F);
+
+    for (int bit = 6; bit >= 0; --bit) pushBit(units, high & (1 << bit));
+    for (int bit = 6; bit >= 0; --bit) pushBit(units, low & (1 << bit));
+  }
+  else
+  {
+    for (int bit = 7; bit >= 0; --bit) pushBit(units, byte & (1 << bit));
+  }
+}
+
+
+void TorDataEncoder::pushBit(
+  TorBoolList &units,
+  bool bit)
+{
+  if (coding == Manchester_Coding)
+  {
+    units.push_back(bit);
+    units.push_back(!bit);
+  }
+  else
+  {
+    units.push_back(bit);
+  }
+}
+
+
+TorDataDecoder::TorDataDecoder(
+  TorClock *c,
+  TorLineCoding lc,
+  unsigned int dd)
+  : clock(c),
+    coding(lc),
+    dotDuration(dd),
+    started(false),
+    lastLevel(false),
+    lastEdgeTime(0)
+{
+}
+
+
+void TorDataDecoder::edgeEmitted(
+  TorLEDChannel channel,
+  int intensity)
+{
+  Q_UNUSED(channel);
+
+  bool level = (intensity > 0);
+  qint64 now = clock->currentTime();
+
+  if (!started)
+  {
+    // The frame starts at the first time the light comes on:
+    if (!level) return;
+
+    started = true;
+  }
+  else
+  {
+    qint64 unitLength = qint64(dotDuration) * 1000;
+    qint64 count = (now - lastEdgeTime + (unitLength / 2)) / unitLength;
+
+    while (count > 0)
+    {
+      units.push_back(lastLevel);
+      --count;
+    }
+  }
+
+  lastLevel = level;
+  lastEdgeTime = now;
+}
+
+
+bool TorDataDecoder::finish(
+  QByteArray &payload,
+  QString &error)
+{
+  return decodeUnits(units, coding, payload, error);
+}
+
+
+// Walks through a unit timeline, handing back one bit at a time.  Anything
+// past the end of the timeline reads as zero, since trailing zero bits
+// never produce an edge to mark where they stop.
+class TorBitReader
+{
+public:
+  TorBitReader(
+    const TorBoolList &u,
+    TorLineCoding lc)
+    : units(u),
+      position(u.begin()),
+      coding(lc)
+  {}
+
+  bool readBit()
+  {
+    bool first = nextUnit();
+
+    if (coding == NRZ_Coding) return first;
+
+    // For Manchester, the second half should be the inverse of the first;
+    // if not, the first half is the best guess available.
+    nextUnit();
+    return first;
+  }
+
+  unsigned char readByte(
+    bool protect)
+  {
+    if (protect)
+    {
+      unsigned char high = 0;
+      unsigned char low = 0;
+
+      for (int i = 0; i < 7; ++i) high = (high << 1) | readBit();
+      for (int i = 0; i < 7; ++i) low = (low << 1) | readBit();
+
+      return (hammingDecode(high) << 4) | hammingDecode(low);
+    }
+
+    unsigned char byte = 0;
+    for (int i = 0; i < 8; ++i) byte = (byte << 1) | readBit();
+
+    return byte;
+  }
+
+private:
+  bool nextUnit()
+  {
+    if (position == units.end()) return false;
+
+    bool unit = *position;
+    ++position;
+    return unit;
+  }
+
+  const TorBoolList &units;
+  TorBoolList::const_iterator position;
+  TorLineCoding coding;
+};
+
+
+bool TorDataDecoder::decodeUnits(
+  const TorBoolList &units,
+  TorLineCoding coding,
+  QByteArray &payload,
+  QString &error)
+{
+  TorBitReader reader(units, coding);
+
+  if ( (reader.readByte(false) != DATALINK_PREAMBLE)
+    || (reader.readByte(false) != DATALINK_PREAMBLE))
+  {
+    error = "Frame preamble not found";
+    return false;
+  }
+
+  bool protect;
+  unsigned char sync = reader.readByte(false);
+
+  if (sync == DATALINK_SYNC)
+  {
+    protect = false;
+  }
+  else if (sync == DATALINK_SYNC_FEC)
+  {
+    protect = true;
+  }
+  else
+  {
+    error = "Frame sync byte not found";
+    return false;
+  }
+
+  unsigned int length = reader.readByte(protect) << 8;
+  length |= reader.readByte(protect);
+
+  payload.clear();
+  payload.reserve(length);
+
+  for (unsigned int i = 0; i < length; ++i)
+  {
+    payload.append(reader.readByte(protect));
+  }
+
+  quint32 crc = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    crc = (crc << 8) | reader.readByte(protect);
+  }
+
+  if (crc != torCRC32(payload))
+  {
+    error = "Frame CRC mismatch";
+    return false;
+  }
+
+  return true;
+}
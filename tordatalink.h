@@ -0,0 +1,137 @@
+//
+// tordatalink.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORDATALINK_H
+#define TORDATALINK_H
+
+#include "torledbackend.h"
+#include "tormorse.h"
+
+#include <QByteArray>
+#include <QString>
+
+class TorClock;
+
+// A simple optical data link, for pushing small binary payloads out to a
+// light sensor.  Each frame is sent as:
+//
+//   preamble: 0xAA 0xAA (a run of alternating bits, to settle a receiver)
+//   sync:     0x7E, or 0x7D if the rest of the frame is FEC-protected
+//   length:   payload length in bytes, 16 bits big-endian
+//   payload
+//   CRC32:    the standard (IEEE 802.3) CRC of the payload, big-endian
+//
+// Bits go out most significant first.  With forward error correction,
+// every byte after the sync is sent as two Hamming(7,4) codewords, which
+// corrects any single flipped bit in each half-byte.
+//
+// The line coding turns bits into timeline units (one dot duration each):
+// NRZ sends each bit as one unit (on for 1, off for 0); Manchester sends
+// each bit as two units (on-off for 1, off-on for 0), so the light always
+// changes mid-bit and long runs can't confuse a receiver.
+
+enum TorLineCoding
+{
+  Manchester_Coding,
+  NRZ_Coding
+};
+
+
+class TorDataEncoder
+{
+public:
+  TorDataEncoder(
+    TorLineCoding coding,
+    bool useFEC);
+
+  void encode(
+    const QByteArray &payload,
+    TorBoolList &units);
+
+  // Payload bits per second for the most recent encode:
+  double getEffectiveBitRate(
+    unsigned int dotDuration);
+
+  unsigned int getPayloadSize();
+  unsigned int getUnitCount();
+
+private:
+  void pushByte(
+    TorBoolList &units,
+    unsigned char byte,
+    bool protect);
+
+  void pushBit(
+    TorBoolList &units,
+    bool bit);
+
+  TorLineCoding coding;
+  bool useFEC;
+
+  unsigned int payloadSize;
+  unsigned int unitCount;
+};
+
+
+// The receiving side, for loopback testing: fed the LED edges as they
+// happen, it rebuilds the unit timeline and decodes the frame from it.
+class TorDataDecoder: public TorEdgeListener
+{
+public:
+  TorDataDecoder(
+    TorClock *clock,
+    TorLineCoding coding,
+    unsigned int dotDuration);
+
+  void edgeEmitted(
+    TorLEDChannel channel,
+    int intensity);
+
+  // Decode whatever has been received.  Returns false (with a reason in
+  // error) if no valid frame was found.
+  bool finish(
+    QByteArray &payload,
+    QString &error);
+
+  static bool decodeUnits(
+    const TorBoolList &units,
+    TorLineCoding coding,
+    QByteArray &payload,
+    QString &error);
+
+private:
+  TorClock *clock;
+  TorLineCoding coding;
+  unsigned int dotDuration;
+
+  TorBoolList units;
+  bool started;
+  bool lastLevel;
+  qint64 lastEdgeTime;
+};
+
+
+quint32 torCRC32(
+  const QByteArray &data);
+
+#endif // TORDATALINK_H
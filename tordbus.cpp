@@ -21,8 +21,11 @@
 //
 
 #include "tordbus.h"
+#include "torcoretrace.h"
 
-#include <QDBusInterface>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCall>
 #include <QDBusMetaType>
 
 #include <iostream>
@@ -50,45 +53,99 @@ const QDBusArgument & operator>>(
 }
 
 
+#define HAL_SERVICE "org.freedesktop.Hal"
+#define HAL_DEVICE_INTERFACE "org.freedesktop.Hal.Device"
+#define CAMERA_SHUTTER_PATH "/org/freedesktop/Hal/devices/platform_cam_shutter"
+
+// A plain method call, rather than a QDBusInterface, saves a blocking
+// round trip to introspect the shutter object:
+static QDBusMessage coverStateMessage()
+{
+  QDBusMessage message = QDBusMessage::createMethodCall(
+    HAL_SERVICE,
+    CAMERA_SHUTTER_PATH,
+    HAL_DEVICE_INTERFACE,
+    "GetProperty");
+
+  message << QString("button.state.value");
+
+  return message;
+}
+
+
+static bool coverClosedInReply(
+  const QDBusMessage &reply)
+{
+  if ( (reply.type() != QDBusMessage::ReplyMessage)
+    || reply.arguments().isEmpty())
+  {
+    // No answer from HAL; don't let that keep the light off:
+    return false;
+  }
+
+  return reply.arguments().at(0).toBool();
+}
+
+
 // Now, on to the actual TorDBus methods:
 
 TorDBus::TorDBus()
-  : halCameraShutter(0)
+  : coverQuery(0),
+    coverEvents(0),
+    coverClosures(0)
 {
-  // Set up the camera shutter interface:
-  halCameraShutter = new QDBusInterface(
-    "org.freedesktop.Hal",
-    "/org/freedesktop/Hal/devices/platform_cam_shutter",
-    "org.freedesktop.Hal.Device",
-    QDBusConnection::systemBus());
+}
 
-  // Some annoying QT DBus metatypes:
-  qDBusRegisterMetaType<DBusProperty>();
-  qDBusRegisterMetaType<QList<DBusProperty> >();
 
-  // Connect any camera cover updates to our cover slot:
-  QDBusConnection::systemBus().connect(
-    "",
-    "/org/freedesktop/Hal/devices/platform_cam_shutter",
-    "org.freedesktop.Hal.Device",
-    "PropertyModified",
-    this,
-    SLOT(cameraCoverPropertyModified(int, QList<DBusProperty>)));
+TorDBus::~TorDBus()
+{
+  if (coverQuery) delete coverQuery;
 }
 
 
-TorDBus::~TorDBus()
+void TorDBus::requestCoverState()
 {
-  if (halCameraShutter) delete halCameraShutter;
+  if (coverQuery) return;
+
+  TOR_TRACE_SPAN("requestCoverState", "dbus");
+
+  coverQuery = new QDBusPendingCall(
+    QDBusConnection::systemBus().asyncCall(coverStateMessage()));
 }
 
 
 bool TorDBus::coverCurrentlyClosed()
 {
-  QDBusMessage message =
-    halCameraShutter->call("GetProperty", "button.state.value");
+  requestCoverState();
+
+  TOR_TRACE_SPAN("coverCurrentlyClosed", "dbus");
+
+  coverQuery->waitForFinished();
+  bool closed = coverClosedInReply(coverQuery->reply());
 
-  return message.arguments().at(0).toBool();
+  delete coverQuery;
+  coverQuery = 0;
+
+  return closed;
+}
+
+
+void TorDBus::watchCover()
+{
+  TOR_TRACE_SPAN("watchCover", "dbus");
+
+  // Some annoying QT DBus metatypes:
+  qDBusRegisterMetaType<DBusProperty>();
+  qDBusRegisterMetaType<QList<DBusProperty> >();
+
+  // Connect any camera cover updates to our cover slot:
+  QDBusConnection::systemBus().connect(
+    "",
+    CAMERA_SHUTTER_PATH,
+    HAL_DEVICE_INTERFACE,
+    "PropertyModified",
+    this,
+    SLOT(cameraCoverPropertyModified(int, QList<DBusProperty>)));
 }
 
 
@@ -99,14 +156,33 @@ void TorDBus::cameraCoverPropertyModified(
   Q_UNUSED(count);
   Q_UNUSED(properties);
 
-  QDBusMessage message =
-    halCameraShutter->call("GetProperty", "button.state.value");
+  ++coverEvents;
+
+  TOR_TRACE_SPAN("cameraCoverPropertyModified", "dbus");
 
-  // Should check for errors here!
+  QDBusMessage reply =
+    QDBusConnection::systemBus().call(coverStateMessage());
 
-  if (message.arguments().at(0).toBool())
+  if (coverClosedInReply(reply))
   {
+    ++coverClosures;
     emit userClosedCover();
   }
 }
 
+
+void TorDBus::registerMetrics(
+  TorCoreMetrics &metrics)
+{
+  metrics.addCounter(
+    "torchio_cover_events_total",
+    "",
+    "Camera cover changes reported by HAL.",
+    &coverEvents);
+
+  metrics.addCounter(
+    "torchio_cover_closures_total",
+    "",
+    "Camera cover changes that left it closed.",
+    &coverClosures);
+}
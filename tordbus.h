@@ -28,7 +28,9 @@
 #include <QMetaType>
 #include <QList>
 
-class QDBusInterface;
+#include "torcoremetrics.h"
+
+class QDBusPendingCall;
 
 // Some annoying nowhere-documented types for use with DBus:
 struct DBusProperty
@@ -41,6 +43,9 @@ Q_DECLARE_METATYPE(DBusProperty)
 Q_DECLARE_METATYPE(QList<DBusProperty>)
 
 
+// Talks to HAL about the camera cover.  Nothing is done on construction;
+// the cover query is sent without waiting for its reply, so that other
+// setup can go on while HAL answers.
 class TorDBus: public QObject
 {
   Q_OBJECT
@@ -49,8 +54,20 @@ public:
   TorDBus();
   ~TorDBus();
 
+  // Ask for the cover state now, and collect it later:
+  void requestCoverState();
+
+  // Waits for the answer to requestCoverState() (sending it first, if
+  // need be):
   bool coverCurrentlyClosed();
 
+  // Start reporting the cover being closed, through userClosedCover():
+  void watchCover();
+
+  // Cover events seen, and how many of them were closures:
+  void registerMetrics(
+    TorCoreMetrics &metrics);
+
 signals:
   void userClosedCover();
 
@@ -60,7 +77,10 @@ public slots:
     QList<DBusProperty> properties);
 
 private:
-  QDBusInterface *halCameraShutter;
+  QDBusPendingCall *coverQuery;
+
+  TorCoreCounter coverEvents;
+  TorCoreCounter coverClosures;
 };
 
 #endif // TORDBUS_H
@@ -0,0 +1,324 @@
+//
+// toredgelog.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "toredgelog.h"
+#include "torclock.h"
+#include "torexception.h"
+
+#include <string.h>
+
+#define TOR_EDGELOG_MAGIC "TORLOG1\n"
+#define TOR_EDGEIDX_MAGIC "TORIDX1\n"
+#define TOR_MAGIC_SIZE 8
+#define TOR_EDGEIDX_ENTRY_SIZE 16
+
+
+static void encodeLittleEndian64(
+  quint64 value,
+  unsigned char *bytes)
+{
+  for (int i = 0; i < 8; ++i)
+  {
+    bytes[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+
+static quint64 decodeLittleEndian64(
+  const unsigned char *bytes)
+{
+  quint64 value = 0;
+
+  for (int i = 7; i >= 0; --i)
+  {
+    value = (value << 8) | bytes[i];
+  }
+
+  return value;
+}
+
+
+TorEdgeLogWriter::TorEdgeLogWriter(
+  TorClock *c,
+  QString filename)
+  : clock(c),
+    startTime(0),
+    lastTime(0),
+    edgeCount(0),
+    logFile(filename),
+    indexFile(filename + ".idx"),
+    bufferUsed(0),
+    bufferOffset(TOR_MAGIC_SIZE)
+{
+  if (!logFile.open(QFile::WriteOnly | QFile::Truncate))
+  {
+    QString errString = "Unable to create edge log ";
+    errString += filename;
+    throw TorException(errString);
+  }
+
+  if (!indexFile.open(QFile::WriteOnly | QFile::Truncate))
+  {
+    QString errString = "Unable to create edge log index ";
+    errString += indexFile.fileName();
+    throw TorException(errString);
+  }
+
+  logFile.write(TOR_EDGELOG_MAGIC, TOR_MAGIC_SIZE);
+  indexFile.write(TOR_EDGEIDX_MAGIC, TOR_MAGIC_SIZE);
+
+  startTime = clock->currentTime();
+}
+
+
+TorEdgeLogWriter::~TorEdgeLogWriter()
+{
+  flush();
+}
+
+
+void TorEdgeLogWriter::edgeEmitted(
+  TorLEDChannel channel,
+  int intensity)
+{
+  qint64 now = clock->currentTime() - startTime;
+
+  // Make sure a whole record always fits (three varints of at most ten
+  // bytes each):
+  if (bufferUsed + 30 > TOR_EDGELOG_BUFFER_SIZE) flush();
+
+  if ((edgeCount % TOR_EDGELOG_INDEX_STRIDE) == 0)
+  {
+    writeIndexEntry(lastTime, bufferOffset + bufferUsed);
+  }
+
+  appendVarint(now - lastTime);
+  appendVarint(channel);
+  appendVarint(intensity);
+
+  lastTime = now;
+  ++edgeCount;
+}
+
+
+void TorEdgeLogWriter::flush()
+{
+  if (bufferUsed)
+  {
+    logFile.write(buffer, bufferUsed);
+    bufferOffset += bufferUsed;
+    bufferUsed = 0;
+  }
+
+  logFile.flush();
+  indexFile.flush();
+}
+
+
+void TorEdgeLogWriter::appendVarint(
+  quint64 value)
+{
+  while (value >= 0x80)
+  {
+    buffer[bufferUsed++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+
+  buffer[bufferUsed++] = value;
+}
+
+
+void TorEdgeLogWriter::writeIndexEntry(
+  quint64 baseTime,
+  quint64 offset)
+{
+  unsigned char entry[TOR_EDGEIDX_ENTRY_SIZE];
+
+  encodeLittleEndian64(baseTime, entry);
+  encodeLittleEndian64(offset, entry + 8);
+
+  indexFile.write((const char *)entry, TOR_EDGEIDX_ENTRY_SIZE);
+}
+
+
+TorEdgeLogReader::TorEdgeLogReader(
+  QString filename)
+  : logFile(filename),
+    indexFilename(filename + ".idx"),
+    bufferPos(0),
+    bufferEnd(0),
+    lastTime(0)
+{
+  if (!logFile.open(QFile::ReadOnly))
+  {
+    QString errString = "Unable to open edge log ";
+    errString += filename;
+    throw TorException(errString);
+  }
+
+  char magic[TOR_MAGIC_SIZE];
+
+  if ( (logFile.read(magic, TOR_MAGIC_SIZE) != TOR_MAGIC_SIZE)
+    || memcmp(magic, TOR_EDGELOG_MAGIC, TOR_MAGIC_SIZE))
+  {
+    QString errString = filename;
+    errString += " is not a Torchio edge log";
+    throw TorException(errString);
+  }
+}
+
+
+TorEdgeLogReader::~TorEdgeLogReader()
+{
+}
+
+
+bool TorEdgeLogReader::nextEdge(
+  TorEdge &edge)
+{
+  quint64 delta;
+  quint64 channel;
+  quint64 intensity;
+
+  if ( !readVarint(delta)
+    || !readVarint(channel)
+    || !readVarint(intensity))
+  {
+    return false;
+  }
+
+  lastTime += delta;
+
+  edge.time = lastTime;
+  edge.channel = channel;
+  edge.intensity = intensity;
+
+  return true;
+}
+
+
+bool TorEdgeLogReader::seekToTime(
+  qint64 time,
+  TorEdge &edge)
+{
+  QFile indexFile(indexFilename);
+
+  if (indexFile.open(QFile::ReadOnly)
+    && (indexFile.size() > TOR_MAGIC_SIZE))
+  {
+    qint64 entryCount =
+      (indexFile.size() - TOR_MAGIC_SIZE) / TOR_EDGEIDX_ENTRY_SIZE;
+
+    const unsigned char *entries =
+      indexFile.map(TOR_MAGIC_SIZE, entryCount * TOR_EDGEIDX_ENTRY_SIZE);
+
+    if (entries)
+    {
+      // Find the last entry whose base time lies before the target:
+      qint64 low = 0;
+      qint64 high = entryCount;
+
+      while (high - low > 1)
+      {
+        qint64 middle = (low + high) / 2;
+
+        if (qint64(decodeLittleEndian64(
+              entries + middle * TOR_EDGEIDX_ENTRY_SIZE)) < time)
+        {
+          low = middle;
+        }
+        else
+        {
+          high = middle;
+        }
+      }
+
+      const unsigned char *entry = entries + low * TOR_EDGEIDX_ENTRY_SIZE;
+
+      seekToOffset(
+        decodeLittleEndian64(entry + 8),
+        decodeLittleEndian64(entry));
+
+      indexFile.unmap((uchar *)entries);
+    }
+  }
+
+  // Without an index, this just becomes a linear scan:
+  while (nextEdge(edge))
+  {
+    if (edge.time >= time) return true;
+  }
+
+  return false;
+}
+
+
+bool TorEdgeLogReader::readByte(
+  unsigned char &byte)
+{
+  if (bufferPos == bufferEnd)
+  {
+    qint64 count = logFile.read(buffer, TOR_EDGELOG_BUFFER_SIZE);
+
+    if (count <= 0) return false;
+
+    bufferPos = 0;
+    bufferEnd = count;
+  }
+
+  byte = buffer[bufferPos++];
+
+  return true;
+}
+
+
+bool TorEdgeLogReader::readVarint(
+  quint64 &value)
+{
+  unsigned char byte;
+  unsigned int shift = 0;
+
+  value = 0;
+
+  do
+  {
+    if (!readByte(byte) || (shift > 63)) return false;
+
+    value |= quint64(byte & 0x7F) << shift;
+    shift += 7;
+  }
+  while (byte & 0x80);
+
+  return true;
+}
+
+
+void TorEdgeLogReader::seekToOffset(
+  qint64 offset,
+  qint64 baseTime)
+{
+  logFile.seek(offset);
+  bufferPos = 0;
+  bufferEnd = 0;
+  lastTime = baseTime;
+}
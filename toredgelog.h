@@ -0,0 +1,141 @@
+//
+// toredgelog.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TOREDGELOG_H
+#define TOREDGELOG_H
+
+#include "torledbackend.h"
+
+#include <QString>
+#include <QFile>
+
+class TorClock;
+
+// The edge log is a compact binary record of every LED change:
+//
+//   header:  the 8 bytes "TORLOG1\n"
+//   records: varint(microseconds since previous edge)
+//            varint(channel)
+//            varint(intensity)
+//
+// Varints are unsigned LEB128 (7 bits per byte, low bits first, high bit
+// set on all but the last byte), so a typical edge takes 3 to 5 bytes.
+//
+// Every TOR_EDGELOG_INDEX_STRIDE edges, an entry is added to a companion
+// index file (the log's name plus ".idx"):
+//
+//   header:  the 8 bytes "TORIDX1\n"
+//   entries: 64-bit little-endian time of the preceding edge,
+//            64-bit little-endian file offset of the record
+//
+// The fixed-size entries can be mapped and binary-searched in place, so
+// any point in a log can be found without reading what comes before it.
+
+#define TOR_EDGELOG_BUFFER_SIZE 4096
+#define TOR_EDGELOG_INDEX_STRIDE 256
+
+struct TorEdge
+{
+  qint64 time; // microseconds since the start of the log
+  int channel;
+  int intensity;
+};
+
+
+class TorEdgeLogWriter: public TorEdgeListener
+{
+public:
+  TorEdgeLogWriter(
+    TorClock *clock,
+    QString filename);
+
+  ~TorEdgeLogWriter();
+
+  void edgeEmitted(
+    TorLEDChannel channel,
+    int intensity);
+
+  void flush();
+
+private:
+  void appendVarint(
+    quint64 value);
+
+  void writeIndexEntry(
+    quint64 baseTime,
+    quint64 offset);
+
+  TorClock *clock;
+  qint64 startTime;
+  qint64 lastTime;
+  quint64 edgeCount;
+
+  QFile logFile;
+  QFile indexFile;
+
+  char buffer[TOR_EDGELOG_BUFFER_SIZE];
+  unsigned int bufferUsed;
+  qint64 bufferOffset;
+};
+
+
+// Reads a log back one edge at a time through a fixed-size buffer, so
+// memory use doesn't depend on the length of the log:
+class TorEdgeLogReader
+{
+public:
+  TorEdgeLogReader(
+    QString filename);
+
+  ~TorEdgeLogReader();
+
+  bool nextEdge(
+    TorEdge &edge);
+
+  // Position the reader so that the next edge returned is the first one
+  // at or after the given time.  Returns false if there is no such edge.
+  bool seekToTime(
+    qint64 time,
+    TorEdge &edge);
+
+private:
+  bool readByte(
+    unsigned char &byte);
+
+  bool readVarint(
+    quint64 &value);
+
+  void seekToOffset(
+    qint64 offset,
+    qint64 baseTime);
+
+  QFile logFile;
+  QString indexFilename;
+
+  char buffer[TOR_EDGELOG_BUFFER_SIZE];
+  unsigned int bufferPos;
+  unsigned int bufferEnd;
+  qint64 lastTime;
+};
+
+#endif // TOREDGELOG_H
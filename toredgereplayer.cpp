@@ -0,0 +1,124 @@
+//
+// toredgereplayer.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "toredgereplayer.h"
+#include "torclock.h"
+#include "tortimer.h"
+#include "torledbackend.h"
+#include "torexception.h"
+
+#include <QTextStream>
+
+
+TorEdgeReplayer::TorEdgeReplayer(
+  TorClock *c,
+  TorLEDBackend *l)
+  : clock(c),
+    led(l),
+    timer(0),
+    reader(0),
+    startTime(0),
+    startOffset(0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(playEdge()));
+}
+
+
+TorEdgeReplayer::~TorEdgeReplayer()
+{
+  if (reader) delete reader;
+  if (timer) delete timer;
+}
+
+
+void TorEdgeReplayer::startReplay(
+  QString filename,
+  qint64 offset)
+{
+  timer->stop();
+
+  if (reader) delete reader;
+  reader = new TorEdgeLogReader(filename);
+
+  startTime = clock->currentTime();
+  startOffset = offset;
+
+  if (!reader->seekToTime(startOffset, pendingEdge))
+  {
+    // Nothing to play:
+    emit replayFinished();
+    return;
+  }
+
+  timer->startAt(startTime + pendingEdge.time - startOffset);
+}
+
+
+void TorEdgeReplayer::stopRunning()
+{
+  timer->stop();
+}
+
+
+void TorEdgeReplayer::playEdge()
+{
+  try
+  {
+    // Logs record actual levels, so faded runs play back faithfully:
+    if (pendingEdge.channel == Torch_Channel)
+    {
+      led->setIntensity(Torch_Channel, pendingEdge.intensity);
+    }
+    else if (pendingEdge.channel == Indicator_Channel)
+    {
+      led->setIntensity(Indicator_Channel, pendingEdge.intensity);
+    }
+  }
+  catch (TorException &e)
+  {
+    QTextStream qts(stderr);
+    qts << e.getError() << endl;
+    emit replayFinished();
+    return;
+  }
+
+  scheduleEdge();
+}
+
+
+void TorEdgeReplayer::scheduleEdge()
+{
+  if (!reader->nextEdge(pendingEdge))
+  {
+    emit replayFinished();
+    return;
+  }
+
+  timer->startAt(startTime + pendingEdge.time - startOffset);
+}
@@ -0,0 +1,76 @@
+//
+// toredgereplayer.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TOREDGEREPLAYER_H
+#define TOREDGEREPLAYER_H
+
+#include "toredgelog.h"
+
+#include <QObject>
+#include <QString>
+
+class TorClock;
+class TorTimer;
+class TorLEDBackend;
+
+// Drives an LED backend from a recorded edge log, reproducing the original
+// timing.  Only one edge is held in memory at a time.
+class TorEdgeReplayer: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorEdgeReplayer(
+    TorClock *clock,
+    TorLEDBackend *led);
+
+  ~TorEdgeReplayer();
+
+  // Start playing the log, skipping everything before startOffset
+  // (in microseconds):
+  void startReplay(
+    QString filename,
+    qint64 startOffset);
+
+  void stopRunning();
+
+signals:
+  void replayFinished();
+
+private slots:
+  void playEdge();
+
+private:
+  void scheduleEdge();
+
+  TorClock *clock;
+  TorLEDBackend *led;
+  TorTimer *timer;
+  TorEdgeLogReader *reader;
+
+  TorEdge pendingEdge;
+  qint64 startTime;
+  qint64 startOffset;
+};
+
+#endif // TOREDGEREPLAYER_H
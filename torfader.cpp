@@ -0,0 +1,301 @@
+//
+// torfader.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torfader.h"
+#include "tortimer.h"
+#include "torexception.h"
+
+#include <QTextStream>
+#include <math.h>
+#include <time.h>
+
+// Perceived brightness is roughly light output raised to 1/2.2:
+#define FADE_GAMMA 2.2
+
+// Steepness of the exponential curve; larger values spend more of the
+// ramp near the dim end:
+#define FADE_EXPONENT 5.0
+
+
+TorFader::TorFader(
+  TorClock *c,
+  TorLEDBackend *l)
+  : clock(c),
+    timer(0),
+    led(l),
+    curve(Gamma_Curve),
+    updatePeriod(5000),
+    channel(Torch_Channel),
+    fromLevel(0.0),
+    toLevel(0.0),
+    startTime(0),
+    duration(0),
+    nextUpdate(0),
+    rampFinished(false),
+    minIntensity(0),
+    maxIntensity(1),
+    currentIntensity(-1),
+    ditherError(0.0),
+    updateCount(0),
+    writeCount(0),
+    missedUpdates(0),
+    updateCost(0),
+    maxUpdateCost(0),
+    startCPUTime(0),
+    stopTime(0),
+    stopCPUTime(0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(update()));
+}
+
+
+TorFader::~TorFader()
+{
+  if (timer) delete timer;
+}
+
+
+void TorFader::setCurve(
+  TorFadeCurve c)
+{
+  curve = c;
+}
+
+
+void TorFader::setUpdateRate(
+  unsigned int rate)
+{
+  if (!rate) rate = 1;
+  updatePeriod = 1000000 / rate;
+  if (!updatePeriod) updatePeriod = 1;
+}
+
+
+void TorFader::startFade(
+  TorLEDChannel ch,
+  unsigned int from,
+  unsigned int to,
+  qint64 d)
+{
+  channel = ch;
+  fromLevel = (from > 100 ? 100 : from) / 100.0;
+  toLevel = (to > 100 ? 100 : to) / 100.0;
+  duration = d;
+  rampFinished = false;
+
+  minIntensity = led->getMinIntensity(channel);
+  maxIntensity = led->getMaxIntensity(channel);
+  currentIntensity = -1;
+  ditherError = 0.0;
+
+  updateCount = 0;
+  writeCount = 0;
+  missedUpdates = 0;
+  updateCost = 0;
+  maxUpdateCost = 0;
+  startCPUTime = cpuTime();
+  stopTime = 0;
+
+  startTime = clock->currentTime();
+  nextUpdate = startTime;
+  update();
+}
+
+
+void TorFader::stopRunning()
+{
+  if (!stopTime && updateCount)
+  {
+    stopTime = clock->currentTime();
+    stopCPUTime = cpuTime();
+  }
+
+  timer->stop();
+}
+
+
+void TorFader::writeReport(
+  QTextStream &out)
+{
+  if (!updateCount)
+  {
+    out << "No fade updates were made" << endl;
+    return;
+  }
+
+  qint64 endTime = stopTime ? stopTime : clock->currentTime();
+  qint64 endCPUTime = stopTime ? stopCPUTime : cpuTime();
+  qint64 elapsed = endTime - startTime;
+
+  out << "Fade: " << updateCount << " updates over ";
+  out << QString::number(elapsed / 1000.0, 'f', 1) << " ms";
+  if (elapsed > 0)
+  {
+    out << " (" << QString::number(updateCount * 1000000.0 / elapsed, 'f', 1);
+    out << " per second)";
+  }
+  out << ", " << writeCount << " LED writes" << endl;
+
+  out << "Missed updates: " << missedUpdates << endl;
+
+  // An update can't be scheduled any faster than it takes to run:
+  double meanCost = double(updateCost) / updateCount;
+  out << "Update cost: mean " << QString::number(meanCost, 'f', 1);
+  out << " us, max " << maxUpdateCost << " us";
+  if (meanCost > 0.0)
+  {
+    out << " (ceiling about " << qint64(1000000.0 / meanCost);
+    out << " updates per second)";
+  }
+  out << endl;
+
+  if (elapsed > 0)
+  {
+    out << "CPU cost: ";
+    out << QString::number(
+      (endCPUTime - startCPUTime) * 1000.0 / elapsed, 'f', 2);
+    out << " ms per second of fading" << endl;
+  }
+}
+
+
+void TorFader::update()
+{
+  qint64 updateStart = wallClock.currentTime();
+  qint64 now = clock->currentTime();
+
+  // Updates that have already been overtaken are dropped, not queued up:
+  if (now - nextUpdate >= updatePeriod)
+  {
+    qint64 behind = (now - nextUpdate) / updatePeriod;
+    missedUpdates += behind;
+    nextUpdate += behind * updatePeriod;
+  }
+
+  double progress = 1.0;
+  if ((duration > 0) && (nextUpdate - startTime < duration))
+  {
+    progress = double(nextUpdate - startTime) / duration;
+  }
+
+  bool endOfRamp = false;
+  if ((progress >= 1.0) && !rampFinished)
+  {
+    rampFinished = true;
+    endOfRamp = true;
+  }
+
+  double level = fromLevel + (toLevel - fromLevel) * progress;
+  double target =
+    minIntensity + lightOutput(level) * (maxIntensity - minIntensity);
+
+  int intensity;
+  bool done = false;
+
+  if (rampFinished && (target == floor(target)))
+  {
+    // Holding a level that sits exactly on a hardware step needs no more
+    // updates:
+    intensity = int(target);
+    ditherError = 0.0;
+    done = true;
+  }
+  else
+  {
+    // First-order error diffusion: the levels actually written average
+    // out to the target over successive updates:
+    intensity = int(floor(target + ditherError + 0.5));
+    if (intensity < minIntensity) intensity = minIntensity;
+    else if (intensity > maxIntensity) intensity = maxIntensity;
+    ditherError += target - intensity;
+  }
+
+  // Arm the next update before the write, so its cost doesn't delay it:
+  nextUpdate += updatePeriod;
+  if (!done) timer->startAt(nextUpdate);
+
+  if (intensity != currentIntensity)
+  {
+    try
+    {
+      led->setIntensity(channel, intensity);
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      done = true;
+      endOfRamp = true;
+    }
+
+    currentIntensity = intensity;
+    ++writeCount;
+  }
+
+  ++updateCount;
+
+  qint64 cost = wallClock.currentTime() - updateStart;
+  updateCost += cost;
+  if (cost > maxUpdateCost) maxUpdateCost = cost;
+
+  if (done) stopRunning();
+
+  if (endOfRamp) emit fadeFinished();
+}
+
+
+double TorFader::lightOutput(
+  double level)
+{
+  if (level <= 0.0) return 0.0;
+  if (level >= 1.0) return 1.0;
+
+  switch (curve)
+  {
+  case Exponential_Curve:
+    return (exp(FADE_EXPONENT * level) - 1.0) / (exp(FADE_EXPONENT) - 1.0);
+
+  case Gamma_Curve:
+    return pow(level, FADE_GAMMA);
+
+  case Linear_Curve:
+  default:
+    return level;
+  }
+}
+
+
+qint64 TorFader::cpuTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+  return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,125 @@
+//
+// torfader.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORFADER_H
+#define TORFADER_H
+
+#include <QObject>
+#include "torledbackend.h"
+#include "torclock.h"
+
+class TorTimer;
+class QTextStream;
+
+enum TorFadeCurve
+{
+  Linear_Curve,
+  Exponential_Curve,
+  Gamma_Curve
+};
+
+
+// Ramps one LED channel between two brightness levels.  Levels are given
+// as perceived brightness (0 to 100 percent); the curve maps them onto the
+// channel's hardware steps.  A target falling between two steps is reached
+// by dithering between them on every update, which amounts to software PWM
+// at the update rate.  Where dithering is still needed at the end of the
+// ramp, the fader keeps running to hold the final level.
+class TorFader: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorFader(
+    TorClock *clock,
+    TorLEDBackend *led);
+
+  ~TorFader();
+
+  void setCurve(
+    TorFadeCurve curve);
+
+  // Updates per second:
+  void setUpdateRate(
+    unsigned int rate);
+
+  void startFade(
+    TorLEDChannel channel,
+    unsigned int fromLevel,
+    unsigned int toLevel,
+    qint64 duration);
+
+  void stopRunning();
+
+  // Achieved update rate, missed updates, and what each update costs:
+  void writeReport(
+    QTextStream &out);
+
+signals:
+  void fadeFinished();
+
+private slots:
+  void update();
+
+private:
+  double lightOutput(
+    double level);
+
+  static qint64 cpuTime();
+
+  TorClock *clock;
+  TorTimer *timer;
+  TorLEDBackend *led;
+
+  // Update costs are real time, even when the fade runs on a virtual clock:
+  TorSystemClock wallClock;
+
+  TorFadeCurve curve;
+  qint64 updatePeriod;
+
+  TorLEDChannel channel;
+  double fromLevel;
+  double toLevel;
+  qint64 startTime;
+  qint64 duration;
+  qint64 nextUpdate;
+  bool rampFinished;
+
+  int minIntensity;
+  int maxIntensity;
+  int currentIntensity;
+  double ditherError;
+
+  // Statistics:
+  unsigned int updateCount;
+  unsigned int writeCount;
+  unsigned int missedUpdates;
+  qint64 updateCost;
+  qint64 maxUpdateCost;
+  qint64 startCPUTime;
+  qint64 stopTime;
+  qint64 stopCPUTime;
+};
+
+#endif // TORFADER_H
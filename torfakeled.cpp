@@ -0,0 +1,222 @@
+//
+// torfakeled.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torfakeled.h"
+#include "torclock.h"
+#include "torexception.h"
+
+#include <QTextStream>
+
+
+TorFakeLED::TorFakeLED(
+  TorClock *c,
+  QTextStream *traceStream)
+  : clock(c),
+    trace(traceStream),
+    core(this),
+    minTime(3000),
+    maxTime(10000),
+    chosenTime(5000),
+    strobePrepared(false),
+    simulatedLatency(0)
+{
+}
+
+
+TorFakeLED::~TorFakeLED()
+{
+}
+
+
+void TorFakeLED::turnTorchOn()
+{
+  setIntensity(Torch_Channel, getMaxIntensity(Torch_Channel));
+}
+
+
+void TorFakeLED::turnTorchOff()
+{
+  setIntensity(Torch_Channel, getMinIntensity(Torch_Channel));
+}
+
+
+void TorFakeLED::turnIndicatorOn()
+{
+  setIntensity(Indicator_Channel, getMaxIntensity(Indicator_Channel));
+}
+
+
+void TorFakeLED::turnIndicatorOff()
+{
+  setIntensity(Indicator_Channel, getMinIntensity(Indicator_Channel));
+}
+
+
+void TorFakeLED::setIntensity(
+  TorLEDChannel channel,
+  int intensity)
+{
+  TorCoreChannel coreChannel = toCoreChannel(channel);
+
+  if (intensity < core.getMinLevel(coreChannel))
+  {
+    intensity = core.getMinLevel(coreChannel);
+  }
+  else if (intensity > core.getMaxLevel(coreChannel))
+  {
+    intensity = core.getMaxLevel(coreChannel);
+  }
+
+  // Only actual changes in state count as edges:
+  if (core.getLevel(coreChannel) == intensity) return;
+
+  // The LED only changes once the (simulated) driver call completes:
+  clock->delay(simulatedLatency);
+
+  core.setLevel(coreChannel, intensity);
+}
+
+
+int TorFakeLED::getMinIntensity(
+  TorLEDChannel channel)
+{
+  return core.getMinLevel(toCoreChannel(channel));
+}
+
+
+int TorFakeLED::getMaxIntensity(
+  TorLEDChannel channel)
+{
+  return core.getMaxLevel(toCoreChannel(channel));
+}
+
+
+int TorFakeLED::getMinTime()
+{
+  return minTime;
+}
+
+
+int TorFakeLED::getMaxTime()
+{
+  return maxTime;
+}
+
+
+int TorFakeLED::getChosenTime()
+{
+  return chosenTime;
+}
+
+
+void TorFakeLED::setFlashDuration(
+  int duration)
+{
+  if (duration < minTime)
+  {
+    chosenTime = minTime;
+  }
+  else if (duration > maxTime)
+  {
+    chosenTime = maxTime;
+  }
+  else
+  {
+    chosenTime = duration;
+  }
+
+  strobePrepared = false;
+}
+
+
+void TorFakeLED::prepareStrobe()
+{
+  turnTorchOff();
+  clock->delay(simulatedLatency);
+  strobePrepared = true;
+}
+
+
+void TorFakeLED::triggerStrobe()
+{
+  // The real controller fires with whatever was last programmed, which
+  // is most likely not what was intended:
+  if (!strobePrepared)
+  {
+    throw TorException("Flash strobed before being prepared");
+  }
+
+  clock->delay(simulatedLatency);
+
+  if (!trace) return;
+
+  *trace << clock->currentTime() << " flash " << chosenTime << "\n";
+}
+
+
+void TorFakeLED::setSimulatedLatency(
+  qint64 latency)
+{
+  simulatedLatency = latency;
+}
+
+
+unsigned int TorFakeLED::getEdgeCount()
+{
+  return core.getEdgeCount();
+}
+
+
+int64_t TorFakeLED::currentTime()
+{
+  return clock->currentTime();
+}
+
+
+void TorFakeLED::writeTrace(
+  TorCoreChannel channel,
+  int level,
+  const char *line)
+{
+  if (channel == Torch_CoreChannel)
+  {
+    notifyEdge(Torch_Channel, level);
+  }
+  else
+  {
+    notifyEdge(Indicator_Channel, level);
+  }
+
+  if (!trace) return;
+
+  *trace << line;
+}
+
+
+TorCoreChannel TorFakeLED::toCoreChannel(
+  TorLEDChannel channel)
+{
+  if (channel == Torch_Channel) return Torch_CoreChannel;
+
+  return Indicator_CoreChannel;
+}
@@ -0,0 +1,108 @@
+//
+// torfakeled.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORFAKELED_H
+#define TORFAKELED_H
+
+#include "torledbackend.h"
+#include "torcorefakeled.h"
+
+class TorClock;
+class QTextStream;
+
+// An LED backend with no hardware behind it: the Qt-side face of
+// TorCoreFakeLED, on the front end's clock.  Every change in LED state is
+// written to the trace stream (if any) as a line of the form:
+//
+//   <time in microseconds> <channel> <intensity>
+//
+// Each strobe of the flash appears as a "flash" line giving its duration.
+//
+class TorFakeLED: public TorLEDBackend, public TorCoreFakeLEDClient
+{
+public:
+  TorFakeLED(
+    TorClock *clock,
+    QTextStream *traceStream);
+
+  ~TorFakeLED();
+
+  void turnTorchOn();
+  void turnTorchOff();
+
+  void turnIndicatorOn();
+  void turnIndicatorOff();
+
+  void setIntensity(
+    TorLEDChannel channel,
+    int intensity);
+
+  int getMinIntensity(
+    TorLEDChannel channel);
+
+  int getMaxIntensity(
+    TorLEDChannel channel);
+
+  int getMinTime();
+  int getMaxTime();
+  int getChosenTime();
+
+  void setFlashDuration(
+    int duration);
+
+  void prepareStrobe();
+  void triggerStrobe();
+
+  // Make each change take this long (in microseconds) to complete, as a
+  // real driver would:
+  void setSimulatedLatency(
+    qint64 latency);
+
+  unsigned int getEdgeCount();
+
+  // For the core LED:
+  int64_t currentTime();
+
+  void writeTrace(
+    TorCoreChannel channel,
+    int level,
+    const char *line);
+
+private:
+  TorCoreChannel toCoreChannel(
+    TorLEDChannel channel);
+
+  TorClock *clock;
+  QTextStream *trace;
+  TorCoreFakeLED core;
+
+  // Flash timings mimic the N900's adp1653 controller:
+  int minTime;
+  int maxTime;
+  int chosenTime;
+  bool strobePrepared;
+
+  qint64 simulatedLatency;
+};
+
+#endif // TORFAKELED_H
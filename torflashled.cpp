@@ -21,40 +21,54 @@
 //
 
 #include "torflashled.h"
-
-#include <sys/ioctl.h>
-#include <linux/videodev2.h>
-#include <fcntl.h>
-
-// Error handling stuff:
+#include "torcoreflashled.h"
+#include "torcoreexception.h"
 #include "torexception.h"
-#include <errno.h>
-#include <QString>
 
-//#include <QDebug>
+#include <QString>
+#include <QSocketNotifier>
+#include <QTextStream>
 
-// The Flash LEDs are tied into video device 0, along with the camera itself:
-#define PATH_TO_FLASH_DEVICE "/dev/video0"
+// The hardware itself is driven by the core library, whose errors are
+// passed on as TorExceptions:
+static TorException convertError(
+  TorCoreException &e)
+{
+  return TorException(QString::fromLocal8Bit(e.getError().c_str()));
+}
 
-#include <iostream>
 
-TorFlashLED::TorFlashLED()
-  : fileDescriptor(-1),
-    minTorch(0),
-    maxTorch(1),
+TorFlashLED::TorFlashLED(
+  bool useDiscoveryCache)
+  : core(0),
     torchOn(false),
-    minFlash(12),
-    maxFlash(19),
-    chosenFlash(12),
-    minTime(3000),
-    maxTime(10000),
-    chosenTime(0),
-    minIndicator(0),
-    maxIndicator(7),
-    chosenIndicator(7),
-    indicatorOn(false)
+    chosenFlash(-1),
+    chosenTime(-1),
+    chosenIndicator(-1),
+    currentIndicator(0),
+    indicatorOn(false),
+    notifier(0),
+    discoveryFromCache(false),
+    discoveryTime(0),
+    probedCount(0)
 {
-  openFlashDevice();
+  try
+  {
+    TorCoreFlashDiscovery discovery(TorCoreFlashDiscovery::defaultCachePath());
+    TorCoreFlashDevice device = discovery.discover(useDiscoveryCache);
+
+    devicePath = QString::fromLocal8Bit(device.path.c_str());
+    driverName = QString::fromLocal8Bit(device.driver.c_str());
+    discoveryFromCache = discovery.usedCache();
+    discoveryTime = discovery.getDiscoveryTime();
+    probedCount = discovery.getProbedCount();
+
+    core = new TorCoreFlashLED(device);
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
 }
 
 
@@ -63,56 +77,27 @@ TorFlashLED::~TorFlashLED()
   if (torchOn) toggleTorch();
   if (indicatorOn) turnIndicatorOff();
 
-  if (fileDescriptor >= 0)
-  {
-    if (close(fileDescriptor) == -1)
-    {
-      // Failed to close the Flash LED:
-      QString ss;
-      ss += "Failed to close flash LED device.\n";
-      ss += "Error is: ";
-      ss += strerror(errno);
-      throw TorException(ss);
-    }
-  }
+  // The notifier watches the descriptor that deleting core closes:
+  if (notifier) delete notifier;
+
+  delete core;
 }
 
 
 void TorFlashLED::toggleTorch()
 {
-  struct v4l2_control ctrl;
-
-  // Sanity check:
-  if (fileDescriptor == -1)
-  {
-    // Throw an error here?
-    return;
-  }
-
-  ctrl.id = V4L2_CID_TORCH_INTENSITY;
-
   if (torchOn)
   {
     // Turn torch off:
-    ctrl.value = minTorch;
+    switchTorch(getMinIntensity(Torch_Channel));
     torchOn = false;
   }
   else
   {
     // Turn torch on:
-    ctrl.value = maxTorch;
+    switchTorch(getMaxIntensity(Torch_Channel));
     torchOn = true;
   }
-
-  if (ioctl(fileDescriptor, VIDIOC_S_CTRL, &ctrl) == -1)
-  {
-    QString ss;
-    ss += "Failed to set torch intensity to ";
-    ss += ctrl.value;
-    ss += "\nError is ";
-    ss += strerror(errno);
-    throw TorException(ss);
-  }
 }
 
 
@@ -130,37 +115,77 @@ void TorFlashLED::turnTorchOff()
 
 int TorFlashLED::getMinFlash()
 {
-  return minFlash;
+  try
+  {
+    return core->getMinFlash();
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
 }
 
 
 int TorFlashLED::getMaxFlash()
 {
-  return maxFlash;
+  try
+  {
+    return core->getMaxFlash();
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
 }
 
 
 int TorFlashLED::getMinTime()
 {
-  return minTime;
+  try
+  {
+    return core->getMinTime();
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
 }
 
 
 int TorFlashLED::getMaxTime()
 {
-  return maxTime;
+  try
+  {
+    return core->getMaxTime();
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
 }
 
 
 int TorFlashLED::getChosenTime()
 {
-  return chosenTime;
+  if (chosenTime >= 0) return chosenTime;
+
+  try
+  {
+    return core->getDefaultTime();
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
 }
 
 
 void TorFlashLED::setFlashBrightness(
   int brightness)
 {
+  int minFlash = getMinFlash();
+  int maxFlash = getMaxFlash();
+
   if (brightness < minFlash)
   {
     chosenFlash = minFlash;
@@ -179,6 +204,9 @@ void TorFlashLED::setFlashBrightness(
 void TorFlashLED::setFlashDuration(
   int duration)
 {
+  int minTime = getMinTime();
+  int maxTime = getMaxTime();
+
   if (duration < minTime)
   {
     chosenTime = minTime;
@@ -195,53 +223,39 @@ void TorFlashLED::setFlashDuration(
 
 
 void TorFlashLED::strobe()
+{
+  prepareStrobe();
+  triggerStrobe();
+}
+
+
+void TorFlashLED::prepareStrobe()
 {
   if (torchOn) toggleTorch();
 
-  struct v4l2_control ctrl;
+  int intensity = chosenFlash;
+  if (intensity < 0) intensity = getMinFlash();
 
-  // Sanity check:
-  if (fileDescriptor == -1)
+  try
   {
-    // Throw an error here?
-    return;
+    core->prepareStrobe(intensity, getChosenTime());
   }
-
-  ctrl.id = V4L2_CID_FLASH_INTENSITY;
-  ctrl.value = chosenFlash;
-
-  if (ioctl(fileDescriptor, VIDIOC_S_CTRL, &ctrl) == -1)
+  catch (TorCoreException &e)
   {
-    QString ss;
-    ss += "Failed to set flash intensity to ";
-    ss += chosenFlash;
-    ss += "\nError is ";
-    ss += strerror(errno);
-    throw TorException(ss);
+    throw convertError(e);
   }
+}
 
-  ctrl.id = V4L2_CID_FLASH_TIMEOUT;
-  // For now, let's be a bit conservative and cut the max time in half:
-  ctrl.value = chosenTime;
 
-  if (ioctl(fileDescriptor, VIDIOC_S_CTRL, &ctrl) == -1)
+void TorFlashLED::triggerStrobe()
+{
+  try
   {
-    QString ss;
-    ss += "Failed to set flash timeout to ";
-    ss += chosenTime;
-    ss += "\nError is ";
-    ss += strerror(errno);
-    throw TorException(ss);
+    core->triggerStrobe();
   }
-
-  ctrl.id = V4L2_CID_FLASH_STROBE;
-
-  if (ioctl(fileDescriptor, VIDIOC_S_CTRL, &ctrl) == -1)
+  catch (TorCoreException &e)
   {
-    QString ss;
-    ss += "Failed to strobe flash.\nError is ";
-    ss += strerror(errno);
-    throw TorException(ss);
+    throw convertError(e);
   }
 }
 
@@ -250,19 +264,22 @@ void TorFlashLED::toggleIndicator()
 {
   if (indicatorOn)
   {
-    switchIndicator(minIndicator);
-    indicatorOn = false;
+    turnIndicatorOff();
   }
   else
   {
-    switchIndicator(chosenIndicator);
-    indicatorOn = true;
+    turnIndicatorOn();
   }
 }
 
 
 void TorFlashLED::turnIndicatorOn()
 {
+  if (chosenIndicator < 0)
+  {
+    chosenIndicator = getMaxIntensity(Indicator_Channel);
+  }
+
   switchIndicator(chosenIndicator);
   indicatorOn = true;
 }
@@ -270,7 +287,7 @@ void TorFlashLED::turnIndicatorOn()
 
 void TorFlashLED::turnIndicatorOff()
 {
-  switchIndicator(minIndicator);
+  switchIndicator(getMinIntensity(Indicator_Channel));
   indicatorOn = false;
 }
 
@@ -278,6 +295,9 @@ void TorFlashLED::turnIndicatorOff()
 void TorFlashLED::setIndicatorBrightnessLevel(
   int brightness)
 {
+  int minIndicator = getMinIntensity(Indicator_Channel);
+  int maxIndicator = getMaxIntensity(Indicator_Channel);
+
   if (brightness < minIndicator)
   {
     chosenIndicator = minIndicator;
@@ -293,6 +313,67 @@ void TorFlashLED::setIndicatorBrightnessLevel(
 }
 
 
+void TorFlashLED::setIntensity(
+  TorLEDChannel channel,
+  int intensity)
+{
+  int minimum = getMinIntensity(channel);
+  int maximum = getMaxIntensity(channel);
+
+  if (intensity < minimum) intensity = minimum;
+  else if (intensity > maximum) intensity = maximum;
+
+  if (channel == Torch_Channel)
+  {
+    switchTorch(intensity);
+    torchOn = (intensity > minimum);
+  }
+  else
+  {
+    switchIndicator(intensity);
+    indicatorOn = (intensity > minimum);
+  }
+}
+
+
+int TorFlashLED::getMinIntensity(
+  TorLEDChannel channel)
+{
+  try
+  {
+    if (channel == Torch_Channel)
+    {
+      return core->getMinLevel(Torch_CoreChannel);
+    }
+
+    return core->getMinLevel(Indicator_CoreChannel);
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
+}
+
+
+int TorFlashLED::getMaxIntensity(
+  TorLEDChannel channel)
+{
+  try
+  {
+    if (channel == Torch_Channel)
+    {
+      return core->getMaxLevel(Torch_CoreChannel);
+    }
+
+    return core->getMaxLevel(Indicator_CoreChannel);
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
+  }
+}
+
+
 bool TorFlashLED::ledsCurrentlyLit()
 {
   return (torchOn || indicatorOn);
@@ -314,112 +395,132 @@ void TorFlashLED::swapLEDs()
 }
 
 
-void TorFlashLED::openFlashDevice()
+void TorFlashLED::registerMetrics(
+  TorCoreMetrics &metrics)
+{
+  TorLEDBackend::registerMetrics(metrics);
+  core->registerMetrics(metrics);
+}
+
+
+void TorFlashLED::writeDiscoveryReport(
+  QTextStream &out)
 {
-  // Not sure why "O_RDWR", but it seems to be necessary:
-  fileDescriptor = open(PATH_TO_FLASH_DEVICE, O_RDWR | O_NONBLOCK, 0);
-//  fileDescriptor = open(PATH_TO_FLASH_DEVICE, O_RDWR, 0);
+  out << "Flash device: " << devicePath;
+  if (!driverName.isEmpty()) out << " (" << driverName << ")";
+  out << endl;
 
-  if (fileDescriptor == -1)
+  QString time = QString::number(discoveryTime / 1000.0, 'f', 2);
+
+  if (discoveryFromCache)
+  {
+    out << "Discovery: " << time << " ms, warm (from the cache)" << endl;
+  }
+  else
   {
-    QString ss;
-    ss += "Failed to connect to ";
-    ss += PATH_TO_FLASH_DEVICE;
-    ss += "\nError is ";
-    ss += strerror(errno);
-    throw TorException(ss);
+    out << "Discovery: " << time << " ms, cold (probed " << probedCount;
+    out << " nodes)" << endl;
   }
+}
 
-  // Find out the intensity values for the LED:
 
-  struct v4l2_queryctrl qctrl;
+bool TorFlashLED::watchControlEvents()
+{
+  if (notifier) return true;
 
-  // Retrieve intensity values for strobe usage:
-  qctrl.id = V4L2_CID_FLASH_INTENSITY;
+  if (!core->subscribeToEvents()) return false;
 
-  if (ioctl(fileDescriptor, VIDIOC_QUERYCTRL, &qctrl) == -1)
-  {
-    QString ss;
-    ss += "Failed to retrieve flash LED intensity values.\n";
-    ss += "Error is ";
-    ss += strerror(errno);
-    throw TorException(ss);
-  }
+  notifier = new QSocketNotifier(
+    core->getDescriptor(),
+    QSocketNotifier::Exception,
+    this);
 
-  minFlash = qctrl.minimum;
-  maxFlash = qctrl.maximum;
-  chosenFlash = qctrl.minimum;
+  connect(
+    notifier,
+    SIGNAL(activated(int)),
+    this,
+    SLOT(readControlEvents()));
 
-  // Retrieve timeout values for strobe usage:
-  qctrl.id = V4L2_CID_FLASH_TIMEOUT;
+  // The initial levels may already be waiting:
+  readControlEvents();
 
-  if (ioctl(fileDescriptor, VIDIOC_QUERYCTRL, &qctrl) == -1)
-  {
-    QString ss;
-    ss += "Failed to retrieve flash timeout values.\n";
-    ss += "Error is ";
-    ss += strerror(errno);
-    throw TorException(ss);
-  }
+  return true;
+}
 
-  minTime = qctrl.minimum;
-  maxTime = qctrl.maximum;
-  chosenTime = qctrl.maximum / 2;
 
-  // Retrieve intensity values for sustained usage:
-  qctrl.id = V4L2_CID_TORCH_INTENSITY;
+void TorFlashLED::readControlEvents()
+{
+  TorCoreControlEvent event;
 
-  if (ioctl(fileDescriptor, VIDIOC_QUERYCTRL, &qctrl) == -1)
+  try
+  {
+    while (core->dequeueEvent(event))
+    {
+      if (event.control == TorchIntensity_Control)
+      {
+        bool lit = (event.value > getMinIntensity(Torch_Channel));
+        if (lit == torchOn) continue;
+
+        torchOn = lit;
+        notifyEdge(Torch_Channel, event.value);
+      }
+      else if (event.control == IndicatorIntensity_Control)
+      {
+        if (event.value == currentIndicator) continue;
+
+        currentIndicator = event.value;
+        indicatorOn = (event.value > getMinIntensity(Indicator_Channel));
+        notifyEdge(Indicator_Channel, event.value);
+      }
+      else if ((event.control == FlashFault_Control) && event.value)
+      {
+        std::string description =
+          TorCoreFlashLED::describeFaults(event.value);
+
+        emit flashFault(QString::fromLocal8Bit(description.c_str()));
+      }
+    }
+  }
+  catch (TorException &e)
   {
-    QString ss;
-    ss += "Failed to retrieve torch LED intensity values.\n";
-    ss += "Error is ";
-    ss += strerror(errno);
-    throw TorException(ss);
+    emit flashFault(e.getError());
   }
+}
 
-  minTorch = qctrl.minimum;
-  maxTorch = qctrl.maximum;
-
-  // Does this pick up the indicator LED?
-  qctrl.id = V4L2_CID_INDICATOR_INTENSITY;
 
-  if (ioctl(fileDescriptor, VIDIOC_QUERYCTRL, &qctrl) == -1)
+void TorFlashLED::switchTorch(
+  int intensity)
+{
+  try
+  {
+    core->setLevel(Torch_CoreChannel, intensity);
+  }
+  catch (TorCoreException &e)
   {
-    QString ss;
-    ss += "Failed to retrieve indicator LED intensity values.\n";
-    ss += "Error is ";
-    ss += strerror(errno);
-    throw TorException(ss);
+    throw convertError(e);
   }
 
-  minIndicator = qctrl.minimum;
-  maxIndicator = qctrl.maximum;
-  chosenIndicator = qctrl.maximum;
+  notifyEdge(Torch_Channel, intensity);
 }
 
 
 void TorFlashLED::switchIndicator(
   int brightness)
 {
-  struct v4l2_control ctrl;
-
-  // Sanity check:
-  if (fileDescriptor == -1)
+  try
   {
-    return;
+    core->setLevel(Indicator_CoreChannel, brightness);
+  }
+  catch (TorCoreException &e)
+  {
+    throw convertError(e);
   }
 
-  ctrl.id = V4L2_CID_INDICATOR_INTENSITY;
-  ctrl.value = brightness;
-
-  if (ioctl(fileDescriptor, VIDIOC_S_CTRL, &ctrl) == -1)
+  // The indicator gets rewritten even when its level doesn't change, so
+  // only report actual changes:
+  if (brightness != currentIndicator)
   {
-    QString ss;
-    ss += "Failed to set indicator intensity to ";
-    ss += ctrl.value;
-    ss += "\nError is ";
-    ss += strerror(errno);
-    throw TorException(ss);
+    currentIndicator = brightness;
+    notifyEdge(Indicator_Channel, brightness);
   }
 }
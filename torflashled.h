@@ -23,10 +23,26 @@
 #ifndef TORFLASHLED_H
 #define TORFLASHLED_H
 
-class TorFlashLED
+#include "torledbackend.h"
+
+#include <QObject>
+#include <QString>
+
+class TorCoreFlashLED;
+class QSocketNotifier;
+class QTextStream;
+
+// The Qt-side face of TorCoreFlashLED: it keeps track of which LEDs are
+// lit and at what level, and reports each edge to any listeners.
+class TorFlashLED: public QObject, public TorLEDBackend
 {
+  Q_OBJECT
+
 public:
-  TorFlashLED();
+  // The device is found by TorCoreFlashDiscovery; without the cache,
+  // every node is probed afresh:
+  TorFlashLED(
+    bool useDiscoveryCache);
 
   ~TorFlashLED();
 
@@ -50,6 +66,9 @@ public:
 
   void strobe();
 
+  void prepareStrobe();
+  void triggerStrobe();
+
   // Indicator controls:
   void toggleIndicator();
   void turnIndicatorOn();
@@ -57,33 +76,65 @@ public:
   void setIndicatorBrightnessLevel(
     int brightness);
 
+  // Intensity control across each LED's full hardware range:
+  void setIntensity(
+    TorLEDChannel channel,
+    int intensity);
+
+  int getMinIntensity(
+    TorLEDChannel channel);
+
+  int getMaxIntensity(
+    TorLEDChannel channel);
+
   bool ledsCurrentlyLit();
   void swapLEDs();
 
+  void registerMetrics(
+    TorCoreMetrics &metrics);
+
+  // Keep the lit state in step with changes made by other processes, and
+  // report flash faults, as the driver announces them.  Returns false if
+  // the driver has no control events, leaving things as they were:
+  bool watchControlEvents();
+
+  // Which device was found, and how long finding it took:
+  void writeDiscoveryReport(
+    QTextStream &out);
+
+signals:
+  void flashFault(
+    QString description);
+
+private slots:
+  void readControlEvents();
+
 private:
-  void openFlashDevice();
+  void switchTorch(
+    int intensity);
 
   void switchIndicator(
     int brightness);
 
-  int fileDescriptor;
+  TorCoreFlashLED *core;
 
-  int minTorch;
-  int maxTorch;
   bool torchOn;
 
-  int minFlash;
-  int maxFlash;
+  // Negative until chosen, meaning the driver defaults:
   int chosenFlash;
-
-  int minTime;
-  int maxTime;
   int chosenTime;
-
-  int minIndicator;
-  int maxIndicator;
   int chosenIndicator;
+
+  int currentIndicator;
   bool indicatorOn;
+
+  QSocketNotifier *notifier;
+
+  QString devicePath;
+  QString driverName;
+  bool discoveryFromCache;
+  qint64 discoveryTime;
+  unsigned int probedCount;
 };
 
 #endif // TORFLASHLED_H
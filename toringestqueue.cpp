@@ -0,0 +1,403 @@
+//
+// toringestqueue.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "toringestqueue.h"
+#include "torclock.h"
+#include "torcoretrace.h"
+
+#include <QSocketNotifier>
+#include <QTextStream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define INGEST_READ_SIZE 4096
+
+
+TorIngestQueue::TorIngestQueue(
+  TorClock *c)
+  : clock(c),
+    notifier(0),
+    savedFlags(0),
+    running(true),
+    inputFinished(false),
+    blocked(false),
+    policy(Block_Policy),
+    maxLines(64),
+    maxBytes(65536),
+    latestCount(1),
+    queuedBytes(0),
+    bytesRead(0),
+    linesRead(0),
+    droppedOldest(0),
+    droppedNewest(0),
+    producerBlocks(0)
+{
+}
+
+
+TorIngestQueue::~TorIngestQueue()
+{
+  stopRunning();
+}
+
+
+void TorIngestQueue::setLimits(
+  int lineLimit,
+  int byteLimit)
+{
+  maxLines = (lineLimit > 0) ? lineLimit : 1;
+  maxBytes = (byteLimit > 0) ? byteLimit : 1;
+}
+
+
+void TorIngestQueue::setPolicy(
+  TorIngestPolicy p,
+  int count)
+{
+  policy = p;
+  latestCount = (count > 0) ? count : 1;
+}
+
+
+void TorIngestQueue::startWatching()
+{
+  if (inputFinished) return;
+
+  // Reads must never hold up the LEDs:
+  savedFlags = fcntl(STDIN_FILENO, F_GETFL);
+  fcntl(STDIN_FILENO, F_SETFL, savedFlags | O_NONBLOCK);
+
+  notifier = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read);
+
+  connect(
+    notifier,
+    SIGNAL(activated(int)),
+    this,
+    SLOT(readInput()));
+}
+
+
+void TorIngestQueue::waitForLine()
+{
+  queueLines();
+
+  while (lines.isEmpty() && !inputFinished)
+  {
+    readChunk();
+    queueLines();
+  }
+}
+
+
+bool TorIngestQueue::takeLine(
+  TorIngestLine &line)
+{
+  if (lines.isEmpty()) return false;
+
+  line = lines.takeFirst();
+  queuedBytes -= line.text.size();
+
+  waitTime.record(clock->currentTime() - line.arrival);
+
+  // There's room again for whatever the producer was held up on:
+  if (blocked) queueLines();
+
+  return true;
+}
+
+
+bool TorIngestQueue::isFinished()
+{
+  return inputFinished && lines.isEmpty() && pending.isEmpty();
+}
+
+
+void TorIngestQueue::lineSent(
+  const TorIngestLine &line)
+{
+  latency.record(clock->currentTime() - line.arrival);
+}
+
+
+bool TorIngestQueue::isRunning()
+{
+  return running;
+}
+
+
+void TorIngestQueue::stopRunning()
+{
+  running = false;
+
+  if (notifier)
+  {
+    // We may be inside the notifier's own signal:
+    notifier->setEnabled(false);
+    notifier->deleteLater();
+    notifier = 0;
+
+    fcntl(STDIN_FILENO, F_SETFL, savedFlags);
+  }
+}
+
+
+void TorIngestQueue::writeReport(
+  QTextStream &out)
+{
+  out << "Input queue: " << linesRead << " lines (" << bytesRead;
+  out << " bytes) read, at most " << qint64(depth.max) << " waiting; ";
+  out << droppedOldest << " oldest and " << droppedNewest;
+  out << " newest dropped; producer held up " << producerBlocks;
+  out << " times" << endl;
+
+  if (waitTime.count)
+  {
+    out << "Time queued: mean ";
+    out << QString::number(waitTime.sum / 1000000.0 / waitTime.count, 'f', 3);
+    out << " s, max ";
+    out << QString::number(waitTime.max / 1000000.0, 'f', 3) << " s" << endl;
+  }
+
+  if (latency.count)
+  {
+    out << "Arrival to sent: mean ";
+    out << QString::number(latency.sum / 1000000.0 / latency.count, 'f', 3);
+    out << " s, max ";
+    out << QString::number(latency.max / 1000000.0, 'f', 3) << " s" << endl;
+  }
+}
+
+
+void TorIngestQueue::registerMetrics(
+  TorCoreMetrics &metrics)
+{
+  metrics.addCounter(
+    "torchio_stdin_bytes_total",
+    "",
+    "Bytes of Morse text read from standard input.",
+    &bytesRead);
+
+  metrics.addCounter(
+    "torchio_ingest_lines_total",
+    "",
+    "Lines of Morse text read from standard input.",
+    &linesRead);
+
+  metrics.addCounter(
+    "torchio_ingest_dropped_total",
+    "end=\"oldest\"",
+    "Lines thrown away because the input queue was full.",
+    &droppedOldest);
+
+  metrics.addCounter(
+    "torchio_ingest_dropped_total",
+    "end=\"newest\"",
+    "Lines thrown away because the input queue was full.",
+    &droppedNewest);
+
+  metrics.addCounter(
+    "torchio_ingest_producer_blocks_total",
+    "",
+    "Times reading stopped until the input queue had room.",
+    &producerBlocks);
+
+  metrics.addSummary(
+    "torchio_ingest_depth_lines",
+    "",
+    "Lines waiting in the input queue, as each one arrived.",
+    &depth,
+    1.0);
+
+  metrics.addSummary(
+    "torchio_ingest_wait_seconds",
+    "",
+    "Time each line spent in the input queue.",
+    &waitTime);
+
+  metrics.addSummary(
+    "torchio_ingest_latency_seconds",
+    "",
+    "Time from each line arriving to it having been sent.",
+    &latency);
+}
+
+
+void TorIngestQueue::readInput()
+{
+  TOR_TRACE_SPAN("read", "stdin");
+
+  bool wasEmpty = lines.isEmpty();
+
+  readChunk();
+  queueLines();
+
+  if (wasEmpty && !lines.isEmpty()) emit lineQueued();
+
+  if (inputFinished) emit inputEnded();
+}
+
+
+bool TorIngestQueue::readChunk()
+{
+  char buffer[INGEST_READ_SIZE];
+
+  ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+
+  if (count > 0)
+  {
+    pending.append(buffer, count);
+    bytesRead += count;
+    return true;
+  }
+
+  if (count == 0)
+  {
+    finishInput();
+    return false;
+  }
+
+  if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+  {
+    return true;
+  }
+
+  QTextStream qts(stderr);
+  qts << "Failed to read standard input: " << strerror(errno) << endl;
+  finishInput();
+  return false;
+}
+
+
+void TorIngestQueue::queueLines()
+{
+  bool wasBlocked = blocked;
+  blocked = false;
+
+  while (true)
+  {
+    int end = pending.indexOf('\n');
+    int length;
+    bool lineEnds = false;
+
+    if (end >= 0)
+    {
+      length = end;
+      lineEnds = true;
+    }
+    else if (pending.size() >= maxBytes)
+    {
+      length = maxBytes;
+    }
+    else if (inputFinished && !pending.isEmpty())
+    {
+      length = pending.size();
+    }
+    else
+    {
+      break;
+    }
+
+    // A line too long to ever fit is cut into pieces that do, whether or
+    // not its end has arrived yet; the newline goes with the last piece:
+    if (length > maxBytes)
+    {
+      length = maxBytes;
+      lineEnds = false;
+    }
+
+    if (!admitLine(pending.left(length))) break;
+
+    pending.remove(0, lineEnds ? length + 1 : length);
+  }
+
+  // Left unread, the input backs up until the producer has to wait:
+  if (blocked && !wasBlocked) ++producerBlocks;
+
+  if (notifier) notifier->setEnabled(!blocked && !inputFinished);
+}
+
+
+bool TorIngestQueue::admitLine(
+  const QByteArray &text)
+{
+  if (policy == Latest_Policy)
+  {
+    while (lines.size() >= latestCount) dropOldest();
+  }
+
+  if (isFull(text.size()))
+  {
+    if (policy == Block_Policy)
+    {
+      blocked = true;
+      return false;
+    }
+
+    if (policy == DropNewest_Policy)
+    {
+      ++linesRead;
+      ++droppedNewest;
+      return true;
+    }
+
+    while (!lines.isEmpty() && isFull(text.size())) dropOldest();
+  }
+
+  TorIngestLine line;
+  line.text = text;
+  line.arrival = clock->currentTime();
+
+  lines.append(line);
+  queuedBytes += text.size();
+  ++linesRead;
+  depth.record(lines.size());
+
+  return true;
+}
+
+
+bool TorIngestQueue::isFull(
+  int extraBytes)
+{
+  return (lines.size() >= maxLines)
+    || (queuedBytes + extraBytes > maxBytes);
+}
+
+
+void TorIngestQueue::dropOldest()
+{
+  queuedBytes -= lines.first().text.size();
+  lines.removeFirst();
+  ++droppedOldest;
+}
+
+
+void TorIngestQueue::finishInput()
+{
+  inputFinished = true;
+
+  if (notifier) notifier->setEnabled(false);
+}
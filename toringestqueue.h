@@ -0,0 +1,160 @@
+//
+// toringestqueue.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORINGESTQUEUE_H
+#define TORINGESTQUEUE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include "torcoremetrics.h"
+
+class TorClock;
+class QSocketNotifier;
+class QTextStream;
+
+// What to do with a line that arrives when the queue is full:
+enum TorIngestPolicy
+{
+  Block_Policy,       // Stop reading, so the producer blocks on its pipe
+  DropOldest_Policy,  // Make room by throwing away the oldest lines
+  DropNewest_Policy,  // Throw away the line that just arrived
+  Latest_Policy       // Keep only the newest few lines, whatever the limits
+};
+
+struct TorIngestLine
+{
+  QByteArray text;
+  qint64 arrival;
+};
+
+
+// Lines of Morse text, read from standard input as they arrive and held
+// until the LEDs get to them.  A line takes seconds to send, so a chatty
+// producer could otherwise build up any amount of lag; the queue is
+// limited both in lines and in bytes, and the policy decides what gives
+// when it fills up.  Each line is stamped on arrival, so the time it
+// spends waiting, and the time until it has been sent, can be reported.
+class TorIngestQueue: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorIngestQueue(
+    TorClock *clock);
+
+  ~TorIngestQueue();
+
+  void setLimits(
+    int maxLines,
+    int maxBytes);
+
+  // For Latest_Policy, how many lines are kept:
+  void setPolicy(
+    TorIngestPolicy policy,
+    int latestCount);
+
+  // Read from the event loop, without ever blocking:
+  void startWatching();
+
+  // Blocks until a line is queued or the input ends (for virtual time,
+  // where nothing can arrive while the LEDs are busy):
+  void waitForLine();
+
+  // Takes the oldest queued line, if there is one:
+  bool takeLine(
+    TorIngestLine &line);
+
+  // Nothing queued, and nothing more to come:
+  bool isFinished();
+
+  // A taken line has been sent in full:
+  void lineSent(
+    const TorIngestLine &line);
+
+  bool isRunning();
+
+  void stopRunning();
+
+  void writeReport(
+    QTextStream &out);
+
+  void registerMetrics(
+    TorCoreMetrics &metrics);
+
+signals:
+  // The queue has gone from empty to holding a line:
+  void lineQueued();
+
+  void inputEnded();
+
+private slots:
+  void readInput();
+
+private:
+  // Returns false if the input has ended:
+  bool readChunk();
+
+  // Moves complete lines from the read buffer into the queue, until the
+  // buffer runs out or (when blocking) the queue is full:
+  void queueLines();
+
+  // Returns false if the line has to wait for room:
+  bool admitLine(
+    const QByteArray &text);
+
+  bool isFull(
+    int extraBytes);
+
+  void dropOldest();
+
+  void finishInput();
+
+  TorClock *clock;
+  QSocketNotifier *notifier;
+  int savedFlags;
+  bool running;
+  bool inputFinished;
+  bool blocked;
+
+  TorIngestPolicy policy;
+  int maxLines;
+  int maxBytes;
+  int latestCount;
+
+  QByteArray pending;
+  QList<TorIngestLine> lines;
+  int queuedBytes;
+
+  // Statistics:
+  TorCoreCounter bytesRead;
+  TorCoreCounter linesRead;
+  TorCoreCounter droppedOldest;
+  TorCoreCounter droppedNewest;
+  TorCoreCounter producerBlocks;
+  TorCoreSummary depth;
+  TorCoreSummary waitTime;
+  TorCoreSummary latency;
+};
+
+#endif // TORINGESTQUEUE_H
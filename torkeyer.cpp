@@ -0,0 +1,535 @@
+//
+// torkeyer.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torkeyer.h"
+#include "torclock.h"
+#include "tortimer.h"
+#include "tormorsetable.h"
+#include "torexception.h"
+
+#include <QSocketNotifier>
+#include <QTextStream>
+
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+// Key-to-light latency beyond this (in microseconds) is counted as too slow:
+#define KEYER_LATENCY_BUDGET 5000
+
+#define KEYER_EVENT_BATCH 64
+
+
+TorKeyer::TorKeyer(
+  TorClock *c,
+  TorLEDBackend *l,
+  TorLEDChannel ch)
+  : clock(c),
+    timer(0),
+    led(l),
+    channel(ch),
+    mode(Iambic_Keyer),
+    dotDuration(100000),
+    inputDescriptor(-1),
+    ownsDescriptor(false),
+    isEvdev(false),
+    evdevTimesMatch(false),
+    terminalChanged(false),
+    notifier(0),
+    ditHeld(false),
+    dahHeld(false),
+    ditMemory(false),
+    dahMemory(false),
+    lastWasDit(false),
+    elementActive(false),
+    lightOn(false),
+    elementEnd(0),
+    latencyCount(0),
+    totalLatency(0),
+    maxLatency(0),
+    overBudget(0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(endOfElement()));
+}
+
+
+TorKeyer::~TorKeyer()
+{
+  stopRunning();
+
+  if (timer) delete timer;
+}
+
+
+void TorKeyer::setMode(
+  TorKeyerMode m)
+{
+  mode = m;
+}
+
+
+void TorKeyer::setDotDuration(
+  unsigned int duration)
+{
+  dotDuration = qint64(duration) * 1000;
+}
+
+
+void TorKeyer::openInput(
+  QString path)
+{
+  if (path == "-")
+  {
+    inputDescriptor = STDIN_FILENO;
+  }
+  else
+  {
+    inputDescriptor =
+      open(path.toLocal8Bit().constData(), O_RDONLY | O_NONBLOCK);
+
+    if (inputDescriptor == -1)
+    {
+      QString ss;
+      ss += "Failed to open keyer input ";
+      ss += path;
+      ss += "\nError is ";
+      ss += strerror(errno);
+      throw TorException(ss);
+    }
+
+    ownsDescriptor = true;
+  }
+
+  int version;
+  if (ioctl(inputDescriptor, EVIOCGVERSION, &version) == 0)
+  {
+    isEvdev = true;
+
+    // Have the kernel stamp events against the same clock we use:
+    int clockId = CLOCK_MONOTONIC;
+    evdevTimesMatch =
+      (ioctl(inputDescriptor, EVIOCSCLOCKID, &clockId) == 0);
+  }
+  else if (isatty(inputDescriptor))
+  {
+    if (mode == Straight_Keyer)
+    {
+      throw TorException(
+        "A straight key needs key releases, which only evdev devices report");
+    }
+
+    if (tcgetattr(inputDescriptor, &savedTerminal) == -1)
+    {
+      QString ss;
+      ss += "Failed to read terminal settings.\nError is ";
+      ss += strerror(errno);
+      throw TorException(ss);
+    }
+
+    // Raw input, a byte at a time, with Ctrl-C handled here rather than
+    // raising a signal:
+    struct termios raw = savedTerminal;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+
+    if (tcsetattr(inputDescriptor, TCSANOW, &raw) == -1)
+    {
+      QString ss;
+      ss += "Failed to put terminal into raw mode.\nError is ";
+      ss += strerror(errno);
+      throw TorException(ss);
+    }
+
+    terminalChanged = true;
+  }
+  else
+  {
+    QString ss;
+    ss += path;
+    ss += " is neither a terminal nor an evdev device";
+    throw TorException(ss);
+  }
+
+  notifier = new QSocketNotifier(inputDescriptor, QSocketNotifier::Read);
+
+  connect(
+    notifier,
+    SIGNAL(activated(int)),
+    this,
+    SLOT(readInput()));
+}
+
+
+void TorKeyer::stopRunning()
+{
+  timer->stop();
+
+  if (notifier)
+  {
+    // We may be inside the notifier's own signal:
+    notifier->setEnabled(false);
+    notifier->deleteLater();
+    notifier = 0;
+  }
+
+  if (terminalChanged)
+  {
+    tcsetattr(inputDescriptor, TCSANOW, &savedTerminal);
+    terminalChanged = false;
+  }
+
+  if (ownsDescriptor)
+  {
+    close(inputDescriptor);
+    ownsDescriptor = false;
+  }
+
+  inputDescriptor = -1;
+}
+
+
+void TorKeyer::writeReport(
+  QTextStream &out)
+{
+  if (!latencyCount)
+  {
+    out << "Keyer: no keyed edges" << endl;
+    return;
+  }
+
+  out << "Keyer: " << latencyCount << " keyed edges, latency mean ";
+  out << QString::number(totalLatency / 1000.0 / latencyCount, 'f', 3);
+  out << " ms, max " << QString::number(maxLatency / 1000.0, 'f', 3);
+  out << " ms; " << overBudget << " over ";
+  out << KEYER_LATENCY_BUDGET / 1000 << " ms";
+
+  if (!isEvdev || !evdevTimesMatch)
+  {
+    out << " (measured from when input was read)";
+  }
+
+  out << endl;
+}
+
+
+void TorKeyer::readInput()
+{
+  if (isEvdev)
+  {
+    readEvdev();
+  }
+  else
+  {
+    readTerminal();
+  }
+}
+
+
+void TorKeyer::readEvdev()
+{
+  struct input_event events[KEYER_EVENT_BATCH];
+
+  ssize_t count = read(inputDescriptor, events, sizeof(events));
+  if (count <= 0) return;
+
+  qint64 readTime = clock->currentTime();
+
+  int total = count / sizeof(struct input_event);
+  int i = 0;
+  while (i < total)
+  {
+    const struct input_event &event = events[i];
+    ++i;
+
+    // Only presses and releases; autorepeats change nothing:
+    if ((event.type != EV_KEY) || (event.value == 2)) continue;
+
+    if (event.code == KEY_ESC)
+    {
+      emit keyerFinished();
+      return;
+    }
+
+    qint64 eventTime = readTime;
+    if (evdevTimesMatch)
+    {
+      eventTime = qint64(event.time.tv_sec) * 1000000 + event.time.tv_usec;
+    }
+
+    TorKey key = Other_Key;
+    switch (event.code)
+    {
+    case KEY_Z:
+    case KEY_LEFT:
+    case KEY_LEFTCTRL:
+    case KEY_DOT:
+    case BTN_LEFT:
+      key = Dit_Key;
+      break;
+
+    case KEY_X:
+    case KEY_RIGHT:
+    case KEY_RIGHTCTRL:
+    case KEY_MINUS:
+    case BTN_RIGHT:
+      key = Dah_Key;
+      break;
+
+    default:
+      break;
+    }
+
+    handleKey(key, (event.value == 1), eventTime);
+  }
+}
+
+
+void TorKeyer::readTerminal()
+{
+  char buffer[64];
+
+  ssize_t count = read(inputDescriptor, buffer, sizeof(buffer));
+  if (count <= 0) return;
+
+  qint64 readTime = clock->currentTime();
+
+  ssize_t i = 0;
+  while (i < count)
+  {
+    char c = buffer[i];
+    ++i;
+
+    // Ctrl-C and Ctrl-D:
+    if ((c == 3) || (c == 4))
+    {
+      emit keyerFinished();
+      return;
+    }
+
+    queueCharacter(c);
+  }
+
+  if (!elementActive) startNextElement(readTime);
+}
+
+
+void TorKeyer::handleKey(
+  TorKey key,
+  bool pressed,
+  qint64 eventTime)
+{
+  if (mode == Straight_Keyer)
+  {
+    if (pressed != lightOn) setLight(pressed, eventTime);
+    return;
+  }
+
+  if (key == Dit_Key)
+  {
+    ditHeld = pressed;
+    if (pressed) ditMemory = true;
+  }
+  else if (key == Dah_Key)
+  {
+    dahHeld = pressed;
+    if (pressed) dahMemory = true;
+  }
+  else
+  {
+    return;
+  }
+
+  if (pressed && !elementActive) startNextElement(eventTime);
+}
+
+
+void TorKeyer::queueCharacter(
+  char c)
+{
+  if (c == '.')
+  {
+    queue.append(1);
+  }
+  else if (c == '-')
+  {
+    queue.append(3);
+  }
+  else if (c == ' ')
+  {
+    // With the gap already left after the last character, a word gap:
+    queue.append(-4);
+  }
+  else
+  {
+    const char *code = torMorseCode(c);
+    if (!code) return;
+
+    while (*code)
+    {
+      queue.append((*code == '.') ? 1 : 3);
+      ++code;
+    }
+
+    // Stretch the space after the last element out to a character gap:
+    queue.append(-2);
+  }
+}
+
+
+void TorKeyer::startNextElement(
+  qint64 eventTime)
+{
+  int units = 0;
+
+  if (!queue.isEmpty())
+  {
+    units = queue.takeFirst();
+  }
+  else
+  {
+    // Paddles, whether still held or pressed during the last element:
+    bool dit = ditHeld || ditMemory;
+    bool dah = dahHeld || dahMemory;
+
+    if (dit && dah)
+    {
+      // Squeezed, so alternate:
+      dit = !lastWasDit;
+      dah = lastWasDit;
+    }
+
+    if (dit)
+    {
+      units = 1;
+      ditMemory = false;
+      lastWasDit = true;
+    }
+    else if (dah)
+    {
+      units = 3;
+      dahMemory = false;
+      lastWasDit = false;
+    }
+  }
+
+  if (!units)
+  {
+    elementActive = false;
+    return;
+  }
+
+  // Carry on from the end of the last element, unless we've been idle:
+  qint64 start = elementActive ? elementEnd : clock->currentTime();
+  elementActive = true;
+
+  if (units > 0)
+  {
+    elementEnd = start + units * dotDuration;
+    timer->startAt(elementEnd);
+    setLight(true, eventTime);
+  }
+  else
+  {
+    elementEnd = start - units * dotDuration;
+    timer->startAt(elementEnd);
+  }
+}
+
+
+void TorKeyer::endOfElement()
+{
+  if (lightOn)
+  {
+    // Every element is followed by a one-dot space:
+    elementEnd += dotDuration;
+    timer->startAt(elementEnd);
+    setLight(false, -1);
+    return;
+  }
+
+  startNextElement(-1);
+}
+
+
+void TorKeyer::setLight(
+  bool on,
+  qint64 eventTime)
+{
+  try
+  {
+    if (channel == Torch_Channel)
+    {
+      if (on)
+      {
+        led->turnTorchOn();
+      }
+      else
+      {
+        led->turnTorchOff();
+      }
+    }
+    else
+    {
+      if (on)
+      {
+        led->turnIndicatorOn();
+      }
+      else
+      {
+        led->turnIndicatorOff();
+      }
+    }
+  }
+  catch (TorException &e)
+  {
+    QTextStream qts(stderr);
+    qts << e.getError() << endl;
+    emit keyerFinished();
+    return;
+  }
+
+  lightOn = on;
+
+  // Only edges caused directly by a key count towards latency:
+  if (eventTime < 0) return;
+
+  qint64 latency = clock->currentTime() - eventTime;
+
+  ++latencyCount;
+  totalLatency += latency;
+  if (latency > maxLatency) maxLatency = latency;
+  if (latency > KEYER_LATENCY_BUDGET) ++overBudget;
+}
@@ -0,0 +1,159 @@
+//
+// torkeyer.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORKEYER_H
+#define TORKEYER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include "torledbackend.h"
+
+#include <termios.h>
+
+class TorClock;
+class TorTimer;
+class QSocketNotifier;
+class QTextStream;
+
+enum TorKeyerMode
+{
+  Straight_Keyer,
+  Iambic_Keyer
+};
+
+
+// Live Morse keying, straight to the LEDs.  Input comes either from an
+// evdev device, or from a terminal switched into raw mode:
+//
+// evdev: as a straight key, any key lights the LED for as long as it is
+// held.  As an iambic keyer, Z, Left, Left Ctrl, "." or the left mouse
+// button are the dot paddle, and X, Right, Right Ctrl, "-" or the right
+// mouse button the dash paddle; squeezing both alternates dots and dashes.
+// Escape ends the session.
+//
+// Terminal: terminals don't report key releases, so only the keyer works:
+// "." and "-" send single elements, letters and digits send their Morse
+// code, and a space sends a word gap.  Ctrl-C or Ctrl-D ends the session.
+//
+// Key-to-light latency is measured from the input event's timestamp (or,
+// for terminals, from when it was read) to when the LED call returns.
+class TorKeyer: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorKeyer(
+    TorClock *clock,
+    TorLEDBackend *led,
+    TorLEDChannel channel);
+
+  ~TorKeyer();
+
+  void setMode(
+    TorKeyerMode mode);
+
+  void setDotDuration(
+    unsigned int duration);
+
+  // A terminal or evdev device path, or "-" for standard input:
+  void openInput(
+    QString path);
+
+  void stopRunning();
+
+  void writeReport(
+    QTextStream &out);
+
+signals:
+  void keyerFinished();
+
+private slots:
+  void readInput();
+  void endOfElement();
+
+private:
+  enum TorKey
+  {
+    Other_Key,
+    Dit_Key,
+    Dah_Key
+  };
+
+  void readEvdev();
+  void readTerminal();
+
+  void handleKey(
+    TorKey key,
+    bool pressed,
+    qint64 eventTime);
+
+  void queueCharacter(
+    char c);
+
+  void startNextElement(
+    qint64 eventTime);
+
+  void setLight(
+    bool on,
+    qint64 eventTime);
+
+  TorClock *clock;
+  TorTimer *timer;
+  TorLEDBackend *led;
+  TorLEDChannel channel;
+  TorKeyerMode mode;
+  qint64 dotDuration;
+
+  int inputDescriptor;
+  bool ownsDescriptor;
+  bool isEvdev;
+  bool evdevTimesMatch;
+  bool terminalChanged;
+  struct termios savedTerminal;
+  QSocketNotifier *notifier;
+
+  // Paddle state:
+  bool ditHeld;
+  bool dahHeld;
+  bool ditMemory;
+  bool dahMemory;
+  bool lastWasDit;
+
+  // Elements waiting to go out from the terminal, in dots; positive
+  // values are lit, negative ones dark:
+  QList<int> queue;
+
+  bool elementActive;
+  bool lightOn;
+  qint64 elementEnd;
+
+  // Statistics:
+  unsigned int latencyCount;
+  qint64 totalLatency;
+  qint64 maxLatency;
+  unsigned int overBudget;
+};
+
+#endif // TORKEYER_H
@@ -0,0 +1,61 @@
+//
+// torlatencyestimator.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torlatencyestimator.h"
+
+
+TorLatencyEstimator::TorLatencyEstimator()
+  : scaledEstimate(0),
+    sampleCount(0)
+{
+}
+
+
+void TorLatencyEstimator::addSample(
+  qint64 latency)
+{
+  if (latency < 0) latency = 0;
+
+  if (sampleCount == 0)
+  {
+    scaledEstimate = latency * 8;
+  }
+  else
+  {
+    scaledEstimate += latency - (scaledEstimate / 8);
+  }
+
+  ++sampleCount;
+}
+
+
+qint64 TorLatencyEstimator::getEstimate()
+{
+  return scaledEstimate / 8;
+}
+
+
+unsigned int TorLatencyEstimator::getSampleCount()
+{
+  return sampleCount;
+}
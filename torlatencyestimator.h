@@ -0,0 +1,51 @@
+//
+// torlatencyestimator.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORLATENCYESTIMATOR_H
+#define TORLATENCYESTIMATOR_H
+
+#include <QtGlobal>
+
+// A rolling estimate of how long some operation takes, kept as an
+// exponentially weighted moving average (each new sample gets a weight of
+// 1/8, much like TCP's smoothed round-trip time).
+class TorLatencyEstimator
+{
+public:
+  TorLatencyEstimator();
+
+  void addSample(
+    qint64 latency);
+
+  // In microseconds; zero until the first sample arrives:
+  qint64 getEstimate();
+
+  unsigned int getSampleCount();
+
+private:
+  // Kept scaled up by 8, to hold onto some precision:
+  qint64 scaledEstimate;
+  unsigned int sampleCount;
+};
+
+#endif // TORLATENCYESTIMATOR_H
@@ -0,0 +1,76 @@
+//
+// torledbackend.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torledbackend.h"
+
+
+TorLEDBackend::TorLEDBackend()
+  : torchEdges(0),
+    indicatorEdges(0)
+{
+}
+
+
+TorLEDBackend::~TorLEDBackend()
+{
+}
+
+
+void TorLEDBackend::addEdgeListener(
+  TorEdgeListener *listener)
+{
+  listeners.append(listener);
+}
+
+
+void TorLEDBackend::registerMetrics(
+  TorCoreMetrics &metrics)
+{
+  metrics.addCounter(
+    "torchio_led_edges_total",
+    "channel=\"torch\"",
+    "Changes of LED state.",
+    &torchEdges);
+
+  metrics.addCounter(
+    "torchio_led_edges_total",
+    "channel=\"indicator\"",
+    "Changes of LED state.",
+    &indicatorEdges);
+}
+
+
+void TorLEDBackend::notifyEdge(
+  TorLEDChannel channel,
+  int intensity)
+{
+  if (channel == Torch_Channel) ++torchEdges;
+  else ++indicatorEdges;
+
+  QList<TorEdgeListener *>::const_iterator i = listeners.constBegin();
+  while (i != listeners.constEnd())
+  {
+    (*i)->edgeEmitted(channel, intensity);
+    ++i;
+  }
+}
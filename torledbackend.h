@@ -0,0 +1,109 @@
+//
+// torledbackend.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORLEDBACKEND_H
+#define TORLEDBACKEND_H
+
+#include "torcoremetrics.h"
+
+#include <QList>
+
+enum TorLEDChannel
+{
+  Torch_Channel,
+  Indicator_Channel
+};
+
+
+// Anything that wants to see each change in LED state as it happens:
+class TorEdgeListener
+{
+public:
+  virtual ~TorEdgeListener() {}
+
+  virtual void edgeEmitted(
+    TorLEDChannel channel,
+    int intensity) = 0;
+};
+
+
+// The set of LED operations the controller relies on.  TorFlashLED drives
+// the real hardware; TorFakeLED stands in for it under simulation.
+class TorLEDBackend
+{
+public:
+  TorLEDBackend();
+  virtual ~TorLEDBackend();
+
+  virtual void turnTorchOn() = 0;
+  virtual void turnTorchOff() = 0;
+
+  virtual void turnIndicatorOn() = 0;
+  virtual void turnIndicatorOff() = 0;
+
+  // Set a channel to any level within its hardware range (out of range
+  // values are clamped):
+  virtual void setIntensity(
+    TorLEDChannel channel,
+    int intensity) = 0;
+
+  virtual int getMinIntensity(
+    TorLEDChannel channel) = 0;
+
+  virtual int getMaxIntensity(
+    TorLEDChannel channel) = 0;
+
+  // Flash strobe.  Flash durations are in microseconds, and out of range
+  // values are clamped.  prepareStrobe() programs the flash brightness and
+  // duration; after that, each triggerStrobe() just fires the flash:
+  virtual int getMinTime() = 0;
+  virtual int getMaxTime() = 0;
+  virtual int getChosenTime() = 0;
+
+  virtual void setFlashDuration(
+    int duration) = 0;
+
+  virtual void prepareStrobe() = 0;
+  virtual void triggerStrobe() = 0;
+
+  // Listeners are not owned by the backend:
+  void addEdgeListener(
+    TorEdgeListener *listener);
+
+  // Edges on each channel; backends with more to count add to this:
+  virtual void registerMetrics(
+    TorCoreMetrics &metrics);
+
+protected:
+  // Backends call this whenever a channel actually changes intensity:
+  void notifyEdge(
+    TorLEDChannel channel,
+    int intensity);
+
+private:
+  QList<TorEdgeListener *> listeners;
+  TorCoreCounter torchEdges;
+  TorCoreCounter indicatorEdges;
+};
+
+#endif // TORLEDBACKEND_H
@@ -0,0 +1,241 @@
+//
+// torlightsensor.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torlightsensor.h"
+#include "torclock.h"
+#include "tortimer.h"
+#include "tormorsedecoder.h"
+#include "torexception.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SAMPLE_FILE_MAGIC "TORSMP1\n"
+#define SAMPLE_FILE_MAGIC_SIZE 8
+#define SAMPLE_RECORD_SIZE 12
+#define SAMPLE_BUFFER_SIZE 65536
+
+
+TorLightSensor::TorLightSensor(
+  TorClock *c,
+  TorMorseDecoder *d)
+  : clock(c),
+    timer(0),
+    decoder(d),
+    sensorDescriptor(-1),
+    samplePeriod(1000),
+    nextSample(0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(takeSample()));
+}
+
+
+TorLightSensor::~TorLightSensor()
+{
+  if (timer) delete timer;
+  if (sensorDescriptor >= 0) close(sensorDescriptor);
+}
+
+
+void TorLightSensor::startPolling(
+  QString path,
+  unsigned int sampleRate)
+{
+  sensorDescriptor = open(path.toLocal8Bit().constData(), O_RDONLY);
+
+  if (sensorDescriptor == -1)
+  {
+    QString ss;
+    ss += "Failed to open light sensor ";
+    ss += path;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorException(ss);
+  }
+
+  if (!sampleRate) sampleRate = 1;
+  samplePeriod = 1000000 / sampleRate;
+
+  nextSample = clock->currentTime();
+  takeSample();
+}
+
+
+void TorLightSensor::stopRunning()
+{
+  timer->stop();
+}
+
+
+void TorLightSensor::decodeFile(
+  QString filename)
+{
+  int fd = open(filename.toLocal8Bit().constData(), O_RDONLY);
+
+  if (fd == -1)
+  {
+    QString ss;
+    ss += "Failed to open sample file ";
+    ss += filename;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorException(ss);
+  }
+
+  char magic[SAMPLE_FILE_MAGIC_SIZE];
+
+  if ( (read(fd, magic, SAMPLE_FILE_MAGIC_SIZE) == SAMPLE_FILE_MAGIC_SIZE)
+    && !memcmp(magic, SAMPLE_FILE_MAGIC, SAMPLE_FILE_MAGIC_SIZE))
+  {
+    decodeBinaryFile(fd);
+  }
+  else
+  {
+    lseek(fd, 0, SEEK_SET);
+    decodeCSVFile(fd);
+  }
+
+  close(fd);
+
+  decoder->finish();
+}
+
+
+void TorLightSensor::takeSample()
+{
+  // sysfs attributes are re-read from the start each time:
+  char buffer[32];
+  ssize_t count = pread(sensorDescriptor, buffer, sizeof(buffer) - 1, 0);
+
+  if (count > 0)
+  {
+    buffer[count] = '\0';
+    decoder->addSample(clock->currentTime(), strtol(buffer, 0, 10));
+  }
+
+  nextSample += samplePeriod;
+  timer->startAt(nextSample);
+}
+
+
+void TorLightSensor::decodeBinaryFile(
+  int fd)
+{
+  unsigned char buffer[SAMPLE_BUFFER_SIZE];
+  ssize_t leftover = 0;
+  ssize_t count;
+
+  while ((count = read(fd, buffer + leftover, SAMPLE_BUFFER_SIZE - leftover)) > 0)
+  {
+    count += leftover;
+
+    const unsigned char *record = buffer;
+    const unsigned char *end = buffer + count;
+
+    while (end - record >= SAMPLE_RECORD_SIZE)
+    {
+      quint64 time = 0;
+      quint32 value = 0;
+
+      for (int i = 7; i >= 0; --i) time = (time << 8) | record[i];
+      for (int i = 11; i >= 8; --i) value = (value << 8) | record[i];
+
+      decoder->addSample(time, qint32(value));
+
+      record += SAMPLE_RECORD_SIZE;
+    }
+
+    // Hold onto any partial record for the next pass:
+    leftover = end - record;
+    memmove(buffer, record, leftover);
+  }
+}
+
+
+void TorLightSensor::decodeCSVFile(
+  int fd)
+{
+  char buffer[SAMPLE_BUFFER_SIZE];
+  ssize_t leftover = 0;
+  ssize_t count;
+
+  while ((count = read(fd, buffer + leftover, SAMPLE_BUFFER_SIZE - leftover - 1)) > 0)
+  {
+    count += leftover;
+    buffer[count] = '\0';
+
+    char *line = buffer;
+    char *newline;
+
+    while ((newline = (char *)memchr(line, '\n', buffer + count - line)))
+    {
+      *newline = '\0';
+
+      char *field;
+      long long time = strtoll(line, &field, 10);
+
+      if ((field != line) && (*field == ','))
+      {
+        char *valueEnd;
+        long value = strtol(field + 1, &valueEnd, 10);
+
+        if (valueEnd != field + 1) decoder->addSample(time, value);
+      }
+
+      line = newline + 1;
+    }
+
+    leftover = buffer + count - line;
+
+    if (leftover >= SAMPLE_BUFFER_SIZE - 1)
+    {
+      // A single line filling the whole buffer; nothing useful in it.
+      leftover = 0;
+    }
+
+    memmove(buffer, line, leftover);
+  }
+
+  // A last line without a newline:
+  if (leftover > 0)
+  {
+    buffer[leftover] = '\0';
+
+    char *field;
+    long long time = strtoll(buffer, &field, 10);
+
+    if ((field != buffer) && (*field == ','))
+    {
+      decoder->addSample(time, strtol(field + 1, 0, 10));
+    }
+  }
+}
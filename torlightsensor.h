@@ -0,0 +1,83 @@
+//
+// torlightsensor.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORLIGHTSENSOR_H
+#define TORLIGHTSENSOR_H
+
+#include <QObject>
+#include <QString>
+
+class TorClock;
+class TorTimer;
+class TorMorseDecoder;
+
+// Feeds light level samples to a decoder, either live from a sysfs
+// illuminance attribute (polled at a fixed rate), or from a recorded
+// sample file.  Sample files come in two forms:
+//
+// CSV text: one "time,value" pair per line, with the time in microseconds;
+// lines that don't start with a number (headers, comments) are skipped.
+//
+// Binary: the 8 bytes "TORSMP1\n", then 12-byte records of a 64-bit
+// little-endian time in microseconds and a 32-bit little-endian value.
+class TorLightSensor: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorLightSensor(
+    TorClock *clock,
+    TorMorseDecoder *decoder);
+
+  ~TorLightSensor();
+
+  void startPolling(
+    QString path,
+    unsigned int sampleRate);
+
+  void stopRunning();
+
+  // Runs through an entire file as fast as possible:
+  void decodeFile(
+    QString filename);
+
+private slots:
+  void takeSample();
+
+private:
+  void decodeBinaryFile(
+    int fd);
+
+  void decodeCSVFile(
+    int fd);
+
+  TorClock *clock;
+  TorTimer *timer;
+  TorMorseDecoder *decoder;
+
+  int sensorDescriptor;
+  qint64 samplePeriod;
+  qint64 nextSample;
+};
+
+#endif // TORLIGHTSENSOR_H
@@ -0,0 +1,387 @@
+//
+// tormetricsexporter.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+#include "tormetricsexporter.h"
+#include "tortimer.h"
+#include "torexception.h"
+
+#include <QSocketNotifier>
+#include <QTextStream>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+// How many times each part of the benchmark is repeated:
+#define BENCHMARK_UPDATES 10000000
+#define BENCHMARK_EXPORTS 10000
+
+
+TorMetricsExporter::TorMetricsExporter(
+  TorClock *c,
+  TorCoreMetrics *m)
+  : clock(c),
+    metrics(m),
+    fileInterval(0),
+    fileTimer(0),
+    fileFailed(false),
+    fileError(0),
+    socketDescriptor(-1),
+    notifier(0),
+    connections(0)
+{
+  metrics->addSummary(
+    "torchio_metrics_export_seconds",
+    "",
+    "Time spent rendering and writing each metrics export.",
+    &exportTime);
+
+  metrics->addCounter(
+    "torchio_metrics_connections_total",
+    "",
+    "Connections served on the metrics socket.",
+    &connections);
+}
+
+
+TorMetricsExporter::~TorMetricsExporter()
+{
+  stopRunning();
+
+  if (fileTimer) delete fileTimer;
+}
+
+
+void TorMetricsExporter::exportToFile(
+  QString path,
+  qint64 interval)
+{
+  filePath = path;
+  fileInterval = interval;
+
+  // Any problem with the path is best found straight away:
+  if (!writeFile())
+  {
+    QString ss;
+    ss += "Failed to write metrics file ";
+    ss += filePath;
+    ss += "\nError is ";
+    ss += strerror(fileError);
+    throw TorException(ss);
+  }
+
+  fileTimer = clock->createTimer();
+
+  connect(
+    fileTimer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(rewriteFile()));
+
+  fileTimer->startAt(clock->currentTime() + fileInterval);
+}
+
+
+void TorMetricsExporter::listenOnSocket(
+  QString path)
+{
+  QByteArray name = path.toLocal8Bit();
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (name.size() >= int(sizeof(address.sun_path)))
+  {
+    throw TorException("Metrics socket path is too long");
+  }
+
+  strcpy(address.sun_path, name.constData());
+
+  // A socket left behind by an earlier run can go, but nothing else:
+  struct stat info;
+  if (lstat(name.constData(), &info) == 0)
+  {
+    if (!S_ISSOCK(info.st_mode))
+    {
+      QString ss;
+      ss += path;
+      ss += " already exists, and is not a socket";
+      throw TorException(ss);
+    }
+
+    unlink(name.constData());
+  }
+
+  socketDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if ( (socketDescriptor == -1)
+    || (bind(
+          socketDescriptor,
+          (struct sockaddr *) &address,
+          sizeof(address)) == -1)
+    || (listen(socketDescriptor, 4) == -1))
+  {
+    QString ss;
+    ss += "Failed to listen on metrics socket ";
+    ss += path;
+    ss += "\nError is ";
+    ss += strerror(errno);
+
+    if (socketDescriptor != -1)
+    {
+      close(socketDescriptor);
+      socketDescriptor = -1;
+    }
+
+    throw TorException(ss);
+  }
+
+  fcntl(
+    socketDescriptor,
+    F_SETFL,
+    fcntl(socketDescriptor, F_GETFL) | O_NONBLOCK);
+
+  socketPath = path;
+
+  notifier = new QSocketNotifier(
+    socketDescriptor,
+    QSocketNotifier::Read,
+    this);
+
+  connect(
+    notifier,
+    SIGNAL(activated(int)),
+    this,
+    SLOT(acceptConnections()));
+}
+
+
+void TorMetricsExporter::stopRunning()
+{
+  if (fileTimer && fileTimer->isActive())
+  {
+    fileTimer->stop();
+    writeFile();
+  }
+
+  if (notifier)
+  {
+    notifier->setEnabled(false);
+    notifier->deleteLater();
+    notifier = 0;
+  }
+
+  if (socketDescriptor != -1)
+  {
+    close(socketDescriptor);
+    socketDescriptor = -1;
+    unlink(socketPath.toLocal8Bit().constData());
+  }
+}
+
+
+void TorMetricsExporter::rewriteFile()
+{
+  if (writeFile())
+  {
+    fileFailed = false;
+  }
+  else if (!fileFailed)
+  {
+    // Keep trying, but only complain the first time:
+    QTextStream qts(stderr);
+    qts << "Warning: failed to write metrics file " << filePath;
+    qts << ": " << strerror(fileError) << endl;
+    fileFailed = true;
+  }
+
+  // Re-arm from the previous deadline, so that exports don't drift:
+  qint64 next = fileTimer->getDeadline() + fileInterval;
+  if (next < clock->currentTime()) next = clock->currentTime();
+
+  fileTimer->startAt(next);
+}
+
+
+void TorMetricsExporter::acceptConnections()
+{
+  int client;
+  while ((client = accept(socketDescriptor, 0, 0)) != -1)
+  {
+    qint64 exportStart = wallClock.currentTime();
+
+    ++connections;
+    text.clear();
+    metrics->render(text);
+
+    // Exports are small enough to go out in one go:
+    const char *data = text.data();
+    size_t remaining = text.size();
+    while (remaining > 0)
+    {
+      ssize_t written = write(client, data, remaining);
+      if (written == -1)
+      {
+        if (errno == EINTR) continue;
+        break;
+      }
+
+      data += written;
+      remaining -= written;
+    }
+
+    close(client);
+
+    exportTime.record(wallClock.currentTime() - exportStart);
+  }
+}
+
+
+bool TorMetricsExporter::writeFile()
+{
+  qint64 exportStart = wallClock.currentTime();
+
+  text.clear();
+  metrics->render(text);
+
+  // Write alongside, then rename over the old file, so that readers
+  // never see a partial export:
+  QByteArray finalName = filePath.toLocal8Bit();
+  QByteArray tempName = (filePath + ".tmp").toLocal8Bit();
+
+  int descriptor = open(
+    tempName.constData(),
+    O_WRONLY | O_CREAT | O_TRUNC,
+    0644);
+
+  bool succeeded =
+    (descriptor != -1)
+    && (write(descriptor, text.data(), text.size()) == ssize_t(text.size()));
+
+  if (!succeeded) fileError = errno;
+
+  if ((descriptor != -1) && (close(descriptor) == -1) && succeeded)
+  {
+    fileError = errno;
+    succeeded = false;
+  }
+
+  if (succeeded && (rename(tempName.constData(), finalName.constData()) == -1))
+  {
+    fileError = errno;
+    succeeded = false;
+  }
+
+  exportTime.record(wallClock.currentTime() - exportStart);
+
+  return succeeded;
+}
+
+
+void TorMetricsExporter::writeBenchmark(
+  QTextStream &out)
+{
+  TorSystemClock wallClock;
+
+  // Counter updates, through a volatile pointer so that the loop can't
+  // be folded away:
+  TorCoreCounter counter = 0;
+  volatile TorCoreCounter *target = &counter;
+
+  qint64 start = wallClock.currentTime();
+  for (int i = 0; i < BENCHMARK_UPDATES; ++i)
+  {
+    ++*target;
+  }
+  qint64 counterTime = wallClock.currentTime() - start;
+
+  TorCoreSummary summary;
+  TorCoreSummary *volatile summaryTarget = &summary;
+
+  start = wallClock.currentTime();
+  for (int i = 0; i < BENCHMARK_UPDATES; ++i)
+  {
+    summaryTarget->record(i & 0xFFF);
+  }
+  qint64 summaryTime = wallClock.currentTime() - start;
+
+  // A registry the size of a full Torchio run's:
+  TorCoreMetrics metrics;
+  TorCoreCounter counters[24];
+  TorCoreSummary summaries[4];
+
+  for (int i = 0; i < 24; ++i)
+  {
+    counters[i] = 1234567 * i;
+    metrics.addCounter(
+      (i < 12) ? "torchio_benchmark_a_total" : "torchio_benchmark_b_total",
+      "label=\"benchmark\"",
+      "Benchmark counter.",
+      &counters[i]);
+  }
+
+  for (int i = 0; i < 4; ++i)
+  {
+    summaries[i].record(1000 * i);
+    metrics.addSummary(
+      "torchio_benchmark_seconds",
+      "label=\"benchmark\"",
+      "Benchmark summary.",
+      &summaries[i]);
+  }
+
+  std::string text;
+  start = wallClock.currentTime();
+  for (int i = 0; i < BENCHMARK_EXPORTS; ++i)
+  {
+    text.clear();
+    metrics.render(text);
+  }
+  qint64 renderTime = wallClock.currentTime() - start;
+
+  double counterCost = 1000.0 * counterTime / BENCHMARK_UPDATES;
+  double summaryCost = 1000.0 * summaryTime / BENCHMARK_UPDATES;
+  double renderCost = double(renderTime) / BENCHMARK_EXPORTS;
+
+  // Each Morse edge bumps an edge counter and an ioctl counter, and
+  // records its lateness:
+  double edgeCost = 2 * counterCost + summaryCost;
+
+  out << "Counter update: " << QString::number(counterCost, 'f', 2);
+  out << " ns" << endl;
+  out << "Summary update: " << QString::number(summaryCost, 'f', 2);
+  out << " ns" << endl;
+  out << "Export of " << metrics.getSeriesCount() << " series (";
+  out << text.size() << " bytes): " << QString::number(renderCost, 'f', 1);
+  out << " us" << endl;
+  out << "Instrumentation per LED edge: " << QString::number(edgeCost, 'f', 2);
+  out << " ns; at 1000 edges per second with an export every second, ";
+  out << QString::number((edgeCost * 1000 + renderCost * 1000) / 1e9 * 100, 'f', 4);
+  out << "% of the CPU" << endl;
+}
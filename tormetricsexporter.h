@@ -0,0 +1,96 @@
+//
+// tormetricsexporter.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+#ifndef TORMETRICSEXPORTER_H
+#define TORMETRICSEXPORTER_H
+
+#include <QObject>
+#include <QString>
+#include "torclock.h"
+#include "torcoremetrics.h"
+
+#include <string>
+
+class QTextStream;
+class QSocketNotifier;
+class TorTimer;
+
+// Publishes a TorCoreMetrics registry in the Prometheus text format,
+// either as a file rewritten every so often (for node_exporter's
+// textfile collector), or on a Unix socket, where each connection is
+// sent a fresh export and then closed.
+class TorMetricsExporter: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorMetricsExporter(
+    TorClock *clock,
+    TorCoreMetrics *metrics);
+
+  ~TorMetricsExporter();
+
+  // The file is replaced atomically, every interval (in microseconds):
+  void exportToFile(
+    QString path,
+    qint64 interval);
+
+  void listenOnSocket(
+    QString path);
+
+  // Writes the file one last time, and stops serving:
+  void stopRunning();
+
+  // Times the instrumentation itself, so its cost is known:
+  static void writeBenchmark(
+    QTextStream &out);
+
+private slots:
+  void rewriteFile();
+  void acceptConnections();
+
+private:
+  // Returns false (with the reason in fileError) on failure:
+  bool writeFile();
+
+  TorClock *clock;
+  TorSystemClock wallClock;
+  TorCoreMetrics *metrics;
+
+  QString filePath;
+  qint64 fileInterval;
+  TorTimer *fileTimer;
+  bool fileFailed;
+  int fileError;
+
+  QString socketPath;
+  int socketDescriptor;
+  QSocketNotifier *notifier;
+
+  std::string text;
+
+  // The exporter's own cost:
+  TorCoreSummary exportTime;
+  TorCoreCounter connections;
+};
+
+#endif // TORMETRICSEXPORTER_H
@@ -22,24 +22,66 @@
 
 #include "tormorse.h"
 #include "torexception.h"
+#include "torclock.h"
+#include "tortimer.h"
+#include "tordatalink.h"
+#include "torcheckpoint.h"
+#include "torcarousel.h"
+#include "torwordcache.h"
+#include "torcoretrace.h"
 
-#include <QTimer>
 #include <QFile>
 //#include <QTextStream>
 
-
-TorMorse::TorMorse()
-  : runMorseContinuously(false),
-    morseConnected(false),
-    dotDuration(100)
+#include <ctype.h>
+#include <string.h>
+
+
+TorMorse::TorMorse(
+  TorClock *c)
+  : clock(c),
+    timer(0),
+    player(this),
+    compensateLatency(false),
+    pulseOpen(false),
+    pulseStart(0),
+    pulseShift(0),
+    pulseNominal(0),
+    pulseCount(0),
+    nominalOnTime(0),
+    compensatedError(0),
+    uncompensatedError(0),
+    edgeCount(0),
+    edgeError(0),
+    source(No_Source),
+    carousel(0),
+    lineRunIndex(0),
+    morseRunIndex(0),
+    checkpoint(0),
+    checkpointInterval(0),
+    checkpointActive(false),
+    nextCheckpoint(0),
+    wordIndex(0),
+    morseCodeIndex(0),
+    runStartIndex(0),
+    sosRunIndex(0),
+    eRunIndex(0),
+    dotDuration(100),
+    missedDeadlines(0),
+    encodedCharacters(0)
 {
-  setupSOSCode();
-  setupECode();
+  timer = clock->createTimer();
+
+  connect (timer, SIGNAL(timeout()), this, SLOT(runCode()));
+
+  setupRepeatingCode("SOS", sosRuns);
+  setupRepeatingCode("E", eRuns);
 }
 
 
 TorMorse::~TorMorse()
 {
+  if (timer) delete timer;
 }
 
 
@@ -47,66 +89,288 @@ void TorMorse::setDotDuration(
   unsigned int dd)
 {
   dotDuration = dd;
+  player.setDotDuration(dd);
+}
+
+
+void TorMorse::setLatencyCompensation(
+  bool compensate)
+{
+  compensateLatency = compensate;
+}
+
+
+void TorMorse::writeTimingReport(
+  QTextStream &stream)
+{
+  stream << "Torch on latency: " << onLatency.getEstimate() << " us, ";
+  stream << "off latency: " << offLatency.getEstimate() << " us ";
+  stream << "(" << (onLatency.getSampleCount() + offLatency.getSampleCount());
+  stream << " samples)" << endl;
+
+  stream << "Pulses: " << pulseCount << ", nominal on time: ";
+  stream << (nominalOnTime / 1000) << " ms" << endl;
+
+  if (!nominalOnTime) return;
+
+  // Errors are relative to the nominal on time, so they read directly as
+  // a duty-cycle error:
+  QString compensated =
+    QString::number(100.0 * compensatedError / nominalOnTime, 'f', 2);
+  QString uncompensated =
+    QString::number(100.0 * uncompensatedError / nominalOnTime, 'f', 2);
+
+  if (compensateLatency)
+  {
+    stream << "Duty-cycle error: " << compensated << "% compensated, ";
+    stream << uncompensated << "% uncompensated (estimated)" << endl;
+  }
+  else
+  {
+    stream << "Duty-cycle error: " << uncompensated << "% uncompensated";
+    stream << endl;
+  }
+}
+
+
+void TorMorse::setAlignment(
+  qint64 period)
+{
+  player.setAlignment(period);
+}
+
+
+void TorMorse::writeAlignmentReport(
+  QTextStream &stream)
+{
+  unsigned int alignedStarts = player.getAlignedStarts();
+
+  if (!alignedStarts)
+  {
+    stream << "No aligned starts were made" << endl;
+    return;
+  }
+
+  stream << "Aligned starts: " << alignedStarts << ", phase error ";
+  stream << "mean " << QString::number(
+    double(player.getPhaseErrorTotal()) / alignedStarts / 1000.0, 'f', 3);
+  stream << " ms, max ";
+  stream << QString::number(player.getMaxPhaseError() / 1000.0, 'f', 3);
+  stream << " ms" << endl;
+}
+
+
+void TorMorse::resetTimingStats()
+{
+  pulseOpen = false;
+  pulseCount = 0;
+  nominalOnTime = 0;
+  compensatedError = 0;
+  uncompensatedError = 0;
+  edgeCount = 0;
+  edgeError = 0;
+}
+
+
+qint64 TorMorse::getMeanEdgeError()
+{
+  if (!edgeCount) return 0;
+
+  return edgeError / edgeCount;
+}
+
+
+const TorCoreSummary &TorMorse::getEdgeLateness()
+{
+  return edgeLateness;
+}
+
+
+TorCoreCounter TorMorse::getMissedDeadlines()
+{
+  return missedDeadlines;
 }
 
 
 void TorMorse::startSOS()
 {
-  timer.stop();
-  sosCodePosition = sosCodeBits.begin();
-  connect (&timer, SIGNAL(timeout()), this, SLOT(runSOSCode()));
-  timer.start(dotDuration);
+  timer->stop();
+  sosRunIndex = 0;
+  source = SOS_Source;
+  startTicking();
 }
 
 
 void TorMorse::startE()
 {
-  timer.stop();
-  eCodePosition = eCodeBits.begin();
-  connect (&timer, SIGNAL(timeout()), this, SLOT(runECode()));
-  timer.start(dotDuration);
+  timer->stop();
+  eRunIndex = 0;
+  source = E_Source;
+  startTicking();
+}
+
+
+void TorMorse::startCarousel(
+  TorCarousel *c)
+{
+  timer->stop();
+  carousel = c;
+  carousel->rewind();
+  source = Carousel_Source;
+  startTicking();
 }
 
 
 void TorMorse::stopRunning()
 {
-  timer.stop();
+  if (checkpointActive)
+  {
+    // Interrupted; make sure the next run can pick up from here:
+    try
+    {
+      saveCheckpoint();
+      checkpoint->sync();
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+    }
+
+    checkpointActive = false;
+  }
+
+  player.stop();
+}
+
+
+void TorMorse::setCheckpoint(
+  TorCheckpoint *c,
+  qint64 interval)
+{
+  checkpoint = c;
+  checkpointInterval = interval;
 }
 
 
 void TorMorse::startMorseFromFile(
-  QString filename)
+  QString filename,
+  qint64 fileOffset,
+  qint64 unitOffset)
 {
   QFile file(filename);
 
-  if (!file.open(QFile::ReadOnly | QFile::Text))
+  if (!file.open(QFile::ReadOnly))
   {
     QString errString = "Error when opening file.  Qt error value: ";
     errString += file.error();
     throw TorException(errString);
   }
 
-  QTextStream stream(&file);
+  // Whatever came before the resume point is never even read:
+  if (fileOffset && !file.seek(fileOffset))
+  {
+    throw TorException("Couldn't seek to the resume point");
+  }
+
+  encodeFile(file.readAll(), fileOffset);
+
+  startPlayback();
+
+  // Skip the part of the first word that was already sent, which may end
+  // partway through a run:
+  while ( (morseCodeIndex < unitOffset)
+    && (morseRunIndex < morseRuns.size()))
+  {
+    TorCoreRun &run = morseRuns[morseRunIndex];
+
+    if (morseCodeIndex + run.units > unitOffset)
+    {
+      run.units -= unitOffset - morseCodeIndex;
+      morseCodeIndex = unitOffset;
+      break;
+    }
+
+    morseCodeIndex += run.units;
+    ++morseRunIndex;
+  }
 
-  startMorseFromStream(stream);
+  if (checkpoint)
+  {
+    checkpointActive = true;
+    nextCheckpoint = clock->currentTime() + checkpointInterval;
+  }
 }
 
 
 void TorMorse::startMorseFromStream(
   QTextStream &stream)
 {
-  // Create the morseCodeBits:
-  translateTextToBits(stream);
+  encodeText(stream);
+
+  startPlayback();
+}
+
+
+void TorMorse::startMorseFromLine(
+  const QByteArray &line,
+  TorWordCache &cache)
+{
+  TOR_TRACE_SPAN("encodeLine", "encode");
+
+  qint64 encodeStart = clock->currentTime();
+
+  timer->stop();
+  lineRuns.clear();
+  cache.encodeLine(line.constData(), line.size(), lineRuns);
+  lineRunIndex = 0;
+
+  encodedCharacters += line.size();
+  encodeTime.record(clock->currentTime() - encodeStart);
+
+  source = Line_Source;
+  startTicking();
+}
+
+
+void TorMorse::startDataFromFile(
+  QString filename,
+  TorDataEncoder &encoder)
+{
+  QFile file(filename);
+
+  if (!file.open(QFile::ReadOnly))
+  {
+    QString errString = "Error when opening file.  Qt error value: ";
+    errString += file.error();
+    throw TorException(errString);
+  }
+
+  QByteArray payload = file.readAll();
 
-  // Execute the morseCodeBits:
-  timer.stop();
-  morseCodePosition = morseCodeBits.begin();
-  if (!morseConnected)
+  if (payload.size() > 0xFFFF)
   {
-    connect (&timer, SIGNAL(timeout()), this, SLOT(runMorseCode()));
-    morseConnected = true;
+    throw TorException("Data link payloads are limited to 65535 bytes");
   }
-  timer.start(dotDuration);
+
+  TorBoolList units;
+  encoder.encode(payload, units);
+  setRunsFromBits(units);
+
+  startPlayback();
+}
+
+
+void TorMorse::startPlayback()
+{
+  timer->stop();
+  morseRunIndex = 0;
+  morseCodeIndex = 0;
+  runStartIndex = 0;
+  wordIndex = 0;
+  checkpointActive = false;
+  source = Morse_Source;
+  startTicking();
 }
 
 
@@ -152,379 +416,402 @@ void LanMorseForm::on_pauseButton_clicked()
 */
 
 
-/*
-void LanMorseForm::on_repeatCheckBox_toggled(bool checked)
+void TorMorse::runCode()
 {
-  runMorseContinuously = checked;
+  player.timerFired();
 }
-*/
 
 
-void TorMorse::runMorseCode()
+TorCorePlayerStep TorMorse::nextRun(
+  TorCoreRun &run)
 {
-  if (morseCodePosition == morseCodeBits.end())
+  switch (source)
   {
-    if (runMorseContinuously)
-    {
-      morseCodePosition = morseCodeBits.begin();
-    }
-    else
-    {
-      timer.stop();
-      emit morseFinished();
-      return;
-    }
-  }
+  case SOS_Source:
+    return nextRepeatingRun(sosRuns, sosRunIndex, run);
 
-  if (*morseCodePosition)
-  {
-    emit turnTorchOn();
-  }
-  else
-  {
-    emit turnTorchOff();
-  }
+  case E_Source:
+    return nextRepeatingRun(eRuns, eRunIndex, run);
 
-  ++morseCodePosition;
-}
+  case Morse_Source:
+    if (morseRunIndex == morseRuns.size()) return End_CorePlayerStep;
 
+    run = morseRuns[morseRunIndex];
+    ++morseRunIndex;
 
-void TorMorse::runSOSCode()
-{
-  if (sosCodePosition == sosCodeBits.end())
-  {
-    sosCodePosition = sosCodeBits.begin();
-  }
+    runStartIndex = morseCodeIndex;
+    morseCodeIndex += run.units;
+    return Run_CorePlayerStep;
 
-  if (*sosCodePosition)
-  {
-    emit turnTorchOn();
-  }
-  else
-  {
-    emit turnTorchOff();
-  }
+  case Line_Source:
+    if (lineRunIndex == lineRuns.size()) return End_CorePlayerStep;
+
+    run = lineRuns[lineRunIndex];
+    ++lineRunIndex;
+    return Run_CorePlayerStep;
+
+  case Carousel_Source:
+    // Repeating a message is what the carousel is for, so a single
+    // looping message is just a carousel of one:
+    if (!carousel->nextRun(run.lit, run.units)) return End_CorePlayerStep;
+
+    return Run_CorePlayerStep;
 
-  ++sosCodePosition;
+  case No_Source:
+  default:
+    // Nothing is playing, so there is nothing to wait for either:
+    return Stall_CorePlayerStep;
+  }
 }
 
 
-void TorMorse::runECode()
+TorCorePlayerStep TorMorse::nextRepeatingRun(
+  const std::vector<TorCoreRun> &runs,
+  size_t &position,
+  TorCoreRun &run)
 {
-  if (eCodePosition == eCodeBits.end())
+  if (position == runs.size())
   {
-    eCodePosition = eCodeBits.begin();
+    position = 0;
+    return Repeat_CorePlayerStep;
   }
 
-  if (*eCodePosition)
-  {
-    emit turnTorchOn();
-  }
-  else
+  run = runs[position];
+  ++position;
+  return Run_CorePlayerStep;
+}
+
+
+void TorMorse::playbackFinished()
+{
+  if (checkpointActive)
   {
-    emit turnTorchOff();
+    // All sent, so there's nothing left to resume:
+    checkpoint->clear();
+    checkpointActive = false;
   }
 
-  ++eCodePosition;
+  emit morseFinished();
 }
 
 
-
 //
-// This method will convert the desired text into morse code bits:
+// A checkpoint marks the run that is currently playing, so that a resumed
+// transmission repeats it rather than losing it:
 //
-void TorMorse::translateTextToBits(
-  QTextStream &stream)
+void TorMorse::saveCheckpoint()
 {
-  morseCodeBits.clear();
-
-  QChar c;
-  while (!stream.atEnd())
+  while ( (wordIndex + 1 < wordStarts.size())
+    && (wordStarts.at(wordIndex + 1).unitIndex <= runStartIndex))
   {
-    stream >> c;
-
-    switch (c.toAscii())
-    {
-    case 'a':
-    case 'A':
-      dot(); dash(); break;
-
-    case 'b':
-    case 'B':
-      dash(); dot(); dot(); dot(); break;
-
-    case 'c':
-    case 'C':
-      dash(); dot(); dash(); dot(); break;
-
-    case 'd':
-    case 'D':
-      dash(); dot(); dot(); break;
-
-    case 'e':
-    case 'E':
-      dot(); break;
-
-    case 'f':
-    case 'F':
-      dot(); dot(); dash(); dot(); break;
-
-    case 'g':
-    case 'G':
-      dash(); dash(); dot(); break;
+    ++wordIndex;
+  }
 
-    case 'h':
-    case 'H':
-      dot(); dot(); dot(); dot(); break;
+  if (wordStarts.isEmpty()) return;
 
-    case 'i':
-    case 'I':
-      dot(); dot(); break;
+  const TorMorseWordStart &word = wordStarts.at(wordIndex);
 
-    case 'j':
-    case 'J':
-      dot(); dash(); dash(); dash(); break;
+  checkpoint->save(word.fileOffset, runStartIndex - word.unitIndex);
+}
 
-    case 'k':
-    case 'K':
-      dash(); dot(); dash(); break;
 
-    case 'l':
-    case 'L':
-      dot(); dash(); dot(); dot(); break;
+//
+// Every start goes through the player, which waits a dot (or until the
+// next aligned boundary) before the first edge:
+//
+void TorMorse::startTicking()
+{
+  pulseOpen = false;
+  player.start();
+}
 
-    case 'm':
-    case 'M':
-      dash(); dash(); break;
 
-    case 'n':
-    case 'N':
-      dash(); dot(); break;
+int64_t TorMorse::currentTime()
+{
+  return clock->currentTime();
+}
 
-    case 'o':
-    case 'O':
-      dash(); dash(); dash(); break;
 
-    case 'p':
-    case 'P':
-      dot(); dash(); dash(); dot(); break;
+int64_t TorMorse::currentRealTime()
+{
+  return clock->currentRealTime();
+}
 
-    case 'q':
-    case 'Q':
-      dash(); dash(); dot(); dash(); break;
 
-    case 'r':
-    case 'R':
-      dot(); dash(); dot(); break;
+void TorMorse::startTimerAt(
+  int64_t deadline,
+  bool precisely)
+{
+  if (precisely)
+  {
+    timer->startAtPrecisely(deadline);
+  }
+  else
+  {
+    timer->startAt(deadline);
+  }
+}
 
-    case 's':
-    case 'S':
-      dot(); dot(); dot(); break;
 
-    case 't':
-    case 'T':
-      dash(); break;
+void TorMorse::stopTimer()
+{
+  timer->stop();
+}
 
-    case 'u':
-    case 'U':
-      dot(); dot(); dash(); break;
 
-    case 'v':
-    case 'V':
-      dot(); dot(); dot(); dash(); break;
+void TorMorse::switchLight(
+  bool lit)
+{
+  if (lit)
+  {
+    emit turnTorchOn();
+  }
+  else
+  {
+    emit turnTorchOff();
+  }
+}
 
-    case 'w':
-    case 'W':
-      dot(); dash(); dash(); break;
 
-    case 'x':
-    case 'X':
-      dash(); dot(); dot(); dash(); break;
+int64_t TorMorse::getSwitchingTime(
+  bool lit)
+{
+  if (!compensateLatency) return 0;
 
-    case 'y':
-    case 'Y':
-      dash(); dot(); dash(); dash(); break;
+  if (lit) return onLatency.getEstimate();
 
-    case 'z':
-    case 'Z':
-      dash(); dash(); dot(); dot(); break;
+  return offLatency.getEstimate();
+}
 
-    case '0':
-      dash(); dash(); dash(); dash(); dash(); break;
 
-    case '1':
-      dot(); dash(); dash(); dash(); dash(); break;
+void TorMorse::edgePlayed(
+  const TorCoreRun &run,
+  int64_t due,
+  int64_t shift,
+  int64_t started,
+  int64_t completed)
+{
+  if (run.lit)
+  {
+    onLatency.addSample(completed - started);
+  }
+  else
+  {
+    offLatency.addSample(completed - started);
+  }
 
-    case '2':
-      dot(); dot(); dash(); dash(); dash(); break;
+  recordEdge(run.lit, due, shift, completed, run.units);
 
-    case '3':
-      dot(); dot(); dot(); dash(); dash(); break;
+  // The edge is already out, so the checkpoint costs it nothing:
+  if (checkpointActive && (clock->currentTime() >= nextCheckpoint))
+  {
+    try
+    {
+      saveCheckpoint();
+    }
+    catch (TorException &e)
+    {
+      QTextStream qts(stderr);
+      qts << e.getError() << endl;
+      qts << "Carrying on without checkpoints" << endl;
+      checkpointActive = false;
+    }
 
-    case '4':
-      dot(); dot(); dot(); dot(); dash(); break;
+    nextCheckpoint += checkpointInterval;
+    if (nextCheckpoint < clock->currentTime())
+    {
+      nextCheckpoint = clock->currentTime() + checkpointInterval;
+    }
+  }
+}
 
-    case '5':
-      dot(); dot(); dot(); dot(); dot(); break;
 
-    case '6':
-      dash(); dot(); dot(); dot(); dot(); break;
+//
+// Keep track of how far each on-pulse strays from its nominal length, both
+// as it was actually played and as it would have been with no latency
+// compensation (where each edge would have landed "shift" later):
+//
+void TorMorse::recordEdge(
+  bool value,
+  qint64 nominal,
+  qint64 shift,
+  qint64 completed,
+  unsigned int units)
+{
+  ++edgeCount;
+  edgeError += qAbs(completed - nominal);
 
-    case '7':
-      dash(); dash(); dot(); dot(); dot(); break;
+  // An edge more than half a dot late could be mistaken for the wrong
+  // element altogether:
+  qint64 lateness = qMax(completed - nominal, qint64(0));
+  edgeLateness.record(lateness);
+  if (lateness > qint64(dotDuration) * 500) ++missedDeadlines;
 
-    case '8':
-      dash(); dash(); dash(); dot(); dot(); break;
+  if (value)
+  {
+    pulseOpen = true;
+    pulseStart = completed;
+    pulseShift = shift;
+    pulseNominal = qint64(units) * dotDuration * 1000;
+    return;
+  }
 
-    case '9':
-      dash(); dash(); dash(); dash(); dot(); break;
+  if (!pulseOpen) return;
 
-    case '.':
-      dot(); dash(); dot(); dash(); dot(); dash(); break;
+  pulseOpen = false;
 
-    case ',':
-      dash(); dash(); dot(); dot(); dash(); dash(); break;
+  qint64 actual = completed - pulseStart;
+  qint64 uncompensated = actual - pulseShift + shift;
 
-    case '?':
-      dot(); dot(); dash(); dash(); dot(); dot(); break;
+  ++pulseCount;
+  nominalOnTime += pulseNominal;
+  compensatedError += qAbs(actual - pulseNominal);
+  uncompensatedError += qAbs(uncompensated - pulseNominal);
+}
 
-    case '\'':
-      dot(); dash(); dash(); dash(); dash(); dot(); break;
 
-    case '!':
-      dash(); dot(); dash(); dot(); dash(); dash(); break;
+void TorMorse::registerMetrics(
+  TorCoreMetrics &metrics)
+{
+  metrics.addSummary(
+    "torchio_morse_edge_lateness_seconds",
+    "",
+    "How late each Morse edge completed, relative to its schedule.",
+    &edgeLateness);
+
+  metrics.addCounter(
+    "torchio_morse_missed_deadlines_total",
+    "",
+    "Morse edges that completed more than half a dot late.",
+    &missedDeadlines);
+
+  metrics.addSummary(
+    "torchio_morse_encode_seconds",
+    "",
+    "Time spent translating text into Morse code, per pass.",
+    &encodeTime);
+
+  metrics.addCounter(
+    "torchio_morse_encoded_characters_total",
+    "",
+    "Characters translated into Morse code.",
+    &encodedCharacters);
+}
 
-    case '/':
-      dash(); dot(); dot(); dash(); dot(); break;
 
-    case '(':
-      dash(); dot(); dash(); dash(); dot(); break;
+void TorMorse::encodeText(
+  QTextStream &stream)
+{
+  TOR_TRACE_SPAN("encodeText", "encode");
 
-    case ')':
-      dash(); dot(); dash(); dash(); dot(); dash(); break;
+  qint64 encodeStart = clock->currentTime();
 
-    case '&':
-      dot(); dash(); dot(); dot(); dot(); break;
+  QByteArray text = stream.readAll().toLocal8Bit();
 
-    case ':':
-      dash(); dash(); dash(); dot(); dot(); dot(); break;
+  morseEncoder.clear();
+  morseEncoder.appendText(text.constData(), text.size());
+  morseRuns = morseEncoder.getRuns();
 
-    case ';':
-      dash(); dot(); dash(); dot(); dash(); dot(); break;
+  encodedCharacters += text.size();
+  encodeTime.record(clock->currentTime() - encodeStart);
+}
 
-    case '=':
-      dash(); dot(); dot(); dot(); dash(); break;
 
-    case '+':
-      dot(); dash(); dot(); dash(); dot(); break;
+//
+// Files are fed to the encoder a word at a time, so that the offset of
+// each word (both in the file and in units of Morse) is known.  A word
+// starts after a space and any whitespace following it, which the encoder
+// folds into the word gap:
+//
+void TorMorse::encodeFile(
+  const QByteArray &text,
+  qint64 baseOffset)
+{
+  TOR_TRACE_SPAN("encodeFile", "encode");
 
-    case '-':
-      dash(); dot(); dot(); dot(); dot(); dash(); break;
+  qint64 encodeStart = clock->currentTime();
 
-    case '_':
-      dot(); dot(); dash(); dash(); dot(); dash(); break;
+  morseEncoder.clear();
+  wordStarts.clear();
 
-    case '"':
-      dot(); dash(); dot(); dot(); dash(); dot(); break;
+  const char *data = text.constData();
+  int size = text.size();
+  int pieceStart = 0;
+  bool startOfWord = true;
 
-    case '$':
-      dot(); dot(); dot(); dash(); dot(); dot(); dash(); break;
+  int i = 0;
+  while (i < size)
+  {
+    if (data[i] == ' ')
+    {
+      ++i;
+      while ((i < size) && isspace((unsigned char) data[i])) ++i;
+      startOfWord = true;
+      continue;
+    }
 
-    case '@':
-      dot(); dash(); dash(); dot(); dash(); dot(); break;
+    if (startOfWord)
+    {
+      morseEncoder.appendText(data + pieceStart, i - pieceStart);
+      pieceStart = i;
 
-    case ' ':
-      // End of a word, so need to add 4 units to the 3-unit character gap:
-      fourUnitGap();
-      // Also, clear out any extra whitespace chars:
-      stream.skipWhiteSpace();
-      break;
+      TorMorseWordStart word;
+      word.fileOffset = baseOffset + i;
+      word.unitIndex = morseEncoder.getUnitCount();
+      wordStarts.append(word);
 
-    default:
-      break;
+      startOfWord = false;
     }
 
-    // At the end of every character is a 3 unit gap:
-    threeUnitGap();
+    ++i;
   }
-}
-
-
-void TorMorse::dot()
-{
-  morseCodeBits.push_back(true);
-  morseCodeBits.push_back(false);
-}
-
-
-void TorMorse::dash()
-{
-  pushBits(morseCodeBits, true, 3);
-  morseCodeBits.push_back(false);
-}
-
-
-void TorMorse::threeUnitGap()
-{
-  pushBits(morseCodeBits, false, 3);
-}
 
+  morseEncoder.appendText(data + pieceStart, size - pieceStart);
+  morseRuns = morseEncoder.getRuns();
 
-void TorMorse::fourUnitGap()
-{
-  pushBits(morseCodeBits, false, 4);
+  encodedCharacters += size;
+  encodeTime.record(clock->currentTime() - encodeStart);
 }
 
 
-void TorMorse::setupSOSCode()
+//
+// Data link frames are built as single units, which play as runs just the
+// same:
+//
+void TorMorse::setRunsFromBits(
+  const TorBoolList &bits)
 {
-  // We'll do the standard SOS, followed by a standard 7-dot word space.
-
-  // S: Three dots, plus char space:
-  sosCodeBits.push_back(true);
-  sosCodeBits.push_back(false);
-  sosCodeBits.push_back(true);
-  sosCodeBits.push_back(false);
-  sosCodeBits.push_back(true);
-  pushBits(sosCodeBits, false, 4);
-
-  // O: Three dashes, plus char space:
-  pushBits(sosCodeBits, true, 3);
-  sosCodeBits.push_back(false);
-  pushBits(sosCodeBits, true, 3);
-  sosCodeBits.push_back(false);
-  pushBits(sosCodeBits, true, 3);
-  pushBits(sosCodeBits, false, 4);
-
-  // S: Three dots, plus word space:
-  sosCodeBits.push_back(true);
-  sosCodeBits.push_back(false);
-  sosCodeBits.push_back(true);
-  sosCodeBits.push_back(false);
-  sosCodeBits.push_back(true);
-  pushBits(sosCodeBits, false, 8);
-}
+  morseRuns.clear();
 
+  TorBoolList::const_iterator bit = bits.begin();
+  while (bit != bits.end())
+  {
+    if (!morseRuns.empty() && (morseRuns.back().lit == *bit))
+    {
+      ++morseRuns.back().units;
+    }
+    else
+    {
+      TorCoreRun run;
+      run.lit = *bit;
+      run.units = 1;
+      morseRuns.push_back(run);
+    }
 
-void TorMorse::setupECode()
-{
-  // We'll do an "E" (single dot), followed by 7-dot word space:
-  eCodeBits.push_back(true);
-  pushBits(eCodeBits, false, 8);
+    ++bit;
+  }
 }
 
 
-void TorMorse::pushBits(
-  TorBoolList &bits,
-  bool value,
-  unsigned int quantity)
+void TorMorse::setupRepeatingCode(
+  const char *text,
+  std::vector<TorCoreRun> &runs)
 {
-  unsigned int index = 0;
-
-  while (index < quantity)
-  {
-    bits.push_back(value);
+  // The encoder ends the message on a character gap; stretch that out to
+  // a word gap before it comes round again:
+  morseEncoder.clear();
+  morseEncoder.appendText(text, strlen(text));
+  morseEncoder.appendGap(4);
 
-    ++index;
-  }
+  runs = morseEncoder.getRuns();
 }
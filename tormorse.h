@@ -23,36 +23,161 @@
 #ifndef TORMORSE_H
 #define TORMORSE_H
 
-#include <QTimer>
+#include "torlatencyestimator.h"
+#include "torcoremetrics.h"
+#include "torcoremorse.h"
+
+#include <QObject>
 #include <QString>
 #include <QTextStream>
+#include <QVector>
 
 #include <list>
+#include <vector>
+
+// Data link frames are built up a unit at a time:
 typedef std::list<bool> TorBoolList;
 
-class TorMorse: public QObject
+// What the timer is currently playing:
+enum TorMorseSource
+{
+  No_Source,
+  SOS_Source,
+  E_Source,
+  Morse_Source,     // A file, a stream or a data link frame
+  Line_Source,      // One line of streamed input
+  Carousel_Source
+};
+
+class TorClock;
+class TorTimer;
+class TorDataEncoder;
+class TorCheckpoint;
+class TorCarousel;
+class TorWordCache;
+
+// Where each word of a file starts, both in the file and in its Morse
+// code; used to checkpoint progress:
+struct TorMorseWordStart
+{
+  qint64 fileOffset;
+  qint64 unitIndex;
+};
+
+// The Qt-side face of TorCoreMorsePlayer: it hands the player runs from
+// whatever is playing, on the front end's clock, and signals each change
+// of light for the controller to make.
+class TorMorse: public QObject, public TorCorePlayerClient
 {
   Q_OBJECT
 
 public:
-  TorMorse();
+  TorMorse(
+    TorClock *clock);
+
   ~TorMorse();
 
   void setDotDuration(
     unsigned int dotDuration);
 
+  // Fire each edge early by the expected time it takes to switch the LED:
+  void setLatencyCompensation(
+    bool compensate);
+
+  void writeTimingReport(
+    QTextStream &stream);
+
+  // Start each transmission on a multiple of this period (in microseconds)
+  // of wall-clock time, and restart repeating ones (SOS and pulsed) on the
+  // next multiple after each ends.  Devices with synchronized clocks then
+  // flash in phase.  Zero turns alignment off.
+  void setAlignment(
+    qint64 period);
+
+  // How closely the aligned starts hit their wall-clock boundaries:
+  void writeAlignmentReport(
+    QTextStream &stream);
+
+  void resetTimingStats();
+
+  // Average distance (in microseconds) between when each edge should have
+  // happened and when the LED call actually completed:
+  qint64 getMeanEdgeError();
+
+  // Lateness of each edge (in microseconds), and how many edges were more
+  // than half a dot late:
+  const TorCoreSummary &getEdgeLateness();
+
+  TorCoreCounter getMissedDeadlines();
+
   void startSOS();
 
   void startE();
 
+  // Periodically record how far a transmission from a file has got
+  // (interval in microseconds):
+  void setCheckpoint(
+    TorCheckpoint *checkpoint,
+    qint64 interval);
+
+  // Send a file, optionally picking up partway through: from the word
+  // starting at fileOffset, skipping unitOffset units into it:
   void startMorseFromFile(
-    QString filename);
+    QString filename,
+    qint64 fileOffset,
+    qint64 unitOffset);
 
   void startMorseFromStream(
     QTextStream &stream);
 
+  // Send one line of streamed input, encoded through a word cache:
+  void startMorseFromLine(
+    const QByteArray &line,
+    TorWordCache &cache);
+
+  // Send the raw contents of a file as a data link frame:
+  void startDataFromFile(
+    QString filename,
+    TorDataEncoder &encoder);
+
+  // Cycle through a carousel's messages (the carousel is not owned):
+  void startCarousel(
+    TorCarousel *carousel);
+
   void stopRunning();
 
+  // Missed deadlines, edge lateness and encoding throughput:
+  void registerMetrics(
+    TorCoreMetrics &metrics);
+
+  // For the player:
+  int64_t currentTime();
+  int64_t currentRealTime();
+
+  void startTimerAt(
+    int64_t deadline,
+    bool precisely);
+
+  void stopTimer();
+
+  TorCorePlayerStep nextRun(
+    TorCoreRun &run);
+
+  void switchLight(
+    bool lit);
+
+  int64_t getSwitchingTime(
+    bool lit);
+
+  void edgePlayed(
+    const TorCoreRun &run,
+    int64_t due,
+    int64_t shift,
+    int64_t started,
+    int64_t completed);
+
+  void playbackFinished();
+
 signals:
   void turnTorchOn();
   void turnTorchOff();
@@ -60,42 +185,102 @@ signals:
   void morseFinished();
 
 private slots:
-  void runSOSCode();
-  void runECode();
-  void runMorseCode();
+  // The timer's one connection, passed on to the player:
+  void runCode();
 
 private:
-  void translateTextToBits(
+  // Plays runs over and over:
+  TorCorePlayerStep nextRepeatingRun(
+    const std::vector<TorCoreRun> &runs,
+    size_t &position,
+    TorCoreRun &run);
+
+  void encodeText(
     QTextStream &stream);
 
-  void dot();
-  void dash();
-  void threeUnitGap();
-  void fourUnitGap();
+  void encodeFile(
+    const QByteArray &text,
+    qint64 baseOffset);
 
-  void setupSOSCode();
-  void setupECode();
+  void setRunsFromBits(
+    const TorBoolList &bits);
 
-  void pushBits(
-    TorBoolList &bits,
+  void saveCheckpoint();
+
+  void startPlayback();
+  void startTicking();
+
+  void recordEdge(
     bool value,
-    unsigned int quantity);
+    qint64 nominal,
+    qint64 shift,
+    qint64 completed,
+    unsigned int units);
+
+  // A message followed by a word gap, for SOS and pulsed mode:
+  void setupRepeatingCode(
+    const char *text,
+    std::vector<TorCoreRun> &runs);
+
+  TorClock *clock;
+  TorTimer *timer;
+
+  TorCoreMorsePlayer player;
+
+  bool compensateLatency;
+  TorLatencyEstimator onLatency;
+  TorLatencyEstimator offLatency;
 
-  QTimer timer;
+  // Timing accounting, for on-pulses:
+  bool pulseOpen;
+  qint64 pulseStart;
+  qint64 pulseShift;
+  qint64 pulseNominal;
+  unsigned int pulseCount;
+  qint64 nominalOnTime;
+  qint64 compensatedError;
+  qint64 uncompensatedError;
+  unsigned int edgeCount;
+  qint64 edgeError;
 
-  bool runMorseContinuously;
-  bool morseConnected;
+  TorMorseSource source;
 
-  TorBoolList morseCodeBits;
-  TorBoolList::const_iterator morseCodePosition;
+  TorCarousel *carousel;
 
-  TorBoolList sosCodeBits;
-  TorBoolList::const_iterator sosCodePosition;
+  // Lines of streamed input, as runs (kept between lines, so that once
+  // it has grown to fit, encoding a line allocates nothing here):
+  std::vector<TorCoreRun> lineRuns;
+  size_t lineRunIndex;
 
-  TorBoolList eCodeBits;
-  TorBoolList::const_iterator eCodePosition;
+  // All text is turned into runs by the core's encoder:
+  TorCoreMorseEncoder morseEncoder;
+
+  std::vector<TorCoreRun> morseRuns;
+  size_t morseRunIndex;
+
+  // Checkpointing of transmissions from a file:
+  TorCheckpoint *checkpoint;
+  qint64 checkpointInterval;
+  bool checkpointActive;
+  qint64 nextCheckpoint;
+  QVector<TorMorseWordStart> wordStarts;
+  int wordIndex;
+  qint64 morseCodeIndex;
+  qint64 runStartIndex;
+
+  std::vector<TorCoreRun> sosRuns;
+  size_t sosRunIndex;
+
+  std::vector<TorCoreRun> eRuns;
+  size_t eRunIndex;
 
   unsigned int dotDuration;
+
+  // Metrics:
+  TorCoreSummary edgeLateness;
+  TorCoreCounter missedDeadlines;
+  TorCoreSummary encodeTime;
+  TorCoreCounter encodedCharacters;
 };
 
 #endif // TORMORSE_H
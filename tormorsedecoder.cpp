@@ -0,0 +1,233 @@
+//
+// tormorsedecoder.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "tormorsedecoder.h"
+#include "tormorsetable.h"
+
+#include <QTextStream>
+
+// How quickly the envelopes relax back towards the signal, per sample:
+#define ENVELOPE_DECAY (1.0 / 512.0)
+
+// How quickly the noise estimate follows the signal, per sample:
+#define NOISE_DECAY (1.0 / 64.0)
+
+// Unless the peak-to-trough contrast stands well clear of the noise,
+// there's no signal to speak of:
+#define MINIMUM_CONTRAST 2.0
+#define MINIMUM_SIGNAL_TO_NOISE 4.0
+
+
+TorMorseDecoder::TorMorseDecoder(
+  QTextStream *o)
+  : output(o),
+    started(false),
+    low(0.0),
+    high(0.0),
+    noise(0.0),
+    previousValue(0),
+    lightOn(false),
+    lastTransition(0),
+    unit(0),
+    treeIndex(TOR_MORSE_ROOT),
+    wordInProgress(false),
+    sampleCount(0),
+    characterCount(0)
+{
+}
+
+
+void TorMorseDecoder::addSample(
+  qint64 time,
+  int value)
+{
+  ++sampleCount;
+
+  if (!started)
+  {
+    low = value;
+    high = value;
+    previousValue = value;
+    lastTransition = time;
+    started = true;
+    return;
+  }
+
+  // Sample-to-sample jitter gives a rough idea of the noise level:
+  noise += (qAbs(value - previousValue) - noise) * NOISE_DECAY;
+  previousValue = value;
+
+  // Track the envelopes:
+  if (value > high)
+  {
+    high = value;
+  }
+  else
+  {
+    high -= (high - value) * ENVELOPE_DECAY;
+  }
+
+  if (value < low)
+  {
+    low = value;
+  }
+  else
+  {
+    low += (value - low) * ENVELOPE_DECAY;
+  }
+
+  double contrast = high - low;
+
+  // (Give the noise estimate a little while to settle first.)
+  if ( (sampleCount > 1.0 / NOISE_DECAY)
+    && (contrast >= MINIMUM_CONTRAST)
+    && (contrast >= noise * MINIMUM_SIGNAL_TO_NOISE))
+  {
+    double threshold = (high + low) / 2.0;
+    double hysteresis = (high - low) / 8.0;
+
+    if (!lightOn && (value > threshold + hysteresis))
+    {
+      addSpace(time - lastTransition);
+      lightOn = true;
+      lastTransition = time;
+    }
+    else if (lightOn && (value < threshold - hysteresis))
+    {
+      addMark(time - lastTransition);
+      lightOn = false;
+      lastTransition = time;
+    }
+  }
+
+  // Don't wait for the next mark to finish off a character:
+  if ( !lightOn
+    && unit
+    && (treeIndex != TOR_MORSE_ROOT)
+    && (time - lastTransition > 2 * unit))
+  {
+    endCharacter();
+  }
+}
+
+
+void TorMorseDecoder::finish()
+{
+  if (treeIndex != TOR_MORSE_ROOT) endCharacter();
+
+  if (output) output->flush();
+}
+
+
+unsigned int TorMorseDecoder::getSampleCount()
+{
+  return sampleCount;
+}
+
+
+unsigned int TorMorseDecoder::getCharacterCount()
+{
+  return characterCount;
+}
+
+
+qint64 TorMorseDecoder::getUnitEstimate()
+{
+  return unit;
+}
+
+
+void TorMorseDecoder::addMark(
+  qint64 duration)
+{
+  if (!unit || (2 * duration < unit) || (duration > 6 * unit))
+  {
+    // Either the first mark, or one far off from the current estimate.
+    // Assume it's a dot; if it was really a dash, the next dot will be
+    // well under the estimate, and correct it again.
+    unit = duration;
+  }
+
+  bool isDash = (duration >= 2 * unit);
+
+  if (isDash)
+  {
+    refineUnit(duration / 3);
+  }
+  else
+  {
+    refineUnit(duration);
+  }
+
+  treeIndex = (2 * treeIndex) + (isDash ? 1 : 0);
+
+  // Overlong codes can't be anything; stop them from running off the tree:
+  if (treeIndex >= TOR_MORSE_MAX_INDEX) treeIndex = TOR_MORSE_MAX_INDEX - 1;
+}
+
+
+void TorMorseDecoder::addSpace(
+  qint64 duration)
+{
+  if (!unit) return;
+
+  if (duration < 2 * unit)
+  {
+    // A gap between the elements of one character:
+    refineUnit(duration);
+    return;
+  }
+
+  if (treeIndex != TOR_MORSE_ROOT) endCharacter();
+
+  if ((duration >= 5 * unit) && wordInProgress)
+  {
+    if (output) *output << ' ';
+    wordInProgress = false;
+  }
+}
+
+
+void TorMorseDecoder::endCharacter()
+{
+  char c = torMorseCharacter(treeIndex);
+
+  if (!c) c = '*';
+
+  if (output)
+  {
+    *output << c;
+    output->flush();
+  }
+
+  ++characterCount;
+  wordInProgress = true;
+  treeIndex = TOR_MORSE_ROOT;
+}
+
+
+void TorMorseDecoder::refineUnit(
+  qint64 duration)
+{
+  unit = ((unit * 7) + duration) / 8;
+}
@@ -0,0 +1,87 @@
+//
+// tormorsedecoder.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORMORSEDECODER_H
+#define TORMORSEDECODER_H
+
+#include <QtGlobal>
+
+class QTextStream;
+
+// Turns a stream of timestamped light levels back into text.
+//
+// The on/off threshold adapts to the signal: it sits halfway between slowly
+// decaying peak and trough envelopes, with some hysteresis so noise near the
+// threshold doesn't create false edges.  The unit length (dot duration) is
+// estimated on the fly from the marks and gaps seen so far, so the sender's
+// speed doesn't need to be known in advance.
+class TorMorseDecoder
+{
+public:
+  TorMorseDecoder(
+    QTextStream *output);
+
+  // Time is in microseconds:
+  void addSample(
+    qint64 time,
+    int value);
+
+  // Emit anything still pending:
+  void finish();
+
+  unsigned int getSampleCount();
+  unsigned int getCharacterCount();
+  qint64 getUnitEstimate();
+
+private:
+  void addMark(
+    qint64 duration);
+
+  void addSpace(
+    qint64 duration);
+
+  void endCharacter();
+
+  void refineUnit(
+    qint64 duration);
+
+  QTextStream *output;
+
+  bool started;
+  double low;
+  double high;
+  double noise;
+  int previousValue;
+
+  bool lightOn;
+  qint64 lastTransition;
+  qint64 unit;
+
+  unsigned int treeIndex;
+  bool wordInProgress;
+
+  unsigned int sampleCount;
+  unsigned int characterCount;
+};
+
+#endif // TORMORSEDECODER_H
@@ -0,0 +1,171 @@
+//
+// torpowersupply.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torpowersupply.h"
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+TorPowerSupply::TorPowerSupply(
+  QString r)
+  : root(r),
+    remainingEnergy(-1.0),
+    powerDraw(-1.0)
+{
+}
+
+
+bool TorPowerSupply::findBattery()
+{
+  DIR *directory = opendir(root.toLocal8Bit().constData());
+  if (!directory) return false;
+
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != 0)
+  {
+    if (entry->d_name[0] == '.') continue;
+
+    QString typePath = root + "/" + entry->d_name + "/type";
+    int fd = open(typePath.toLocal8Bit().constData(), O_RDONLY);
+    if (fd == -1) continue;
+
+    char buffer[32];
+    ssize_t count = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (count <= 0) continue;
+    buffer[count] = '\0';
+
+    if (!strncmp(buffer, "Battery", 7))
+    {
+      batteryPath = root + "/" + entry->d_name;
+      break;
+    }
+  }
+
+  closedir(directory);
+
+  return !batteryPath.isEmpty();
+}
+
+
+bool TorPowerSupply::refresh()
+{
+  if (batteryPath.isEmpty()) return false;
+
+  // Units in sysfs are micro-(watt-hours, amp-hours, volts, watts, amps):
+  double energy;
+  double charge;
+  double voltage;
+  double capacity;
+  double full;
+
+  remainingEnergy = -1.0;
+
+  if (readAttribute("energy_now", energy))
+  {
+    remainingEnergy = energy / 1000.0;
+  }
+  else if ( readAttribute("voltage_now", voltage)
+    && readAttribute("charge_now", charge))
+  {
+    remainingEnergy = (charge / 1000000.0) * (voltage / 1000.0);
+  }
+  else if (readAttribute("capacity", capacity))
+  {
+    if (readAttribute("energy_full", full))
+    {
+      remainingEnergy = capacity / 100.0 * full / 1000.0;
+    }
+    else if ( readAttribute("charge_full", full)
+      && readAttribute("voltage_now", voltage))
+    {
+      remainingEnergy =
+        capacity / 100.0 * (full / 1000000.0) * (voltage / 1000.0);
+    }
+  }
+
+  // Discharge may be reported with either sign:
+  double power;
+  double current;
+
+  powerDraw = -1.0;
+
+  if (readAttribute("power_now", power))
+  {
+    powerDraw = fabs(power) / 1000.0;
+  }
+  else if ( readAttribute("current_now", current)
+    && readAttribute("voltage_now", voltage))
+  {
+    powerDraw = fabs(current / 1000000.0) * (voltage / 1000.0);
+  }
+
+  return (remainingEnergy >= 0.0);
+}
+
+
+QString TorPowerSupply::getBatteryPath()
+{
+  return batteryPath;
+}
+
+
+double TorPowerSupply::getRemainingEnergy()
+{
+  return remainingEnergy;
+}
+
+
+double TorPowerSupply::getPowerDraw()
+{
+  return powerDraw;
+}
+
+
+bool TorPowerSupply::readAttribute(
+  const char *attribute,
+  double &value)
+{
+  QString path = batteryPath + "/" + attribute;
+
+  int fd = open(path.toLocal8Bit().constData(), O_RDONLY);
+  if (fd == -1) return false;
+
+  char buffer[32];
+  ssize_t count = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+  if (count <= 0) return false;
+  buffer[count] = '\0';
+
+  char *end;
+  value = strtod(buffer, &end);
+
+  return (end != buffer);
+}
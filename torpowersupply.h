@@ -0,0 +1,65 @@
+//
+// torpowersupply.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORPOWERSUPPLY_H
+#define TORPOWERSUPPLY_H
+
+#include <QString>
+
+// Reads the state of the battery from the power_supply class in sysfs.
+// Drivers differ in what they export, so energy is taken from energy_now
+// where present, or else worked out from charge_now and voltage_now, or
+// else from capacity and energy_full (or charge_full).  The root can be
+// pointed at a fake tree of plain files for testing.
+class TorPowerSupply
+{
+public:
+  TorPowerSupply(
+    QString root);
+
+  // Looks for the first supply whose type is "Battery":
+  bool findBattery();
+
+  // Re-reads the battery; false if nothing useful could be read:
+  bool refresh();
+
+  QString getBatteryPath();
+
+  // Both in milliwatt-hours and milliwatts; negative when unknown:
+  double getRemainingEnergy();
+  double getPowerDraw();
+
+private:
+  bool readAttribute(
+    const char *attribute,
+    double &value);
+
+  QString root;
+  QString batteryPath;
+
+  double remainingEnergy;
+  double powerDraw;
+};
+
+#endif // TORPOWERSUPPLY_H
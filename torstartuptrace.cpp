@@ -0,0 +1,119 @@
+//
+// torstartuptrace.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torstartuptrace.h"
+#include "torcoreprocess.h"
+
+#include <QTextStream>
+
+
+TorStartupTrace::TorStartupTrace()
+  : knowProcessStart(false),
+    processStart(0),
+    phaseCount(0),
+    lit(false),
+    reported(false)
+{
+  mark("main() entered");
+
+  qint64 age = torCoreProcessAge();
+  if (age >= 0)
+  {
+    processStart = times[0] - age;
+    knowProcessStart = true;
+  }
+}
+
+
+void TorStartupTrace::mark(
+  const char *phase)
+{
+  if (phaseCount >= STARTUP_TRACE_MAX_PHASES) return;
+
+  phases[phaseCount] = phase;
+  times[phaseCount] = clock.currentTime();
+  ++phaseCount;
+}
+
+
+void TorStartupTrace::writeReport(
+  QTextStream &out)
+{
+  qint64 origin = knowProcessStart ? processStart : times[0];
+
+  out << "Startup phases (ms since ";
+  out << (knowProcessStart ? "process start" : "main() entered");
+  out << "; phase duration in brackets):" << endl;
+
+  if (knowProcessStart)
+  {
+    out << "  " << QString::number((times[0] - origin) / 1000.0, 'f', 3);
+    out << "  exec and libraries (to the nearest clock tick)" << endl;
+  }
+
+  int i = 1;
+  while (i < phaseCount)
+  {
+    out << "  " << QString::number((times[i] - origin) / 1000.0, 'f', 3);
+    out << "  " << phases[i] << " (";
+    out << QString::number((times[i] - times[i - 1]) / 1000.0, 'f', 3);
+    out << ")" << endl;
+    ++i;
+  }
+
+  long resident;
+  long peak;
+  if (torCoreMemoryUsage(resident, peak))
+  {
+    out << "Resident memory: " << qint64(resident) << " kB (peak ";
+    out << qint64(peak) << " kB)" << endl;
+  }
+
+  reported = true;
+}
+
+
+void TorStartupTrace::edgeEmitted(
+  TorLEDChannel channel,
+  int intensity)
+{
+  Q_UNUSED(channel);
+
+  if (lit || (intensity <= 0)) return;
+
+  lit = true;
+
+  if (!reported)
+  {
+    mark("First light");
+    return;
+  }
+
+  qint64 origin = knowProcessStart ? processStart : times[0];
+  qint64 now = clock.currentTime();
+
+  QTextStream qts(stderr);
+  qts << "  " << QString::number((now - origin) / 1000.0, 'f', 3);
+  qts << "  First light" << endl;
+}
@@ -0,0 +1,72 @@
+//
+// torstartuptrace.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORSTARTUPTRACE_H
+#define TORSTARTUPTRACE_H
+
+#include "torledbackend.h"
+#include "torclock.h"
+
+class QTextStream;
+
+#define STARTUP_TRACE_MAX_PHASES 16
+
+// Timestamps the phases of startup, from the process being started up to
+// the LEDs first lighting.  Marking a phase is just a clock read, so it is
+// always done; the report is only written on request.
+//
+// When the report is written before the first light (as with the timed
+// modes, which light up from the event loop), that time is added as a
+// line of its own once it happens.
+class TorStartupTrace: public TorEdgeListener
+{
+public:
+  TorStartupTrace();
+
+  void mark(
+    const char *phase);
+
+  void writeReport(
+    QTextStream &out);
+
+  void edgeEmitted(
+    TorLEDChannel channel,
+    int intensity);
+
+private:
+  TorSystemClock clock;
+
+  // When the process started, if the kernel could tell us:
+  bool knowProcessStart;
+  qint64 processStart;
+
+  const char *phases[STARTUP_TRACE_MAX_PHASES];
+  qint64 times[STARTUP_TRACE_MAX_PHASES];
+  int phaseCount;
+
+  bool lit;
+  bool reported;
+};
+
+#endif // TORSTARTUPTRACE_H
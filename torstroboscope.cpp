@@ -0,0 +1,193 @@
+//
+// torstroboscope.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torstroboscope.h"
+#include "tortimer.h"
+#include "torledbackend.h"
+#include "torexception.h"
+
+#include <QTextStream>
+
+
+TorStroboscope::TorStroboscope(
+  TorClock *c,
+  TorLEDBackend *l)
+  : clock(c),
+    timer(0),
+    led(l),
+    period(1000000),
+    flashDuration(0),
+    durationClamped(false),
+    startTime(0),
+    flashNumber(0),
+    flashCount(0),
+    missedFlashes(0),
+    totalLateness(0),
+    maxLateness(0),
+    triggerCost(0),
+    maxTriggerCost(0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(fireFlash()));
+}
+
+
+TorStroboscope::~TorStroboscope()
+{
+  if (timer) delete timer;
+}
+
+
+void TorStroboscope::startStrobe(
+  double frequency,
+  unsigned int dutyCycle)
+{
+  if (frequency <= 0.0)
+  {
+    throw TorException("Strobe frequency must be greater than zero");
+  }
+
+  period = qint64(1000000.0 / frequency);
+
+  // The flash must have gone out before it can be fired again:
+  if (period < led->getMinTime())
+  {
+    QString ss;
+    ss += "Strobe frequency too high: the shortest flash lasts ";
+    ss += QString::number(led->getMinTime());
+    ss += " microseconds, allowing at most ";
+    ss += QString::number(1000000.0 / led->getMinTime(), 'f', 1);
+    ss += " Hz";
+    throw TorException(ss);
+  }
+
+  qint64 duration = period * dutyCycle / 100;
+  if (duration > period) duration = period;
+
+  led->setFlashDuration(duration);
+  flashDuration = led->getChosenTime();
+  durationClamped = (flashDuration != duration);
+
+  // Programmed once, not per flash:
+  led->prepareStrobe();
+
+  flashCount = 0;
+  missedFlashes = 0;
+  totalLateness = 0;
+  maxLateness = 0;
+  triggerCost = 0;
+  maxTriggerCost = 0;
+
+  startTime = clock->currentTime();
+  flashNumber = 0;
+  fireFlash();
+}
+
+
+void TorStroboscope::stopRunning()
+{
+  timer->stop();
+}
+
+
+void TorStroboscope::writeReport(
+  QTextStream &out)
+{
+  out << "Strobe: " << flashCount << " flashes at ";
+  out << QString::number(1000000.0 / period, 'f', 2) << " Hz, ";
+  out << missedFlashes << " missed deadlines" << endl;
+
+  out << "Flash duration: " << flashDuration << " us";
+  if (durationClamped)
+  {
+    out << " (duty cycle limited to the flash's ";
+    out << led->getMinTime() << " to " << led->getMaxTime() << " us)";
+  }
+  out << endl;
+
+  if (!flashCount) return;
+
+  qint64 meanLateness = totalLateness / flashCount;
+  qint64 meanCost = triggerCost / flashCount;
+
+  out << "Wakeup lateness: mean " << meanLateness;
+  out << " us, max " << maxLateness << " us" << endl;
+  out << "Trigger cost: mean " << meanCost;
+  out << " us, max " << maxTriggerCost << " us" << endl;
+
+  // Each flash needs the flash itself, plus the time taken to wake up and
+  // trigger it:
+  qint64 shortestPeriod = led->getMinTime() + maxLateness + maxTriggerCost;
+  out << "Maximum sustainable rate: about ";
+  out << QString::number(1000000.0 / shortestPeriod, 'f', 1) << " Hz" << endl;
+}
+
+
+void TorStroboscope::fireFlash()
+{
+  qint64 deadline = startTime + flashNumber * period;
+  qint64 lateness = clock->currentTime() - deadline;
+
+  // Give up on any flashes that have been overtaken entirely:
+  if (lateness >= period)
+  {
+    qint64 behind = lateness / period;
+    missedFlashes += behind;
+    flashNumber += behind;
+    lateness -= behind * period;
+  }
+
+  totalLateness += lateness;
+  if (lateness > maxLateness) maxLateness = lateness;
+
+  // Arm the next flash before triggering this one:
+  ++flashNumber;
+  timer->startAt(startTime + flashNumber * period);
+
+  qint64 triggerStart = wallClock.currentTime();
+
+  try
+  {
+    led->triggerStrobe();
+  }
+  catch (TorException &e)
+  {
+    QTextStream qts(stderr);
+    qts << e.getError() << endl;
+    timer->stop();
+    emit strobeFailed();
+    return;
+  }
+
+  qint64 cost = wallClock.currentTime() - triggerStart;
+  triggerCost += cost;
+  if (cost > maxTriggerCost) maxTriggerCost = cost;
+
+  ++flashCount;
+}
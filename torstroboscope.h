@@ -0,0 +1,94 @@
+//
+// torstroboscope.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORSTROBOSCOPE_H
+#define TORSTROBOSCOPE_H
+
+#include <QObject>
+#include "torclock.h"
+
+class TorTimer;
+class TorLEDBackend;
+class QTextStream;
+
+// Fires the flash at a steady rate.  The flash brightness and duration are
+// programmed once up front; each flash after that is a single strobe
+// trigger, made at an absolute deadline so that timing errors don't
+// accumulate.  Flashes whose deadline has already passed by more than a
+// period are skipped and counted as missed.
+class TorStroboscope: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorStroboscope(
+    TorClock *clock,
+    TorLEDBackend *led);
+
+  ~TorStroboscope();
+
+  // The frequency is in Hz; the duty cycle (the share of each period the
+  // flash stays lit, in percent) sets the flash duration, within the
+  // range the flash supports:
+  void startStrobe(
+    double frequency,
+    unsigned int dutyCycle);
+
+  void stopRunning();
+
+  // Flashes fired and missed, trigger costs, and the fastest rate they
+  // leave room for:
+  void writeReport(
+    QTextStream &out);
+
+signals:
+  void strobeFailed();
+
+private slots:
+  void fireFlash();
+
+private:
+  TorClock *clock;
+  TorTimer *timer;
+  TorLEDBackend *led;
+
+  // Trigger costs are real time, even when running on a virtual clock:
+  TorSystemClock wallClock;
+
+  qint64 period;
+  qint64 flashDuration;
+  bool durationClamped;
+  qint64 startTime;
+  qint64 flashNumber;
+
+  // Statistics:
+  unsigned int flashCount;
+  unsigned int missedFlashes;
+  qint64 totalLateness;
+  qint64 maxLateness;
+  qint64 triggerCost;
+  qint64 maxTriggerCost;
+};
+
+#endif // TORSTROBOSCOPE_H
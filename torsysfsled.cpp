@@ -0,0 +1,148 @@
+//
+// torsysfsled.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torsysfsled.h"
+#include "torexception.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYSFS_LED_DIRECTORY "/sys/class/leds/"
+
+
+TorSysfsLED::TorSysfsLED(
+  QString name)
+  : brightnessDescriptor(-1),
+    maxBrightness(255),
+    currentBrightness(-1)
+{
+  if (name.startsWith("/"))
+  {
+    path = name;
+  }
+  else
+  {
+    path = SYSFS_LED_DIRECTORY;
+    path += name;
+  }
+
+  maxBrightness = readAttribute("max_brightness");
+
+  QString brightnessPath = path + "/brightness";
+
+  brightnessDescriptor =
+    open(brightnessPath.toLocal8Bit().constData(), O_WRONLY);
+
+  if (brightnessDescriptor == -1)
+  {
+    QString ss;
+    ss += "Failed to open LED ";
+    ss += brightnessPath;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorException(ss);
+  }
+}
+
+
+TorSysfsLED::~TorSysfsLED()
+{
+  if (brightnessDescriptor >= 0)
+  {
+    // Don't leave the LED lit, but don't throw from here either:
+    if (currentBrightness > 0) pwrite(brightnessDescriptor, "0\n", 2, 0);
+
+    close(brightnessDescriptor);
+  }
+}
+
+
+void TorSysfsLED::setIntensity(
+  int intensity)
+{
+  if (intensity < 0) intensity = 0;
+  else if (intensity > maxBrightness) intensity = maxBrightness;
+
+  if (intensity == currentBrightness) return;
+
+  char buffer[16];
+  int length = snprintf(buffer, sizeof(buffer), "%d\n", intensity);
+
+  if (pwrite(brightnessDescriptor, buffer, length, 0) != length)
+  {
+    QString ss;
+    ss += "Failed to set brightness of LED ";
+    ss += path;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorException(ss);
+  }
+
+  currentBrightness = intensity;
+}
+
+
+int TorSysfsLED::getMaxIntensity()
+{
+  return maxBrightness;
+}
+
+
+int TorSysfsLED::readAttribute(
+  QString attribute)
+{
+  QString attributePath = path + "/" + attribute;
+
+  int fd = open(attributePath.toLocal8Bit().constData(), O_RDONLY);
+
+  if (fd == -1)
+  {
+    QString ss;
+    ss += "Failed to open LED attribute ";
+    ss += attributePath;
+    ss += "\nError is ";
+    ss += strerror(errno);
+    throw TorException(ss);
+  }
+
+  char buffer[32];
+  ssize_t count = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+
+  if (count <= 0)
+  {
+    QString ss;
+    ss += "Failed to read LED attribute ";
+    ss += attributePath;
+    throw TorException(ss);
+  }
+
+  buffer[count] = '\0';
+
+  return atoi(buffer);
+}
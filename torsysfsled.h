@@ -0,0 +1,57 @@
+//
+// torsysfsled.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORSYSFSLED_H
+#define TORSYSFSLED_H
+
+#include <QString>
+
+// One of the LEDs exported under /sys/class/leds (keyboard backlight,
+// notification LED, and so on), driven through its "brightness" attribute.
+// The LED is switched off again when this object goes away.
+class TorSysfsLED
+{
+public:
+  // Either a bare LED name, or the full path of its sysfs directory:
+  TorSysfsLED(
+    QString name);
+
+  ~TorSysfsLED();
+
+  void setIntensity(
+    int intensity);
+
+  int getMaxIntensity();
+
+private:
+  int readAttribute(
+    QString attribute);
+
+  QString path;
+  int brightnessDescriptor;
+  int maxBrightness;
+  int currentBrightness;
+};
+
+#endif // TORSYSFSLED_H
@@ -0,0 +1,327 @@
+//
+// torthermalgovernor.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "torthermalgovernor.h"
+#include "torclock.h"
+#include "tortimer.h"
+#include "torfader.h"
+
+#include <QTextStream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// How often the model is brought up to date, in microseconds:
+#define GOVERNOR_PERIOD 1000000
+
+// The thermal model: left on at full brightness, the LED settles this many
+// degrees above ambient, getting about 63% of the way there in the time
+// constant (in seconds):
+#define THERMAL_FULL_RISE 50.0
+#define THERMAL_TIME_CONSTANT 60.0
+
+// Dimming starts once the modelled rise reaches the soft limit, and would
+// reach zero at the hard limit:
+#define THERMAL_SOFT_RISE 25.0
+#define THERMAL_HARD_RISE 40.0
+
+// The same, for thermal zone readings, in degrees Celsius:
+#define THERMAL_SOFT_TEMPERATURE 50.0
+#define THERMAL_HARD_TEMPERATURE 65.0
+
+// Brightness never drops below this share of full, and never moves by more
+// than this much per period:
+#define GOVERNOR_MIN_CEILING 0.1
+#define GOVERNOR_MAX_STEP 0.05
+
+// Rough light output at full brightness, used only for reporting:
+#define TORCH_LUMENS 20.0
+#define INDICATOR_LUMENS 1.0
+
+#define THERMAL_ZONE_PATTERN "/sys/class/thermal/thermal_zone%d/temp"
+#define THERMAL_ZONE_SEARCH_LIMIT 10
+
+
+TorThermalGovernor::TorThermalGovernor(
+  TorClock *c,
+  TorLEDBackend *l)
+  : clock(c),
+    timer(0),
+    led(l),
+    fader(0),
+    thermalDescriptor(-1),
+    channel(Torch_Channel),
+    minIntensity(0),
+    maxIntensity(1),
+    currentOutput(0.0),
+    lastEdgeTime(0),
+    intervalOnTime(0.0),
+    totalOnTime(0.0),
+    modelRise(0.0),
+    ceiling(1.0),
+    level(0),
+    running(false),
+    startTime(0),
+    stopTime(0),
+    nextCheck(0),
+    peakRise(0.0),
+    peakTemperature(0.0),
+    lowestCeiling(1.0),
+    deratings(0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(checkTemperature()));
+
+  // Levels are given to the fader as shares of full light output:
+  fader = new TorFader(clock, led);
+  fader->setCurve(Linear_Curve);
+  fader->setUpdateRate(100);
+
+  led->addEdgeListener(this);
+}
+
+
+TorThermalGovernor::~TorThermalGovernor()
+{
+  if (fader) delete fader;
+  if (timer) delete timer;
+  if (thermalDescriptor >= 0) close(thermalDescriptor);
+}
+
+
+void TorThermalGovernor::setThermalZone(
+  QString path)
+{
+  thermalZone = path;
+}
+
+
+void TorThermalGovernor::startGoverning(
+  TorLEDChannel ch)
+{
+  channel = ch;
+  minIntensity = led->getMinIntensity(channel);
+  maxIntensity = led->getMaxIntensity(channel);
+
+  if (thermalZone.isEmpty())
+  {
+    char path[64];
+    int zone = 0;
+    while ((thermalDescriptor == -1) && (zone < THERMAL_ZONE_SEARCH_LIMIT))
+    {
+      snprintf(path, sizeof(path), THERMAL_ZONE_PATTERN, zone);
+      thermalDescriptor = open(path, O_RDONLY);
+      if (thermalDescriptor >= 0) thermalZone = path;
+      ++zone;
+    }
+  }
+  else
+  {
+    thermalDescriptor = open(thermalZone.toLocal8Bit().constData(), O_RDONLY);
+  }
+
+  running = true;
+  startTime = clock->currentTime();
+  lastEdgeTime = startTime;
+  stopTime = 0;
+
+  modelRise = 0.0;
+  ceiling = 1.0;
+  level = 100;
+
+  fader->startFade(channel, level, level, 0);
+
+  nextCheck = startTime + GOVERNOR_PERIOD;
+  timer->startAt(nextCheck);
+}
+
+
+void TorThermalGovernor::stopRunning()
+{
+  timer->stop();
+  fader->stopRunning();
+
+  if (running)
+  {
+    accountOnTime();
+    stopTime = clock->currentTime();
+    running = false;
+  }
+}
+
+
+bool TorThermalGovernor::isRunning()
+{
+  return running;
+}
+
+
+void TorThermalGovernor::edgeEmitted(
+  TorLEDChannel ch,
+  int intensity)
+{
+  if (ch != channel) return;
+
+  accountOnTime();
+
+  if (maxIntensity > minIntensity)
+  {
+    currentOutput =
+      double(intensity - minIntensity) / (maxIntensity - minIntensity);
+  }
+}
+
+
+void TorThermalGovernor::writeReport(
+  QTextStream &out)
+{
+  qint64 endTime = running ? clock->currentTime() : stopTime;
+  double minutes = (endTime - startTime) / 60000000.0;
+  double fullMinutes = totalOnTime / 60000000.0;
+  double lumens =
+    (channel == Torch_Channel) ? TORCH_LUMENS : INDICATOR_LUMENS;
+
+  out << "Governor: ran " << QString::number(minutes, 'f', 1);
+  out << " minutes, equal to " << QString::number(fullMinutes, 'f', 1);
+  out << " minutes at full brightness" << endl;
+
+  out << "Usable light: " << QString::number(fullMinutes * lumens, 'f', 1);
+  out << " lumen-minutes (assuming " << QString::number(lumens, 'f', 0);
+  out << " lm at full brightness)" << endl;
+
+  out << "Peak modelled rise: " << QString::number(peakRise, 'f', 1);
+  out << " C; lowest brightness " << int(lowestCeiling * 100 + 0.5);
+  out << "%; " << deratings << " reductions" << endl;
+
+  if (thermalDescriptor >= 0)
+  {
+    out << "Peak " << thermalZone << " reading: ";
+    out << QString::number(peakTemperature, 'f', 1) << " C" << endl;
+  }
+}
+
+
+void TorThermalGovernor::checkTemperature()
+{
+  qint64 now = clock->currentTime();
+  double elapsed = now - (nextCheck - GOVERNOR_PERIOD);
+
+  accountOnTime();
+
+  // Heat goes in at a rate proportional to the light's average output
+  // over the period, and leaks away in proportion to the current rise:
+  double power = (elapsed > 0.0) ? intervalOnTime / elapsed : 0.0;
+  intervalOnTime = 0.0;
+
+  double decay = 1.0 - exp(-elapsed / (THERMAL_TIME_CONSTANT * 1000000.0));
+  modelRise += (power * THERMAL_FULL_RISE - modelRise) * decay;
+  if (modelRise > peakRise) peakRise = modelRise;
+
+  double target =
+    headroom(modelRise, THERMAL_SOFT_RISE, THERMAL_HARD_RISE);
+
+  double temperature;
+  if (readThermalZone(temperature))
+  {
+    if (temperature > peakTemperature) peakTemperature = temperature;
+
+    double sensorTarget = headroom(
+      temperature, THERMAL_SOFT_TEMPERATURE, THERMAL_HARD_TEMPERATURE);
+
+    if (sensorTarget < target) target = sensorTarget;
+  }
+
+  if (target < GOVERNOR_MIN_CEILING) target = GOVERNOR_MIN_CEILING;
+
+  // Ease towards the target, rather than jumping:
+  if (target < ceiling - GOVERNOR_MAX_STEP)
+  {
+    target = ceiling - GOVERNOR_MAX_STEP;
+  }
+  else if (target > ceiling + GOVERNOR_MAX_STEP)
+  {
+    target = ceiling + GOVERNOR_MAX_STEP;
+  }
+
+  if (target < ceiling) ++deratings;
+  ceiling = target;
+  if (ceiling < lowestCeiling) lowestCeiling = ceiling;
+
+  nextCheck += GOVERNOR_PERIOD;
+  timer->startAt(nextCheck);
+
+  unsigned int newLevel = (unsigned int)(ceiling * 100 + 0.5);
+  if (newLevel != level)
+  {
+    // Spread the change across the coming period:
+    fader->startFade(channel, level, newLevel, GOVERNOR_PERIOD);
+    level = newLevel;
+  }
+}
+
+
+void TorThermalGovernor::accountOnTime()
+{
+  qint64 now = clock->currentTime();
+  double onTime = currentOutput * (now - lastEdgeTime);
+
+  intervalOnTime += onTime;
+  totalOnTime += onTime;
+  lastEdgeTime = now;
+}
+
+
+bool TorThermalGovernor::readThermalZone(
+  double &temperature)
+{
+  if (thermalDescriptor == -1) return false;
+
+  char buffer[32];
+  ssize_t count = pread(thermalDescriptor, buffer, sizeof(buffer) - 1, 0);
+  if (count <= 0) return false;
+
+  buffer[count] = '\0';
+  temperature = atoi(buffer) / 1000.0;
+
+  return true;
+}
+
+
+double TorThermalGovernor::headroom(
+  double value,
+  double softLimit,
+  double hardLimit)
+{
+  if (value <= softLimit) return 1.0;
+  if (value >= hardLimit) return 0.0;
+
+  return (hardLimit - value) / (hardLimit - softLimit);
+}
@@ -0,0 +1,125 @@
+//
+// torthermalgovernor.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORTHERMALGOVERNOR_H
+#define TORTHERMALGOVERNOR_H
+
+#include <QObject>
+#include <QString>
+#include "torledbackend.h"
+
+class TorClock;
+class TorTimer;
+class TorFader;
+class QTextStream;
+
+// Keeps an LED as bright as it can be for as long as possible, without
+// letting it run too hot.  Heat is tracked with a simple first-order model
+// driven by the LED's actual on-time (as reported through its edges), and
+// also, where one is available, by a thermal zone's temperature.  As
+// either nears its limit the LED is dimmed a little at a time, down to a
+// floor, rather than being cut off.
+class TorThermalGovernor: public QObject, public TorEdgeListener
+{
+  Q_OBJECT
+
+public:
+  // Registers itself as a listener on the LEDs, so must outlive them:
+  TorThermalGovernor(
+    TorClock *clock,
+    TorLEDBackend *led);
+
+  ~TorThermalGovernor();
+
+  // A sysfs thermal zone "temp" attribute (in millidegrees Celsius); if
+  // none is set, the first readable thermal zone is used, if any:
+  void setThermalZone(
+    QString path);
+
+  void startGoverning(
+    TorLEDChannel channel);
+
+  void stopRunning();
+
+  bool isRunning();
+
+  void edgeEmitted(
+    TorLEDChannel channel,
+    int intensity);
+
+  // Run time, light delivered (in lumen-minutes), and how hard the
+  // governor had to work:
+  void writeReport(
+    QTextStream &out);
+
+private slots:
+  void checkTemperature();
+
+private:
+  void accountOnTime();
+
+  bool readThermalZone(
+    double &temperature);
+
+  static double headroom(
+    double value,
+    double softLimit,
+    double hardLimit);
+
+  TorClock *clock;
+  TorTimer *timer;
+  TorLEDBackend *led;
+  TorFader *fader;
+
+  QString thermalZone;
+  int thermalDescriptor;
+
+  TorLEDChannel channel;
+  int minIntensity;
+  int maxIntensity;
+
+  // On-time accounting, in microseconds at full brightness:
+  double currentOutput;
+  qint64 lastEdgeTime;
+  double intervalOnTime;
+  double totalOnTime;
+
+  // The thermal model's temperature rise above ambient, in degrees:
+  double modelRise;
+  double ceiling;
+  unsigned int level;
+
+  bool running;
+  qint64 startTime;
+  qint64 stopTime;
+  qint64 nextCheck;
+
+  // Statistics:
+  double peakRise;
+  double peakTemperature;
+  double lowestCeiling;
+  unsigned int deratings;
+};
+
+#endif // TORTHERMALGOVERNOR_H
@@ -0,0 +1,593 @@
+//
+// tortimeline.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "tortimeline.h"
+#include "torclock.h"
+#include "tortimer.h"
+#include "torsysfsled.h"
+#include "torcoremorse.h"
+#include "torexception.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+
+// Simulated sysfs LEDs use the most common max_brightness:
+#define SIMULATED_SYSFS_MAX 255
+
+// Played steps are dropped from the front of a stream once this many
+// have built up:
+#define STREAM_COMPACT_THRESHOLD 4096
+
+
+TorTimeline::TorTimeline(
+  TorClock *c,
+  TorLEDBackend *l)
+  : clock(c),
+    timer(0),
+    led(l),
+    sysfsTrace(0),
+    dotDuration(100000),
+    wakeupCount(0),
+    edgeCount(0),
+    sharedWakeups(0),
+    maxLateness(0),
+    underruns(0),
+    underrunTime(0)
+{
+  timer = clock->createTimer();
+
+  connect(
+    timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(playBatch()));
+}
+
+
+TorTimeline::~TorTimeline()
+{
+  if (timer) delete timer;
+
+  while (!tracks.isEmpty())
+  {
+    TorTimelineTrack *track = tracks.takeFirst();
+    if (track->sysfsLED) delete track->sysfsLED;
+    delete track;
+  }
+}
+
+
+void TorTimeline::simulateSysfsLEDs(
+  QTextStream *trace)
+{
+  sysfsTrace = trace;
+}
+
+
+void TorTimeline::setDotDuration(
+  unsigned int duration)
+{
+  dotDuration = qint64(duration) * 1000;
+}
+
+
+void TorTimeline::loadFile(
+  QString filename)
+{
+  QFile file(filename);
+
+  if (!file.open(QFile::ReadOnly | QFile::Text))
+  {
+    QString errString = "Error when opening file.  Qt error value: ";
+    errString += file.error();
+    throw TorException(errString);
+  }
+
+  QTextStream stream(&file);
+
+  int lineNumber = 1;
+  QString line = stream.readLine();
+  while (!line.isNull())
+  {
+    parseLine(line, lineNumber);
+    line = stream.readLine();
+    ++lineNumber;
+  }
+
+  if (tracks.isEmpty())
+  {
+    throw TorException("Timeline file contains no tracks");
+  }
+}
+
+
+void TorTimeline::parseLine(
+  QString line,
+  int lineNumber)
+{
+  QTextStream lineStream(&line);
+  QStringList words;
+  QString word;
+
+  lineStream >> word;
+  while (!word.isEmpty())
+  {
+    words.append(word);
+    word.clear();
+    lineStream >> word;
+  }
+
+  // Skip blank lines and comments:
+  if (words.isEmpty() || words.at(0).startsWith("#")) return;
+
+  QString lineError = "Timeline line ";
+  lineError += QString::number(lineNumber);
+  lineError += ": ";
+
+  if (words.size() < 3)
+  {
+    throw TorException(lineError + "expected a channel, a mode and steps");
+  }
+
+  TorTimelineTrack *track = new TorTimelineTrack;
+  track->name = words.at(0);
+  track->onBackend = true;
+  track->channel = Torch_Channel;
+  track->sysfsLED = 0;
+  track->position = 0;
+  track->nextEdge = 0;
+  track->currentIntensity = -1;
+  track->finished = false;
+  track->streaming = false;
+  track->stalled = false;
+
+  // From here on, the track is cleaned up along with the others:
+  tracks.append(track);
+
+  if (track->name == "torch")
+  {
+    track->channel = Torch_Channel;
+    track->minIntensity = led->getMinIntensity(Torch_Channel);
+    track->maxIntensity = led->getMaxIntensity(Torch_Channel);
+  }
+  else if (track->name == "indicator")
+  {
+    track->channel = Indicator_Channel;
+    track->minIntensity = led->getMinIntensity(Indicator_Channel);
+    track->maxIntensity = led->getMaxIntensity(Indicator_Channel);
+  }
+  else
+  {
+    track->onBackend = false;
+    track->minIntensity = 0;
+
+    if (sysfsTrace)
+    {
+      track->maxIntensity = SIMULATED_SYSFS_MAX;
+    }
+    else
+    {
+      track->sysfsLED = new TorSysfsLED(track->name);
+      track->maxIntensity = track->sysfsLED->getMaxIntensity();
+    }
+  }
+
+  if (words.at(1) == "loop")
+  {
+    track->loop = true;
+  }
+  else if (words.at(1) == "once")
+  {
+    track->loop = false;
+  }
+  else
+  {
+    throw TorException(lineError + "mode must be \"once\" or \"loop\"");
+  }
+
+  int i = 2;
+  while (i < words.size())
+  {
+    if (words.at(i) == "morse")
+    {
+      // The rest of the line is text:
+      QString text;
+      ++i;
+      while (i < words.size())
+      {
+        if (!text.isEmpty()) text += " ";
+        text += words.at(i);
+        ++i;
+      }
+
+      appendMorse(track, text);
+      break;
+    }
+
+    if (i + 1 >= words.size())
+    {
+      throw TorException(lineError + "level with no duration");
+    }
+
+    int intensity;
+    if (words.at(i) == "on")
+    {
+      intensity = track->maxIntensity;
+    }
+    else if (words.at(i) == "off")
+    {
+      intensity = track->minIntensity;
+    }
+    else
+    {
+      bool isANumber;
+      intensity = words.at(i).toInt(&isANumber);
+      if (!isANumber)
+      {
+        throw TorException(lineError + "couldn't parse level " + words.at(i));
+      }
+    }
+
+    bool isANumber;
+    int duration = words.at(i + 1).toInt(&isANumber);
+    if (!isANumber || (duration < 0))
+    {
+      throw TorException(
+        lineError + "couldn't parse duration " + words.at(i + 1));
+    }
+
+    appendStep(track, intensity, qint64(duration) * 1000);
+    i += 2;
+  }
+
+  qint64 totalDuration = 0;
+  int step = 0;
+  while (step < track->steps.size())
+  {
+    totalDuration += track->steps.at(step).duration;
+    ++step;
+  }
+
+  if (track->loop && !totalDuration)
+  {
+    throw TorException(lineError + "a looping track can't take no time");
+  }
+}
+
+
+TorTimelineTrack *TorTimeline::addStream(
+  TorLEDChannel channel)
+{
+  TorTimelineTrack *track = new TorTimelineTrack;
+  track->name = (channel == Torch_Channel) ? "torch" : "indicator";
+  track->onBackend = true;
+  track->channel = channel;
+  track->sysfsLED = 0;
+  track->minIntensity = led->getMinIntensity(channel);
+  track->maxIntensity = led->getMaxIntensity(channel);
+  track->loop = false;
+  track->streaming = true;
+  track->position = 0;
+  track->nextEdge = 0;
+  track->currentIntensity = -1;
+  track->finished = false;
+  track->stalled = false;
+
+  tracks.append(track);
+
+  return track;
+}
+
+
+void TorTimeline::appendToStream(
+  TorTimelineTrack *track,
+  int intensity,
+  qint64 duration)
+{
+  if (track->position >= STREAM_COMPACT_THRESHOLD)
+  {
+    track->steps.remove(0, track->position);
+    track->position = 0;
+  }
+
+  appendStep(track, intensity, duration);
+
+  if (!track->stalled) return;
+
+  // The stream ran dry; carry on from where it should have been, unless
+  // that has already passed:
+  track->stalled = false;
+
+  qint64 now = clock->currentTime();
+  if (track->nextEdge < now)
+  {
+    if (track->currentIntensity != -1)
+    {
+      ++underruns;
+      underrunTime += now - track->nextEdge;
+    }
+
+    track->nextEdge = now;
+  }
+
+  scheduleNextBatch();
+}
+
+
+void TorTimeline::endStream(
+  TorTimelineTrack *track)
+{
+  track->streaming = false;
+
+  if (!track->stalled) return;
+
+  track->stalled = false;
+
+  qint64 now = clock->currentTime();
+  if (track->nextEdge < now) track->nextEdge = now;
+
+  scheduleNextBatch();
+}
+
+
+void TorTimeline::startTimeline()
+{
+  qint64 now = clock->currentTime();
+
+  QList<TorTimelineTrack *>::iterator i = tracks.begin();
+  while (i != tracks.end())
+  {
+    (*i)->position = 0;
+    (*i)->nextEdge = now;
+    (*i)->finished = (*i)->steps.isEmpty() && !(*i)->streaming;
+    (*i)->stalled = false;
+    ++i;
+  }
+
+  wakeupCount = 0;
+  edgeCount = 0;
+  sharedWakeups = 0;
+  maxLateness = 0;
+  underruns = 0;
+  underrunTime = 0;
+
+  // Every track starts at once, so the first batch runs right away:
+  playBatch();
+}
+
+
+void TorTimeline::stopRunning()
+{
+  timer->stop();
+}
+
+
+void TorTimeline::writeReport(
+  QTextStream &out)
+{
+  out << "Timeline: " << tracks.size() << " tracks, ";
+  out << edgeCount << " edges in " << wakeupCount << " wakeups";
+  out << " (" << sharedWakeups << " shared by several tracks)" << endl;
+  out << "Latest wakeup: " << maxLateness << " us" << endl;
+
+  if (underruns)
+  {
+    out << "Stream underruns: " << underruns << ", holding for ";
+    out << underrunTime << " us in all" << endl;
+  }
+}
+
+
+void TorTimeline::playBatch()
+{
+  qint64 now = clock->currentTime();
+  unsigned int tracksChanged = 0;
+
+  ++wakeupCount;
+
+  QList<TorTimelineTrack *>::iterator i = tracks.begin();
+  while (i != tracks.end())
+  {
+    TorTimelineTrack *track = *i;
+    ++i;
+
+    if ( track->finished
+      || track->stalled
+      || (track->nextEdge > now))
+    {
+      continue;
+    }
+
+    if (now - track->nextEdge > maxLateness)
+    {
+      maxLateness = now - track->nextEdge;
+    }
+
+    // Run through every step that has come due; only the last one
+    // reaches the LED:
+    int intensity = track->currentIntensity;
+    while (!track->finished && (track->nextEdge <= now))
+    {
+      if (track->position >= track->steps.size())
+      {
+        if (track->loop)
+        {
+          track->position = 0;
+        }
+        else if (track->streaming)
+        {
+          // Hold the current level until more steps are appended:
+          track->stalled = true;
+          break;
+        }
+        else
+        {
+          // Once through, then dark:
+          intensity = track->minIntensity;
+          track->finished = true;
+          break;
+        }
+      }
+
+      const TorTimelineStep &step = track->steps.at(track->position);
+      intensity = step.intensity;
+      track->nextEdge += step.duration;
+      ++track->position;
+    }
+
+    if (intensity != track->currentIntensity)
+    {
+      try
+      {
+        writeLevel(track, intensity);
+      }
+      catch (TorException &e)
+      {
+        QTextStream qts(stderr);
+        qts << e.getError() << endl;
+        timer->stop();
+        emit timelineFinished();
+        return;
+      }
+
+      ++edgeCount;
+      ++tracksChanged;
+    }
+  }
+
+  if (tracksChanged > 1) ++sharedWakeups;
+
+  scheduleNextBatch();
+}
+
+
+void TorTimeline::appendStep(
+  TorTimelineTrack *track,
+  int intensity,
+  qint64 duration)
+{
+  if (intensity < track->minIntensity) intensity = track->minIntensity;
+  else if (intensity > track->maxIntensity) intensity = track->maxIntensity;
+
+  // Merge runs at the same level, so they take a single wakeup (but a
+  // step that has already started playing is left alone):
+  if ( (track->steps.size() > track->position)
+    && (track->steps.last().intensity == intensity))
+  {
+    track->steps.last().duration += duration;
+    return;
+  }
+
+  TorTimelineStep step;
+  step.intensity = intensity;
+  step.duration = duration;
+  track->steps.append(step);
+}
+
+
+void TorTimeline::appendMorse(
+  TorTimelineTrack *track,
+  QString text)
+{
+  // The same encoder as every other Morse mode, so that a timeline's
+  // "morse SOS" is timed just like -s:
+  TorCoreMorseEncoder encoder;
+  QByteArray bytes = text.toLocal8Bit();
+  encoder.appendText(bytes.constData(), bytes.size());
+
+  // Leave a word gap before the next time around:
+  encoder.appendGap(4);
+
+  const std::vector<TorCoreRun> &runs = encoder.getRuns();
+  for (size_t i = 0; i < runs.size(); ++i)
+  {
+    appendStep(
+      track,
+      runs[i].lit ? track->maxIntensity : track->minIntensity,
+      runs[i].units * dotDuration);
+  }
+}
+
+
+void TorTimeline::writeLevel(
+  TorTimelineTrack *track,
+  int intensity)
+{
+  track->currentIntensity = intensity;
+
+  if (track->onBackend)
+  {
+    led->setIntensity(track->channel, intensity);
+  }
+  else if (track->sysfsLED)
+  {
+    track->sysfsLED->setIntensity(intensity);
+  }
+  else if (sysfsTrace)
+  {
+    *sysfsTrace << clock->currentTime() << " " << track->name;
+    *sysfsTrace << " " << intensity << "\n";
+  }
+}
+
+
+void TorTimeline::scheduleNextBatch()
+{
+  bool pending = false;
+  bool waiting = false;
+  qint64 nextBatch = 0;
+
+  QList<TorTimelineTrack *>::const_iterator i = tracks.constBegin();
+  while (i != tracks.constEnd())
+  {
+    if ((*i)->stalled)
+    {
+      waiting = true;
+    }
+    else if (!(*i)->finished)
+    {
+      if (!pending || ((*i)->nextEdge < nextBatch))
+      {
+        nextBatch = (*i)->nextEdge;
+        pending = true;
+      }
+    }
+    ++i;
+  }
+
+  if (pending)
+  {
+    timer->startAt(nextBatch);
+  }
+  else if (waiting)
+  {
+    // Nothing to do until a stream is fed:
+    timer->stop();
+  }
+  else
+  {
+    emit timelineFinished();
+  }
+}
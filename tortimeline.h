@@ -0,0 +1,179 @@
+//
+// tortimeline.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORTIMELINE_H
+#define TORTIMELINE_H
+
+#include "torledbackend.h"
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QVector>
+
+class TorClock;
+class TorTimer;
+class TorSysfsLED;
+class QTextStream;
+
+// One step of a track: hold the LED at this level for this long
+// (in microseconds):
+struct TorTimelineStep
+{
+  int intensity;
+  qint64 duration;
+};
+
+
+struct TorTimelineTrack
+{
+  QString name;
+  bool onBackend; // torch or indicator, rather than a sysfs LED
+  TorLEDChannel channel;
+  TorSysfsLED *sysfsLED; // 0 when simulated
+  int minIntensity;
+  int maxIntensity;
+  bool loop;
+  bool streaming; // more steps may still be appended while playing
+  QVector<TorTimelineStep> steps;
+
+  // Playback state:
+  int position;
+  qint64 nextEdge;
+  int currentIntensity;
+  bool finished;
+  bool stalled; // a stream that has played everything it has been given
+};
+
+
+// Plays several LED tracks at once, each with its own independent timing.
+// A single timer serves every track: each wakeup applies all the edges due
+// by then as one batch, and the timer is then re-armed for the earliest
+// edge left on any track.  Adding tracks adds no wakeups beyond their own
+// distinct edge times.
+//
+// A timeline file holds one track per line:
+//
+//   <channel> <once|loop> <steps>
+//
+// The channel is "torch", "indicator", or a /sys/class/leds LED (by name
+// or by full path).  Steps are "<level> <milliseconds>" pairs, where the
+// level is in the channel's own units or is "on" or "off"; or "morse"
+// followed by text to send at the dot duration.  Blank lines and lines
+// starting with '#' are ignored.  For example:
+//
+//   torch      loop  morse SOS
+//   indicator  loop  on 100 off 100 on 100 off 700
+//
+// Tracks can also be streamed: steps are appended while the timeline is
+// playing, and a stream that runs dry holds its level until more arrive.
+//
+class TorTimeline: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorTimeline(
+    TorClock *clock,
+    TorLEDBackend *led);
+
+  ~TorTimeline();
+
+  // Under simulation, sysfs LEDs are written to the trace stream rather
+  // than driven:
+  void simulateSysfsLEDs(
+    QTextStream *trace);
+
+  void setDotDuration(
+    unsigned int duration);
+
+  void loadFile(
+    QString filename);
+
+  // Adds the track described by one line of a timeline file:
+  void parseLine(
+    QString line,
+    int lineNumber);
+
+  // Adds an empty track that is fed through appendToStream():
+  TorTimelineTrack *addStream(
+    TorLEDChannel channel);
+
+  void appendToStream(
+    TorTimelineTrack *track,
+    int intensity,
+    qint64 duration);
+
+  // No more steps will arrive; the track finishes once it has played
+  // the ones it has:
+  void endStream(
+    TorTimelineTrack *track);
+
+  void startTimeline();
+
+  void stopRunning();
+
+  void writeReport(
+    QTextStream &out);
+
+signals:
+  void timelineFinished();
+
+private slots:
+  void playBatch();
+
+private:
+  void appendStep(
+    TorTimelineTrack *track,
+    int intensity,
+    qint64 duration);
+
+  void appendMorse(
+    TorTimelineTrack *track,
+    QString text);
+
+  void writeLevel(
+    TorTimelineTrack *track,
+    int intensity);
+
+  void scheduleNextBatch();
+
+  TorClock *clock;
+  TorTimer *timer;
+  TorLEDBackend *led;
+  QTextStream *sysfsTrace;
+  qint64 dotDuration;
+
+  QList<TorTimelineTrack *> tracks;
+
+  // Statistics:
+  unsigned int wakeupCount;
+  unsigned int edgeCount;
+  unsigned int sharedWakeups;
+  qint64 maxLateness;
+  unsigned int underruns;
+  qint64 underrunTime;
+};
+
+#endif // TORTIMELINE_H
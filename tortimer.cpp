@@ -0,0 +1,208 @@
+//
+// tortimer.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "tortimer.h"
+#include "torclock.h"
+
+#include <QSocketNotifier>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <stdint.h>
+
+
+TorTimer::TorTimer()
+  : active(false),
+    deadline(0)
+{
+}
+
+
+TorTimer::~TorTimer()
+{
+}
+
+
+bool TorTimer::isActive()
+{
+  return active;
+}
+
+
+qint64 TorTimer::getDeadline()
+{
+  return deadline;
+}
+
+
+void TorTimer::startAtPrecisely(
+  qint64 d)
+{
+  startAt(d);
+}
+
+
+TorSystemTimer::TorSystemTimer(
+  TorClock *c)
+  : clock(c),
+    timerDescriptor(-1),
+    notifier(0),
+    preciseArmed(false)
+{
+  timer.setSingleShot(true);
+
+  connect(
+    &timer,
+    SIGNAL(timeout()),
+    this,
+    SLOT(fire()));
+}
+
+
+TorSystemTimer::~TorSystemTimer()
+{
+  if (notifier) delete notifier;
+  if (timerDescriptor != -1) close(timerDescriptor);
+}
+
+
+void TorSystemTimer::startAt(
+  qint64 d)
+{
+  disarmPrecise();
+
+  deadline = d;
+  active = true;
+
+  qint64 remaining = deadline - clock->currentTime();
+
+  if (remaining < 0) remaining = 0;
+
+  // QTimer only works in milliseconds, so round up; we'd rather be a
+  // fraction late than early:
+  timer.start((remaining + 999) / 1000);
+}
+
+
+//
+// The timerfd is only made the first time it's wanted, so the many timers
+// that never need one don't each hold a descriptor open:
+//
+void TorSystemTimer::startAtPrecisely(
+  qint64 d)
+{
+  if (timerDescriptor == -1)
+  {
+    timerDescriptor =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (timerDescriptor == -1)
+    {
+      // Being a millisecond out is better than not going off at all:
+      startAt(d);
+      return;
+    }
+
+    notifier = new QSocketNotifier(timerDescriptor, QSocketNotifier::Read);
+
+    connect(
+      notifier,
+      SIGNAL(activated(int)),
+      this,
+      SLOT(firePrecisely()));
+  }
+
+  timer.stop();
+
+  deadline = d;
+  active = true;
+  preciseArmed = true;
+
+  // An all-zero it_value would disarm the timer, so a deadline already
+  // past is rounded up to the first nanosecond instead:
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = 0;
+  spec.it_interval.tv_nsec = 0;
+
+  if (deadline > 0)
+  {
+    spec.it_value.tv_sec = deadline / 1000000;
+    spec.it_value.tv_nsec = (deadline % 1000000) * 1000;
+  }
+  else
+  {
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 1;
+  }
+
+  timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &spec, 0);
+  notifier->setEnabled(true);
+}
+
+
+void TorSystemTimer::stop()
+{
+  timer.stop();
+  disarmPrecise();
+  active = false;
+}
+
+
+void TorSystemTimer::fire()
+{
+  active = false;
+  emit timeout();
+}
+
+
+void TorSystemTimer::firePrecisely()
+{
+  // Clear the expiration count, so the descriptor stops reading ready:
+  uint64_t expirations;
+  if (read(timerDescriptor, &expirations, sizeof(expirations)) == -1)
+  {
+    // Spurious wakeup; the timer hasn't actually gone off yet:
+    return;
+  }
+
+  notifier->setEnabled(false);
+  preciseArmed = false;
+
+  fire();
+}
+
+
+void TorSystemTimer::disarmPrecise()
+{
+  if (!preciseArmed) return;
+
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = 0;
+  spec.it_interval.tv_nsec = 0;
+  spec.it_value.tv_sec = 0;
+  spec.it_value.tv_nsec = 0;
+
+  timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &spec, 0);
+  notifier->setEnabled(false);
+  preciseArmed = false;
+}
@@ -0,0 +1,101 @@
+//
+// tortimer.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORTIMER_H
+#define TORTIMER_H
+
+#include <QObject>
+#include <QTimer>
+
+class TorClock;
+class QSocketNotifier;
+
+// A single-shot timer that fires at an absolute deadline on its clock.
+// Periodic behavior is left to the caller, which can simply re-arm the
+// timer at (previous deadline + period) to avoid accumulating drift.
+class TorTimer: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorTimer();
+  virtual ~TorTimer();
+
+  virtual void startAt(
+    qint64 deadline) = 0;
+
+  // For the few waits that must end to the microsecond, rather than to
+  // the millisecond; by default, the same as startAt():
+  virtual void startAtPrecisely(
+    qint64 deadline);
+
+  virtual void stop() = 0;
+
+  bool isActive();
+  qint64 getDeadline();
+
+signals:
+  void timeout();
+
+protected:
+  bool active;
+  qint64 deadline;
+};
+
+
+// The real-time implementation, driven by a QTimer:
+class TorSystemTimer: public TorTimer
+{
+  Q_OBJECT
+
+public:
+  TorSystemTimer(
+    TorClock *clock);
+
+  ~TorSystemTimer();
+
+  void startAt(
+    qint64 deadline);
+
+  // Armed on a timerfd, against the absolute deadline:
+  void startAtPrecisely(
+    qint64 deadline);
+
+  void stop();
+
+private slots:
+  void fire();
+  void firePrecisely();
+
+private:
+  void disarmPrecise();
+
+  TorClock *clock;
+  QTimer timer;
+
+  int timerDescriptor;
+  QSocketNotifier *notifier;
+  bool preciseArmed;
+};
+
+#endif // TORTIMER_H
@@ -0,0 +1,498 @@
+//
+// tortimingscript.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#include "tortimingscript.h"
+#include "tortimeline.h"
+#include "torexception.h"
+
+#include <QSocketNotifier>
+#include <QTextStream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define SCRIPT_READ_SIZE 16384
+
+
+TorTimingScript::TorTimingScript(
+  TorTimeline *t,
+  TorLEDChannel channel)
+  : timeline(t),
+    track(0),
+    inputDescriptor(-1),
+    ownsDescriptor(false),
+    savedFlags(0),
+    inputFinished(false),
+    notifier(0),
+    format(Unknown_Format),
+    headerLength(0),
+    tokenLength(0),
+    inComment(false),
+    expectingDuration(false),
+    pendingIntensity(0),
+    onIntensity(0),
+    recordLength(0),
+    lineNumber(1),
+    byteCount(0),
+    stepCount(0),
+    parseTime(0)
+{
+  track = timeline->addStream(channel);
+  onIntensity = track->maxIntensity;
+}
+
+
+TorTimingScript::~TorTimingScript()
+{
+  stopRunning();
+}
+
+
+void TorTimingScript::openInput(
+  QString path)
+{
+  if (path == "-")
+  {
+    inputDescriptor = STDIN_FILENO;
+  }
+  else
+  {
+    inputDescriptor = open(path.toLocal8Bit().constData(), O_RDONLY);
+
+    if (inputDescriptor == -1)
+    {
+      QString ss;
+      ss += "Failed to open timing script ";
+      ss += path;
+      ss += "\nError is ";
+      ss += strerror(errno);
+      throw TorException(ss);
+    }
+
+    ownsDescriptor = true;
+  }
+}
+
+
+bool TorTimingScript::readAvailable()
+{
+  char buffer[SCRIPT_READ_SIZE];
+
+  while (!inputFinished)
+  {
+    ssize_t count = read(inputDescriptor, buffer, sizeof(buffer));
+
+    if (count > 0)
+    {
+      parse(buffer, count);
+    }
+    else if (count == 0)
+    {
+      finishInput();
+    }
+    else if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+    {
+      break;
+    }
+    else if (errno != EINTR)
+    {
+      QString ss;
+      ss += "Failed to read timing script.\nError is ";
+      ss += strerror(errno);
+      throw TorException(ss);
+    }
+  }
+
+  return !inputFinished;
+}
+
+
+void TorTimingScript::readToEnd()
+{
+  char buffer[SCRIPT_READ_SIZE];
+
+  while (!inputFinished)
+  {
+    ssize_t count = read(inputDescriptor, buffer, sizeof(buffer));
+
+    if (count > 0)
+    {
+      parse(buffer, count);
+    }
+    else if (count == 0)
+    {
+      finishInput();
+    }
+    else if (errno != EINTR)
+    {
+      QString ss;
+      ss += "Failed to read timing script.\nError is ";
+      ss += strerror(errno);
+      throw TorException(ss);
+    }
+  }
+}
+
+
+void TorTimingScript::startWatching()
+{
+  if (inputFinished) return;
+
+  // Reads must never hold up the LEDs:
+  savedFlags = fcntl(inputDescriptor, F_GETFL);
+  fcntl(inputDescriptor, F_SETFL, savedFlags | O_NONBLOCK);
+
+  notifier = new QSocketNotifier(inputDescriptor, QSocketNotifier::Read);
+
+  connect(
+    notifier,
+    SIGNAL(activated(int)),
+    this,
+    SLOT(readInput()));
+}
+
+
+void TorTimingScript::stopRunning()
+{
+  if (notifier)
+  {
+    // We may be inside the notifier's own signal:
+    notifier->setEnabled(false);
+    notifier->deleteLater();
+    notifier = 0;
+
+    fcntl(inputDescriptor, F_SETFL, savedFlags);
+  }
+
+  if (ownsDescriptor)
+  {
+    close(inputDescriptor);
+    ownsDescriptor = false;
+  }
+
+  inputDescriptor = -1;
+}
+
+
+void TorTimingScript::writeReport(
+  QTextStream &out)
+{
+  out << "Timing script: " << stepCount << " steps from ";
+  out << byteCount << " bytes, parsed in ";
+  out << QString::number(parseTime / 1000.0, 'f', 3) << " ms";
+
+  if (parseTime > 0)
+  {
+    out << " (" << qint64(stepCount * 1000000.0 / parseTime);
+    out << " steps per second, ";
+    out << QString::number(byteCount / double(parseTime), 'f', 1);
+    out << " MB/s)";
+  }
+
+  out << endl;
+}
+
+
+void TorTimingScript::readInput()
+{
+  try
+  {
+    if (!readAvailable()) stopRunning();
+  }
+  catch (TorException &e)
+  {
+    QTextStream qts(stderr);
+    qts << e.getError() << endl;
+    stopRunning();
+    emit scriptFailed();
+  }
+}
+
+
+void TorTimingScript::parse(
+  const char *data,
+  int size)
+{
+  qint64 parseStart = wallClock.currentTime();
+
+  byteCount += size;
+
+  if (format == Unknown_Format)
+  {
+    // Hold back the start of the input until we can tell which form
+    // it's in:
+    while ((headerLength < 4) && size)
+    {
+      header[headerLength] = *data;
+      ++headerLength;
+      ++data;
+      --size;
+    }
+
+    if (headerLength < 4) return;
+
+    if (!memcmp(header, "TORB", 4))
+    {
+      format = Binary_Format;
+    }
+    else
+    {
+      format = Text_Format;
+      parseText(header, 4);
+    }
+  }
+
+  if (format == Binary_Format)
+  {
+    parseBinary(data, size);
+  }
+  else
+  {
+    parseText(data, size);
+  }
+
+  parseTime += wallClock.currentTime() - parseStart;
+}
+
+
+void TorTimingScript::parseText(
+  const char *data,
+  int size)
+{
+  const char *end = data + size;
+
+  while (data < end)
+  {
+    char c = *data;
+    ++data;
+
+    if (inComment)
+    {
+      if (c == '\n')
+      {
+        inComment = false;
+        ++lineNumber;
+      }
+      continue;
+    }
+
+    switch (c)
+    {
+    case '#':
+      finishToken();
+      inComment = true;
+      break;
+
+    case '\n':
+      finishToken();
+      ++lineNumber;
+      break;
+
+    case ' ':
+    case '\t':
+    case '\r':
+    case ',':
+      finishToken();
+      break;
+
+    default:
+      if (tokenLength >= int(sizeof(token)) - 1)
+      {
+        throw TorException(errorPrefix() + "word too long");
+      }
+
+      token[tokenLength] = c;
+      ++tokenLength;
+      break;
+    }
+  }
+}
+
+
+void TorTimingScript::parseBinary(
+  const char *data,
+  int size)
+{
+  const char *end = data + size;
+
+  while (data < end)
+  {
+    record[recordLength] = *data;
+    ++recordLength;
+    ++data;
+
+    if (recordLength < 4) continue;
+
+    recordLength = 0;
+
+    qint64 duration =
+      record[1] | (record[2] << 8) | (qint64(record[3]) << 16);
+
+    timeline->appendToStream(track, record[0], duration);
+    ++stepCount;
+  }
+}
+
+
+void TorTimingScript::finishToken()
+{
+  if (!tokenLength) return;
+
+  token[tokenLength] = 0;
+
+  if (expectingDuration)
+  {
+    qint64 duration = parseDuration();
+    expectingDuration = false;
+
+    timeline->appendToStream(track, pendingIntensity, duration);
+    ++stepCount;
+  }
+  else if (!strcmp(token, "on"))
+  {
+    pendingIntensity = onIntensity;
+    expectingDuration = true;
+  }
+  else if (!strcmp(token, "off"))
+  {
+    pendingIntensity = track->minIntensity;
+    expectingDuration = true;
+  }
+  else if ((token[0] == 'i') && (token[1] == '='))
+  {
+    int level = 0;
+    const char *digit = token + 2;
+
+    if (!*digit)
+    {
+      throw TorException(errorPrefix() + "no level after \"i=\"");
+    }
+
+    while (*digit)
+    {
+      if ((*digit < '0') || (*digit > '9') || (level > 100000))
+      {
+        throw TorException(errorPrefix() + "couldn't parse " + token);
+      }
+
+      level = level * 10 + (*digit - '0');
+      ++digit;
+    }
+
+    onIntensity = level;
+  }
+  else
+  {
+    throw TorException(errorPrefix() + "unknown word " + token);
+  }
+
+  tokenLength = 0;
+}
+
+
+qint64 TorTimingScript::parseDuration()
+{
+  // Milliseconds, with up to three decimal places; worked out in
+  // microseconds:
+  qint64 duration = 0;
+  int decimals = -1;
+
+  const char *digit = token;
+  while (*digit)
+  {
+    if ((*digit == '.') && (decimals < 0))
+    {
+      decimals = 0;
+    }
+    else if ( (*digit < '0')
+      || (*digit > '9')
+      || (decimals >= 3)
+      || (duration > 1000000000))
+    {
+      throw TorException(
+        errorPrefix() + "couldn't parse duration " + token);
+    }
+    else
+    {
+      duration = duration * 10 + (*digit - '0');
+      if (decimals >= 0) ++decimals;
+    }
+
+    ++digit;
+  }
+
+  if (decimals < 0) decimals = 0;
+
+  while (decimals < 3)
+  {
+    duration *= 10;
+    ++decimals;
+  }
+
+  return duration;
+}
+
+
+void TorTimingScript::finishInput()
+{
+  qint64 parseStart = wallClock.currentTime();
+
+  inputFinished = true;
+
+  if (format == Unknown_Format)
+  {
+    // Too short to carry the binary header:
+    format = Text_Format;
+    parseText(header, headerLength);
+  }
+
+  if (format == Text_Format)
+  {
+    finishToken();
+
+    if (expectingDuration)
+    {
+      throw TorException(errorPrefix() + "level with no duration");
+    }
+  }
+  else if (recordLength)
+  {
+    throw TorException("Timing script ends partway through a step");
+  }
+
+  timeline->endStream(track);
+
+  parseTime += wallClock.currentTime() - parseStart;
+}
+
+
+QString TorTimingScript::errorPrefix()
+{
+  QString prefix = "Timing script line ";
+  prefix += QString::number(lineNumber);
+  prefix += ": ";
+  return prefix;
+}
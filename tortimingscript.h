@@ -0,0 +1,148 @@
+//
+// tortimingscript.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+
+#ifndef TORTIMINGSCRIPT_H
+#define TORTIMINGSCRIPT_H
+
+#include <QObject>
+#include <QString>
+#include "torledbackend.h"
+#include "torclock.h"
+
+class TorTimeline;
+struct TorTimelineTrack;
+class QSocketNotifier;
+class QTextStream;
+
+// Exact on/off timings, fed straight into a timeline stream without going
+// through text encoding.  The input is parsed incrementally as it arrives,
+// a byte at a time, so a generator can keep feeding it for as long as it
+// likes.  It comes in one of two forms:
+//
+// Text: "on <ms>" and "off <ms>" hold the LED lit or dark, and "i=<level>"
+// sets the level (in the channel's own units) used by later "on"s.
+// Durations may have up to three decimal places.  Words are separated by
+// whitespace or commas, and '#' starts a comment running to the end of
+// the line.  For example:
+//
+//   on 300 off 100 i=4 on 50 off 12.5
+//
+// Binary: the bytes "TORB", then four bytes per step: the level, followed
+// by the duration in microseconds as a 24-bit little-endian number.
+class TorTimingScript: public QObject
+{
+  Q_OBJECT
+
+public:
+  TorTimingScript(
+    TorTimeline *timeline,
+    TorLEDChannel channel);
+
+  ~TorTimingScript();
+
+  // A file, or "-" for standard input:
+  void openInput(
+    QString path);
+
+  // Parses whatever has arrived (the input is non-blocking once watched);
+  // at the end of the input, closes the stream.  Returns false once the
+  // input is exhausted.
+  bool readAvailable();
+
+  // Parses the whole input now, blocking as needed:
+  void readToEnd();
+
+  // Parses input as it arrives, from the event loop:
+  void startWatching();
+
+  void stopRunning();
+
+  void writeReport(
+    QTextStream &out);
+
+signals:
+  void scriptFailed();
+
+private slots:
+  void readInput();
+
+private:
+  void parse(
+    const char *data,
+    int size);
+
+  void parseText(
+    const char *data,
+    int size);
+
+  void parseBinary(
+    const char *data,
+    int size);
+
+  void finishToken();
+
+  qint64 parseDuration();
+
+  void finishInput();
+
+  QString errorPrefix();
+
+  TorTimeline *timeline;
+  TorTimelineTrack *track;
+  TorSystemClock wallClock;
+
+  int inputDescriptor;
+  bool ownsDescriptor;
+  int savedFlags;
+  bool inputFinished;
+  QSocketNotifier *notifier;
+
+  // Parser state, carried over from one chunk of input to the next:
+  enum TorScriptFormat
+  {
+    Unknown_Format,
+    Text_Format,
+    Binary_Format
+  };
+
+  TorScriptFormat format;
+  char header[4];
+  int headerLength;
+  char token[32];
+  int tokenLength;
+  bool inComment;
+  bool expectingDuration;
+  int pendingIntensity;
+  int onIntensity;
+  unsigned char record[4];
+  int recordLength;
+  unsigned int lineNumber;
+
+  // Statistics:
+  qint64 byteCount;
+  unsigned int stepCount;
+  qint64 parseTime;
+};
+
+#endif // TORTIMINGSCRIPT_H
@@ -0,0 +1,180 @@
+//
+// torvirtualclock.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torvirtualclock.h"
+
+
+TorVirtualClock::TorVirtualClock()
+  : now(0),
+    sequence(0)
+{
+}
+
+
+TorVirtualClock::~TorVirtualClock()
+{
+}
+
+
+qint64 TorVirtualClock::currentTime()
+{
+  return now;
+}
+
+
+qint64 TorVirtualClock::currentRealTime()
+{
+  return now;
+}
+
+
+TorTimer *TorVirtualClock::createTimer()
+{
+  return new TorVirtualTimer(this);
+}
+
+
+void TorVirtualClock::delay(
+  qint64 duration)
+{
+  if (duration > 0) now += duration;
+}
+
+
+unsigned int TorVirtualClock::run(
+  qint64 endTime)
+{
+  unsigned int fired = 0;
+
+  TorVirtualTimer *timer = findNextTimer();
+
+  while (timer && (timer->getDeadline() <= endTime))
+  {
+    if (timer->getDeadline() > now)
+    {
+      now = timer->getDeadline();
+    }
+
+    timer->fire();
+    ++fired;
+
+    timer = findNextTimer();
+  }
+
+  return fired;
+}
+
+
+void TorVirtualClock::advanceTo(
+  qint64 time)
+{
+  if (time > now) now = time;
+}
+
+
+void TorVirtualClock::registerTimer(
+  TorVirtualTimer *timer)
+{
+  timers.append(timer);
+}
+
+
+void TorVirtualClock::unregisterTimer(
+  TorVirtualTimer *timer)
+{
+  timers.removeAll(timer);
+}
+
+
+unsigned int TorVirtualClock::nextSequence()
+{
+  return ++sequence;
+}
+
+
+TorVirtualTimer *TorVirtualClock::findNextTimer()
+{
+  TorVirtualTimer *next = 0;
+
+  QList<TorVirtualTimer *>::const_iterator i = timers.constBegin();
+  while (i != timers.constEnd())
+  {
+    if ((*i)->isActive())
+    {
+      if ( !next
+        || ((*i)->getDeadline() < next->getDeadline())
+        || ( ((*i)->getDeadline() == next->getDeadline())
+          && ((*i)->getSequence() < next->getSequence())))
+      {
+        next = *i;
+      }
+    }
+
+    ++i;
+  }
+
+  return next;
+}
+
+
+TorVirtualTimer::TorVirtualTimer(
+  TorVirtualClock *c)
+  : clock(c),
+    sequence(0)
+{
+  clock->registerTimer(this);
+}
+
+
+TorVirtualTimer::~TorVirtualTimer()
+{
+  clock->unregisterTimer(this);
+}
+
+
+void TorVirtualTimer::startAt(
+  qint64 d)
+{
+  deadline = d;
+  sequence = clock->nextSequence();
+  active = true;
+}
+
+
+void TorVirtualTimer::stop()
+{
+  active = false;
+}
+
+
+unsigned int TorVirtualTimer::getSequence()
+{
+  return sequence;
+}
+
+
+void TorVirtualTimer::fire()
+{
+  active = false;
+  emit timeout();
+}
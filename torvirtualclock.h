@@ -0,0 +1,107 @@
+//
+// torvirtualclock.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORVIRTUALCLOCK_H
+#define TORVIRTUALCLOCK_H
+
+#include "torclock.h"
+#include "tortimer.h"
+
+#include <QList>
+
+class TorVirtualTimer;
+
+// The virtual clock never waits: run() simply jumps the current time
+// forward to the earliest pending deadline and fires that timer, so hours
+// of scheduled activity can be played through in a few milliseconds.
+// Timers sharing a deadline fire in the order they were armed, so runs are
+// fully deterministic.
+class TorVirtualClock: public TorClock
+{
+public:
+  TorVirtualClock();
+  ~TorVirtualClock();
+
+  qint64 currentTime();
+
+  // Virtual wall-clock time is just virtual time, so it too moves only
+  // when run:
+  qint64 currentRealTime();
+
+  TorTimer *createTimer();
+
+  // Virtual time just jumps ahead:
+  void delay(
+    qint64 duration);
+
+  // Fire timers until none are pending, or until the next deadline lies
+  // beyond endTime.  Returns the number of timers fired.
+  unsigned int run(
+    qint64 endTime);
+
+  void advanceTo(
+    qint64 time);
+
+  // Used by TorVirtualTimer:
+  void registerTimer(
+    TorVirtualTimer *timer);
+
+  void unregisterTimer(
+    TorVirtualTimer *timer);
+
+  unsigned int nextSequence();
+
+private:
+  TorVirtualTimer *findNextTimer();
+
+  qint64 now;
+  unsigned int sequence;
+  QList<TorVirtualTimer *> timers;
+};
+
+
+class TorVirtualTimer: public TorTimer
+{
+  Q_OBJECT
+
+public:
+  TorVirtualTimer(
+    TorVirtualClock *clock);
+
+  ~TorVirtualTimer();
+
+  void startAt(
+    qint64 deadline);
+
+  void stop();
+
+  unsigned int getSequence();
+
+  void fire();
+
+private:
+  TorVirtualClock *clock;
+  unsigned int sequence;
+};
+
+#endif // TORVIRTUALCLOCK_H
@@ -0,0 +1,232 @@
+//
+// torwordcache.cpp
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#include "torwordcache.h"
+
+#include <QTextStream>
+
+#include <ctype.h>
+#include <time.h>
+
+
+static qint64 threadCPUTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+  return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+
+TorWordCache::TorWordCache(
+  int c)
+  : cache(c > 0 ? c : 1),
+    capacity(c),
+    lines(0),
+    lookups(0),
+    hits(0)
+{
+}
+
+
+void TorWordCache::encodeLine(
+  const char *text,
+  int length,
+  std::vector<TorCoreRun> &runs)
+{
+  qint64 start = threadCPUTime();
+
+  int i = 0;
+  while (i < length)
+  {
+    if (text[i] == ' ')
+    {
+      // The space and any whitespace after it make up the word gap:
+      int gapStart = i;
+      ++i;
+      while ((i < length) && isspace((unsigned char) text[i])) ++i;
+
+      encoder.clear();
+      encoder.appendText(text + gapStart, i - gapStart);
+      appendFragment(encoder.getRuns(), runs);
+
+      continue;
+    }
+
+    int wordStart = i;
+    while ((i < length) && (text[i] != ' ')) ++i;
+
+    appendWord(text + wordStart, i - wordStart, runs);
+  }
+
+  ++lines;
+  encodeTime.record(threadCPUTime() - start);
+}
+
+
+quint64 TorWordCache::getLineCount()
+{
+  return lines;
+}
+
+
+quint64 TorWordCache::getLookupCount()
+{
+  return lookups;
+}
+
+
+quint64 TorWordCache::getHitCount()
+{
+  return hits;
+}
+
+
+const TorCoreSummary &TorWordCache::getEncodeTime()
+{
+  return encodeTime;
+}
+
+
+void TorWordCache::writeReport(
+  QTextStream &out)
+{
+  out << "Word cache: " << quint64(lookups) << " words in ";
+  out << quint64(lines) << " lines, ";
+
+  if (lookups)
+  {
+    out << QString::number(hits * 100.0 / lookups, 'f', 1);
+  }
+  else
+  {
+    out << "0.0";
+  }
+
+  out << "% found in the cache (" << cache.count() << " of " << capacity;
+  out << " held); ";
+
+  if (encodeTime.count)
+  {
+    out << QString::number(
+      encodeTime.sum / 1000.0 / encodeTime.count, 'f', 2);
+  }
+  else
+  {
+    out << "0.00";
+  }
+
+  out << " us CPU per line" << endl;
+}
+
+
+void TorWordCache::registerMetrics(
+  TorCoreMetrics &metrics)
+{
+  metrics.addCounter(
+    "torchio_word_cache_lookups_total",
+    "",
+    "Words looked up in the encoded word cache.",
+    &lookups);
+
+  metrics.addCounter(
+    "torchio_word_cache_hits_total",
+    "",
+    "Words found already encoded in the word cache.",
+    &hits);
+
+  metrics.addSummary(
+    "torchio_word_cache_encode_cpu_seconds",
+    "",
+    "CPU time spent encoding each line of input.",
+    &encodeTime,
+    0.000000001);
+}
+
+
+void TorWordCache::appendWord(
+  const char *word,
+  int length,
+  std::vector<TorCoreRun> &runs)
+{
+  ++lookups;
+
+  if (capacity > 0)
+  {
+    // Only looked at, so there's no need to copy the word:
+    TorWordFragment *fragment =
+      cache.object(QByteArray::fromRawData(word, length));
+
+    if (fragment)
+    {
+      ++hits;
+      appendFragment(fragment->runs, runs);
+      return;
+    }
+  }
+
+  encoder.clear();
+  encoder.appendText(word, length);
+
+  const std::vector<TorCoreRun> &encoded = encoder.getRuns();
+  appendFragment(encoded, runs);
+
+  if (capacity > 0)
+  {
+    TorWordFragment *fragment = new TorWordFragment;
+    fragment->runs = encoded;
+    cache.insert(QByteArray(word, length), fragment);
+  }
+}
+
+
+void TorWordCache::appendFragment(
+  const std::vector<TorCoreRun> &fragment,
+  std::vector<TorCoreRun> &runs)
+{
+  if (fragment.empty()) return;
+
+  // Only the first run can merge with what came before; the rest are
+  // copied across in one go:
+  std::vector<TorCoreRun>::const_iterator first = fragment.begin();
+  appendRun(first->lit, first->units, runs);
+  runs.insert(runs.end(), first + 1, fragment.end());
+}
+
+
+void TorWordCache::appendRun(
+  bool lit,
+  unsigned int units,
+  std::vector<TorCoreRun> &runs)
+{
+  if (!runs.empty() && (runs.back().lit == lit))
+  {
+    runs.back().units += units;
+    return;
+  }
+
+  TorCoreRun run;
+  run.lit = lit;
+  run.units = units;
+  runs.push_back(run);
+}
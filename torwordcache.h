@@ -0,0 +1,101 @@
+//
+// torwordcache.h
+//
+// Copyright 2014 by John Pietrzak (jpietrzak8@gmail.com)
+//
+// This file is part of Torchio.
+//
+// Torchio is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Torchio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Torchio; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef TORWORDCACHE_H
+#define TORWORDCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include "torcoremorse.h"
+#include "torcoremetrics.h"
+
+#include <vector>
+
+class QTextStream;
+
+// The Morse for one word, ending in its last character gap:
+struct TorWordFragment
+{
+  std::vector<TorCoreRun> runs;
+};
+
+
+// Encodes lines of text into runs a word at a time, remembering the most
+// recently used words.  Streamed input such as logs keeps repeating the
+// same few words (hostnames, ERROR, OK), so most of a line is spliced
+// together from fragments that are already encoded.  Every fragment comes
+// from TorCoreMorseEncoder, so the timing is the same as for any other text.
+class TorWordCache
+{
+public:
+  // Capacity in words; zero encodes every word afresh:
+  TorWordCache(
+    int capacity);
+
+  // Appends the line's runs to those given:
+  void encodeLine(
+    const char *text,
+    int length,
+    std::vector<TorCoreRun> &runs);
+
+  quint64 getLineCount();
+  quint64 getLookupCount();
+  quint64 getHitCount();
+
+  // Thread CPU time spent encoding, in nanoseconds:
+  const TorCoreSummary &getEncodeTime();
+
+  void writeReport(
+    QTextStream &out);
+
+  void registerMetrics(
+    TorCoreMetrics &metrics);
+
+private:
+  void appendWord(
+    const char *word,
+    int length,
+    std::vector<TorCoreRun> &runs);
+
+  void appendFragment(
+    const std::vector<TorCoreRun> &fragment,
+    std::vector<TorCoreRun> &runs);
+
+  void appendRun(
+    bool lit,
+    unsigned int units,
+    std::vector<TorCoreRun> &runs);
+
+  QCache<QByteArray, TorWordFragment> cache;
+  int capacity;
+
+  // Encodes the words that miss, and the gaps between words:
+  TorCoreMorseEncoder encoder;
+
+  TorCoreCounter lines;
+  TorCoreCounter lookups;
+  TorCoreCounter hits;
+  TorCoreSummary encodeTime;
+};
+
+#endif // TORWORDCACHE_H